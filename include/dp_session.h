@@ -136,9 +136,11 @@ struct session;
  * @param [in] data - pointer to the context passed at the time of
  * registration.
  *
- * session watch callback should never block as this function is
- * called from dataplane forwarding path and can affect forwarding
- * performance.
+ * The callback is called from a session export thread rather than
+ * the forwarding path, and the session is held until the callback
+ * returns. Events for a session are delivered in the order they
+ * occurred. If the export thread falls behind events are dropped, so
+ * the callback should not block.
  */
 typedef void (session_watch_fn_t) (struct session *session,
 				   enum dp_session_hook hook, void *data);
@@ -159,13 +161,15 @@ struct session_watch {
 };
 
 /**
- * Register a session watcher. Only one session watcher may be
- * registered at a time.
+ * Register a session watcher. A small number of session watchers may
+ * be registered at a time, and each is called for the session types
+ * it asks for.
  *
  * @param [in] se_watch - a filled up struct session_watch.
  *
  * @return - non-negative watcher id on success,
- *     -EBUSY if another watcher is already registered.
+ *     -EBUSY if the maximum number of watchers are registered.
+ *     -ENOMEM if the session export thread can't be started.
  *     -errno other errors.
  */
 int dp_session_watch_register(struct session_watch *se_watch);
@@ -173,6 +177,10 @@ int dp_session_watch_register(struct session_watch *se_watch);
 /**
  * unregister a previously registered watcher.
  *
+ * Once this returns the watcher's callback is no longer running, and
+ * won't be called again, so the struct session_watch and its data may
+ * be freed. It must not be called from the watcher's callback.
+ *
  * @param [in] watcher_id - session watcher to unregister.
  *
  * @return - 0 on success
@@ -233,6 +241,27 @@ void *dp_session_get_private(int id, const struct session *session);
 int dp_session_table_walk(dp_session_walk_t *fn, void *data,
 			  unsigned int types);
 
+/**
+ * Close the current session change generation and start a new one.
+ *
+ * Sessions are stamped with the generation in which they were created or
+ * last changed state or counters. A sync agent closes a generation before
+ * each delta pass, and on the next pass packs only those sessions for which
+ * dp_session_changed_since() with the previously closed generation is true.
+ *
+ * @return - the generation just closed.
+ */
+uint64_t dp_session_generation_next(void);
+
+/**
+ * Has a session been created, or changed state or counters, since the
+ * given generation was closed?
+ *
+ * @param [in] session
+ * @param [in] gen - generation returned by dp_session_generation_next()
+ */
+bool dp_session_changed_since(const struct session *session, uint64_t gen);
+
 /**
  * Get a session's unique id.
  *
@@ -326,4 +355,32 @@ int dp_session_pack_pb(struct session *session, void *buf, uint32_t size,
 		       enum session_pack_type spt,
 		       struct session **session_peer);
 
+/* Maximum number of sessions packed by one dp_session_pack_pb_bulk() call */
+#define DP_SESSION_PACK_BULK_MAX 256
+
+/**
+ * Serialize a number of sessions to a single packed protocol buffer,
+ * in the same format as dp_session_pack_pb(). dp_session_restore()
+ * restores or updates all the sessions in the buffer.
+ *
+ * Sessions are packed in order until the buffer is full, or count or
+ * DP_SESSION_PACK_BULK_MAX sessions have been consumed. Sessions which
+ * cannot be packed, e.g. NAT sessions, are consumed but skipped.
+ *
+ * @param [in] sessions - sessions to be packed
+ * @param [in] count - number of sessions
+ * @param [in, out] buf - session buffer pointer
+ * @param [in] size - size of buffer
+ * @param [in] spt - pack type
+ * @param [out] consumed - number of sessions consumed from the array
+ *
+ * @return - packed length on success (includes header length), 0 if no
+ *   sessions were packed, -errno on error. -ENOSPC if the buffer is too
+ *   small for the first session.
+ */
+int dp_session_pack_pb_bulk(struct session **sessions, unsigned int count,
+			    void *buf, uint32_t size,
+			    enum session_pack_type spt,
+			    unsigned int *consumed);
+
 #endif
@@ -108,6 +108,8 @@ struct	ether_arp {
 struct arp_nbr_cfg arp_cfg = {
 	.arp_aging_time = ARPT_KEEP,
 	.arp_max_entry  = ARP_MAX_ENTRY,
+	.arp_max_unres  = ARP_MAX_UNRES,
+	.arp_max_unres_total = ARP_MAX_UNRES_TOTAL,
 };
 
 static struct garp_cfg garp_cfg = {
@@ -241,10 +243,49 @@ arprequest(struct ifnet *ifp, struct sockaddr *sa)
  * VYATTA: Unlike BSD, there is no socket or context for
  * this request so error code doesn't really matter.
  */
+/*
+ * Create an incomplete entry on behalf of the forwarding path, if the
+ * interface and global limits on unresolved entries allow. The entry
+ * is counted as unresolved until it resolves or is destroyed, unless
+ * another thread created it first.
+ *
+ * Returns NULL with *throttled set if a limit was hit.
+ */
+static struct llentry *
+arp_create_incomplete(struct ifnet *ifp, in_addr_t addr, bool *throttled)
+{
+	struct lltable *llt = ifp->if_lltable;
+	struct llentry *la;
+
+	*throttled = false;
+	if (!lltable_unres_get(llt, ARP_CFG(arp_max_unres),
+			       ARP_CFG(arp_max_unres_total))) {
+		ARPSTAT_INC(if_vrfid(ifp), resthrot);
+		*throttled = true;
+		return NULL;
+	}
+
+	la = in_lltable_lookup(ifp, LLE_CREATE|LLE_LOCAL, addr);
+	if (unlikely(la == NULL)) {
+		lltable_unres_put(llt);
+		return NULL;
+	}
+
+	rte_spinlock_lock(&la->ll_lock);
+	if (la->la_flags & (LLE_VALID | LLE_DELETED | LLE_UNRESOLVED))
+		lltable_unres_put(llt);
+	else
+		la->la_flags |= LLE_UNRESOLVED;
+	rte_spinlock_unlock(&la->ll_lock);
+
+	return la;
+}
+
 int arpresolve(struct ifnet *ifp, struct rte_mbuf *m,
 	       in_addr_t addr, struct rte_ether_addr *desten)
 {
 	struct llentry *la;
+	bool throttled;
 
 lookup:
 	la = in_lltable_find(ifp, addr);
@@ -252,17 +293,19 @@ lookup:
 	/* resolved now */
 	if (likely(la && (la->la_flags & LLE_VALID))) {
 resolved:
-		rte_atomic16_clear(&la->ll_idle);
+		llentry_mark_used(la);
 		rte_ether_addr_copy(&la->ll_addr, desten);
 		return 0;
 	}
 
 	/* Create if necessary */
 	if (la == NULL) {
-		la = in_lltable_lookup(ifp, LLE_CREATE|LLE_LOCAL, addr);
+		la = arp_create_incomplete(ifp, addr, &throttled);
 
-		/* out of memory or cache limit hit */
+		/* out of memory, cache or unresolved limit hit */
 		if (unlikely(la == NULL)) {
+			if (throttled)
+				ARPSTAT_INC(if_vrfid(ifp), resdropped);
 			rte_pktmbuf_free(m);
 			return -ENOMEM;
 		}
@@ -335,6 +378,7 @@ void arpresolve_hw_ecmp(struct rte_mbuf *m, const struct next_hop *nh_prime)
 	in_addr_t daddr;
 	in_addr_t addr;
 	char b1[INET_ADDRSTRLEN];
+	bool throttled;
 
 	if (nhl == NULL)
 		return;
@@ -376,7 +420,7 @@ void arpresolve_hw_ecmp(struct rte_mbuf *m, const struct next_hop *nh_prime)
 		/*
 		 * Create new entry and issue the ARP request
 		 */
-		la = in_lltable_lookup(ifp, LLE_CREATE|LLE_LOCAL, addr);
+		la = arp_create_incomplete(ifp, addr, &throttled);
 		if (la == NULL) {
 			nh->flags |= RTF_NH_NEEDS_HW_RES;
 			continue;
@@ -575,6 +619,32 @@ static int cmd_arp_cfg_handler(struct pb_msg *pbmsg)
 		ARP_DEBUG("Cfg param arp_max_entry (cache size) set to: %d\n",
 			  arp_cfg.arp_max_entry);
 		break;
+	case NBR_RES_CONFIG__PARAM__MAX_UNRESOLVED:
+		/*
+		 * Changes to the unresolved limits only impact subsequent
+		 * resolutions. Entries already pending are not affected.
+		 */
+		if (set && (int)val <= 0) {
+			RTE_LOG(ERR, ARP,
+				"Cfg max unresolved value %d out of range\n",
+				val);
+			goto end;
+		}
+		arp_cfg.arp_max_unres = set ? val : ARP_MAX_UNRES;
+		ARP_DEBUG("Cfg param arp_max_unres set to: %d\n",
+			  arp_cfg.arp_max_unres);
+		break;
+	case NBR_RES_CONFIG__PARAM__MAX_UNRESOLVED_TOTAL:
+		if (set && (int)val <= 0) {
+			RTE_LOG(ERR, ARP,
+				"Cfg max unresolved total %d out of range\n",
+				val);
+			goto end;
+		}
+		arp_cfg.arp_max_unres_total = set ? val : ARP_MAX_UNRES_TOTAL;
+		ARP_DEBUG("Cfg param arp_max_unres_total set to: %d\n",
+			  arp_cfg.arp_max_unres_total);
+		break;
 	default:
 		RTE_LOG(ERR, ARP,
 			"Cfg parameter not supported (%d)\n", msg->param);
@@ -606,6 +676,10 @@ int cmd_arp_get_cfg(FILE *f)
 
 	jsonw_uint_field(wr, "Aging time",	   arp_cfg.arp_aging_time);
 	jsonw_int_field(wr, "Max entries",	   arp_cfg.arp_max_entry);
+	jsonw_int_field(wr, "Max unresolved",	   arp_cfg.arp_max_unres);
+	jsonw_int_field(wr, "Max unresolved total",
+			arp_cfg.arp_max_unres_total);
+	jsonw_int_field(wr, "Unresolved total",	   lltable_unres_total());
 
 	jsonw_destroy(&wr);
 
@@ -31,6 +31,8 @@ void arpresolve_hw_ecmp(struct rte_mbuf *m, const struct next_hop *nh_prime);
 struct arp_nbr_cfg {
 	uint32_t arp_aging_time;
 	int32_t  arp_max_entry;
+	int32_t  arp_max_unres;
+	int32_t  arp_max_unres_total;
 };
 
 extern struct arp_nbr_cfg arp_cfg;
@@ -56,6 +58,8 @@ struct arp_stats {
 	uint64_t mpoolfail;	/* Memory pool limit hit */
 	uint64_t memfail;	/* Out of memory hit */
 	uint64_t tablimit;	/* Cache limit hit */
+	uint64_t resthrot;	/* Resolution throttles */
+	uint64_t resdropped;	/* # of packets dropped by throttling */
 
 	uint64_t total_added;	/* total # of valid/static ARP requests added to the table*/
 	uint64_t total_deleted;	/* total # of valid/static ARP requests deleted from the table*/
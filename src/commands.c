@@ -337,7 +337,8 @@ static const char *arpstat_names[] = {
 	"duplicate_ip",	"dropped",
 	"timeout",	"proxy",
 	"garp_reqs_dropped", "garp_reps_dropped",
-	"mpool_fail", "mem_fail", "cache_limit",
+	"mpool_fail", "mem_fail", "cache_limit", "res_throttle",
+	"res_throttle_dropped",
 	"total_added", "total_deleted"
 };
 
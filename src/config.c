@@ -395,6 +395,7 @@ struct str_val {
 
 struct str_val rx_offload_strs[] = {
 	{ "keep_crc", DEV_RX_OFFLOAD_KEEP_CRC },
+	{ "ipv4_cksum", DEV_RX_OFFLOAD_IPV4_CKSUM },
 };
 
 #define MAX_RX_OFFLOAD_STRS (sizeof(rx_offload_strs) / \
@@ -699,6 +700,27 @@ static void backplane_list_destroy(void)
 	}
 }
 
+/*
+ * Parse a boolean config value, accepting yes/no, true/false or 1/0.
+ * Returns false if the value is none of those.
+ */
+static bool parse_bool(const char *value, bool *res)
+{
+	if (strcasecmp(value, "yes") == 0 ||
+	    strcasecmp(value, "true") == 0 ||
+	    strcmp(value, "1") == 0) {
+		*res = true;
+		return true;
+	}
+	if (strcasecmp(value, "no") == 0 ||
+	    strcasecmp(value, "false") == 0 ||
+	    strcmp(value, "0") == 0) {
+		*res = false;
+		return true;
+	}
+	return false;
+}
+
 static bool parse_pci_addr(const char *value, struct rte_pci_addr *pci_addr)
 {
 	int rc;
@@ -779,6 +801,16 @@ static int parse_platform_entry(void *user, const char *section,
 		} else if (strcmp(name, "fal_plugin") == 0) {
 			if (value)
 				cfg->fal_plugin = strdup(value);
+		} else if (strcmp(name, "rx_interrupts") == 0) {
+			if (value && !parse_bool(value, &cfg->rx_interrupts))
+				DP_DEBUG(INIT, ERR, DATAPLANE,
+					 "rx_interrupts format error: %s\n",
+					 value);
+		} else if (strcmp(name, "rx_rebalance") == 0) {
+			if (value && !parse_bool(value, &cfg->rx_rebalance))
+				DP_DEBUG(INIT, ERR, DATAPLANE,
+					 "rx_rebalance format error: %s\n",
+					 value);
 		} else if (strncmp(name, "mgmt_port",
 				   strlen("mgmt_port")) == 0) {
 			struct config_pci_entry *pci_entry;
@@ -820,6 +852,8 @@ malloc_failed:
  * backplane_port<num> = domain:bus:devid.function
  * backplane_port<num> = domain:bus:devid.function
  * fal_plugin = /path/to/shared/library.so
+ * rx_interrupts = yes|no
+ * rx_rebalance = yes|no
  */
 void parse_platform_config(const char *cfgfile)
 {
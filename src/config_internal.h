@@ -90,6 +90,10 @@ struct platform_param {
 	bool hardware_lag;
 	/* management port pci list */
 	LIST_HEAD(config_mgmt_pci_list, config_pci_entry) mgmt_list;
+	/* wait for RX interrupts rather than napping when idle */
+	bool rx_interrupts;
+	/* move RX queues between lcores based on their measured load */
+	bool rx_rebalance;
 };
 
 extern struct config_param config;
@@ -41,6 +41,7 @@
 #include "mstp.h"
 #include "netlink.h"
 #include "npf/config/npf_config.h"
+#include "npf/dpi/dpi_internal.h"
 #include "pl_commands.h"
 #include "power.h"
 #include "protobuf.h"
@@ -1247,6 +1248,16 @@ static int feature_affinity_cmd_handler(struct pb_msg *msg)
 					   fmsg->cpumask.len);
 		break;
 
+	case FEATURE_AFFINITY_CONFIG__FEATURE__CRYPTO_SPRAY:
+		ret = crypto_set_spray_cores(fmsg->cpumask.data,
+					     fmsg->cpumask.len);
+		break;
+
+	case FEATURE_AFFINITY_CONFIG__FEATURE__DPI:
+		ret = dpi_set_worker_cores(fmsg->cpumask.data,
+					   fmsg->cpumask.len);
+		break;
+
 	default:
 		ret = -EINVAL;
 		break;
@@ -179,6 +179,8 @@ static const char * const ipsec_counter_names[] = {
 	[CRYPTO_DIGEST_OP_FAILED] = "Failed digest op",
 	[CRYPTO_DIGEST_CB_FAILED] = "Failed digest cb",
 	[CRYPTO_PP_ENQ_FAILED] = "Postprocessing enqueue failed",
+	[CRYPTO_REORDER_LATE] = "Reorder late arrival",
+	[CRYPTO_REORDER_GAP_SKIPPED] = "Reorder gap skipped",
 };
 
 unsigned long ipsec_counters[RTE_MAX_LCORE][IPSEC_CNT_MAX] __rte_cache_aligned;
@@ -823,12 +825,14 @@ static int crypto_enqueue_internal(enum crypto_xfrm xfrm,
 				   struct ifnet *in_ifp,
 				   struct ifnet *nxt_ifp,
 				   uint32_t reqid, int pmd_dev_id,
-				   uint32_t spi,
+				   uint32_t spi, struct sadb_sa *spray_sa,
 				   void *l3hdr)
 {
 	struct crypto_pkt_buffer fallback_cpb;
 	struct crypto_pkt_ctx *ctx;
 	struct crypto_pkt_buffer *cpb;
+	uint32_t seq = 0;
+	uint8_t spray_slot = 0;
 
 	if (unlikely(pmd_dev_id == CRYPTO_PMD_INVALID_ID)) {
 		IPSEC_CNT_INC(DROPPED_INVALID_PMD_DEV_ID);
@@ -837,6 +841,27 @@ static int crypto_enqueue_internal(enum crypto_xfrm xfrm,
 		goto free_mbuf_on_error;
 	}
 
+	if (xfrm == CRYPTO_ENCRYPT) {
+		/*
+		 * For a VTI tunnel, do output crypto processing
+		 * in transport VRF context
+		 */
+		if (nxt_ifp && nxt_ifp->if_type == IFT_TUNNEL_VTI &&
+		    vti_set_output_vrf(nxt_ifp, m) != 0) {
+			IPSEC_CNT_INC(NO_VTI);
+			goto free_mbuf_on_error;
+		}
+
+		/*
+		 * If the SA is sprayed across crypto cores, then
+		 * pick the PMD for this packet and assign it its
+		 * sequence number now.
+		 */
+		if (unlikely(spray_sa != NULL))
+			pmd_dev_id = crypto_sadb_spray_assign(
+				spray_sa, pmd_dev_id, &seq, &spray_slot);
+	}
+
 	cpb = RTE_PER_LCORE(crypto_pkt_buffer);
 	if (!cpb) {
 		/*
@@ -880,19 +905,10 @@ static int crypto_enqueue_internal(enum crypto_xfrm xfrm,
 	ctx->family    = family;
 	ctx->reqid     = reqid;
 	ctx->action    = CRYPTO_ACT_NONE;
+	ctx->seq       = seq;
+	ctx->spray_slot = spray_slot;
 	if (xfrm == CRYPTO_ENCRYPT) {
-		/*
-		 * For a VTI tunnel, do output crypto processing
-		 * in transport VRF context
-		 */
-		if (!nxt_ifp || nxt_ifp->if_type != IFT_TUNNEL_VTI ||
-		    (vti_set_output_vrf(nxt_ifp, m) == 0)) {
-			memcpy(&ctx->dst, dst, sizeof(ctx->dst));
-		} else {
-			IPSEC_CNT_INC(NO_VTI);
-			release_crypto_packet_ctx(ctx);
-			goto free_mbuf_on_error;
-		}
+		memcpy(&ctx->dst, dst, sizeof(ctx->dst));
 		if (family == AF_INET)
 			ctx->out_ethertype = ETH_P_IP;
 		else
@@ -984,7 +1000,7 @@ int crypto_enqueue_inbound_v4(struct rte_mbuf *m,
 
 	if (!crypto_enqueue_internal(CRYPTO_DECRYPT, m, AF_INET, AF_INET,
 				    NULL, input_if, NULL, 0,
-				    pmd_dev_id, spi,
+				    pmd_dev_id, spi, NULL,
 				    iphdr(m)))
 		IPSEC_CNT_INC(ENQUEUED_INPUT_IPV4);
 
@@ -1027,7 +1043,7 @@ int crypto_enqueue_inbound_v6(struct rte_mbuf *m,
 
 	if (!crypto_enqueue_internal(CRYPTO_DECRYPT, m, AF_INET6, AF_INET6,
 				    NULL, input_if, NULL, 0,
-				    pmd_dev_id, spi,
+				    pmd_dev_id, spi, NULL,
 				    ip6hdr(m)))
 		IPSEC_CNT_INC(ENQUEUED_INPUT_IPV6);
 
@@ -1045,7 +1061,7 @@ void crypto_enqueue_outbound(struct rte_mbuf *m, uint16_t orig_family,
 			     struct ifnet *in_ifp,
 			     struct ifnet *nxt_ifp,
 			     uint32_t reqid, int pmd_dev_id,
-			     uint32_t spi)
+			     uint32_t spi, struct sadb_sa *spray_sa)
 {
 	if (!dst) {
 		CRYPTO_DATA_ERR("No destination address\n");
@@ -1057,7 +1073,7 @@ void crypto_enqueue_outbound(struct rte_mbuf *m, uint16_t orig_family,
 	if (!crypto_enqueue_internal(CRYPTO_ENCRYPT, m,
 				     orig_family, family, dst,
 				     in_ifp, nxt_ifp, reqid,
-				     pmd_dev_id, spi, iphdr(m))) {
+				     pmd_dev_id, spi, spray_sa, iphdr(m))) {
 		if (family == AF_INET)
 			IPSEC_CNT_INC(ENQUEUED_OUTPUT_IPV4);
 		else
@@ -1139,25 +1155,206 @@ static void crypto_redirect_processed_packets(struct crypto_pkt_ctx **contexts,
 					     batch_cnt);
 }
 
+/*
+ * Per post-crypto forwarding core reorder state for a sprayed SA.
+ * As the SA's packets are encrypted on several crypto cores, they
+ * can arrive here out of order. Each is held in slot[seq & mask]
+ * until all earlier sequence numbers have been forwarded. A gap that
+ * isn't filled within CRYPTO_REORDER_TIMEOUT_US, e.g. because the
+ * packet was dropped, is skipped.
+ */
+#define CRYPTO_REORDER_SIZE 1024
+#define CRYPTO_REORDER_MASK (CRYPTO_REORDER_SIZE - 1)
+#define CRYPTO_REORDER_TIMEOUT_US 100
+
+struct crypto_reorder {
+	uint32_t spi;
+	uint32_t next_seq;
+	uint32_t held;
+	uint64_t stall_tsc;
+	struct crypto_pkt_ctx *slot[CRYPTO_REORDER_SIZE];
+};
+
+static uint64_t crypto_reorder_timeout;
+
+/*
+ * Forward everything in sequence from the head of the window.
+ */
+static void crypto_reorder_drain(struct crypto_fwd_info *fwd_info,
+				 struct crypto_reorder *ro)
+{
+	struct crypto_pkt_ctx *ctx;
+	bool progress = false;
+	uint32_t idx;
+
+	while (ro->held) {
+		idx = ro->next_seq & CRYPTO_REORDER_MASK;
+		ctx = ro->slot[idx];
+		if (!ctx)
+			break;
+
+		ro->slot[idx] = NULL;
+		ro->held--;
+		fwd_info->reorder_held--;
+		ro->next_seq++;
+		progress = true;
+		fwd_info->reorder_emit(ctx);
+	}
+
+	if (progress)
+		ro->stall_tsc = rte_get_timer_cycles();
+}
+
+/*
+ * Give up waiting for the missing sequence number(s) at the head of
+ * the window and forward up to the next gap.
+ */
+static void crypto_reorder_skip(struct crypto_fwd_info *fwd_info,
+				struct crypto_reorder *ro)
+{
+	if (!ro->held)
+		return;
+
+	if (!ro->slot[ro->next_seq & CRYPTO_REORDER_MASK]) {
+		IPSEC_CNT_INC(CRYPTO_REORDER_GAP_SKIPPED);
+		while (!ro->slot[ro->next_seq & CRYPTO_REORDER_MASK])
+			ro->next_seq++;
+	}
+
+	crypto_reorder_drain(fwd_info, ro);
+}
+
+void crypto_reorder_insert(struct crypto_fwd_info *fwd_info,
+			   struct crypto_pkt_ctx *ctx)
+{
+	struct crypto_reorder *ro = &fwd_info->reorder[ctx->spray_slot];
+	uint32_t idx;
+
+	/*
+	 * The slot has been reused by a new SA, so forward anything
+	 * left over from the old one. Sequence numbers start at 1.
+	 */
+	if (unlikely(ro->spi != ctx->spi)) {
+		while (ro->held)
+			crypto_reorder_skip(fwd_info, ro);
+		ro->spi = ctx->spi;
+		ro->next_seq = 1;
+	}
+
+	/* Too late, the gap it would have filled has been skipped */
+	if (unlikely((int32_t)(ctx->seq - ro->next_seq) < 0)) {
+		IPSEC_CNT_INC(CRYPTO_REORDER_LATE);
+		fwd_info->reorder_emit(ctx);
+		return;
+	}
+
+	/* Too far ahead, make room for it by skipping gaps */
+	while (unlikely(ctx->seq - ro->next_seq >= CRYPTO_REORDER_SIZE)) {
+		if (!ro->held) {
+			IPSEC_CNT_INC(CRYPTO_REORDER_GAP_SKIPPED);
+			ro->next_seq = ctx->seq;
+			break;
+		}
+		crypto_reorder_skip(fwd_info, ro);
+	}
+
+	idx = ctx->seq & CRYPTO_REORDER_MASK;
+	if (unlikely(ro->slot[idx])) {
+		fwd_info->reorder_emit(ctx);
+		return;
+	}
+
+	if (!ro->held)
+		ro->stall_tsc = rte_get_timer_cycles();
+	ro->slot[idx] = ctx;
+	ro->held++;
+	fwd_info->reorder_held++;
+
+	if (ctx->seq == ro->next_seq)
+		crypto_reorder_drain(fwd_info, ro);
+}
+
+void crypto_reorder_check_stalled(struct crypto_fwd_info *fwd_info)
+{
+	uint64_t now = rte_get_timer_cycles();
+	struct crypto_reorder *ro;
+	unsigned int i;
+
+	for (i = 0; i < CRYPTO_SPRAY_MAX_SA && fwd_info->reorder_held; i++) {
+		ro = &fwd_info->reorder[i];
+		if (ro->held && now - ro->stall_tsc > crypto_reorder_timeout)
+			crypto_reorder_skip(fwd_info, ro);
+	}
+}
+
+static void crypto_reorder_purge(struct crypto_fwd_info *fwd_info)
+{
+	struct crypto_reorder *ro;
+	unsigned int i, j;
+
+	for (i = 0; i < CRYPTO_SPRAY_MAX_SA; i++) {
+		ro = &fwd_info->reorder[i];
+		for (j = 0; j < CRYPTO_REORDER_SIZE && ro->held; j++) {
+			if (!ro->slot[j])
+				continue;
+			rte_pktmbuf_free(ro->slot[j]->mbuf);
+			release_crypto_packet_ctx(ro->slot[j]);
+			ro->slot[j] = NULL;
+			ro->held--;
+		}
+	}
+	fwd_info->reorder_held = 0;
+}
+
+int crypto_reorder_init(struct crypto_fwd_info *fwd_info, unsigned int socket,
+			crypto_reorder_emit_fn emit)
+{
+	fwd_info->reorder =
+		rte_zmalloc_socket("crypto reorder",
+				   CRYPTO_SPRAY_MAX_SA *
+				   sizeof(struct crypto_reorder),
+				   RTE_CACHE_LINE_SIZE, socket);
+	if (!fwd_info->reorder)
+		return -ENOMEM;
+
+	fwd_info->reorder_held = 0;
+	fwd_info->reorder_emit = emit;
+	return 0;
+}
+
+void crypto_reorder_fini(struct crypto_fwd_info *fwd_info)
+{
+	crypto_reorder_purge(fwd_info);
+	rte_free(fwd_info->reorder);
+	fwd_info->reorder = NULL;
+}
+
 void crypto_fwd_processed_packets(void)
 {
 	struct crypto_pkt_ctx *contexts[MAX_CRYPTO_PKT_BURST];
 	unsigned int i, count, lcore = dp_lcore_id();
+	struct crypto_fwd_info *fwd_info = &crypto_fwd[lcore];
 
-	if (rte_ring_empty(crypto_fwd[lcore].fwd_q))
+	if (unlikely(fwd_info->reorder_held))
+		crypto_reorder_check_stalled(fwd_info);
+
+	if (rte_ring_empty(fwd_info->fwd_q))
 		return;
 
-	count = rte_ring_mc_dequeue_burst(crypto_fwd[lcore].fwd_q,
+	count = rte_ring_mc_dequeue_burst(fwd_info->fwd_q,
 					  (void **)&contexts,
 					  MAX_CRYPTO_PKT_BURST, NULL);
-	crypto_fwd[lcore].fwd_cnt += count;
+	fwd_info->fwd_cnt += count;
 
 	for (i = 0; i < count; i++) {
 		if (unlikely(contexts[i]->status < 0))
 			contexts[i]->action = CRYPTO_ACT_DROP;
 
 		crypto_prefetch_ctx(contexts, count, i);
-		crypto_pkt_ctx_forward_and_free(contexts[i]);
+		if (unlikely(contexts[i]->seq))
+			crypto_reorder_insert(fwd_info, contexts[i]);
+		else
+			crypto_pkt_ctx_forward_and_free(contexts[i]);
 		crypto_prefetch_ctx_data(contexts, count, i+1);
 	}
 }
@@ -1230,7 +1427,8 @@ sadb_lookup_sa(struct rte_mbuf *m __unused, enum crypto_xfrm xfrm,
 
 static inline unsigned int
 crypto_pmd_process_packets(struct crypto_pkt_ctx *contexts[],
-			   uint16_t count, enum crypto_xfrm xfrm)
+			   uint16_t count, enum crypto_xfrm xfrm,
+			   uint8_t rte_cdev_id)
 {
 	struct rte_mbuf *m;
 	unsigned int total_bytes = 0;
@@ -1259,8 +1457,16 @@ crypto_pmd_process_packets(struct crypto_pkt_ctx *contexts[],
 			contexts[i]->status = -1;
 			contexts[i]->action = CRYPTO_ACT_DROP;
 			bad_idx[bad_count++] = i;
-		} else
+		} else {
 			contexts[i]->status = 0;
+			/*
+			 * A sprayed packet must use the device of the PMD
+			 * it was queued to, as the SA's own device is
+			 * being driven by another crypto core.
+			 */
+			contexts[i]->rte_cdev_id = contexts[i]->seq ?
+				rte_cdev_id : contexts[i]->sa->rte_cdev_id;
+		}
 
 		crypto_prefetch_ctx_data(contexts, count, i);
 	}
@@ -1279,20 +1485,24 @@ crypto_pmd_process_packets(struct crypto_pkt_ctx *contexts[],
  *
  * Returning false terminates the pmd  walk.
  */
-static bool crypto_pmd_walk_cb(int pmd_dev_id __unused, enum crypto_xfrm xfrm,
+static bool crypto_pmd_walk_cb(int pmd_dev_id, enum crypto_xfrm xfrm,
 			       struct rte_ring *pmd_queue,
 			       uint64_t *bytes,
 			       uint32_t *packets)
 {
 	struct crypto_pkt_ctx *contexts[MAX_CRYPTO_PKT_BURST];
 	unsigned int count, total_bytes = 0;
+	enum cryptodev_type dev_type;
+	uint8_t rte_cdev_id = 0;
 
 	count = rte_ring_sc_dequeue_burst(pmd_queue,
 					  (void **)&contexts,
 					  MAX_CRYPTO_PKT_BURST,
 					  NULL);
 	if (count > 0) {
-		total_bytes = crypto_pmd_process_packets(contexts, count, xfrm);
+		(void)crypto_pmd_get_info(pmd_dev_id, &rte_cdev_id, &dev_type);
+		total_bytes = crypto_pmd_process_packets(contexts, count, xfrm,
+							 rte_cdev_id);
 
 		crypto_cb[xfrm].post_process(contexts, count);
 		*packets = count;
@@ -1354,6 +1564,11 @@ void crypto_create_fwd_queue(unsigned int lcore_id)
 						     cpu_socket, lcore_id, 0);
 		/* crypto_create_ring is always expected to succeed */
 
+		if (crypto_reorder_init(fwd_info, cpu_socket,
+					crypto_pkt_ctx_forward_and_free) < 0)
+			rte_panic("no memory for lcore %u crypto reorder\n",
+				  lcore_id);
+
 		RTE_PER_LCORE(crypto_fwd) = fwd_info;
 	}
 }
@@ -1361,6 +1576,7 @@ void crypto_create_fwd_queue(unsigned int lcore_id)
 void crypto_destroy_fwd_queue(void)
 {
 	if (RTE_PER_LCORE(crypto_fwd)) {
+		crypto_reorder_fini(RTE_PER_LCORE(crypto_fwd));
 		crypto_delete_queue(RTE_PER_LCORE(crypto_fwd)->fwd_q);
 		RTE_PER_LCORE(crypto_fwd)->fwd_q = NULL;
 		RTE_PER_LCORE(crypto_fwd) = NULL;
@@ -1546,6 +1762,8 @@ void dp_crypto_init(void)
 	unsigned int cores, cache;
 
 	bitmask_zero(&crypto_fwd_cores);
+	crypto_reorder_timeout = rte_get_timer_hz() /
+		(1000000 / CRYPTO_REORDER_TIMEOUT_US);
 
 	CRYPTO_INFO("Crypto thread initialise begin\n");
 
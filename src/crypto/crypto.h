@@ -29,6 +29,7 @@ struct udphdr;
 
 struct ifnet;
 struct rte_mbuf;
+struct sadb_sa;
 
 struct crypto_fragment_ctx {
 	xfrm_address_t *dst;
@@ -38,6 +39,7 @@ struct crypto_fragment_ctx {
 	uint32_t reqid;
 	int pmd_dev_id;
 	uint32_t spi;
+	struct sadb_sa *spray_sa;
 };
 
 /*
@@ -71,7 +73,8 @@ void crypto_enqueue_outbound(struct rte_mbuf *m, uint16_t orig_family,
 			     uint16_t family,
 			     xfrm_address_t *dst, struct ifnet *in_ifp,
 			     struct ifnet *nxt_ifp, uint32_t reqid,
-			     int pmd_dev_id, uint32_t spi);
+			     int pmd_dev_id, uint32_t spi,
+			     struct sadb_sa *spray_sa);
 int udp_esp_dp(struct rte_mbuf *m, void *ip,
 	       struct udphdr *udp, struct ifnet *ifp);
 int udp_esp_dp6(struct rte_mbuf *m, void *ip,
@@ -95,5 +98,6 @@ unsigned long hash_xfrm_address(const xfrm_address_t *addr,
 uint8_t crypto_sa_alloc_fwd_core(void);
 void crypto_sa_free_fwd_core(uint8_t fwd_core);
 int crypto_set_fwd_cores(const uint8_t *bytes, uint8_t len);
+int crypto_set_spray_cores(const uint8_t *bytes, uint8_t len);
 void crypto_flush_all(void);
 #endif /* CRYPTO_H */
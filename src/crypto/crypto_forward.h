@@ -52,4 +52,14 @@ void crypto_policy_post_features_outbound(struct ifnet *vfp_ifp,
 					  struct rte_mbuf *mbuf,
 					  uint16_t proto);
 
+/*
+ * crypto_policy_classify_burst
+ *
+ * Look up the IPsec policies for a burst received on an interface
+ * in bulk and cache the results for the per-packet checks.
+ */
+void crypto_policy_classify_burst(struct ifnet *ifp,
+				  struct rte_mbuf *pkts[],
+				  uint16_t count);
+
 #endif /* CRYPTO_FORWARD_H */
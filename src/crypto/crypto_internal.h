@@ -42,6 +42,14 @@
 
 #define PMD_RING_SIZE  4096
 
+/*
+ * Maximum number of PMDs, and hence crypto cores, that the packets of
+ * a single outbound SA can be sprayed across, and the maximum number
+ * of SAs that can be sprayed at any one time.
+ */
+#define CRYPTO_SPRAY_MAX_PMD 8
+#define CRYPTO_SPRAY_MAX_SA  16
+
 #define SPI_LEN_IN_HEXCHARS (8+1) /* 32 bit SPI */
 
 static inline void spi_to_hexstr(char *buf, uint32_t spi)
@@ -169,6 +177,16 @@ struct sadb_sa {
 	struct ifnet *feat_attach_ifp;
 	vrfid_t overlay_vrf_id;
 	uint64_t epoch;
+	/*
+	 * Spray set for outbound SAs spread across multiple crypto
+	 * cores. The first entry is always pmd_dev_id. When spray_cnt
+	 * is greater than 1 the sequence number is assigned by the
+	 * forwarding thread and packets are put back into order on
+	 * the post-crypto forwarding core using reorder slot spray_slot.
+	 */
+	uint8_t spray_cnt;
+	uint8_t spray_slot;
+	int8_t spray_dev_ids[CRYPTO_SPRAY_MAX_PMD];
 };
 
 static_assert(offsetof(struct sadb_sa, udp_sport) == 64,
@@ -375,6 +393,8 @@ struct crypto_overhead {
 	int pmd_dev_id;
 	uint spi;
 	uint8_t block_size;
+	/* the SA, if it is sprayed across crypto cores, else NULL */
+	struct sadb_sa *spray_sa;
 };
 
 enum ipsec_cnt_types {
@@ -440,6 +460,8 @@ enum ipsec_cnt_types {
 	CRYPTO_DIGEST_OP_FAILED,
 	CRYPTO_DIGEST_CB_FAILED,
 	CRYPTO_PP_ENQ_FAILED,
+	CRYPTO_REORDER_LATE,
+	CRYPTO_REORDER_GAP_SKIPPED,
 	IPSEC_CNT_MAX /* this must be last */
 };
 
@@ -534,6 +556,12 @@ int crypto_allocate_pmd(enum crypto_xfrm xfrm,
 			enum rte_crypto_cipher_algorithm cipher_algo,
 			enum rte_crypto_aead_algorithm aead_algo,
 			bool *setup_openssl);
+unsigned int crypto_allocate_spray_pmds(int pmd_dev_id, enum crypto_xfrm xfrm,
+					int8_t dev_ids[], unsigned int max);
+void crypto_remove_sa_from_spray_pmds(const int8_t dev_ids[],
+				      unsigned int count,
+				      enum crypto_xfrm xfrm);
+void crypto_spray_unbind_rcu(const int8_t dev_ids[], unsigned int count);
 struct rte_ring *crypto_pmd_get_q(int dev_id, enum crypto_xfrm xfrm);
 typedef bool (*crypto_pmd_walker_cb)(int pmd_dev_id, enum crypto_xfrm,
 				     struct rte_ring *,
@@ -601,6 +629,10 @@ struct crypto_pkt_ctx {
 	unsigned int counter_modify;
 	xfrm_address_t dst; /* Only used for outbound traffic */
 	vrfid_t vrfid;
+	/* ESP sequence number pre-assigned to a sprayed packet, else 0 */
+	uint32_t seq;
+	uint8_t  spray_slot;
+	uint8_t  rte_cdev_id;
 };
 
 /*
@@ -63,9 +63,19 @@ struct crypto_pkt_buffer {
  * constraint is that all packets associated with a particular SA need to
  * be processed on the same forwarding core.
  */
+struct crypto_reorder;
+struct crypto_pkt_ctx;
+
+/* Forwards a packet released in order from the reorder window */
+typedef void (*crypto_reorder_emit_fn)(struct crypto_pkt_ctx *ctx);
+
 struct crypto_fwd_info {
 	struct rte_ring *fwd_q;
 	uint64_t         fwd_cnt;
+	/* reorder state for sprayed SAs, indexed by spray slot */
+	struct crypto_reorder *reorder;
+	uint32_t         reorder_held;
+	crypto_reorder_emit_fn reorder_emit;
 };
 
 RTE_DECLARE_PER_LCORE(struct crypto_fwd_info *, crypto_fwd);
@@ -83,6 +93,13 @@ extern struct crypto_pkt_buffer *cpbdb[RTE_MAX_LCORE];
 int crypto_send_burst(struct crypto_pkt_buffer *cpb,
 		      enum crypto_xfrm xfrm, bool drop);
 
+int crypto_reorder_init(struct crypto_fwd_info *fwd_info, unsigned int socket,
+			crypto_reorder_emit_fn emit);
+void crypto_reorder_fini(struct crypto_fwd_info *fwd_info);
+void crypto_reorder_insert(struct crypto_fwd_info *fwd_info,
+			   struct crypto_pkt_ctx *ctx);
+void crypto_reorder_check_stalled(struct crypto_fwd_info *fwd_info);
+
 static inline __hot_func void crypto_send(struct crypto_pkt_buffer *cpb)
 {
 	if (cpb->local_q_count[CRYPTO_ENCRYPT])
@@ -1,5 +1,5 @@
 /*-
- * Copyright (c) 2017-2020, AT&T Intellectual Property.  All rights reserved.
+ * Copyright (c) 2017-2021, AT&T Intellectual Property.  All rights reserved.
  * Copyright (c) 2017 by Brocade Communications Systems, Inc.
  * All rights reserved.
  *
@@ -23,6 +23,7 @@
 #include "crypto.h"
 #include "crypto_internal.h"
 #include "crypto_main.h"
+#include "bitmask.h"
 #include "json_writer.h"
 #include "main.h"
 #include "urcu.h"
@@ -199,33 +200,18 @@ crypto_pmd_alloc_loadshare(enum crypto_xfrm xfrm,
  */
 static int8_t lcore_dev_ids[RTE_MAX_LCORE][CRYPTODEV_MAX];
 
+/*
+ * Return the PMD of the desired type on the given crypto core,
+ * creating it if there isn't one already.
+ */
 static struct crypto_pmd *
-crypto_pmd_find_or_create(enum crypto_xfrm xfrm,
-			  enum cryptodev_type dev_type)
+crypto_pmd_find_or_create_lcore(enum cryptodev_type dev_type, int lcore)
 {
 	unsigned int cpu_socket;
 	uint8_t dev_id;
 	struct crypto_pmd *pmd;
 	enum crypto_xfrm q;
 	int err;
-	int lcore;
-
-	if (pmd_alloc == 0)
-		memset(lcore_dev_ids, -1, sizeof(lcore_dev_ids));
-
-	if (xfrm == MAX_CRYPTO_XFRM)
-		return NULL;
-
-	if (crypto_rte_dev_cnt(dev_type) >= num_crypto_cpus)
-		return crypto_pmd_alloc_loadshare(xfrm, dev_type);
-
-	/*
-	 * check if we have an existing PMD of the desired type
-	 * on the next available crypto core
-	 */
-	lcore = next_available_crypto_lcore();
-	if (lcore < 0)
-		return NULL;
 
 	if (lcore_dev_ids[lcore][dev_type] != CRYPTO_PMD_INVALID_ID) {
 		dev_id = lcore_dev_ids[lcore][dev_type];
@@ -304,6 +290,32 @@ crypto_pmd_find_or_create(enum crypto_xfrm xfrm,
 	return pmd;
 }
 
+static struct crypto_pmd *
+crypto_pmd_find_or_create(enum crypto_xfrm xfrm,
+			  enum cryptodev_type dev_type)
+{
+	int lcore;
+
+	if (pmd_alloc == 0)
+		memset(lcore_dev_ids, -1, sizeof(lcore_dev_ids));
+
+	if (xfrm == MAX_CRYPTO_XFRM)
+		return NULL;
+
+	if (crypto_rte_dev_cnt(dev_type) >= num_crypto_cpus)
+		return crypto_pmd_alloc_loadshare(xfrm, dev_type);
+
+	/*
+	 * check if we have an existing PMD of the desired type
+	 * on the next available crypto core
+	 */
+	lcore = next_available_crypto_lcore();
+	if (lcore < 0)
+		return NULL;
+
+	return crypto_pmd_find_or_create_lcore(dev_type, lcore);
+}
+
 void crypto_pmd_mod_pending_del(int pmd_dev_id, enum crypto_xfrm xfrm, bool inc)
 {
 	if (pmd_dev_id == CRYPTO_PMD_INVALID_ID)
@@ -324,6 +336,125 @@ void crypto_pmd_dec_pending_del(int pmd_dev_id, enum crypto_xfrm xfrm)
 		crypto_pmd_devs[pmd_dev_id]->pending_remove[xfrm]--;
 }
 
+/*
+ * Set of crypto cores that an outbound SA may be sprayed across. An
+ * empty set disables spraying. Only the cores that are also in the
+ * crypto engine set at the time an SA is created are used.
+ */
+static bitmask_t crypto_spray_cores;
+
+int crypto_set_spray_cores(const uint8_t *bytes, uint8_t len)
+{
+	bitmask_t engines = crypto_engine_cores();
+	bitmask_t usable, unusable;
+	char tmp[BITMASK_STRSZ];
+	unsigned int lcore;
+	int rc;
+
+	rc = bitmask_parse_bytes(&crypto_spray_cores, bytes, len);
+	if (rc) {
+		RTE_LOG(ERR, DATAPLANE,
+			"Failed to parse cpumask for crypto spraying\n");
+		bitmask_zero(&crypto_spray_cores);
+		return rc;
+	}
+
+	bitmask_and(&usable, &crypto_spray_cores, &engines);
+	unusable = crypto_spray_cores;
+	for (lcore = 0; lcore < RTE_MAX_LCORE; lcore++)
+		if (bitmask_isset(&usable, lcore))
+			bitmask_clear(&unusable, lcore);
+
+	if (!bitmask_isempty(&unusable)) {
+		bitmask_sprint(&unusable, tmp, sizeof(tmp));
+		RTE_LOG(NOTICE, DATAPLANE,
+			"Crypto spray core(s) %s not crypto cores, ignored\n",
+			tmp);
+	}
+
+	bitmask_sprint(&usable, tmp, sizeof(tmp));
+	DP_DEBUG(INIT, INFO, DATAPLANE,
+		 "Crypto spray cores set: %s\n", tmp);
+
+	return rc;
+}
+
+/*
+ * Build the spray set for an SA that has already been bound to the
+ * PMD pmd_dev_id. The SA is additionally bound to a PMD of the same
+ * type on each of the spray cores, so that the rte session set up
+ * for the primary PMD is valid on all of them. Returns the number
+ * of PMDs in the set, including the primary one.
+ */
+unsigned int crypto_allocate_spray_pmds(int pmd_dev_id, enum crypto_xfrm xfrm,
+					int8_t dev_ids[], unsigned int max)
+{
+	bitmask_t engines = crypto_engine_cores();
+	struct crypto_pmd *primary, *pmd;
+	unsigned int count = 0;
+	bitmask_t spray;
+	bool err;
+	int lcore;
+
+	primary = crypto_dev_id_to_pmd(pmd_dev_id, &err);
+	if (!primary)
+		return 0;
+
+	dev_ids[count++] = pmd_dev_id;
+
+	/* the crypto engine set may have changed since spraying was set */
+	bitmask_and(&spray, &crypto_spray_cores, &engines);
+	if (xfrm != CRYPTO_ENCRYPT || bitmask_isempty(&spray))
+		return count;
+
+	RTE_LCORE_FOREACH(lcore) {
+		if (count >= max)
+			break;
+
+		if (!bitmask_isset(&spray, lcore) ||
+		    (unsigned int)lcore == primary->lcore ||
+		    (unsigned int)lcore == rte_get_master_lcore())
+			continue;
+
+		pmd = crypto_pmd_find_or_create_lcore(primary->dev_type,
+						      lcore);
+		if (!pmd || pmd->dev_id == pmd_dev_id)
+			continue;
+
+		rte_atomic32_inc(&pmd->sa_cnt);
+		pmd->sa_cnt_per_type[xfrm]++;
+		pmd_sa_active++;
+		dev_ids[count++] = pmd->dev_id;
+	}
+
+	PMD_DEBUG("SA on pmd %s sprayed over %u pmds\n",
+		  primary->dev_name, count);
+
+	return count;
+}
+
+/*
+ * Undo the additional bindings made by crypto_allocate_spray_pmds.
+ * The first entry is the primary PMD and is handled by the caller.
+ */
+void crypto_remove_sa_from_spray_pmds(const int8_t dev_ids[],
+				      unsigned int count,
+				      enum crypto_xfrm xfrm)
+{
+	unsigned int i;
+
+	for (i = 1; i < count; i++)
+		crypto_remove_sa_from_pmd(dev_ids[i], xfrm, false);
+}
+
+void crypto_spray_unbind_rcu(const int8_t dev_ids[], unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 1; i < count; i++)
+		crypto_sa_unbind_rcu(dev_ids[i]);
+}
+
 static int crypto_cpu_describe(FILE *f, unsigned int count,
 			       bool sticky)
 {
@@ -1610,7 +1610,8 @@ void crypto_enqueue_fragment(struct ifnet *ifp,
 	crypto_enqueue_outbound(mbuf, frag_ctx->orig_family,
 				frag_ctx->family, frag_ctx->dst,
 				frag_ctx->in_ifp, ifp, frag_ctx->reqid,
-				frag_ctx->pmd_dev_id, frag_ctx->spi);
+				frag_ctx->pmd_dev_id, frag_ctx->spi,
+				frag_ctx->spray_sa);
 }
 
 /*
@@ -1781,6 +1782,8 @@ crypto_policy_handle_packet_outbound(struct ifnet *vfp_ifp,
 			frag_ctx.reqid = pr->reqid;
 			frag_ctx.pmd_dev_id = pr->overhead.pmd_dev_id;
 			frag_ctx.spi = pr->overhead.spi;
+			frag_ctx.spray_sa =
+				rcu_dereference(pr->overhead.spray_sa);
 			ip_fragment_mtu(nxt_ifp, effective_mtu,
 					mbuf, &frag_ctx,
 					crypto_enqueue_fragment);
@@ -1791,7 +1794,8 @@ crypto_policy_handle_packet_outbound(struct ifnet *vfp_ifp,
 	crypto_enqueue_outbound(mbuf, AF_INET, pr->output_peer_af,
 				&pr->output_peer, in_ifp, NULL,
 				pr->reqid, pr->overhead.pmd_dev_id,
-				pr->overhead.spi);
+				pr->overhead.spi,
+				rcu_dereference(pr->overhead.spray_sa));
 	return;
 
 drop:
@@ -1894,6 +1898,8 @@ crypto_policy_handle_packet6_outbound(struct ifnet *vfp_ifp,
 			frag_ctx.reqid = pr->reqid;
 			frag_ctx.pmd_dev_id = pr->overhead.pmd_dev_id;
 			frag_ctx.spi = pr->overhead.spi;
+			frag_ctx.spray_sa =
+				rcu_dereference(pr->overhead.spray_sa);
 
 			ip6_fragment_mtu(nxt_ifp, effective_mtu, mbuf,
 					 &frag_ctx, crypto_enqueue_fragment);
@@ -1904,7 +1910,8 @@ crypto_policy_handle_packet6_outbound(struct ifnet *vfp_ifp,
 	crypto_enqueue_outbound(mbuf, AF_INET6, pr->output_peer_af,
 				&pr->output_peer, in_ifp, NULL,
 				pr->reqid, pr->overhead.pmd_dev_id,
-				pr->overhead.spi);
+				pr->overhead.spi,
+				rcu_dereference(pr->overhead.spray_sa));
 	return;
 
 drop:
@@ -2606,6 +2613,177 @@ bool crypto_policy_check_inbound_terminating(struct ifnet *in_ifp,
 	return (crypto_policy_check_inbound(in_ifp, mbuf, eth_type));
 }
 
+/*
+ * Record a policy match from a bulk lookup in the flow cache, as
+ * crypto_policy_check_outbound() would have done for the packet.
+ * Matches on a policy with an interface selector depend on the
+ * nexthop, so they are left for the per-packet check.
+ */
+static void
+crypto_policy_burst_cache_add(struct policy_rule *pr, struct rte_mbuf *m,
+			      bool v4, int dir)
+{
+	if (pr->sel.ifindex)
+		return;
+
+	crypto_flow_cache_add(flow_cache, pr, m, v4, false, dir);
+}
+
+static void
+crypto_policy_classify_bulk(struct crypto_vrf_ctx *vrf_ctx, bool v4,
+			    struct rte_mbuf *m[], uint32_t count)
+{
+	struct rldb_result result[RLDB_MATCH_BULK_MAX];
+	struct rte_mbuf *out[RLDB_MATCH_BULK_MAX];
+	struct rldb_db_handle *db_in, *db_out;
+	struct policy_rule *pr;
+	uint32_t i, out_count = 0;
+	int err;
+
+	if (v4) {
+		db_in = vrf_ctx->input_policy_v4_rldb;
+		db_out = vrf_ctx->output_policy_v4_rldb;
+	} else {
+		db_in = vrf_ctx->input_policy_v6_rldb;
+		db_out = vrf_ctx->output_policy_v6_rldb;
+	}
+
+	err = rldb_match(db_in, m, count, result);
+	if (err && err != -ENOENT)
+		return;
+
+	for (i = 0; i < count; i++) {
+		if (!result[i].rldb_rule_no) {
+			out[out_count++] = m[i];
+			continue;
+		}
+		pr = (struct policy_rule *)result[i].rldb_user_data;
+		crypto_policy_burst_cache_add(pr, m[i], v4, XFRM_POLICY_IN);
+	}
+
+	if (!out_count)
+		return;
+
+	err = rldb_match(db_out, out, out_count, result);
+	if (err && err != -ENOENT)
+		return;
+
+	/* misses are left for the per-packet check to cache */
+	for (i = 0; i < out_count; i++) {
+		if (!result[i].rldb_rule_no)
+			continue;
+		pr = (struct policy_rule *)result[i].rldb_user_data;
+		crypto_policy_burst_cache_add(pr, out[i], v4,
+					      XFRM_POLICY_OUT);
+	}
+}
+
+/*
+ * Is the received packet an untagged IP packet with enough of a header
+ * for the policy lookup? It has not been validated yet.
+ */
+static inline bool
+crypto_policy_burst_pkt_ok(struct rte_mbuf *m, uint16_t eth_type)
+{
+	const struct rte_ether_hdr *eh;
+	const uint8_t *l3;
+	uint16_t len = RTE_ETHER_HDR_LEN + sizeof(uint32_t);
+
+	if (m->ol_flags & PKT_RX_VLAN)
+		return false;
+
+	eh = rte_pktmbuf_mtod(m, const struct rte_ether_hdr *);
+	if (eh->ether_type != eth_type)
+		return false;
+
+	l3 = (const uint8_t *)(eh + 1);
+	if (eth_type == htons(RTE_ETHER_TYPE_IPV4))
+		return rte_pktmbuf_data_len(m) >= len + sizeof(struct iphdr) &&
+			(*l3 >> 4) == IPVERSION;
+
+	return rte_pktmbuf_data_len(m) >= len + sizeof(struct ip6_hdr) &&
+		(*l3 >> 4) == 6;
+}
+
+/*
+ * Look up the IPsec policies for a received burst in bulk, so that
+ * rte_acl can classify several packets per trie walk, and record the
+ * results in the flow cache. The per-packet checks in the forwarding
+ * path then find their result in the cache.
+ *
+ * A policy lookup depends only on the packet's addresses, protocol,
+ * ports and VRF, so the result is the same whether or not the packet
+ * reaches the policy check unchanged. Packets that have been rewritten
+ * in the meantime, eg. by NAT, miss the cache and are looked up then.
+ *
+ * This runs before the packets are validated or filtered, so only
+ * policy matches are cached here. A packet that matches no policy
+ * only gets a cache entry if it reaches the per-packet check, so a
+ * flood of packets that are later dropped, eg. with spoofed sources,
+ * can't fill the cache with no-policy entries and evict real ones.
+ */
+void crypto_policy_classify_burst(struct ifnet *ifp, struct rte_mbuf *pkts[],
+				  uint16_t count)
+{
+	struct rte_mbuf *m4[RLDB_MATCH_BULK_MAX], *m6[RLDB_MATCH_BULK_MAX];
+	struct crypto_vrf_ctx *vrf_ctx;
+	uint32_t n4 = 0, n6 = 0;
+	vrfid_t vrfid;
+	uint16_t i;
+
+	if (!flow_cache || flow_cache_disabled || ifp->if_brport)
+		return;
+
+	vrfid = if_vrfid(ifp);
+	vrf_ctx = crypto_vrf_find(vrfid);
+	if (likely(!vrf_ctx))
+		return;
+
+	for (i = 0; i < count; i++) {
+		struct rte_mbuf *m = pkts[i];
+		bool v4;
+
+		if (vrf_ctx->crypto_live_ipv4_policies &&
+		    crypto_policy_burst_pkt_ok(m,
+					       htons(RTE_ETHER_TYPE_IPV4)))
+			v4 = true;
+		else if (vrf_ctx->crypto_live_ipv6_policies &&
+			 crypto_policy_burst_pkt_ok(m,
+						    htons(RTE_ETHER_TYPE_IPV6)))
+			v4 = false;
+		else
+			continue;
+
+		/* as the input nodes will set them */
+		dp_pktmbuf_l2_len(m) = RTE_ETHER_HDR_LEN;
+		pktmbuf_set_vrf(m, vrfid);
+
+		if (crypto_flow_cache_lookup(m, v4))
+			continue;
+
+		if (v4) {
+			m4[n4++] = m;
+			if (n4 == RLDB_MATCH_BULK_MAX) {
+				crypto_policy_classify_bulk(vrf_ctx, true,
+							    m4, n4);
+				n4 = 0;
+			}
+		} else {
+			m6[n6++] = m;
+			if (n6 == RLDB_MATCH_BULK_MAX) {
+				crypto_policy_classify_bulk(vrf_ctx, false,
+							    m6, n6);
+				n6 = 0;
+			}
+		}
+	}
+
+	if (n4)
+		crypto_policy_classify_bulk(vrf_ctx, true, m4, n4);
+	if (n6)
+		crypto_policy_classify_bulk(vrf_ctx, false, m6, n6);
+}
+
 /*
  * For a given reqid, find the matching output policy and retrieve the
  * virtual feature point interface, if any.
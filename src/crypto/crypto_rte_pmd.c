@@ -1147,10 +1147,10 @@ crypto_rte_xform_packets(struct crypto_pkt_ctx *cctx_arr[], uint16_t count)
 
 		crypto_prefetch_ctx_data(cctx_arr, count, i);
 
-		if (pkt_batch.cdev_id != cctx->sa->rte_cdev_id ||
+		if (pkt_batch.cdev_id != cctx->rte_cdev_id ||
 		    pkt_batch.qid != qid) {
 			crypto_rte_process_op_batch(&pkt_batch);
-			pkt_batch.cdev_id = cctx->sa->rte_cdev_id;
+			pkt_batch.cdev_id = cctx->rte_cdev_id;
 			pkt_batch.qid = qid;
 		}
 		pkt_batch.cop_arr[pkt_batch.batch_size] = cop;
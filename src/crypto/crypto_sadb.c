@@ -1,5 +1,5 @@
 /*-
- * Copyright (c) 2017-2020, AT&T Intellectual Property. All rights reserved.
+ * Copyright (c) 2017-2021, AT&T Intellectual Property. All rights reserved.
  * Copyright (c) 2015-2016 by Brocade Communications Systems, Inc.
  * All rights reserved.
  *
@@ -19,6 +19,7 @@
 #include <sys/queue.h>
 #include <sys/socket.h>
 #include <urcu/list.h>
+#include <urcu/uatomic.h>
 
 #include "compiler.h"
 #include "crypto.h"
@@ -84,6 +85,16 @@ struct sadb_spi_out_key {
 
 static uint64_t sa_epoch;
 
+/* Reorder slots in use by sprayed SAs */
+static uint32_t sadb_spray_slots;
+
+/*
+ * Number of consecutive sequence numbers sent to each PMD of a
+ * sprayed SA in turn, expressed as a shift. Sending runs rather than
+ * single packets keeps the per-lcore crypto bursts intact.
+ */
+#define CRYPTO_SPRAY_RUN_SHIFT 4
+
 /*
  * Hash seed used when hashing the spi and dest address
  * for an output SA lookup.
@@ -283,6 +294,29 @@ struct sadb_sa *sadb_lookup_sa_outbound(vrfid_t vrfid,
 	return sa;
 }
 
+/*
+ * Used by the forwarding threads for packets on a sprayed SA, as
+ * cached in the policy or VTI overhead. Pick the PMD the packet is
+ * to be encrypted on and pre-assign its sequence number, so that the
+ * crypto cores can process the SA's packets in parallel. Returns the
+ * passed pmd_dev_id, with seq left untouched, if the SA is blocked.
+ */
+int crypto_sadb_spray_assign(struct sadb_sa *sa, int pmd_dev_id,
+			     uint32_t *seq, uint8_t *slot)
+{
+	uint32_t sa_seq;
+
+	if (sa->spray_cnt < 2 || CMM_LOAD_SHARED(sa->blocked))
+		return pmd_dev_id;
+
+	sa_seq = uatomic_add_return(&sa->seq, 1);
+	*seq = sa_seq;
+	*slot = sa->spray_slot;
+
+	return sa->spray_dev_ids[(sa_seq >> CRYPTO_SPRAY_RUN_SHIFT) %
+				 sa->spray_cnt];
+}
+
 static bool sadb_add_sa_to_spi_out_hash(struct sadb_sa *sa,
 					struct crypto_vrf_ctx *vrf_ctx)
 {
@@ -500,6 +534,12 @@ static void sadb_remove_peer(struct sadb_peer *peer, vrfid_t vrfid)
 	vrf_ctx->count_of_peers--;
 }
 
+/* The SA, if the forwarding threads are to spray its packets */
+static struct sadb_sa *sadb_sa_spray(struct sadb_sa *sa)
+{
+	return sa->spray_cnt > 1 ? sa : NULL;
+}
+
 static void sadb_refresh_osbervers_of_sa(struct sadb_sa *sa,
 					 struct sadb_peer *peer,
 					 bool unique)
@@ -537,9 +577,20 @@ static void sadb_refresh_osbervers_of_sa(struct sadb_sa *sa,
 								sa->family);
 				observer->pmd_dev_id = sa->pmd_dev_id;
 				observer->spi = sa->spi;
+				rcu_assign_pointer(observer->spray_sa,
+						   !unique ?
+						   sadb_sa_spray(sa) : NULL);
 			}
 		}
 	}
+
+	/* Don't leave anyone spraying onto an SA being deleted */
+	if (unique) {
+		TAILQ_FOREACH(observer, &peer->observers, links) {
+			if (observer->spray_sa == sa)
+				rcu_assign_pointer(observer->spray_sa, NULL);
+		}
+	}
 }
 
 /*
@@ -762,6 +813,7 @@ static void sadb_sa_destroy(struct sadb_sa *sa)
 {
 	cipher_teardown_ctx(sa);
 	crypto_sa_unbind_rcu(sa->del_pmd_dev_id);
+	crypto_spray_unbind_rcu(sa->spray_dev_ids, sa->spray_cnt);
 	free(sa);
 }
 
@@ -771,6 +823,59 @@ static enum crypto_xfrm crypto_sa_to_xfrm(struct sadb_sa *sa)
 		CRYPTO_DECRYPT : CRYPTO_ENCRYPT;
 }
 
+/*
+ * Spread an outbound SA over the configured spray cores. This is
+ * only possible when the SA has a post-crypto forwarding core, as
+ * that is where the packets are put back into sequence order, and
+ * when the session is handled by an rte PMD, as an openssl session
+ * context can't be shared between crypto cores.
+ *
+ * This must be done before the SA is visible to the forwarding
+ * threads, so that all its sequence numbers are assigned in the
+ * same place.
+ */
+static void crypto_sadb_spray_setup(struct sadb_sa *sa, bool setup_openssl)
+{
+	unsigned int slot, count;
+
+	if (sa->dir != CRYPTO_DIR_OUT || !sa->fwd_core || setup_openssl ||
+	    sa->pmd_dev_id == CRYPTO_PMD_INVALID_ID)
+		return;
+
+	for (slot = 0; slot < CRYPTO_SPRAY_MAX_SA; slot++)
+		if (!(sadb_spray_slots & (1u << slot)))
+			break;
+	if (slot == CRYPTO_SPRAY_MAX_SA)
+		return;
+
+	count = crypto_allocate_spray_pmds(sa->pmd_dev_id, CRYPTO_ENCRYPT,
+					   sa->spray_dev_ids,
+					   CRYPTO_SPRAY_MAX_PMD);
+	if (count < 2)
+		return;
+
+	sadb_spray_slots |= 1u << slot;
+	sa->spray_slot = slot;
+	sa->spray_cnt = count;
+
+	SADB_DEBUG("SPI %x sprayed over %u PMDs, slot %u\n",
+		   ntohl(sa->spi), count, slot);
+}
+
+/*
+ * Drop the additional PMD bindings of a sprayed SA. The PMDs
+ * themselves are unbound once the SA is freed.
+ */
+static void crypto_sadb_spray_release(struct sadb_sa *sa)
+{
+	if (sa->spray_cnt < 2)
+		return;
+
+	crypto_remove_sa_from_spray_pmds(sa->spray_dev_ids, sa->spray_cnt,
+					 CRYPTO_ENCRYPT);
+	sadb_spray_slots &= ~(1u << sa->spray_slot);
+}
+
 /*
  * This function is invoked at the time of SA creation to
  * set the direction and set up the session in the driver
@@ -927,6 +1032,11 @@ int crypto_sadb_new_sa(const struct xfrm_usersa_info *sa_info,
 			return -EINVAL;
 		}
 	}
+
+	/* allocate a core for post crypto processing */
+	sa->fwd_core = crypto_sa_alloc_fwd_core();
+	crypto_sadb_spray_setup(sa, setup_openssl);
+
 	rc = sadb_insert_sa(sa, vrf_ctx, peer, sa->reqid);
 	if (rc < 0) {
 		/*
@@ -936,6 +1046,8 @@ int crypto_sadb_new_sa(const struct xfrm_usersa_info *sa_info,
 		 * the  PMD it is attached to.
 		 */
 		SADB_ERR("Failed to insert SA into SADB\n");
+		crypto_sadb_spray_release(sa);
+		crypto_sa_free_fwd_core(sa->fwd_core);
 		sadb_sa_destroy(sa);
 		return rc;
 	}
@@ -948,8 +1060,6 @@ int crypto_sadb_new_sa(const struct xfrm_usersa_info *sa_info,
 		crypto_policy_feat_attach_by_reqid(vrf_ctx, sa->reqid) : NULL;
 	rcu_assign_pointer(sa->feat_attach_ifp, ifp);
 
-	/* allocate a core for post crypto processing */
-	sa->fwd_core = crypto_sa_alloc_fwd_core();
 	vrf_ctx->count_of_sas++;
 
 	return 0;
@@ -1035,6 +1145,7 @@ static int crypto_sadb_del_sa_internal(const xfrm_address_t *dst,
 	crypto_remove_sa_from_pmd(sa->del_pmd_dev_id,
 				  crypto_sa_to_xfrm(sa),
 				  sa->pending_del);
+	crypto_sadb_spray_release(sa);
 	crypto_sa_free_fwd_core(sa->fwd_core);
 	call_rcu(&sa->sa_rcu, sadb_sa_rcu_free);
 	vrf_ctx->count_of_sas--;
@@ -1261,6 +1372,15 @@ void crypto_sadb_show_summary(FILE *f, vrfid_t vrfid)
 			jsonw_string_field(wr, "spi", spi_as_hexstring);
 			jsonw_uint_field(wr, "pmd_dev_id", sa->pmd_dev_id);
 			jsonw_uint_field(wr, "fwd_core", sa->fwd_core);
+			if (sa->spray_cnt > 1) {
+				unsigned int i;
+
+				jsonw_name(wr, "spray_pmd_dev_ids");
+				jsonw_start_array(wr);
+				for (i = 0; i < sa->spray_cnt; i++)
+					jsonw_int(wr, sa->spray_dev_ids[i]);
+				jsonw_end_array(wr);
+			}
 			jsonw_string_field(wr, "pending_delete",
 					   sa->pending_del ? "Yes" : "No");
 			crypto_engine_summary(wr, sa);
@@ -1366,8 +1486,14 @@ void crypto_sadb_show_spi_mapping(FILE *f, vrfid_t vrfid)
 void crypto_sadb_increment_counters(struct sadb_sa *sa, uint32_t bytes,
 				    uint32_t packets)
 {
-	sa->packet_count += packets;
-	sa->byte_count   += bytes;
+	/* A sprayed SA is updated from several crypto cores at once */
+	if (unlikely(sa->spray_cnt > 1)) {
+		uatomic_add(&sa->packet_count, packets);
+		uatomic_add(&sa->byte_count, bytes);
+	} else {
+		sa->packet_count += packets;
+		sa->byte_count   += bytes;
+	}
 
 	if ((sa->packet_count > sa->packet_limit) ||
 	    (sa->byte_count > sa->byte_limit)) {
@@ -1399,6 +1525,7 @@ static void cypto_sadb_overhead_refresh(struct sadb_peer *peer,
 						 ESP_PAYLOAD_MIN_ALIGN);
 		overhead->pmd_dev_id = sa->pmd_dev_id;
 		overhead->spi = sa->spi;
+		rcu_assign_pointer(overhead->spray_sa, sadb_sa_spray(sa));
 		break;
 	}
 }
@@ -1419,6 +1546,7 @@ void crypto_sadb_tunl_overhead_subscribe(uint32_t reqid,
 	overhead->pmd_dev_id = CRYPTO_PMD_INVALID_ID;
 	overhead->block_size = ESP_PAYLOAD_MIN_ALIGN;
 	overhead->spi = 0;
+	overhead->spray_sa = NULL;
 	TAILQ_INSERT_TAIL(&peer->observers, overhead, links);
 	cypto_sadb_overhead_refresh(peer, overhead);
 }
@@ -1440,6 +1568,7 @@ void crypto_sadb_tunl_overhead_unsubscribe(uint32_t reqid,
 	overhead->bytes = 0;
 	overhead->pmd_dev_id = CRYPTO_PMD_INVALID_ID;
 	overhead->spi = 0;
+	rcu_assign_pointer(overhead->spray_sa, NULL);
 	/*
 	 * If there are no more observers and
 	 * no SAs then we can remove the peer.
@@ -58,6 +58,8 @@ struct sadb_sa *sadb_lookup_sa_by_spi_in(uint32_t spi);
 struct sadb_sa *sadb_lookup_sa_outbound(vrfid_t vrfid,
 					const xfrm_address_t *dst,
 					uint16_t family, uint32_t spi);
+int crypto_sadb_spray_assign(struct sadb_sa *sa, int pmd_dev_id,
+			     uint32_t *seq, uint8_t *slot);
 int crypto_spi_to_pmd_dev_id(uint32_t spi);
 void crypto_sadb_feat_attach_in(uint32_t reqid, struct ifnet *ifp);
 void crypto_incmpl_sa_init(void);
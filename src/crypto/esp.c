@@ -1234,6 +1234,7 @@ esp_output_pre_encrypt(struct crypto_pkt_ctx *ctx_arr[],
 	struct sadb_sa *sa;
 	struct rte_mbuf *m;
 	struct esp_hdr_ctx *h;
+	uint32_t seq;
 
 	crypto_prefetch_ivs();
 
@@ -1347,7 +1348,12 @@ esp_output_pre_encrypt(struct crypto_pkt_ctx *ctx_arr[],
 		/* Add Spi, sequence and IV */
 		*(uint32_t *)esp_ptr = (sa->spi);
 		esp_ptr += 4;
-		*(uint32_t *)esp_ptr = htonl(++(sa->seq));
+		/*
+		 * A sprayed SA has its sequence numbers assigned by
+		 * the forwarding thread.
+		 */
+		seq = ctx->seq ? ctx->seq : ++(sa->seq);
+		*(uint32_t *)esp_ptr = htonl(seq);
 		esp_ptr += 4;
 
 		/*
@@ -1363,7 +1369,7 @@ esp_output_pre_encrypt(struct crypto_pkt_ctx *ctx_arr[],
 		crypto_get_iv(j, (char *)esp_ptr,
 			      crypto_session_iv_len(sa->session));
 
-		if (unlikely(sa->seq == ESP_SEQ_SA_REKEY_THRESHOLD)) {
+		if (unlikely(seq == ESP_SEQ_SA_REKEY_THRESHOLD)) {
 			crypto_rekey_requests++;
 			crypto_expire_request(sa->spi,
 					      crypto_sadb_get_reqid(sa),
@@ -1371,7 +1377,7 @@ esp_output_pre_encrypt(struct crypto_pkt_ctx *ctx_arr[],
 					      crypto_sadb_get_family(sa),
 					      IPPROTO_ESP, 0 /* hard */);
 		}
-		if (unlikely(sa->seq > (ESP_SEQ_SA_BLOCK_LIMIT - 1)))
+		if (unlikely(seq > (ESP_SEQ_SA_BLOCK_LIMIT - 1)))
 			crypto_sadb_mark_as_blocked(sa);
 
 		/* set up output parameters */
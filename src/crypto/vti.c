@@ -603,6 +603,8 @@ void vti_tunnel_out(struct ifnet *in_ifp, struct ifnet *nxt_ifp,
 		frag_ctx.reqid = ctxt->reqid;
 		frag_ctx.pmd_dev_id = ctxt->ipsec_overhead.pmd_dev_id;
 		frag_ctx.spi = ctxt->ipsec_overhead.spi;
+		frag_ctx.spray_sa =
+			rcu_dereference(ctxt->ipsec_overhead.spray_sa);
 		if (ip->version == 4)
 			ip_fragment_mtu(nxt_ifp, effective_mtu, m,
 					&frag_ctx, crypto_enqueue_fragment);
@@ -614,7 +616,9 @@ void vti_tunnel_out(struct ifnet *in_ifp, struct ifnet *nxt_ifp,
 					&ctxt->key.dst,
 					in_ifp, nxt_ifp, ctxt->reqid,
 					ctxt->ipsec_overhead.pmd_dev_id,
-					ctxt->ipsec_overhead.spi);
+					ctxt->ipsec_overhead.spi,
+					rcu_dereference(
+						ctxt->ipsec_overhead.spray_sa));
 	}
 
 	return;
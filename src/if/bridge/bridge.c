@@ -19,6 +19,7 @@
 #include <linux/neighbour.h>
 #include <linux/netlink.h>
 #include <netinet/ip.h>
+#include <pthread.h>
 #include <rte_atomic.h>
 #include <rte_branch_prediction.h>
 #include <rte_common.h>
@@ -29,12 +30,14 @@
 #include <rte_log.h>
 #include <rte_mbuf.h>
 #include <rte_memory.h>
+#include <rte_ring.h>
 #include <rte_timer.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <unistd.h>
 #include <urcu/uatomic.h>
 
 #include "arp.h"
@@ -88,6 +91,51 @@ struct bridge_vlan_set;
 #define BRIDGE_AGEING_TIME_MIN	10
 #define BRIDGE_AGEING_TIME_MAX	1000000
 
+/*
+ * Source address learning.
+ *
+ * Forwarding cores don't insert into the forwarding table themselves,
+ * as that means allocating and programming the FAL in the forwarding
+ * path. Instead they queue the source to a learner thread over a
+ * per-lcore ring; any other thread learns inline, as it would share a
+ * ring slot.  A small per-lcore cache of recently queued sources
+ * suppresses repeat requests, e.g. for a burst of frames from a new
+ * source, and the learner rate limits new addresses per port.
+ *
+ * The learner only runs while there are bridges. Frames to a source
+ * that is queued but not yet learned are flooded, as before it was
+ * seen. This normally lasts for one pass of the learner, but a source
+ * dropped by a full ring is retried on its next frame, and one over
+ * the port learn rate on its next frame after the holdoff.
+ */
+#define BRIDGE_LEARN_RING_SZ	1024
+#define BRIDGE_LEARN_BURST	64
+#define BRIDGE_LEARN_CACHE_SZ	256	/* power of 2 */
+#define BRIDGE_LEARN_HOLDOFF_MS	100
+#define BRIDGE_LEARN_IDLE_US	100
+#define BRIDGE_LEARN_RATE	1000	/* per port per second, 0 = no limit */
+
+struct bridge_learn_req {
+	uint32_t		ifindex;
+	uint16_t		vlan;
+	struct rte_ether_addr	addr;
+};
+
+struct bridge_learn_lcore {
+	struct rte_ring		*ring;
+	struct {
+		struct bridge_key key;
+		uint32_t	ifindex;
+		uint64_t	tsc;
+	} cache[BRIDGE_LEARN_CACHE_SZ];
+} __rte_cache_aligned;
+
+static struct bridge_learn_lcore *bridge_learn_lcores[RTE_MAX_LCORE];
+static unsigned int bridge_count;
+static bool bridge_learn_running;
+static pthread_t bridge_learn_tid;
+static uint32_t bridge_learn_rate = BRIDGE_LEARN_RATE;
+
 /* Enable/disable fragmentation on L2 GRE bridge intf */
 static bool bridge_frag_enable = true;
 
@@ -462,6 +510,14 @@ bridge_rtnode_insert(struct bridge_softc *sc, struct bridge_rtnode *brt)
 	return (ret_node != &brt->brt_node) ? EEXIST : 0;
 }
 
+/* Mark the entry used, without dirtying the cacheline if already so */
+static inline void
+bridge_rtnode_mark_used(struct bridge_rtnode *brt)
+{
+	if (rte_atomic32_read(&brt->brt_unused))
+		rte_atomic32_clear(&brt->brt_unused);
+}
+
 /*
  * Update existing forwarding table entry
  */
@@ -520,7 +576,203 @@ bridge_rtupdate(struct ifnet *ifp,
 	}
 
 	/* Entry is marked used */
-	rte_atomic32_clear(&brt->brt_unused);
+	bridge_rtnode_mark_used(brt);
+}
+
+/*
+ * Learn the source address of a frame received on a bridge port.
+ *
+ * Known sources on the same port are just marked as used, anything else
+ * is queued to the learner.
+ */
+static void
+bridge_learn(struct bridge_softc *sc, struct ifnet *ifp,
+	     const struct rte_ether_addr *src, uint16_t vlan)
+{
+	struct bridge_learn_lcore *bl;
+	struct bridge_rtnode *brt;
+	unsigned int lcore = dp_lcore_id();
+	uint64_t now;
+
+	brt = bridge_rtnode_lookup(sc, src, vlan);
+	if (likely(brt != NULL) &&
+	    (brt->brt_difp == ifp || !bridge_mac_is_dynamic(brt))) {
+		bridge_rtnode_mark_used(brt);
+		return;
+	}
+
+	/*
+	 * The learn ring and cache for a slot are single producer, and
+	 * dp_lcore_id() is 0 for the master and non-EAL threads, so only
+	 * the forwarding thread that owns the slot may queue to it.
+	 */
+	bl = lcore < RTE_MAX_LCORE ? bridge_learn_lcores[lcore] : NULL;
+	if (unlikely(bl == NULL || rte_lcore_id() != lcore ||
+		     !CMM_LOAD_SHARED(bridge_learn_running))) {
+		/* No learner for this thread, so learn inline */
+		bridge_rtupdate(ifp, src, vlan);
+		return;
+	}
+
+	struct bridge_key key = { .addr = *src, .vlan = vlan };
+	unsigned int idx = bridge_key_hash(&key) & (BRIDGE_LEARN_CACHE_SZ - 1);
+
+	now = rte_get_timer_cycles();
+	if (bl->cache[idx].ifindex == ifp->if_index &&
+	    bridge_key_equal(&bl->cache[idx].key, &key) &&
+	    now - bl->cache[idx].tsc <
+	    rte_get_timer_hz() * BRIDGE_LEARN_HOLDOFF_MS / 1000)
+		return;
+
+	struct bridge_learn_req req = {
+		.ifindex = ifp->if_index,
+		.vlan = vlan,
+		.addr = *src,
+	};
+
+	/* If the learner is behind, the next frame will try again */
+	if (rte_ring_sp_enqueue_elem(bl->ring, &req, sizeof(req)) != 0)
+		return;
+
+	bl->cache[idx].key = key;
+	bl->cache[idx].ifindex = ifp->if_index;
+	bl->cache[idx].tsc = now;
+}
+
+static void
+bridge_learn_one(const struct bridge_learn_req *req)
+{
+	struct ifnet *ifp = dp_ifnet_byifindex(req->ifindex);
+
+	/* The port may have left the bridge since the frame was seen */
+	if (!ifp || !ifp->if_brport)
+		return;
+
+	if (!bridge_port_learn_allowed(ifp->if_brport,
+				       CMM_LOAD_SHARED(bridge_learn_rate)))
+		return;
+
+	bridge_rtupdate(ifp, &req->addr, req->vlan);
+}
+
+/* Drain up to a burst from each learn ring, returning the count */
+static unsigned int
+bridge_learn_drain(bool discard)
+{
+	struct bridge_learn_req reqs[BRIDGE_LEARN_BURST];
+	struct bridge_learn_lcore *bl;
+	unsigned int lcore, n, i, total = 0;
+
+	RTE_LCORE_FOREACH(lcore) {
+		bl = bridge_learn_lcores[lcore];
+		if (!bl)
+			continue;
+
+		n = rte_ring_sc_dequeue_burst_elem(bl->ring, reqs,
+						   sizeof(reqs[0]),
+						   BRIDGE_LEARN_BURST, NULL);
+		for (i = 0; i < n && !discard; i++)
+			bridge_learn_one(&reqs[i]);
+		total += n;
+	}
+	return total;
+}
+
+/* Learner thread, draining the per-lcore learn rings */
+static void *
+bridge_learner(void *arg __unused)
+{
+	unsigned int total;
+
+	pthread_setname_np(pthread_self(), "dp/br-learn");
+	dp_rcu_register_thread();
+
+	while (CMM_LOAD_SHARED(bridge_learn_running)) {
+		dp_rcu_thread_online();
+		total = bridge_learn_drain(false);
+		dp_rcu_thread_offline();
+
+		if (total == 0)
+			usleep(BRIDGE_LEARN_IDLE_US);
+	}
+
+	/* Requests left now are stale by the time the learner restarts */
+	while (bridge_learn_drain(true))
+		;
+
+	dp_rcu_unregister_thread();
+	return NULL;
+}
+
+static void
+bridge_learn_rings_free(void)
+{
+	struct bridge_learn_lcore *bl;
+	unsigned int lcore;
+
+	RTE_LCORE_FOREACH(lcore) {
+		bl = bridge_learn_lcores[lcore];
+		if (bl) {
+			bridge_learn_lcores[lcore] = NULL;
+			rte_ring_free(bl->ring);
+			free(bl);
+		}
+	}
+}
+
+/*
+ * Set up the learn rings, once, and start the learner. On failure,
+ * frames are learned inline by the forwarding cores.
+ */
+static void
+bridge_learn_start(void)
+{
+	struct bridge_learn_lcore *bl;
+	char name[RTE_RING_NAMESIZE];
+	unsigned int lcore;
+
+	RTE_LCORE_FOREACH(lcore) {
+		if (bridge_learn_lcores[lcore])
+			continue;
+
+		bl = zmalloc_aligned(sizeof(*bl));
+		if (!bl)
+			goto fail;
+
+		snprintf(name, sizeof(name), "br-learn-%u", lcore);
+		bl->ring = rte_ring_create_elem(name,
+						sizeof(struct bridge_learn_req),
+						BRIDGE_LEARN_RING_SZ,
+						rte_lcore_to_socket_id(lcore),
+						RING_F_SP_ENQ | RING_F_SC_DEQ);
+		if (!bl->ring) {
+			free(bl);
+			goto fail;
+		}
+		bridge_learn_lcores[lcore] = bl;
+	}
+
+	CMM_STORE_SHARED(bridge_learn_running, true);
+	if (pthread_create(&bridge_learn_tid, NULL, bridge_learner,
+			   NULL) != 0) {
+		CMM_STORE_SHARED(bridge_learn_running, false);
+		goto fail;
+	}
+	return;
+
+fail:
+	RTE_LOG(ERR, BRIDGE, "Failed to start bridge learner\n");
+}
+
+/* Stop the learner, forwarding cores learn inline until restarted */
+static void
+bridge_learn_stop(void)
+{
+	if (!bridge_learn_running)
+		return;
+
+	CMM_STORE_SHARED(bridge_learn_running, false);
+	pthread_join(bridge_learn_tid, NULL);
 }
 
 static void
@@ -787,6 +1039,9 @@ static int bridge_if_init(struct ifnet *ifp, void *ctx __unused)
 
 	ifp->if_softc = sc;
 
+	if (bridge_count++ == 0)
+		bridge_learn_start();
+
 	return 0;
 }
 
@@ -813,6 +1068,9 @@ static void bridge_if_uninit(struct ifnet *ifp)
 	}
 
 	call_rcu(&sc->scbr_rcu, bridge_free);
+
+	if (--bridge_count == 0)
+		bridge_learn_stop();
 }
 
 static bool
@@ -1229,7 +1487,7 @@ bridge_forward(struct bridge_softc *sc, struct ifnet *ifp,
 		capture_burst(brif, &m, 1);
 
 	/* Mark entry as used */
-	rte_atomic32_clear(&brt->brt_unused);
+	bridge_rtnode_mark_used(brt);
 
 	if (dif->if_type == IFT_TUNNEL_GRE)
 		bridge_forward_via_tunnel(brif, ifp, dif, &brt->brt_dip, m);
@@ -1440,7 +1698,7 @@ void bridge_output(struct ifnet *ifp, struct rte_mbuf *m,
 		capture_burst(ifp, &m, 1);
 
 	/* Mark entry as used */
-	rte_atomic32_clear(&brt->brt_unused);
+	bridge_rtnode_mark_used(brt);
 
 	if (dif->if_type == IFT_TUNNEL_GRE)
 		bridge_forward_via_tunnel(ifp, in_ifp, dif, &brt->brt_dip, m);
@@ -1596,7 +1854,7 @@ void bridge_input(struct bridge_port *port, struct rte_mbuf *m)
 	/* Learn the source address */
 	if (state == STP_IFSTATE_LEARNING ||
 	    state == STP_IFSTATE_FORWARDING)
-		bridge_rtupdate(ifp, &eh->s_addr, bridge_frame_get_vlan(m));
+		bridge_learn(sc, ifp, &eh->s_addr, bridge_frame_get_vlan(m));
 
 	if (state != STP_IFSTATE_FORWARDING)
 		goto drop;
@@ -2641,10 +2899,55 @@ bridge_frag(FILE *f, int argc, char **argv)
 	return -1;
 }
 
+/*
+ * bridge learn {rate <per-port-per-second> | show}
+ *
+ * Sets the maximum rate at which each port learns new addresses,
+ * 0 for no limit.
+ */
+static int
+bridge_learn_cmd(FILE *f, int argc, char **argv)
+{
+	unsigned int rate;
+
+	if (argc < 2) {
+		fprintf(f, "%s: missing argument: %d", __func__, argc);
+		return -1;
+	}
+	argc--, argv++; /* skip 'learn' */
+
+	if (strcmp(argv[0], "rate") == 0) {
+		if (argc < 2 || get_unsigned(argv[1], &rate) < 0) {
+			fprintf(f, "bridge learn rate: invalid rate\n");
+			return -1;
+		}
+		CMM_STORE_SHARED(bridge_learn_rate, rate);
+		return 0;
+	}
+	if (strcmp(argv[0], "show") == 0) {
+		json_writer_t *wr = jsonw_new(f);
+
+		if (!wr)
+			return -1;
+
+		jsonw_name(wr, "learn");
+		jsonw_start_object(wr);
+		jsonw_uint_field(wr, "rate", bridge_learn_rate);
+		jsonw_bool_field(wr, "learner", bridge_learn_running);
+		jsonw_end_object(wr);
+		jsonw_destroy(&wr);
+		return 0;
+	}
+
+	fprintf(f, "Unknown bridge learn command\n");
+	return -1;
+}
+
 /*
  * bridge <bridge> macs show [port <port>] [mac <mac>] [vlan <vlan>] [hardware]
  * bridge <bridge> macs clear [port <port>] [mac <mac>]
  * bridge frag {enable | disable | show}
+ * bridge learn {rate <rate> | show}
  */
 int
 cmd_bridge(FILE *f, int argc, char **argv)
@@ -2659,6 +2962,8 @@ cmd_bridge(FILE *f, int argc, char **argv)
 
 	if (strcmp(argv[0], "frag") == 0)
 		return bridge_frag(f, argc, argv);
+	if (strcmp(argv[0], "learn") == 0)
+		return bridge_learn_cmd(f, argc, argv);
 
 	bridge = dp_ifnet_byifname(argv[0]);
 
@@ -2781,8 +3086,15 @@ static void bridge_init(void)
 		bridge_pvst_flood_local = true;
 }
 
+static void bridge_uninit(void)
+{
+	bridge_learn_stop();
+	bridge_learn_rings_free();
+}
+
 static const struct dp_event_ops bridge_events = {
 	.init = bridge_init,
+	.uninit = bridge_uninit,
 	.if_feat_mode_change = bridge_if_feat_mode_change,
 	.if_admin_status_change = bridge_if_admin_status_change,
 };
@@ -9,6 +9,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <rte_cycles.h>
 #include <urcu/list.h>
 
 #include "bridge_vlan_set.h"
@@ -72,6 +73,10 @@ struct bridge_port {
 	bool                    fal_created;
 	uint8_t                 state[MSTP_MSTI_COUNT];
 
+	/* Learn rate limiting, only used by the learner */
+	uint64_t                learn_window;
+	uint32_t                learn_count;
+
 	/* Administrative */
 	struct rcu_head		    rcu;
 };
@@ -268,3 +273,22 @@ bool bridge_port_is_fal_created(struct bridge_port *port)
 {
 	return port->fal_created;
 }
+
+bool bridge_port_learn_allowed(struct bridge_port *port, uint32_t rate)
+{
+	uint64_t now = rte_get_timer_cycles();
+
+	if (rate == 0)
+		return true;
+
+	if (now - port->learn_window >= rte_get_timer_hz()) {
+		port->learn_window = now;
+		port->learn_count = 0;
+	}
+
+	if (port->learn_count >= rate)
+		return false;
+
+	port->learn_count++;
+	return true;
+}
@@ -171,4 +171,12 @@ void bridge_port_set_fal_created(struct bridge_port *port, bool created);
  */
 bool bridge_port_is_fal_created(struct bridge_port *port);
 
+/*
+ * Account for an address learned on the port. Returns false if the
+ * port has already learned rate addresses in the last second, in which
+ * case the address should not be learned. A rate of 0 is no limit.
+ * Not thread safe; only called by the bridge learner.
+ */
+bool bridge_port_learn_allowed(struct bridge_port *port, uint32_t rate);
+
 #endif /* BRIDGE_PORT_H */
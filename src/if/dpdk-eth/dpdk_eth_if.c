@@ -22,6 +22,7 @@
 #include "if_var.h"
 #include "l2_rx_fltr.h"
 #include "lag.h"
+#include "main.h"
 #include "qos.h"
 #include "vhost.h"
 #include "vplane_debug.h"
@@ -202,6 +203,9 @@ void dpdk_eth_if_start_port(struct ifnet *ifp)
 			dpdk_eth_if_reset_port(NULL, ifp);
 
 		ret = rte_eth_dev_start(port);
+		/* retry without RX interrupts if the device refused them */
+		if (ret < 0 && eth_port_rx_intr_fallback(port))
+			ret = rte_eth_dev_start(port);
 		if (ret < 0 && !sc->scd_need_reset) {
 			RTE_LOG(ERR, DATAPLANE,
 				"rte_eth_dev_start: port=%u err=%d\n",
@@ -209,6 +213,8 @@ void dpdk_eth_if_start_port(struct ifnet *ifp)
 			unassign_queues(port);
 			return;
 		}
+		if (ret == 0)
+			eth_port_rx_intr_check(port);
 
 		sc->scd_need_reset = false;
 	}
@@ -255,6 +255,33 @@ gre_info_lookup(struct gre_infotbl_st *gre_infos,
 	return NULL;
 }
 
+/*
+ * One's complement partial sum of the outer IPv4 source and
+ * destination addresses. These are fixed for a tunnel or mGRE peer,
+ * so encapsulation only has to add in the fields that vary per packet
+ * to get the header checksum.
+ */
+static uint32_t gre_iph_addr_sum(const struct iphdr *iph)
+{
+	return (iph->saddr >> 16) + (iph->saddr & 0xffff) +
+		(iph->daddr >> 16) + (iph->daddr & 0xffff);
+}
+
+/* Checksum of an outer header whose address sum is precomputed */
+static inline uint16_t
+gre_iph_cksum(const struct iphdr *ip, uint32_t addr_sum)
+{
+	const uint16_t *w = (const uint16_t *)ip;
+	uint32_t sum;
+
+	/* words 0-4; word 5 is the checksum and 6-9 the addresses */
+	sum = addr_sum + w[0] + w[1] + w[2] + w[3] + w[4];
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+
+	return ~sum;
+}
+
 static struct gre_info_st *
 gre_info_init(struct vrf *vrf, const struct gre_info_hash_key *h_key)
 {
@@ -278,6 +305,7 @@ gre_info_init(struct vrf *vrf, const struct gre_info_hash_key *h_key)
 		greinfo->iph.version = IPVERSION;
 		greinfo->iph.frag_off = htons(IP_DF);
 		greinfo->iph.tos = 0;
+		greinfo->iph_addr_sum = gre_iph_addr_sum(&greinfo->iph);
 		greinfo->family = AF_INET;
 	} else {
 		greinfo->iph6.ip6_src = h_key->local6;
@@ -1263,6 +1291,7 @@ mgre_newneigh(struct ifnet *ifp,
 	rt_info->iph.frag_off = htons(IP_DF);
 	rt_info->iph.saddr = greinfo->iph.saddr;
 	rt_info->iph.daddr = nbma_addr->s_addr;
+	rt_info->iph_addr_sum = gre_iph_addr_sum(&rt_info->iph);
 	rt_info->tun_addr.s_addr = tun_addr->s_addr;
 	rt_info->nbma_vrfid = nbma_vrfid;
 	rt_info->rt_info_bits = 0;
@@ -1756,7 +1785,7 @@ gre_tunnel_add_encap(struct ifnet *tunnel_ifp, struct rte_mbuf *m,
 		     const uint16_t inner_len, const uint8_t inner_ttl,
 		     const uint8_t inner_tos, const uint16_t dont_frag,
 		     char *hdr, struct gre_info_st *greinfo,
-		     struct iphdr *outer_ip)
+		     struct iphdr *outer_ip, uint32_t outer_addr_sum)
 {
 	struct gre_hdr *gre;
 	struct iphdr *ip = NULL;
@@ -1808,8 +1837,7 @@ gre_tunnel_add_encap(struct ifnet *tunnel_ifp, struct rte_mbuf *m,
 	if (proto == ETH_P_NHRP)
 		ip->tos |= IPTOS_PREC_INTERNETCONTROL;
 	ip->id = dp_ip_randomid(0);
-	ip->check = 0;
-	ip->check = dp_in_cksum_hdr(ip);
+	ip->check = gre_iph_cksum(ip, outer_addr_sum);
 
 	eth_hdr = (struct rte_ether_hdr *)hdr;
 	eth_hdr->ether_type = htons(ETH_P_IP);
@@ -2030,6 +2058,7 @@ gre_tunnel_encap(struct ifnet *input_ifp, struct ifnet *tunnel_ifp,
 	struct gre_softc *sc;
 	char *hdr;
 	struct iphdr *outer_ip = NULL;
+	uint32_t outer_addr_sum;
 	uint16_t new_hdr_len;
 	uint16_t inner_len;
 	uint8_t inner_ttl;
@@ -2057,15 +2086,23 @@ gre_tunnel_encap(struct ifnet *input_ifp, struct ifnet *tunnel_ifp,
 		rt_info = mgre_rtinfo_lookup(sc, &tun_addr);
 		if (rt_info) {
 			outer_ip = &rt_info->iph;
+			outer_addr_sum = rt_info->iph_addr_sum;
 			t_vrfid = rt_info->nbma_vrfid;
-			/* Set rt_info to used since the last timer reset */
-			CMM_ACCESS_ONCE(rt_info->rt_info_bits) |=
+			/*
+			 * Set rt_info to used since the last timer reset.
+			 * Only write when it changes, to avoid bouncing the
+			 * cache line between lcores sending to this peer.
+			 */
+			if (!(CMM_ACCESS_ONCE(rt_info->rt_info_bits) &
+			      RT_INFO_BIT_IS_USED))
+				CMM_ACCESS_ONCE(rt_info->rt_info_bits) |=
 							RT_INFO_BIT_IS_USED;
 		} else {
 			goto slow_path;
 		}
 	} else {
 		outer_ip = &greinfo->iph;
+		outer_addr_sum = greinfo->iph_addr_sum;
 		t_vrfid = greinfo->t_vrfid;
 	}
 	/*
@@ -2179,7 +2216,7 @@ gre_tunnel_encap(struct ifnet *input_ifp, struct ifnet *tunnel_ifp,
 	}
 	return gre_tunnel_add_encap(tunnel_ifp, m, proto, inner_len, inner_ttl,
 				    inner_tos, inner_df, hdr, greinfo,
-				    outer_ip);
+				    outer_ip, outer_addr_sum);
 
 drop:
 	rte_pktmbuf_free(m);
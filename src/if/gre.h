@@ -59,6 +59,7 @@ struct gre_info_st {
 		struct iphdr   iph;
 		struct ip6_hdr iph6;
 	};
+	uint32_t               iph_addr_sum; /* see gre_iph_addr_sum() */
 	struct ifnet           *ifp;
 	vrfid_t                t_vrfid; /* Transport VRF ID */
 	uint16_t               gre_size;
@@ -78,6 +79,7 @@ struct mgre_rt_info {
 	struct in_addr       tun_addr;
 	vrfid_t              nbma_vrfid;
 	struct iphdr         iph;
+	uint32_t             iph_addr_sum; /* see gre_iph_addr_sum() */
 	uint32_t             rt_info_bits;
 	struct rcu_head      rtinfo_rcu;
 	struct gre_info_st   *greinfo;
@@ -41,6 +41,7 @@
 #include <rte_memory.h>
 #include <rte_timer.h>
 #include <rte_udp.h>
+#include <urcu/uatomic.h>
 
 #include "capture.h"
 #include "compat.h"
@@ -68,6 +69,7 @@
 #include "pl_fused.h"
 #include "route.h"
 #include "route_flags.h"
+#include "rt_tracker.h"
 #include "shadow.h"
 #include "snmp_mib.h"
 #include "udp_handler.h"
@@ -88,6 +90,12 @@
 #define VXLAN_RTABLE_PRUNE_HZ	5
 #define VXLAN_RTABLE_EXPIRE	((30 * 60) / VXLAN_RTABLE_PRUNE_HZ)
 
+/* Size of the per-VNI remote VTEP encap cache. */
+#define VXLAN_ENCAP_HASH_MIN	8
+#define VXLAN_ENCAP_HASH_MAX	1024
+#define VXLAN_ENCAP_MAX		1024
+#define VXLAN_ENCAP_EXPIRE	((5 * 60) / VXLAN_RTABLE_PRUNE_HZ)
+
 /* Forwarding table */
 #define	IFBAF_TYPEMASK	0x03	/* address type mask */
 #define	IFBAF_DYNAMIC	0x00	/* dynamically learned address */
@@ -98,6 +106,8 @@
 
 struct vxlan_softc {
 	struct cds_lfht		*scvx_rthash;	/* fdb hash table linkage */
+	struct cds_lfht		*scvx_encap_hash; /* remote VTEP encap cache */
+	uint32_t		scvx_encap_count;
 	uint32_t		scvx_vni;
 
 	/* administrative */
@@ -105,6 +115,40 @@ struct vxlan_softc {
 	struct rcu_head		scvx_rcu;
 };
 
+/*
+ * Outer headers pre-rendered for a remote VTEP, along with the egress
+ * interface and next hop of the route covering it.  Rebuilt on the
+ * master thread and swapped in under RCU so that the forwarding path
+ * only has to patch the lengths, checksum, TOS and UDP source port.
+ */
+struct vxlan_encap_tmpl {
+	struct ifnet		*vet_ifp;	/* egress interface */
+	struct ip_addr		vet_nhip;	/* next hop address */
+	uint16_t		vet_ether_type;	/* network byte order */
+	uint16_t		vet_hdr_len;	/* outer IP + UDP */
+	bool			vet_inherit_tos;
+	uint8_t			vet_hdr[sizeof(struct ip6_hdr) +
+					sizeof(struct rte_udp_hdr)];
+	struct rcu_head		vet_rcu;
+};
+
+/*
+ * Encap cache entry for a remote VTEP.  Entries are added by the
+ * forwarding path on first use, but a template is only built once the
+ * master thread has started tracking the route to the VTEP.
+ */
+struct vxlan_encap_node {
+	struct cds_lfht_node	ven_node;
+	struct ip_addr		ven_dst;
+	struct vxlan_encap_tmpl	*ven_tmpl;	/* NULL if not cacheable */
+	struct vxlan_softc	*ven_sc;
+	struct rt_tracker_info	*ven_tracker;
+	vrfid_t			ven_vrfid;	/* VRF being tracked in */
+	rte_atomic32_t		ven_unused;	/* 0 = used */
+	uint16_t		ven_expire;
+	struct rcu_head		ven_rcu;
+};
+
 enum VXLAN_STATS {
 	VXLAN_STATS_INPKTS,
 	VXLAN_STATS_INDISCARDS_OPTIONS,
@@ -243,6 +287,39 @@ void vxlan_tbl_walk(vxlan_walker_t walk_func, void *ctx)
 	}
 }
 
+/* Display the remote VTEPs in the encap cache in JSON */
+static void
+vxlan_show_encap(json_writer_t *wr, struct vxlan_softc *sc)
+{
+	struct vxlan_encap_tmpl *tmpl;
+	struct vxlan_encap_node *ven;
+	struct cds_lfht_iter iter;
+	char b[INET6_ADDRSTRLEN];
+
+	jsonw_name(wr, "encap");
+	jsonw_start_array(wr);
+	dp_rcu_read_lock();
+	cds_lfht_for_each_entry(sc->scvx_encap_hash, &iter, ven, ven_node) {
+		jsonw_start_object(wr);
+		jsonw_string_field(wr, "remote",
+				   inet_ntop(ven->ven_dst.type,
+					     &ven->ven_dst.address,
+					     b, sizeof(b)));
+		tmpl = rcu_dereference(ven->ven_tmpl);
+		if (tmpl) {
+			jsonw_string_field(wr, "nexthop",
+					   inet_ntop(tmpl->vet_nhip.type,
+						     &tmpl->vet_nhip.address,
+						     b, sizeof(b)));
+			jsonw_string_field(wr, "ifname",
+					   tmpl->vet_ifp->if_name);
+		}
+		jsonw_end_object(wr);
+	}
+	dp_rcu_read_unlock();
+	jsonw_end_array(wr);
+}
+
 /* Display vxlan info in JSON */
 static void
 vxlan_show_info(json_writer_t *wr, struct ifnet *ifp)
@@ -276,6 +353,7 @@ vxlan_show_info(json_writer_t *wr, struct ifnet *ifp)
 	jsonw_uint(wr, vni->port_high);
 	jsonw_end_array(wr);
 	jsonw_uint_field(wr, "learning", vni->learning);
+	vxlan_show_encap(wr, ifp->if_softc);
 	jsonw_end_object(wr);
 }
 
@@ -294,6 +372,32 @@ uint16_t vxlan_get_src_port(struct vxlan_vninode *vnode, uint8_t *entropy,
 	return (((uint64_t) hash * range) >> 32) + vnode->port_low;
 }
 
+static ALWAYS_INLINE
+void vxlan_ipv4_hdr_init(struct vxlan_vninode *vnode, struct iphdr *iph,
+			 uint8_t tos, const struct ip_addr *sip,
+			 const struct ip_addr *dip, uint16_t payload_len)
+{
+	iph->ihl = 5;
+	iph->version = 4;
+	iph->check = 0;
+	if (vnode->ttl == 0)
+		iph->ttl = IPDEFTTL;
+	else
+		iph->ttl = vnode->ttl;
+
+	if (vnode->tos != 0)
+		iph->tos = vnode->tos;
+	else
+		iph->tos = tos;
+	iph->id = 0;
+	iph->frag_off = htons(IP_DF);
+	iph->protocol = IPPROTO_UDP;
+	iph->tot_len = htons(sizeof(struct iphdr) + payload_len);
+	iph->saddr = sip->address.ip_v4.s_addr;
+	iph->daddr = dip->address.ip_v4.s_addr;
+	iph->check = dp_in_cksum_hdr(iph);
+}
+
 static ALWAYS_INLINE
 int vxlan_ipv4_set_encap(struct vxlan_vninode *vnode, struct rte_mbuf *m,
 			 uint8_t tos, struct ip_addr *sip,
@@ -322,28 +426,10 @@ int vxlan_ipv4_set_encap(struct vxlan_vninode *vnode, struct rte_mbuf *m,
 	eth->ether_type = htons(RTE_ETHER_TYPE_IPV4);
 
 	/* IPv4 header construction */
-	iph->ihl = 5;
-	iph->version = 4;
-	iph->check = 0;
-	if (vnode->ttl == 0)
-		iph->ttl = IPDEFTTL;
-	else
-		iph->ttl = vnode->ttl;
-
-	if (vnode->tos != 0)
-		iph->tos = vnode->tos;
-	else
-		iph->tos = tos;
-	iph->id = 0;
-	iph->frag_off = htons(IP_DF);
-	iph->protocol = IPPROTO_UDP;
-	iph->tot_len = htons(sizeof(struct iphdr) +
-			     sizeof(struct rte_udp_hdr) +
-			     sizeof(struct rte_vxlan_hdr) +
-			     orig_pkt_data_len);
-	iph->saddr = sip->address.ip_v4.s_addr;
-	iph->daddr = dip->address.ip_v4.s_addr;
-	iph->check = dp_in_cksum_hdr(iph);
+	vxlan_ipv4_hdr_init(vnode, iph, tos, sip, dip,
+			    sizeof(struct rte_udp_hdr) +
+			    sizeof(struct rte_vxlan_hdr) +
+			    orig_pkt_data_len);
 
 	*udpp = udp;
 	*vxhdrp = vxhdr;
@@ -351,6 +437,25 @@ int vxlan_ipv4_set_encap(struct vxlan_vninode *vnode, struct rte_mbuf *m,
 	return 0;
 }
 
+static ALWAYS_INLINE
+void vxlan_ipv6_hdr_init(struct vxlan_vninode *vnode, struct ip6_hdr *ip6h,
+			 uint8_t tc, const struct ip_addr *sip,
+			 const struct ip_addr *dip, uint16_t payload_len)
+{
+	uint8_t tos;
+
+	if (vnode->tos != 0)
+		tos = vnode->tos;
+	else
+		tos = tc;
+	ip6h->ip6_flow = htonl((IPV6_VERSION << 4 | tos) << 20);
+	ip6h->ip6_nxt = IPPROTO_UDP;
+	ip6h->ip6_hlim = IPV6_DEFAULT_HOPLIMIT;
+	ip6h->ip6_src = sip->address.ip_v6;
+	ip6h->ip6_dst = dip->address.ip_v6;
+	ip6h->ip6_plen = htons(payload_len);
+}
+
 static ALWAYS_INLINE
 int vxlan_ipv6_set_encap(struct vxlan_vninode *vnode, struct rte_mbuf *m,
 			 uint8_t tc, struct ip_addr *sip,
@@ -359,7 +464,6 @@ int vxlan_ipv6_set_encap(struct vxlan_vninode *vnode, struct rte_mbuf *m,
 {
 	uint16_t orig_pkt_data_len = rte_pktmbuf_pkt_len(m);
 	struct rte_ether_hdr *eth;
-	uint8_t tos = 0;
 
 	static_assert(sizeof(struct rte_ether_hdr) + sizeof(struct ip6_hdr) +
 		      sizeof(struct rte_udp_hdr) + sizeof(struct rte_vxlan_hdr)
@@ -384,18 +488,10 @@ int vxlan_ipv6_set_encap(struct vxlan_vninode *vnode, struct rte_mbuf *m,
 	eth->ether_type = htons(RTE_ETHER_TYPE_IPV6);
 
 	/* IPv6 header construction */
-	if (vnode->tos != 0)
-		tos = vnode->tos;
-	else
-		tos = tc;
-	ip6h->ip6_flow = htonl((IPV6_VERSION << 4 | tos) << 20);
-	ip6h->ip6_nxt = IPPROTO_UDP;
-	ip6h->ip6_hlim = IPV6_DEFAULT_HOPLIMIT;
-	ip6h->ip6_src = sip->address.ip_v6;
-	ip6h->ip6_dst = dip->address.ip_v6;
-	ip6h->ip6_plen = htons(sizeof(struct rte_udp_hdr) +
-			       sizeof(struct rte_vxlan_hdr) +
-			       orig_pkt_data_len);
+	vxlan_ipv6_hdr_init(vnode, ip6h, tc, sip, dip,
+			    sizeof(struct rte_udp_hdr) +
+			    sizeof(struct rte_vxlan_hdr) +
+			    orig_pkt_data_len);
 	*udpp = udp;
 	*vxhdrp = vxhdr;
 
@@ -605,6 +701,435 @@ int vxlan_select_src(struct vxlan_vninode *vnode,
 	return err;
 }
 
+/*
+ * Remote VTEP encap cache
+ */
+static inline unsigned long
+vxlan_encap_hash(const struct ip_addr *addr)
+{
+	if (addr->type == AF_INET)
+		return rte_jhash_1word(addr->address.ip_v4.s_addr, 0);
+
+	return rte_jhash_32b(addr->address.ip_v6.s6_addr32, 4, 0);
+}
+
+static int vxlan_encap_match(struct cds_lfht_node *node, const void *key)
+{
+	const struct vxlan_encap_node *ven
+		= caa_container_of(node, const struct vxlan_encap_node,
+				   ven_node);
+
+	return dp_addr_eq(key, &ven->ven_dst);
+}
+
+static ALWAYS_INLINE struct vxlan_encap_node *
+vxlan_encap_lookup(struct vxlan_softc *sc, const struct ip_addr *dip)
+{
+	struct cds_lfht_iter iter;
+	struct cds_lfht_node *node;
+
+	cds_lfht_lookup(sc->scvx_encap_hash, vxlan_encap_hash(dip),
+			vxlan_encap_match, dip, &iter);
+	node = cds_lfht_iter_get_node(&iter);
+	if (node == NULL)
+		return NULL;
+
+	return caa_container_of(node, struct vxlan_encap_node, ven_node);
+}
+
+/*
+ * Called from the forwarding path on a cache miss.  The tracker can
+ * only be added on the master thread, so the entry is picked up by the
+ * next run of vxlan_timer.
+ */
+static void
+vxlan_encap_create(struct vxlan_softc *sc, const struct ip_addr *dip)
+{
+	struct cds_lfht_node *ret_node;
+	struct vxlan_encap_node *ven;
+
+	if (CMM_LOAD_SHARED(sc->scvx_encap_count) >= VXLAN_ENCAP_MAX)
+		return;
+
+	ven = zmalloc_aligned(sizeof(*ven));
+	if (unlikely(ven == NULL))
+		return;
+
+	ven->ven_dst = *dip;
+	ven->ven_sc = sc;
+	cds_lfht_node_init(&ven->ven_node);
+
+	ret_node = cds_lfht_add_unique(sc->scvx_encap_hash,
+				       vxlan_encap_hash(dip),
+				       vxlan_encap_match, dip, &ven->ven_node);
+	if (ret_node != &ven->ven_node) {
+		free(ven);
+		return;
+	}
+	uatomic_inc(&sc->scvx_encap_count);
+}
+
+static void
+vxlan_encap_tmpl_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct vxlan_encap_tmpl, vet_rcu));
+}
+
+/*
+ * Render the outer headers for the VTEP using the path the tracker
+ * has resolved.  Multipath routes aren't cached as the path depends
+ * on the hash of each packet.
+ */
+static struct vxlan_encap_tmpl *
+vxlan_encap_tmpl_build(struct vxlan_vninode *vnode,
+		       struct vxlan_encap_node *ven)
+{
+	struct ip_addr *dip = &ven->ven_dst;
+	struct vxlan_encap_tmpl *tmpl;
+	const struct in6_addr *saddr_v6;
+	struct rte_udp_hdr *udp;
+	struct ip_addr sip;
+	struct next_hop *nh;
+	struct ifnet *dif;
+
+	if (!dp_get_rt_tracker_tracking(ven->ven_tracker))
+		return NULL;
+
+	nh = nexthop_select_single(dip->type,
+				   dp_get_rt_tracker_nh_index(ven->ven_tracker));
+	if (nh == NULL || (nh->flags & RTF_NOROUTE))
+		return NULL;
+
+	dif = dp_nh_get_ifp(nh);
+	if (dif == NULL)
+		return NULL;
+
+	tmpl = zmalloc_aligned(sizeof(*tmpl));
+	if (tmpl == NULL)
+		return NULL;
+
+	tmpl->vet_ifp = dif;
+	tmpl->vet_inherit_tos = (vnode->tos == 0);
+	if (nh->flags & RTF_GATEWAY)
+		tmpl->vet_nhip = nh->gateway;
+	else
+		tmpl->vet_nhip = *dip;
+	sip.type = dip->type;
+
+	if (dip->type == AF_INET) {
+		struct iphdr *iph = (struct iphdr *)tmpl->vet_hdr;
+
+		if (vnode->s_addr == 0)
+			sip.address.ip_v4.s_addr =
+				ip_select_source(dif,
+						 dip->address.ip_v4.s_addr);
+		else
+			sip.address.ip_v4.s_addr = vnode->s_addr;
+
+		vxlan_ipv4_hdr_init(vnode, iph, 0, &sip, dip,
+				    sizeof(struct rte_udp_hdr) +
+				    sizeof(struct rte_vxlan_hdr));
+		tmpl->vet_ether_type = htons(RTE_ETHER_TYPE_IPV4);
+		tmpl->vet_hdr_len = sizeof(*iph);
+	} else {
+		struct ip6_hdr *ip6h = (struct ip6_hdr *)tmpl->vet_hdr;
+
+		if (IN6_IS_ADDR_UNSPECIFIED(&vnode->s_addr_v6)) {
+			saddr_v6 = ip6_select_source(dif,
+						     &dip->address.ip_v6);
+			if (saddr_v6 == NULL) {
+				free(tmpl);
+				return NULL;
+			}
+			sip.address.ip_v6 = *saddr_v6;
+		} else {
+			sip.address.ip_v6 = vnode->s_addr_v6;
+		}
+
+		vxlan_ipv6_hdr_init(vnode, ip6h, 0, &sip, dip,
+				    sizeof(struct rte_udp_hdr) +
+				    sizeof(struct rte_vxlan_hdr));
+		tmpl->vet_ether_type = htons(RTE_ETHER_TYPE_IPV6);
+		tmpl->vet_hdr_len = sizeof(*ip6h);
+	}
+
+	udp = (struct rte_udp_hdr *)(tmpl->vet_hdr + tmpl->vet_hdr_len);
+	udp->src_port = 0;
+	udp->dgram_len = htons(sizeof(struct rte_udp_hdr) +
+			       sizeof(struct rte_vxlan_hdr));
+	udp->dgram_cksum = 0; /* No UDP checksum. */
+	if (vnode->flags & VXLAN_FLAG_GPE)
+		udp->dst_port = htons(VXLAN_GPE_PORT);
+	else
+		udp->dst_port = htons(VXLAN_PORT);
+	tmpl->vet_hdr_len += sizeof(*udp);
+
+	return tmpl;
+}
+
+static void
+vxlan_encap_tmpl_update(struct vxlan_encap_node *ven)
+{
+	struct vxlan_encap_tmpl *old, *tmpl = NULL;
+	struct vxlan_vninode *vnode;
+
+	vnode = vxlan_vni_lookup(ven->ven_sc->scvx_vni);
+	if (vnode)
+		tmpl = vxlan_encap_tmpl_build(vnode, ven);
+
+	old = rcu_xchg_pointer(&ven->ven_tmpl, tmpl);
+	if (old)
+		call_rcu(&old->vet_rcu, vxlan_encap_tmpl_free);
+}
+
+/* Route tracker callback, the route covering the VTEP has changed */
+static void vxlan_encap_route_change(void *ctx)
+{
+	vxlan_encap_tmpl_update(ctx);
+}
+
+static void
+vxlan_encap_track(struct vxlan_encap_node *ven)
+{
+	struct vxlan_vninode *vnode;
+	struct vrf *vrf;
+
+	vnode = vxlan_vni_lookup(ven->ven_sc->scvx_vni);
+	if (!vnode)
+		return;
+
+	vrf = vrf_get_rcu(vnode->t_vrfid);
+	if (!vrf)
+		return;
+
+	ven->ven_tracker = dp_rt_tracker_add(vrf, &ven->ven_dst, ven,
+					     vxlan_encap_route_change);
+	if (!ven->ven_tracker)
+		return;
+
+	ven->ven_vrfid = vnode->t_vrfid;
+	vxlan_encap_tmpl_update(ven);
+}
+
+static void
+vxlan_encap_node_free(struct rcu_head *head)
+{
+	struct vxlan_encap_node *ven =
+		caa_container_of(head, struct vxlan_encap_node, ven_rcu);
+
+	/* Readers are done with the entry, so the template is unused too */
+	free(ven->ven_tmpl);
+	free(ven);
+}
+
+static void
+vxlan_encap_destroy(struct vxlan_softc *sc, struct vxlan_encap_node *ven)
+{
+	struct vrf *vrf;
+
+	if (cds_lfht_del(sc->scvx_encap_hash, &ven->ven_node))
+		return;
+	uatomic_dec(&sc->scvx_encap_count);
+
+	if (ven->ven_tracker) {
+		vrf = vrf_get_rcu(ven->ven_vrfid);
+		if (vrf)
+			dp_rt_tracker_delete(vrf, &ven->ven_dst, ven);
+		ven->ven_tracker = NULL;
+	}
+	call_rcu(&ven->ven_rcu, vxlan_encap_node_free);
+}
+
+/*
+ * Track newly added entries and expire unused ones.  Run from the
+ * master thread.
+ */
+static void vxlan_encap_age(struct vxlan_softc *sc)
+{
+	struct vxlan_encap_node *ven;
+	struct cds_lfht_iter iter;
+
+	cds_lfht_for_each_entry(sc->scvx_encap_hash, &iter, ven, ven_node) {
+		if (rte_atomic32_test_and_set(&ven->ven_unused)) {
+			if (++ven->ven_expire > VXLAN_ENCAP_EXPIRE) {
+				vxlan_encap_destroy(sc, ven);
+				continue;
+			}
+		} else
+			ven->ven_expire = 0;
+
+		if (!ven->ven_tracker)
+			vxlan_encap_track(ven);
+	}
+}
+
+/*
+ * Drop all entries, e.g. when the VNI parameters that the templates
+ * were built from change.  Run from the master thread.
+ */
+static void vxlan_encap_flush(struct vxlan_softc *sc)
+{
+	struct vxlan_encap_node *ven;
+	struct cds_lfht_iter iter;
+
+	dp_rcu_read_lock();
+	cds_lfht_for_each_entry(sc->scvx_encap_hash, &iter, ven, ven_node)
+		vxlan_encap_destroy(sc, ven);
+	dp_rcu_read_unlock();
+}
+
+/* Is addr the outer source address of the template */
+static bool
+vxlan_encap_tmpl_has_src(const struct vxlan_encap_tmpl *tmpl, int af,
+			 const void *addr)
+{
+	if (af == AF_INET) {
+		const struct iphdr *iph = (const struct iphdr *)tmpl->vet_hdr;
+
+		return tmpl->vet_ether_type == htons(RTE_ETHER_TYPE_IPV4) &&
+			iph->saddr == *(const in_addr_t *)addr;
+	}
+	if (af == AF_INET6) {
+		const struct ip6_hdr *ip6h =
+			(const struct ip6_hdr *)tmpl->vet_hdr;
+
+		return tmpl->vet_ether_type == htons(RTE_ETHER_TYPE_IPV6) &&
+			IN6_ARE_ADDR_EQUAL(&ip6h->ip6_src, addr);
+	}
+	return false;
+}
+
+struct vxlan_addr_del_ctx {
+	int		af;
+	const void	*addr;
+};
+
+static void
+vxlan_encap_addr_del_walk(struct vxlan_vninode *vnode, void *arg)
+{
+	const struct vxlan_addr_del_ctx *ctx = arg;
+	struct vxlan_softc *sc = vnode->ifp->if_softc;
+	struct vxlan_encap_tmpl *tmpl;
+	struct vxlan_encap_node *ven;
+	struct cds_lfht_iter iter;
+
+	cds_lfht_for_each_entry(sc->scvx_encap_hash, &iter, ven, ven_node) {
+		tmpl = rcu_dereference(ven->ven_tmpl);
+		if (tmpl && vxlan_encap_tmpl_has_src(tmpl, ctx->af, ctx->addr))
+			vxlan_encap_tmpl_update(ven);
+	}
+}
+
+/*
+ * A local address has been removed.  The route to the VTEP hasn't
+ * changed, so the tracker won't rebuild templates that selected the
+ * address as their source; do it here.  Run from the master thread.
+ */
+static void
+vxlan_if_addr_delete(enum cont_src_en cont_src __unused,
+		     struct ifnet *ifp __unused, uint32_t ifindex __unused,
+		     int af, const void *addr)
+{
+	struct vxlan_addr_del_ctx ctx = { .af = af, .addr = addr };
+
+	if (!vxlans)
+		return;
+
+	dp_rcu_read_lock();
+	vxlan_tbl_walk(vxlan_encap_addr_del_walk, &ctx);
+	dp_rcu_read_unlock();
+}
+
+/*
+ * Return the template for the VTEP, or NULL if the packet has to take
+ * the uncached path.
+ */
+static ALWAYS_INLINE struct vxlan_encap_tmpl *
+vxlan_encap_cache_get(struct vxlan_vninode *vnode, const struct ip_addr *dip)
+{
+	struct vxlan_softc *sc = vnode->ifp->if_softc;
+	struct vxlan_encap_tmpl *tmpl;
+	struct vxlan_encap_node *ven;
+
+	ven = vxlan_encap_lookup(sc, dip);
+	if (unlikely(ven == NULL)) {
+		vxlan_encap_create(sc, dip);
+		return NULL;
+	}
+
+	/* Avoid dirtying the cache line on every packet */
+	if (rte_atomic32_read(&ven->ven_unused))
+		rte_atomic32_clear(&ven->ven_unused);
+
+	tmpl = rcu_dereference(ven->ven_tmpl);
+	if (unlikely(tmpl == NULL))
+		return NULL;
+
+	if (unlikely(!(tmpl->vet_ifp->if_flags & IFF_UP)))
+		return NULL;
+
+	return tmpl;
+}
+
+/* Encapsulate using the template, fixing up only the per-packet fields */
+static ALWAYS_INLINE
+int vxlan_encap_cached(struct vxlan_vninode *vnode,
+		       const struct vxlan_encap_tmpl *tmpl,
+		       struct rte_mbuf *m, uint8_t *entropy,
+		       uint32_t entropy_len, uint8_t tos_tc,
+		       enum vxlan_type vxl_type,
+		       enum vgpe_nxt_proto nxtproto, bool oam)
+{
+	uint16_t orig_pkt_data_len = rte_pktmbuf_pkt_len(m);
+	struct rte_ether_hdr *eth;
+	struct rte_udp_hdr *udp;
+	uint16_t src_port;
+
+	src_port = vxlan_get_src_port(vnode, entropy, entropy_len, m);
+
+	eth = (struct rte_ether_hdr *)rte_pktmbuf_prepend(
+		m, sizeof(struct rte_ether_hdr) + tmpl->vet_hdr_len +
+		sizeof(struct rte_vxlan_hdr));
+	if (unlikely(eth == NULL))
+		return -ENOMEM;
+
+	dp_pktmbuf_l2_len(m) = RTE_ETHER_HDR_LEN;
+	eth->ether_type = tmpl->vet_ether_type;
+	memcpy(&eth[1], tmpl->vet_hdr, tmpl->vet_hdr_len);
+
+	if (tmpl->vet_ether_type == htons(RTE_ETHER_TYPE_IPV4)) {
+		struct iphdr *iph = (struct iphdr *)&eth[1];
+		uint16_t tot_len;
+
+		tot_len = htons(ntohs(iph->tot_len) + orig_pkt_data_len);
+		iph->check = ip_fixup16_cksum(iph->check, iph->tot_len,
+					      tot_len);
+		iph->tot_len = tot_len;
+		if (tmpl->vet_inherit_tos && tos_tc != 0) {
+			/* TOS is the low byte of the first 16 bit word */
+			iph->check = ip_fixup16_cksum(iph->check, 0,
+						      htons(tos_tc));
+			iph->tos = tos_tc;
+		}
+		udp = (struct rte_udp_hdr *)&iph[1];
+	} else {
+		struct ip6_hdr *ip6h = (struct ip6_hdr *)&eth[1];
+
+		ip6h->ip6_plen = htons(ntohs(ip6h->ip6_plen) +
+				       orig_pkt_data_len);
+		if (tmpl->vet_inherit_tos && tos_tc != 0)
+			ip6h->ip6_flow =
+				htonl((IPV6_VERSION << 4 | tos_tc) << 20);
+		udp = (struct rte_udp_hdr *)&ip6h[1];
+	}
+
+	udp->src_port = htons(src_port);
+	udp->dgram_len = htons(ntohs(udp->dgram_len) + orig_pkt_data_len);
+
+	return vxlan_vhdr_encap(vnode, (struct rte_vxlan_hdr *)&udp[1],
+				vxl_type, nxtproto, oam);
+}
+
 static
 void vxlan_query_payload_mpls(uint32_t *hdr, uint8_t *tc,
 			      uint8_t **entropy, uint32_t *entropy_len)
@@ -788,6 +1313,7 @@ vxlan_send_packet(struct ifnet *ifp, uint32_t vni, struct ip_addr *dip,
 		  enum vgpe_nxt_proto nxtproto, bool multicast, bool oam)
 {
 	struct ifnet *dif = NULL;
+	struct vxlan_encap_tmpl *tmpl;
 	struct vxlan_vninode *vnode;
 	struct ip_addr sip, nhip;
 	int err;
@@ -820,6 +1346,18 @@ vxlan_send_packet(struct ifnet *ifp, uint32_t vni, struct ip_addr *dip,
 	pktmbuf_set_vrf(m, vnode->t_vrfid);
 	pktmbuf_prepare_encap_out(m);
 
+	tmpl = vxlan_encap_cache_get(vnode, dip);
+	if (likely(tmpl != NULL)) {
+		err = vxlan_encap_cached(vnode, tmpl, m, entropy, entropy_len,
+					 tos_tc, vxl_type, nxtproto, oam);
+		if (unlikely(err != 0)) {
+			VXLAN_STAT_INC(VXLAN_STATS_OUTDISCARDS_ENCAP_FAILED);
+			goto drop;
+		}
+		return vxlan_resolve_send_pak(m, &tmpl->vet_nhip, dip, ifp,
+					      tmpl->vet_ifp);
+	}
+
 	err = vxlan_select_src(vnode, dip, m, &dif, &sip, &nhip);
 	if (unlikely(err != 0)) {
 		VXLAN_STAT_INC(VXLAN_STATS_OUTDISCARDS_NO_VTEP_SRC);
@@ -968,6 +1506,14 @@ vxlan_rtable_init(struct vxlan_softc *sc)
 				     NULL);
 	if (sc->scvx_rthash == NULL)
 		rte_panic("Can't allocate rthash\n");
+
+	sc->scvx_encap_hash = cds_lfht_new(VXLAN_ENCAP_HASH_MIN,
+					   VXLAN_ENCAP_HASH_MIN,
+					   VXLAN_ENCAP_HASH_MAX,
+					   CDS_LFHT_AUTO_RESIZE,
+					   NULL);
+	if (sc->scvx_encap_hash == NULL)
+		rte_panic("Can't allocate encap hash\n");
 }
 
 static void
@@ -1305,6 +1851,7 @@ static void vxlan_timer(struct rte_timer *timer __rte_unused, void *arg)
 			vxlan_rtnode_destroy(vxlrt);
 		}
 	}
+	vxlan_encap_age(sc);
 	dp_rcu_read_unlock();
 }
 
@@ -1504,6 +2051,10 @@ void vxlan_modify(struct ifnet *ifp, uint flags, struct nlattr *tb[],
 			ifp->if_name, vni);
 		return;
 	}
+
+	/* Templates may be stale, and the transport VRF may change */
+	vxlan_encap_flush(ifp->if_softc);
+
 	if (!set_vxlan_params(ifp,
 				vninode, vxlaninfo, tb, flags)){
 		RTE_LOG(ERR, VXLAN, "%s failed to set VXLAN parameters\n",
@@ -1687,6 +2238,8 @@ static void vxlan_if_uninit(struct ifnet *ifp)
 	struct vxlan_softc *sc = ifp->if_softc;
 
 	rte_timer_stop(&sc->scvx_timer);
+	vxlan_encap_flush(sc);
+	cds_lfht_destroy(sc->scvx_encap_hash, NULL);
 	cds_lfht_destroy(sc->scvx_rthash, NULL);
 	call_rcu(&sc->scvx_rcu, vxlan_free);
 
@@ -2162,6 +2715,7 @@ static void vxlan_type_init(void)
 static const struct dp_event_ops vxlan_events = {
 	.init = vxlan_type_init,
 	.uninit = vxlan_destroy,
+	.if_addr_delete = vxlan_if_addr_delete,
 };
 
 DP_STARTUP_EVENT_REGISTER(vxlan_events);
@@ -169,6 +169,7 @@ void lladdr_update(struct ifnet *ifp, struct llentry *la,
 	la->la_flags |= flags;
 
 	if (!was_valid) {
+		llentry_unres_release(ifp->if_lltable, la);
 		la_numheld = la->la_numheld;
 		for (int i = 0; i < la_numheld; ++i) {
 			la_held[i] = la->la_held[i];
@@ -164,6 +164,54 @@ __llentry_destroy(struct lltable *llt, struct llentry *lle)
 	call_rcu(&lle->ll_rcu, llentry_free_rcu);
 }
 
+/*
+ * Unresolved entries created by the forwarding path are counted against
+ * both the table's limit and a limit across all tables until they
+ * resolve or are destroyed. This stops a scan of a connected subnet
+ * from filling the tables with incomplete entries, or from starving
+ * resolution of real neighbours on other interfaces.
+ */
+static rte_atomic32_t lle_unresolved;
+
+bool lltable_unres_get(struct lltable *llt, int32_t llt_max, int32_t max)
+{
+	if (rte_atomic32_add_return(&llt->lle_unresolved, 1) > llt_max) {
+		rte_atomic32_dec(&llt->lle_unresolved);
+		return false;
+	}
+
+	if (rte_atomic32_add_return(&lle_unresolved, 1) > max) {
+		rte_atomic32_dec(&lle_unresolved);
+		rte_atomic32_dec(&llt->lle_unresolved);
+		return false;
+	}
+
+	return true;
+}
+
+void lltable_unres_put(struct lltable *llt)
+{
+	rte_atomic32_dec(&llt->lle_unresolved);
+	rte_atomic32_dec(&lle_unresolved);
+}
+
+int32_t lltable_unres_total(void)
+{
+	return rte_atomic32_read(&lle_unresolved);
+}
+
+/*
+ * Stop counting an entry as unresolved, if it was.
+ * Must be protected by spinlock.
+ */
+void llentry_unres_release(struct lltable *llt, struct llentry *lle)
+{
+	if (lle->la_flags & LLE_UNRESOLVED) {
+		lle->la_flags &= ~LLE_UNRESOLVED;
+		lltable_unres_put(llt);
+	}
+}
+
 /* Marks entry as DELETED, so that the main thread can then pick it
  * up from the timer and complete the deletion.
  * Must be protected by spinlock.
@@ -179,6 +227,7 @@ llentry_destroy(struct lltable *llt, struct llentry *lle)
 	}
 
 	lle->la_flags |= LLE_DELETED;
+	llentry_unres_release(llt, lle);
 
 	pktmbuf_free_bulk(lle->la_held, dropped);
 	lle->la_numheld = 0;
@@ -269,6 +318,7 @@ lltable_new(struct ifnet *ifp)
 	llt->lle_unrtoken = 0;
 	rte_atomic16_set(&llt->lle_restoken, ND6_RES_TOKEN);
 	rte_atomic32_clear(&llt->lle_size);
+	rte_atomic32_clear(&llt->lle_unresolved);
 
 	return llt;
 }
@@ -50,6 +50,8 @@
 #define ARP_MAXHOLD	8	/* packets held until entry resolved */
 #define ARP_MAXPROBES	5	/* send at most 5 requests  */
 #define ARP_MAX_ENTRY   INT32_MAX /* default maximum number of entries */
+#define ARP_MAX_UNRES	256	/* default unresolved entries per interface */
+#define ARP_MAX_UNRES_TOTAL 8192 /* default unresolved entries, all tables */
 
 /* timer values */
 #define ARPT_KEEP	(20*60)	/* once resolved, good for 20 * minutes */
@@ -112,6 +114,7 @@ struct lltable {
 	rte_atomic16_t		lle_restoken;
 	rte_atomic32_t		lle_size;
 	uint64_t		lle_refresh_expire;
+	rte_atomic32_t		lle_unresolved;
 };
 
 /*
@@ -125,6 +128,7 @@ struct lltable {
 #define LLE_FWDING		0x0020  /* forwarding is aware of this entry */
 #define LLE_CREATED_IN_HW	0x0040  /* Sourced in the hardware */
 #define LLE_HW_UPD_PENDING	0x0080  /* Incompleted in the hardware */
+#define LLE_UNRESOLVED		0x1000  /* counted as unresolved */
 
 /*
  * flags indicating synchronization
@@ -142,7 +146,7 @@ struct lltable {
  * be displayed to the user.
  */
 #define LLE_INTERNAL_MASK (LLE_FWDING | LLE_CREATED_IN_HW |	\
-			   LLE_HW_UPD_PENDING)
+			   LLE_HW_UPD_PENDING | LLE_UNRESOLVED)
 
 struct lltable *lltable_new(struct ifnet *ifp);
 void lltable_stop_timer(struct lltable *);
@@ -154,6 +158,10 @@ unsigned int lltable_walk(struct lltable *llt, lltable_iter_func_t func,
 			  void *arg);
 void lltable_flush(struct lltable *);
 bool lltable_fal_l3_change(struct lltable *llt, bool enable);
+bool lltable_unres_get(struct lltable *llt, int32_t llt_max, int32_t max);
+void lltable_unres_put(struct lltable *llt);
+void llentry_unres_release(struct lltable *llt, struct llentry *lle);
+int32_t lltable_unres_total(void);
 
 /* Final destroy on main thread */
 void __llentry_destroy(struct lltable *llt, struct llentry *lle);
@@ -204,12 +212,24 @@ struct in_addr *ll_ipv4_addr(struct llentry *lle);
 /* If the entry is v6 return a ptr to the  v4 addr, otherwise null */
 struct in6_addr *ll_ipv6_addr(struct llentry *lle);
 
+/*
+ * Mark an entry as used by the forwarding path. Only write once the
+ * ageing timer has marked it idle, so that the entry's first cache
+ * line stays shared between lcores forwarding to the same neighbour
+ * rather than being written by each of them on every packet.
+ */
+static ALWAYS_INLINE void
+llentry_mark_used(struct llentry *la)
+{
+	if (unlikely(rte_atomic16_read(&la->ll_idle)))
+		rte_atomic16_clear(&la->ll_idle);
+}
+
 static ALWAYS_INLINE bool
 llentry_copy_mac(struct llentry *la,  struct rte_ether_addr *desten)
 {
 	if (likely(la && (la->la_flags & LLE_VALID))) {
-		if (rte_atomic16_read(&la->ll_idle))
-			rte_atomic16_clear(&la->ll_idle);
+		llentry_mark_used(la);
 		rte_ether_addr_copy((struct rte_ether_addr *)&la->ll_addr,
 				    desten);
 		return true;
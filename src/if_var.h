@@ -87,6 +87,8 @@ struct portmonitor_info;
 struct npf_if;
 struct cgn_intf;
 struct egress_map_info;
+struct mpls_label_table;
+struct pppoe_ses_tbl;
 
 /*
  * Software statistics maintained per-core.
@@ -298,9 +300,10 @@ struct ifnet {
 	/* Feature state */
 	struct portmonitor_info *pminfo; /* portmonitor info */
 
-	struct cds_lfht	   *mpls_label_table;
+	struct mpls_label_table *mpls_label_table;
 
 	struct cgn_intf    *if_cgn;     /* CGNAT */
+	struct pppoe_ses_tbl *if_pppoe_ses; /* PPPoE sessions over this if */
 
 	/* Referenced on local packet to/from kernel path */
 	struct ifnet       *aggregator; /* part of team */
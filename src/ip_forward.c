@@ -389,6 +389,7 @@ enum ip_packet_validity ip_validate_packet(
 	struct rte_mbuf *m, const struct iphdr *ip, bool *needs_slow_path)
 {
 	unsigned int len, ip_len, pkt_len;
+	uint64_t cksum_flags;
 	uint16_t hlen;
 
 	assert(dp_pktmbuf_l2_len(m) ==
@@ -419,10 +420,27 @@ enum ip_packet_validity ip_validate_packet(
 	dp_pktmbuf_l3_len(m) = hlen;
 
 	/*
-	 * Checksum correct?
+	 * Checksum correct? Trust the NIC's verdict if it gave one,
+	 * unless it recognised a tunnel, in which case the verdict is
+	 * for the inner header.  The flags are cleared afterwards so
+	 * that they can't be mistaken for a verdict on an inner header
+	 * after decap.
 	 */
-	if (ip_checksum(ip, hlen))
+	cksum_flags = m->ol_flags & PKT_RX_IP_CKSUM_MASK;
+	if (m->packet_type & RTE_PTYPE_TUNNEL_MASK)
+		cksum_flags = PKT_RX_IP_CKSUM_UNKNOWN;
+
+	switch (cksum_flags) {
+	case PKT_RX_IP_CKSUM_GOOD:
+		break;
+	case PKT_RX_IP_CKSUM_BAD:
 		goto bad_hdr;
+	default:
+		if (ip_checksum(ip, hlen))
+			goto bad_hdr;
+		break;
+	}
+	m->ol_flags &= ~PKT_RX_IP_CKSUM_MASK;
 
 	/*
 	 * Is IP header malformed (tot length < header length)
@@ -37,7 +37,9 @@
 #include <netinet/ip.h>
 #include <netinet/ip_icmp.h>
 #include <rte_common.h>
+#include <rte_debug.h>
 #include <rte_ether.h>
+#include <rte_lcore.h>
 #include <rte_mbuf.h>
 #include <rte_log.h>
 #include <stdbool.h>
@@ -108,7 +110,30 @@ struct icmp_ratelimit_state icmp_ratelimit_state[] = {
 	[ICMP_REDIRECT] = {.name = "redirect"},
 };
 
+/*
+ * Each lcore claims a share of the per-second budget from the shared
+ * pool and spends it locally, so that only one in every share-size
+ * generated errors touches the shared cacheline. Shares left over from
+ * a previous second are discarded once the lcore notices the epoch
+ * has moved on, so a share is only a small slice of the budget: at
+ * most one share per lcore goes unused each second.
+ *
+ * Slot 0 is used by the master and by any non-EAL thread as well as
+ * by lcore 0, so it takes tokens straight from the pool and counts
+ * with atomics instead.
+ */
+#define ICMP_RATELIMIT_SHARES	8	/* shares per lcore per second */
+
+struct icmp_ratelimit_lcore {
+	uint32_t	epoch;				/* refresh this share is from */
+	uint32_t	tokens;				/* tokens left in this share */
+	uint32_t	sent;
+	uint32_t	dropped;
+	uint32_t	drop_stats[NUM_DROP_INTERVALS];	/* drop counts per stats interval */
+} __rte_cache_aligned;
+
 static struct rte_timer icmp_ratelimit_refresh_tmr;
+static uint32_t icmp_ratelimit_epoch;
 
 static struct icmp_ratelimit_state *icmp_get_rl_state(void)
 {
@@ -426,20 +451,71 @@ static bool is_icmp_info(const struct icmphdr *icmp)
 }
 
 /*
- * Determine if we need to drop a generated ICMP packet.
+ * Take up to share tokens from the shared pool.
  */
+static uint32_t icmp_ratelimit_claim(struct icmp_ratelimit_state *rl,
+				     uint32_t share)
+{
+	uint32_t avail, take, old;
+
+	avail = CMM_LOAD_SHARED(rl->tokens);
+	while (avail) {
+		take = RTE_MIN(avail, share);
+		old = uatomic_cmpxchg(&rl->tokens, avail, avail - take);
+		if (old == avail)
+			return take;
+		avail = old;
+	}
+
+	return 0;
+}
+
+/* Slot 0 is shared, see struct icmp_ratelimit_lcore */
+static bool icmp_ratelimit_drop_shared(struct icmp_ratelimit_state *rl,
+				       struct icmp_ratelimit_lcore *pc)
+{
+	if (!icmp_ratelimit_claim(rl, 1)) {
+		uatomic_inc(&pc->dropped);
+		uatomic_inc(&pc->drop_stats[icmp_ratelimit_interval]);
+		return true;
+	}
+	uatomic_inc(&pc->sent);
+	return false;
+}
+
 bool icmp_ratelimit_drop(uint8_t type, struct icmp_ratelimit_state *rl, uint8_t entries)
 {
+	struct icmp_ratelimit_lcore *pc;
+	unsigned int lcore;
+	uint32_t epoch, share;
+
 	if (type < entries) {
 		rl = &rl[type];
 
-		if (rl->limiting) {
-			if (rl->tokens <= 0 || uatomic_add_return(&rl->tokens, -1) <= 0) {
-				uatomic_add(&rl->total_dropped, 1);
-				uatomic_add(&rl->drop_stats[icmp_ratelimit_interval], 1);
+		if (rl->limiting && rl->lcore) {
+			lcore = dp_lcore_id();
+			pc = &rl->lcore[lcore];
+			if (unlikely(lcore == 0))
+				return icmp_ratelimit_drop_shared(rl, pc);
+
+			epoch = CMM_LOAD_SHARED(icmp_ratelimit_epoch);
+			if (pc->epoch != epoch) {
+				pc->epoch = epoch;
+				pc->tokens = 0;
+			}
+			if (pc->tokens == 0) {
+				share = rl->max_rate / (rte_lcore_count() *
+							ICMP_RATELIMIT_SHARES);
+				pc->tokens = icmp_ratelimit_claim(rl,
+							share ? share : 1);
+			}
+			if (pc->tokens == 0) {
+				pc->dropped++;
+				pc->drop_stats[icmp_ratelimit_interval]++;
 				return true;
 			}
-			uatomic_add(&rl->total_sent, 1);
+			pc->tokens--;
+			pc->sent++;
 		}
 	}
 
@@ -841,15 +917,29 @@ static bool icmp_msg_type_to_icmp_type(uint8_t msgtype, uint8_t *icmptype)
 	}
 }
 
+static void icmp_ratelimit_clear_stats(struct icmp_ratelimit_state *rl)
+{
+	unsigned int i;
+
+	if (!rl->lcore)
+		return;
+
+	FOREACH_DP_LCORE(i) {
+		rl->lcore[i].sent = 0;
+		rl->lcore[i].dropped = 0;
+		memset(rl->lcore[i].drop_stats, 0,
+		       sizeof(rl->lcore[i].drop_stats));
+	}
+}
+
 static void icmp_ratelimit_reset_entry(struct icmp_ratelimit_state *rl,
 				       bool enable, bool explicit, uint32_t val)
 {
-	rl->total_sent = rl->total_dropped = 0;
+	icmp_ratelimit_clear_stats(rl);
 	rl->limiting = enable;
 	rl->explicit = explicit;
 	rl->max_rate = val;
 	rl->tokens = val;
-	memset(rl->drop_stats, 0, sizeof(rl->drop_stats));
 }
 
 /*
@@ -936,6 +1026,16 @@ end:
 	return ret;
 }
 
+static void icmp_ratelimit_refresh_entry(struct icmp_ratelimit_state *rl)
+{
+	unsigned int i;
+
+	uatomic_set(&rl->tokens, rl->max_rate);
+	if (icmp_ratelimit_second_count == 0 && rl->lcore)
+		FOREACH_DP_LCORE(i)
+			rl->lcore[i].drop_stats[icmp_ratelimit_interval] = 0;
+}
+
 static void icmp_ratelimit_refresh_tmr_hdlr(struct rte_timer *timer __rte_unused,
 					    void *arg __rte_unused)
 {
@@ -952,18 +1052,16 @@ static void icmp_ratelimit_refresh_tmr_hdlr(struct rte_timer *timer __rte_unused
 
 	/* Refresh v4 tokens and stats counters */
 	rl = icmp_get_rl_state();
-	for (i = 0; i < icmp_get_rl_state_entries(); i++) {
-		uatomic_set(&rl[i].tokens, rl[i].max_rate);
-		if (icmp_ratelimit_second_count == 0)
-			rl[i].drop_stats[icmp_ratelimit_interval] = 0;
-	}
+	for (i = 0; i < icmp_get_rl_state_entries(); i++)
+		icmp_ratelimit_refresh_entry(&rl[i]);
 
 	rl = icmp6_get_rl_state();
-	for (i = 0; i < icmp6_get_rl_state_entries(); i++) {
-		uatomic_set(&rl[i].tokens, rl[i].max_rate);
-		if (icmp_ratelimit_second_count == 0)
-			rl[i].drop_stats[icmp_ratelimit_interval] = 0;
-	}
+	for (i = 0; i < icmp6_get_rl_state_entries(); i++)
+		icmp_ratelimit_refresh_entry(&rl[i]);
+
+	/* Make lcores drop any share claimed in the last second */
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(icmp_ratelimit_epoch, icmp_ratelimit_epoch + 1);
 }
 
 static void icmp_ratelimit_set_timer(void)
@@ -975,8 +1073,24 @@ static void icmp_ratelimit_set_timer(void)
 			     icmp_ratelimit_refresh_tmr_hdlr, NULL);
 }
 
+static void icmp_ratelimit_alloc(struct icmp_ratelimit_state *rl,
+				 uint8_t entries)
+{
+	uint8_t i;
+
+	for (i = 0; i < entries; i++) {
+		rl[i].lcore = zmalloc_aligned((get_lcore_max() + 1) *
+					      sizeof(*rl[i].lcore));
+		if (!rl[i].lcore)
+			rte_panic("Failed to allocate ICMP ratelimit state\n");
+	}
+}
+
 void icmp_ratelimit_init(void)
 {
+	icmp_ratelimit_alloc(icmp_get_rl_state(), icmp_get_rl_state_entries());
+	icmp_ratelimit_alloc(icmp6_get_rl_state(),
+			     icmp6_get_rl_state_entries());
 	icmp_ratelimit_set_timer();
 }
 
@@ -984,11 +1098,16 @@ static uint32_t icmp_ratelimit_get_n_min_drop_count(int mins, struct icmp_rateli
 {
 	uint8_t i, interval;
 	uint32_t total = 0;
+	unsigned int lcore;
+
+	if (!rl->lcore)
+		return 0;
 
 	interval = icmp_ratelimit_interval;
 
 	for (i = 0; i < mins * NUM_INTERVALS_PER_MIN; i++) {
-		total += rl->drop_stats[interval];
+		FOREACH_DP_LCORE(lcore)
+			total += rl->lcore[lcore].drop_stats[interval];
 		interval = icmp_ratelimit_prev_interval(interval);
 	}
 
@@ -997,14 +1116,37 @@ static uint32_t icmp_ratelimit_get_n_min_drop_count(int mins, struct icmp_rateli
 
 static void json_one_entry(json_writer_t *wr, struct icmp_ratelimit_state *rl)
 {
+	uint32_t sent = 0, dropped = 0;
+	unsigned int i;
+
+	if (rl->lcore)
+		FOREACH_DP_LCORE(i) {
+			sent += rl->lcore[i].sent;
+			dropped += rl->lcore[i].dropped;
+		}
+
 	jsonw_start_object(wr);
 	jsonw_string_field(wr, "icmp-type", rl->name);
 	jsonw_uint_field(wr, "limit", rl->max_rate);
-	jsonw_uint_field(wr, "sent", rl->total_sent);
-	jsonw_uint_field(wr, "dropped", rl->total_dropped);
+	jsonw_uint_field(wr, "sent", sent);
+	jsonw_uint_field(wr, "dropped", dropped);
 	jsonw_uint_field(wr, "dropped-1-min", icmp_ratelimit_get_n_min_drop_count(1, rl));
 	jsonw_uint_field(wr, "dropped-3-min", icmp_ratelimit_get_n_min_drop_count(3, rl));
 	jsonw_uint_field(wr, "dropped-5-min", icmp_ratelimit_get_n_min_drop_count(5, rl));
+
+	jsonw_name(wr, "lcores");
+	jsonw_start_array(wr);
+	if (rl->lcore)
+		FOREACH_DP_LCORE(i) {
+			if (!rl->lcore[i].sent && !rl->lcore[i].dropped)
+				continue;
+			jsonw_start_object(wr);
+			jsonw_uint_field(wr, "lcore", i);
+			jsonw_uint_field(wr, "sent", rl->lcore[i].sent);
+			jsonw_uint_field(wr, "dropped", rl->lcore[i].dropped);
+			jsonw_end_object(wr);
+		}
+	jsonw_end_array(wr);
 	jsonw_end_object(wr);
 }
 
@@ -1032,11 +1174,8 @@ int cmd_icmp_rl(FILE *f, int argc, char **argv)
 		goto usage;
 
 	if (!strncmp(argv[1], "clear", 6)) {
-		for (int i = 0; i < entries; i++) {
-			rl[i].total_dropped = 0;
-			rl[i].total_sent = 0;
-			memset(&rl[i].drop_stats, 0, sizeof(rl->drop_stats));
-		}
+		for (i = 0; i < entries; i++)
+			icmp_ratelimit_clear_stats(&rl[i]);
 		return 0;
 	}
 
@@ -47,6 +47,7 @@ int cmd_icmp_rl(FILE *f, int argc, char **argv);
 #define NUM_DROP_INTERVALS (300/ICMP_RATELIMIT_STATS_INTERVAL)
 
 struct icmp_ratelimit_state;
+struct icmp_ratelimit_lcore;
 
 void icmp_ratelimit_init(void);
 
@@ -58,11 +59,11 @@ bool icmp_ratelimit_drop(uint8_t type, struct icmp_ratelimit_state *rl, uint8_t
 struct icmp_ratelimit_state {
 	char		*name;				/* type name */
 	uint32_t	max_rate;			/* limit per sec */
-	uint32_t	tokens;				/* remaining tokens for current second */
-	uint32_t	total_sent;
-	uint32_t	total_dropped;
-	uint32_t	drop_stats[NUM_DROP_INTERVALS];	/* drop counts per stats interval */
+	uint32_t	tokens;				/* unclaimed tokens for current second */
+	struct icmp_ratelimit_lcore *lcore;		/* per-lcore token share and counters */
 	bool		limiting;			/* is rate limiting configured */
 	bool		explicit;			/* limiting is explicit, not default */
 };
+
+extern struct icmp_ratelimit_state icmp_ratelimit_state[];
 #endif
@@ -30,10 +30,12 @@
 #include "ip6_mroute.h"
 #include "ip_icmp.h"
 #include "ip_mcast.h"
+#include "json_writer.h"
 #include "main.h"
 #include "netinet/ip_mroute.h"
 #include "pktmbuf_internal.h"
 #include "snmp_mib.h"
+#include "util.h"
 #include "vplane_debug.h"
 #include "vplane_log.h"
 
@@ -81,6 +83,55 @@ void mc_dumpall(FILE *f, struct vrf *vrf)
 	mfc6_stat(f, vrf);
 }
 
+struct mcast_lcore_stats *mcast_lcore_stats_alloc(void)
+{
+	return zmalloc_aligned((get_lcore_max() + 1) *
+			       sizeof(struct mcast_lcore_stats));
+}
+
+void mcast_lcore_stats_sum(const struct mcast_lcore_stats *stats,
+			   uint64_t *pkts, uint64_t *bytes)
+{
+	unsigned int i;
+
+	*pkts = 0;
+	*bytes = 0;
+	FOREACH_DP_LCORE(i) {
+		*pkts += stats[i].pkts;
+		*bytes += stats[i].bytes;
+	}
+}
+
+void mcast_lcore_stats_clear(struct mcast_lcore_stats *stats)
+{
+	unsigned int i;
+
+	FOREACH_DP_LCORE(i) {
+		stats[i].pkts = 0;
+		stats[i].bytes = 0;
+	}
+}
+
+/* Show the lcores that have counted packets, these add up to the totals */
+void mcast_lcore_stats_json(json_writer_t *wr,
+			    const struct mcast_lcore_stats *stats)
+{
+	unsigned int i;
+
+	jsonw_name(wr, "lcores");
+	jsonw_start_array(wr);
+	FOREACH_DP_LCORE(i) {
+		if (!stats[i].pkts)
+			continue;
+		jsonw_start_object(wr);
+		jsonw_uint_field(wr, "lcore", i);
+		jsonw_uint_field(wr, "packets", stats[i].pkts);
+		jsonw_uint_field(wr, "bytes", stats[i].bytes);
+		jsonw_end_object(wr);
+	}
+	jsonw_end_array(wr);
+}
+
 /* Function to create a new header mbuf which is chained to a supplied
  * data mbuf to support efficient replication.
  *
@@ -20,11 +20,13 @@
 #include <netinet/ip.h>
 #include <netinet/ip6.h>
 #include <rte_byteorder.h>
+#include <rte_memory.h>
 #include <rte_ether.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <sys/types.h>
 
+#include "json_writer.h"
 #include "util.h"
 
 struct ifnet;
@@ -117,6 +119,32 @@ struct rte_mbuf *mcast_create_l2l3_header(struct rte_mbuf *m_header,
 					  struct rte_mbuf *m_data,
 					  int iphdrlen);
 
+/*
+ * Per-lcore packet and byte counters for an mroute or a multicast
+ * input interface. Each forwarding lcore only writes its own slot;
+ * readers sum over all lcores.
+ */
+struct mcast_lcore_stats {
+	uint64_t pkts;
+	uint64_t bytes;
+} __rte_cache_aligned;
+
+struct mcast_lcore_stats *mcast_lcore_stats_alloc(void);
+void mcast_lcore_stats_sum(const struct mcast_lcore_stats *stats,
+			   uint64_t *pkts, uint64_t *bytes);
+void mcast_lcore_stats_clear(struct mcast_lcore_stats *stats);
+void mcast_lcore_stats_json(json_writer_t *wr,
+			    const struct mcast_lcore_stats *stats);
+
+static inline void
+mcast_lcore_stats_inc(struct mcast_lcore_stats *stats, uint32_t bytes)
+{
+	struct mcast_lcore_stats *s = &stats[dp_lcore_id()];
+
+	s->pkts++;
+	s->bytes += bytes;
+}
+
 struct vif *get_vif_by_ifindex(unsigned int ifindex);
 struct mif6 *get_mif_by_ifindex(unsigned int ifindex);
 
@@ -68,6 +68,9 @@ extern "C" {
 /** Maximum depth value possible for IPv4 LPM. */
 #define LPM_MAX_DEPTH 33
 
+/** Width of the next hop in a table entry. */
+#define LPM_NEXT_HOP_BITS 24
+
 /** Total number of tbl24 entries. */
 #define LPM_TBL24_NUM_ENTRIES (1 << 24)
 
@@ -82,14 +85,14 @@ struct lpm_tbl24_entry {
 	uint8_t depth	    :6;	/**< Rule depth. */
 	/* Stores Next hop or group index (i.e. gindex)into tbl8. */
 	union {
-		uint32_t next_hop:24;
-		uint32_t tbl8_gindex:24;
+		uint32_t next_hop:LPM_NEXT_HOP_BITS;
+		uint32_t tbl8_gindex:LPM_NEXT_HOP_BITS;
 	} __attribute__ ((__packed__));
 };
 
 /** Tbl8 entry structure. */
 struct lpm_tbl8_entry {
-	uint32_t next_hop    :24;	/**< next hop. */
+	uint32_t next_hop    :LPM_NEXT_HOP_BITS;	/**< next hop. */
 	uint32_t depth       :6;	/**< Rule depth. */
 	uint32_t valid       :1;	/**< Validation flag. */
 	uint32_t valid_group :1;	/**< Group validation flag. */
@@ -84,7 +84,7 @@ enum valid_flag {
 
 /** Tbl entry structure. It is the same for both tbl24 and tbl8 */
 struct lpm6_tbl_entry {
-	uint32_t next_hop    :21;  /**< Next hop / next table to be checked. */
+	uint32_t next_hop    :LPM6_NEXT_HOP_BITS;  /**< Next hop / next table */
 	uint32_t  depth      :8;   /**< Rule depth. */
 	/* Flags. */
 	uint32_t valid       :1;   /**< Validation flag. */
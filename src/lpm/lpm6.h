@@ -59,6 +59,8 @@ extern "C" {
 
 #define LPM6_MAX_DEPTH               128
 #define LPM6_IPV6_ADDR_SIZE           16
+/** Width of the next hop in a table entry. */
+#define LPM6_NEXT_HOP_BITS            21
 /** Max number of characters in LPM name. */
 #define LPM6_NAMESIZE                 32
 
@@ -73,6 +73,7 @@
 #include <rte_errno.h>
 #include <rte_ethdev.h>
 #include <rte_ether.h>
+#include <rte_interrupts.h>
 #include <rte_launch.h>
 #include <rte_lcore.h>
 #include <rte_log.h>
@@ -180,19 +181,33 @@ union atomic_stat {
 };
 
 /* Temporary buffer to aggregate before going into the packet ring */
-struct pkt_burst {
-	uint8_t			port;	/* intended port */
-	uint16_t		queue;  /* queue to use for multi-queue tx */
+/* Packets pending transmission on one egress port */
+struct pkt_burst_port {
 	uint32_t		count;	/* packets in burst */
+	bool			active;	/* port is on the active list */
 	struct rte_mbuf *m_tbl[TX_PKT_BURST];	/* pending packets */
 };
 
+/*
+ * Per-lcore transmit burst buffers. Keeping a buffer per egress port
+ * means traffic fanning out to several ports is still sent in full
+ * bursts; the ports with buffered packets are tracked so they can be
+ * drained at the end of each poll without scanning every port.
+ */
+struct pkt_burst {
+	uint16_t		queue;  /* queue to use for multi-queue tx */
+	uint16_t		nactive; /* entries in active */
+	portid_t		active[DATAPLANE_MAX_PORTS];
+	struct pkt_burst_port	port[DATAPLANE_MAX_PORTS];
+};
+
 RTE_DEFINE_PER_LCORE(unsigned int, _dp_lcore_id) = 0;
 static RTE_DEFINE_PER_LCORE(struct pkt_burst *, pkt_burst);
 
 enum lcore_state {
 	LCORE_STATE_POLL,
 	LCORE_STATE_POWERSAVE,
+	LCORE_STATE_INTERRUPT,
 	LCORE_STATE_IDLE,
 	LCORE_STATE_EXIT,
 };
@@ -212,6 +227,7 @@ struct lcore_conf {
 	uint8_t tx_qid;	      /* my tx queue for multi-queue devices */
 	uint8_t do_crypto;    /* thread is tasked with doing crypto */
 	uint8_t crypto_fwd;   /* post-crypto forwarding workload present */
+	unsigned long rx_intr_seq; /* odd while rx interrupts may be armed */
 
 	/* receive queues this cpu should check for input */
 	struct lcore_rx_queue {
@@ -333,6 +349,8 @@ bitmask_t enabled_port_mask;		/* port is valid */
 bitmask_t poll_port_mask;		/* should be polled */
 /* port should be polled and is link up */
 bitmask_t active_port_mask __hot_data;
+/* RX queue interrupts requested and usable */
+static bitmask_t rx_intr_port_mask;
 
 uint16_t nb_ports_total;		/* highest DPDK portid + 1 */
 
@@ -366,6 +384,7 @@ static const struct rte_eth_conf eth_base_conf = {
 		.mq_mode	= ETH_MQ_RX_RSS,
 		.max_rx_pkt_len = RTE_ETHER_MAX_LEN,
 		.split_hdr_size = 0,
+		.offloads	= DEV_RX_OFFLOAD_IPV4_CKSUM,
 	},
 	.txmode = {
 		.offloads	= DEV_TX_OFFLOAD_MULTI_SEGS |
@@ -571,33 +590,35 @@ pkt_out_burst_cmn(struct ifnet *ifp, bool qos_enabled, uint16_t port,
 	return n;
 }
 
-/* Move packets out of per-cpu burst buffer.
+/* Move packets out of per-cpu burst buffer for a port.
  * If devices is using percoreq mode then go direct to device
  * otherwise queue into packet ring for Tx thread.
  */
 static __hot_func void
-pkt_ring_burst(struct pkt_burst *pb, bool drain)
+pkt_ring_burst(struct pkt_burst *pb, portid_t portid, bool drain)
 {
-	struct ifnet *ifp = ifport_table[pb->port];
+	struct pkt_burst_port *pbp = &pb->port[portid];
+	struct ifnet *ifp = ifport_table[portid];
 	bool qos_enabled = ifp->qos_software_fwd;
 	uint32_t n;
 
-	n = pkt_out_burst_cmn(ifp, qos_enabled, pb->port, pb->queue,
-			      pb->m_tbl, pb->count);
+	n = pkt_out_burst_cmn(ifp, qos_enabled, portid, pb->queue,
+			      pbp->m_tbl, pbp->count);
 
-	if (n < pb->count) {
+	if (n < pbp->count) {
 		if (n == 0 || drain) {
 			/* The transmit queue is full or some packets could
 			 * not be sent (or placed in tx ring) and we are
-			 * changing ports and need to drain the burst queue.
+			 * at the end of the poll and need to drain the
+			 * burst queue.
 			 * Drop the packets (and update counter).
 			 */
-			unsigned int drop = pb->count - n;
-			struct ifnet *ifp = ifnet_byport(pb->port);
+			unsigned int drop = pbp->count - n;
+			struct ifnet *ifp = ifnet_byport(portid);
 
-			pktmbuf_free_bulk(&pb->m_tbl[n], drop);
+			pktmbuf_free_bulk(&pbp->m_tbl[n], drop);
 			if (ifp) {
-				if (__use_directpath(pb->port, qos_enabled))
+				if (__use_directpath(portid, qos_enabled))
 					if_incr_full_hwq(ifp, drop);
 				else
 					if_incr_full_txring(ifp, drop);
@@ -606,15 +627,31 @@ pkt_ring_burst(struct pkt_burst *pb, bool drain)
 		}
 
 		/* If some packets remain, shuffle to front of the queue */
-		unsigned int unsent = pb->count - n;
-		memmove(pb->m_tbl,
-			pb->m_tbl + n,
+		unsigned int unsent = pbp->count - n;
+		memmove(pbp->m_tbl,
+			pbp->m_tbl + n,
 			unsent * sizeof(struct rte_mbuf *));
-		pb->count = unsent;
+		pbp->count = unsent;
 		return;
 	}
 out:
-	pb->count = 0;
+	pbp->count = 0;
+}
+
+/* Send everything left in the per-cpu burst buffers */
+static __hot_func void pkt_burst_drain(struct pkt_burst *pb)
+{
+	unsigned int i;
+
+	for (i = 0; i < pb->nactive; i++) {
+		portid_t portid = pb->active[i];
+		struct pkt_burst_port *pbp = &pb->port[portid];
+
+		if (pbp->count > 0)
+			pkt_ring_burst(pb, portid, true);
+		pbp->active = false;
+	}
+	pb->nactive = 0;
 }
 
 static __hot_func void pkt_ring_drain(void)
@@ -622,8 +659,7 @@ static __hot_func void pkt_ring_drain(void)
 	struct crypto_pkt_buffer *cpb = RTE_PER_LCORE(crypto_pkt_buffer);
 	struct pkt_burst *pb = RTE_PER_LCORE(pkt_burst);
 
-	if (pb->count > 0)
-		pkt_ring_burst(pb, true);
+	pkt_burst_drain(pb);
 	crypto_send(cpb);
 }
 
@@ -658,18 +694,19 @@ void pkt_ring_output(struct ifnet *ifp, struct rte_mbuf *m)
 		    __use_directpath(portid, ifp->qos_software_fwd))
 			portmonitor_src_phy_tx_output(ifp, &m, 1);
 
-		/* If changing flows to another port */
-		if (unlikely(portid != pb->port)) {
-			if (pb->count > 0)
-				pkt_ring_burst(pb, true);
-			pb->port = portid;
+		struct pkt_burst_port *pbp = &pb->port[portid];
+
+		/* First packet for this port since the last drain */
+		if (unlikely(!pbp->active)) {
+			pbp->active = true;
+			pb->active[pb->nactive++] = portid;
 		}
 
-		pb->m_tbl[pb->count++] = m;
+		pbp->m_tbl[pbp->count++] = m;
 
 		/* if burst is ready, send now */
-		if (pb->count == TX_PKT_BURST)
-			pkt_ring_burst(pb, false);
+		if (pbp->count == TX_PKT_BURST)
+			pkt_ring_burst(pb, portid, false);
 	} else {
 		if (__use_directpath(portid, ifp->qos_software_fwd)) {
 			if (unlikely(ifp->portmonitor))
@@ -705,10 +742,7 @@ void dp_pkt_burst_flush(void)
 	if (lcore_id == rte_get_master_lcore() || lcore_id == LCORE_ID_ANY)
 		return;
 
-	struct pkt_burst *pb = RTE_PER_LCORE(pkt_burst);
-
-	if (pb->count > 0)
-		pkt_ring_burst(pb, true);
+	pkt_burst_drain(RTE_PER_LCORE(pkt_burst));
 }
 
 static __hot_func void
@@ -732,6 +766,9 @@ process_burst(portid_t portid, struct rte_mbuf *pkts[], uint16_t nb)
 	if (unlikely(ifp->portmonitor))
 		portmonitor_src_phy_rx_output(ifp, pkts, nb);
 
+	/* Bulk IPsec policy lookup, if the VRF has any policies */
+	crypto_policy_classify_burst(ifp, pkts, nb);
+
 	/* Process already prefetched packets */
 	for (i = 0; i + PREFETCH_OFFSET < nb; i++) {
 		rte_prefetch0(pkts[i + PREFETCH_OFFSET]->cacheline1);
@@ -760,7 +797,10 @@ process_burst(portid_t portid, struct rte_mbuf *pkts[], uint16_t nb)
  * 3. Work out the minimum sleep time based on heuristics of how much
  *    work was done for each work item recently. If less than power
  *    policy minimum sleep time -> poll
- * 4. Otherwise -> powernap for the specified time.
+ * 4. If RX interrupts are enabled, the lcore only has RX queues and
+ *    they have all backed off to the longest nap -> wait for an RX
+ *    interrupt.
+ * 5. Otherwise -> powernap for the specified time.
  */
 static __hot_func enum lcore_state
 lcore_next_state(struct lcore_conf *conf,
@@ -833,9 +873,100 @@ lcore_next_state(struct lcore_conf *conf,
 	if (min_us < pm->min_sleep)
 		return LCORE_STATE_POLL;
 	*nap_us = min_us;
+	if (platform_cfg.rx_interrupts && min_us >= pm->max_sleep &&
+	    !inactive_port_exists && CMM_LOAD_SHARED(conf->num_txq) == 0 &&
+	    !CMM_LOAD_SHARED(conf->do_crypto) &&
+	    !CMM_LOAD_SHARED(conf->crypto_fwd))
+		return LCORE_STATE_INTERRUPT;
 	return LCORE_STATE_POWERSAVE;
 }
 
+/*
+ * Sleep until a packet arrives on one of the lcore's RX queues, or for
+ * at most LCORE_INTR_TIMEOUT_MS which bounds the latency of a packet
+ * that arrived just before the interrupts were enabled.
+ *
+ * Queues are only registered with this thread's epoll instance for the
+ * duration of the wait. The thread is RCU offline while it sleeps, so
+ * a grace period doesn't show that it has let go of a queue. Instead
+ * rx_intr_seq is odd from before the queues are read until after they
+ * are disarmed, and an RX queue being moved off the lcore is only
+ * handed on once the sequence shows the lcore isn't using it.
+ *
+ * Returns false if the interrupts couldn't be armed, e.g. the PMD
+ * doesn't support them, in which case the caller naps instead.
+ */
+static bool lcore_rx_intr_wait(struct lcore_conf *conf)
+{
+	struct rte_epoll_event events[LCORE_INTR_MAX_EVENTS];
+	portid_t ports[MAX_RX_QUEUE_PER_CORE];
+	uint8_t queues[MAX_RX_QUEUE_PER_CORE];
+	unsigned int i, narmed = 0;
+	uint16_t high_rxq;
+	bool ok = false;
+	int n;
+
+	CMM_STORE_SHARED(conf->rx_intr_seq, conf->rx_intr_seq + 1);
+	/* pairs with the barrier in rxq_migrate() */
+	cmm_smp_mb();
+
+	high_rxq = CMM_LOAD_SHARED(conf->high_rxq);
+	for (i = 0; i < high_rxq; i++) {
+		struct lcore_rx_queue *rxq = &conf->rx_poll[i];
+		portid_t portid = CMM_LOAD_SHARED(rxq->portid);
+
+		if (portid == NO_OWNER)
+			continue;
+
+		/* read queueid after reading portid */
+		cmm_smp_rmb();
+
+		/* Any queue that can't wake us has to be polled */
+		if (!bitmask_isset(&rx_intr_port_mask, portid))
+			goto disarm;
+
+		if (rte_eth_dev_rx_intr_ctl_q(portid, rxq->queueid,
+					      RTE_EPOLL_PER_THREAD,
+					      RTE_INTR_EVENT_ADD, NULL) < 0)
+			goto disarm;
+
+		ports[narmed] = portid;
+		queues[narmed++] = rxq->queueid;
+
+		if (rte_eth_dev_rx_intr_enable(portid, rxq->queueid) < 0)
+			goto disarm;
+	}
+
+	if (narmed == 0)
+		goto disarm;
+
+	dp_rcu_thread_offline();
+	n = rte_epoll_wait(RTE_EPOLL_PER_THREAD, events, RTE_DIM(events),
+			   LCORE_INTR_TIMEOUT_MS);
+	dp_rcu_thread_online();
+
+	/* Traffic has resumed, so go back to busy polling */
+	if (n > 0) {
+		for (i = 0; i < high_rxq; i++)
+			conf->rx_poll[i].gov.nap = 0;
+	}
+	ok = true;
+
+disarm:
+	for (i = 0; i < narmed; i++) {
+		rte_eth_dev_rx_intr_disable(ports[i], queues[i]);
+		rte_eth_dev_rx_intr_ctl_q(ports[i], queues[i],
+					  RTE_EPOLL_PER_THREAD,
+					  RTE_INTR_EVENT_DEL, NULL);
+	}
+
+	/* the queues are free to move once they are disarmed */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(conf->rx_intr_seq, conf->rx_intr_seq + 1);
+
+	return ok;
+}
+
 /* Check for packets from network ports */
 static void __hot_func
 poll_receive_queues(struct lcore_conf *conf)
@@ -1074,6 +1205,12 @@ forwarding_loop(unsigned int lcore_id)
 			dp_rcu_quiescent_state(lcore_id);
 			usleep(us);
 			break;
+		case LCORE_STATE_INTERRUPT:
+			if (lcore_rx_intr_wait(conf))
+				break;
+			dp_rcu_quiescent_state(lcore_id);
+			usleep(us);
+			break;
 		case LCORE_STATE_IDLE:
 			dp_rcu_thread_offline();
 			sleep(LCORE_IDLE_SLEEP_SECS);
@@ -1563,6 +1700,8 @@ static void unassign_port_transmit_queues(portid_t portid,
 		bitmask_clear(&conf->portmask, portid);
 }
 
+static void rxq_migrate_cancel(portid_t portid);
+
 static void unassign_port_receive_queues(portid_t portid,
 					 struct lcore_conf *conf)
 {
@@ -1602,6 +1741,7 @@ void unassign_queues(portid_t portid)
 		unassign_port_transmit_queues(portid, conf);
 		unassign_port_receive_queues(portid, conf);
 	}
+	rxq_migrate_cancel(portid);
 
 	dp_rcu_synchronize();
 	pkt_ring_empty(portid);
@@ -1713,6 +1853,42 @@ static bitmask_t cpu_affinity_online(const bitmask_t *cpu_affinity_mask)
 	return mask;
 }
 
+/* Add a receive queue to the set polled by an lcore */
+static int lcore_add_rxq(struct lcore_conf *conf, portid_t portid,
+			 uint8_t queueid)
+{
+	int i;
+
+	/* find empty slot to use */
+	for (i = 0; i < conf->high_rxq; i++) {
+		if (conf->rx_poll[i].portid == NO_OWNER)
+			goto found;
+	}
+
+	if (conf->high_rxq < MAX_RX_QUEUE_PER_CORE)
+		_CMM_STORE_SHARED(conf->high_rxq, conf->high_rxq + 1);
+	else
+		return -ENOMEM;
+found:
+	_CMM_STORE_SHARED(conf->num_rxq, conf->num_rxq + 1);
+
+	struct lcore_rx_queue *rxq = &conf->rx_poll[i];
+	struct rate_stats *rxq_stats = &conf->rx_poll_stats[i];
+
+	init_rate_stats(rxq_stats);
+
+	memset(&rxq->gov, 0, sizeof(rxq->gov));
+	rxq->packets = 0;
+	CMM_STORE_SHARED(rxq->queueid, queueid);
+	/* write queueid before writing portid */
+	cmm_smp_wmb();
+	_CMM_STORE_SHARED(rxq->portid, portid);
+
+	bitmask_set(&conf->portmask, portid);
+
+	return 0;
+}
+
 /* Assign all receive queues for a port */
 static int assign_port_receive_queues(portid_t portid)
 {
@@ -1722,8 +1898,7 @@ static int assign_port_receive_queues(portid_t portid)
 	bitmask_t allowed = cpu_affinity_online(&port_alloc->rx_cpu_affinity);
 
 	for (q = 0; q < port_alloc->rx_queues; q++) {
-		struct lcore_conf *conf;
-		int i, lcore;
+		int lcore;
 
 		if (!bitmask_isset(&port_conf->rx_enabled_queues, q))
 			continue;
@@ -1736,46 +1911,22 @@ static int assign_port_receive_queues(portid_t portid)
 				"no available lcore for rx port %u\n", portid);
 			return -ENOENT;
 		}
-		conf = lcore_conf[lcore];
 
-		/* find empty slot to use */
-		for (i = 0; i < conf->high_rxq; i++) {
-			if (conf->rx_poll[i].portid == NO_OWNER)
-				goto found;
-		}
-
-		if (conf->high_rxq < MAX_RX_QUEUE_PER_CORE)
-			_CMM_STORE_SHARED(conf->high_rxq, conf->high_rxq + 1);
-		else {
+		if (lcore_add_rxq(lcore_conf[lcore], portid, q) < 0) {
 			RTE_LOG(ERR, DATAPLANE,
 				"Socket %d has no unused rx queues\n",
 				port_alloc->socketid);
 			return -ENOMEM;
 		}
-found:
+
 		bitmask_clear(&allowed, lcore);
 		if (bitmask_isempty(&allowed))
 			allowed = cpu_affinity_online(		/* start over */
 				&port_alloc->rx_cpu_affinity);
-		_CMM_STORE_SHARED(conf->num_rxq, conf->num_rxq + 1);
 
 		DP_DEBUG(INIT, DEBUG, DATAPLANE,
 			 "Assign RX port %u queue %u to core %u (node %u)\n",
 			 portid, q, lcore, port_alloc->socketid);
-
-		struct lcore_rx_queue *rxq = &conf->rx_poll[i];
-		struct rate_stats *rxq_stats = &conf->rx_poll_stats[i];
-
-		init_rate_stats(rxq_stats);
-
-		memset(&rxq->gov, 0, sizeof(rxq->gov));
-		rxq->packets = 0;
-		CMM_STORE_SHARED(rxq->queueid, q);
-		/* write queueid before writing portid */
-		cmm_smp_wmb();
-		_CMM_STORE_SHARED(rxq->portid, portid);
-
-		bitmask_set(&conf->portmask, portid);
 	}
 
 	return 0;
@@ -1954,6 +2105,7 @@ int assign_queues(portid_t portid)
 			FOREACH_FORWARD_LCORE(lcore) {
 				struct lcore_conf *conf = lcore_conf[lcore];
 				unassign_port_receive_queues(portid, conf);
+				rxq_migrate_cancel(portid);
 				dp_rcu_synchronize();
 				pkt_ring_empty(portid);
 				stop_cpus();
@@ -2603,6 +2755,15 @@ static int port_conf_final(portid_t portid, struct rte_eth_conf *dev_conf)
 
 	dev_conf->intr_conf.lsc = (port_alloc->dev_flags &
 				   RTE_ETH_DEV_INTR_LSC) ? 1 : 0;
+	dev_conf->intr_conf.rxq =
+		bitmask_isset(&rx_intr_port_mask, portid) ? 1 : 0;
+
+	/*
+	 * IPv4 header checksum validation is used opportunistically,
+	 * ip_validate_packet() falls back to software without it.
+	 */
+	if (!(dev_info.rx_offload_capa & DEV_RX_OFFLOAD_IPV4_CKSUM))
+		port_alloc->rx_conf.offloads &= ~DEV_RX_OFFLOAD_IPV4_CKSUM;
 
 	dev_conf->rxmode.offloads = port_alloc->rx_conf.offloads;
 	dev_conf->rxmode.mq_mode = port_alloc->rx_mq_mode;
@@ -2917,6 +3078,7 @@ int insert_port(portid_t port_id)
 	bitmask_set(&enabled_port_mask, port_id);
 	bitmask_clear(&linkup_port_mask, port_id);
 	if_enable_poll(port_id);
+	eth_port_rx_intr_init(port_id);
 
 	if (port_conf_init(port_id) < 0) {
 		RTE_LOG(ERR, DATAPLANE,
@@ -2944,6 +3106,75 @@ failed:
 	return -1;
 }
 
+/*
+ * RX queue interrupts are requested per port, and withdrawn from any
+ * port whose PMD turns out not to support them so that its queues are
+ * always polled.
+ */
+void eth_port_rx_intr_init(portid_t portid)
+{
+	if (platform_cfg.rx_interrupts)
+		bitmask_set(&rx_intr_port_mask, portid);
+	else
+		bitmask_clear(&rx_intr_port_mask, portid);
+}
+
+bool eth_port_rx_intr_enabled(portid_t portid)
+{
+	return bitmask_isset(&rx_intr_port_mask, portid);
+}
+
+static void eth_port_rx_intr_disable(portid_t portid, const char *why)
+{
+	bitmask_clear(&rx_intr_port_mask, portid);
+	RTE_LOG(NOTICE, DATAPLANE,
+		"port %u: RX interrupts %s, polling instead\n",
+		portid, why);
+}
+
+/*
+ * Called when the port failed to start. If RX interrupts were
+ * requested, reconfigure the port without them so that the start
+ * can be retried.
+ *
+ * Returns true if the port was reconfigured.
+ */
+bool eth_port_rx_intr_fallback(portid_t portid)
+{
+	struct rte_eth_conf dev_conf;
+
+	if (!bitmask_isset(&rx_intr_port_mask, portid))
+		return false;
+
+	eth_port_rx_intr_disable(portid, "rejected by device");
+	if (port_conf_final(portid, &dev_conf) < 0)
+		return false;
+
+	return eth_port_configure(portid, &dev_conf) == 0;
+}
+
+/*
+ * Called once the port has started, check that an RX queue can
+ * actually be registered for interrupts, which needs an interrupt
+ * vector per queue that not every PMD provides.
+ *
+ * Returns true if the port's RX queues can be waited on.
+ */
+bool eth_port_rx_intr_check(portid_t portid)
+{
+	if (!bitmask_isset(&rx_intr_port_mask, portid))
+		return false;
+
+	if (rte_eth_dev_rx_intr_ctl_q(portid, 0, RTE_EPOLL_PER_THREAD,
+				      RTE_INTR_EVENT_ADD, NULL) < 0) {
+		eth_port_rx_intr_disable(portid, "not supported");
+		return false;
+	}
+	rte_eth_dev_rx_intr_ctl_q(portid, 0, RTE_EPOLL_PER_THREAD,
+				  RTE_INTR_EVENT_DEL, NULL);
+	return true;
+}
+
 void remove_port(portid_t port_id)
 {
 	eth_port_uninit(port_id);
@@ -3025,6 +3256,12 @@ int set_crypto_engines(const uint8_t *bytes, uint8_t len, bool *sticky)
 	return bitmask_numset(&crypto_cpus);
 }
 
+/* Cores that crypto engines can currently be allocated to */
+bitmask_t crypto_engine_cores(void)
+{
+	return crypto_cpus;
+}
+
 int next_available_crypto_lcore(void)
 {
 	int lcore;
@@ -3732,6 +3969,329 @@ main(int argc, char **argv)
 	return 0;
 }
 
+/*
+ * Dynamic RX queue rebalancing.
+ *
+ * Initial placement only counts queues, so a few busy queues can end
+ * up on one lcore while others idle. Once per load estimate the
+ * measured packet rates are used to move at most one RX queue from
+ * the busiest lcore to a less loaded one. To avoid queues bouncing
+ * between lcores the imbalance has to be significant, persist for
+ * several estimates, and moves are followed by a hold-off period.
+ */
+#define REBALANCE_MIN_PPS	100000	/* ignore lcores below this load */
+#define REBALANCE_IMBALANCE_PCT	25	/* of the busiest lcore's load */
+#define REBALANCE_PERSIST	3	/* consecutive imbalanced estimates */
+#define REBALANCE_HOLDOFF	10	/* estimates to wait after a move */
+
+#define REBALANCE_POLL_HZ	1000	/* checks for a finished handoff */
+
+/*
+ * An RX queue being handed from one lcore to another. The source
+ * gives the queue up straight away, and the destination only gets it
+ * once an RCU grace period has shown the source finished any burst in
+ * progress, so the queue is never polled by two threads. The grace
+ * period is waited for with call_rcu rather than blocking the master
+ * thread, which installs the queue from rxq_migrate_timer.
+ *
+ * A source sleeping on RX interrupts is RCU offline, so the grace
+ * period can pass while the queue is still armed with the source's
+ * epoll instance. The handoff then also waits for the source's
+ * rx_intr_seq to move on from the odd value seen when the move began.
+ */
+struct rxq_migration {
+	struct rcu_head rcu;
+	unsigned int src;
+	unsigned int dst;
+	unsigned long src_intr_seq;
+	portid_t portid;
+	uint8_t queueid;
+	bool cancelled;		/* port's queues unassigned meanwhile */
+	bool grace_done;	/* set by the call_rcu thread */
+};
+
+static unsigned int rebalance_persist;
+static unsigned int rebalance_holdoff;
+static struct rxq_migration *rxq_migration;
+static struct rte_timer rxq_migrate_timer;
+
+/*
+ * RX packet rate an lcore is polling. TX and crypto work aren't
+ * counted, since they don't move with the RX queues.
+ */
+static uint64_t lcore_load(const struct lcore_conf *conf)
+{
+	uint64_t load = 0;
+	unsigned int i;
+
+	for (i = 0; i < conf->high_rxq; i++)
+		if (conf->rx_poll[i].portid != NO_OWNER)
+			load += conf->rx_poll_stats[i].packet_rate;
+
+	return load;
+}
+
+/*
+ * Would moving an RX queue of the given rate from the busiest lcore
+ * to a less loaded one even out the load? If so return the higher of
+ * the two loads after the move in *peak.
+ */
+bool rxq_move_improves(uint64_t hot_load, uint64_t dst_load,
+		       uint64_t rate, uint64_t *peak)
+{
+	uint64_t after;
+
+	if (rate == 0 || rate > hot_load || dst_load >= hot_load ||
+	    hot_load - dst_load < hot_load * REBALANCE_IMBALANCE_PCT / 100)
+		return false;
+
+	after = RTE_MAX(hot_load - rate, dst_load + rate);
+	if (after >= hot_load)
+		return false;
+
+	*peak = after;
+	return true;
+}
+
+/* Does the lcore still poll any rx or tx queue of the port? */
+static bool lcore_uses_port(const struct lcore_conf *conf, portid_t portid)
+{
+	unsigned int i;
+
+	for (i = 0; i < conf->high_rxq; i++)
+		if (conf->rx_poll[i].portid == portid)
+			return true;
+
+	for (i = 0; i < conf->high_txq; i++)
+		if (conf->tx_poll[i].portid == portid)
+			return true;
+
+	return false;
+}
+
+static void rxq_migrate_grace_done(struct rcu_head *head)
+{
+	struct rxq_migration *mig =
+		caa_container_of(head, struct rxq_migration, rcu);
+
+	CMM_STORE_SHARED(mig->grace_done, true);
+}
+
+/* Install a migrating RX queue on its destination once it is idle */
+static void rxq_migrate_finish(struct rte_timer *timer,
+			       void *arg __rte_unused)
+{
+	struct rxq_migration *mig = rxq_migration;
+	unsigned int dst;
+
+	if (!mig || !CMM_LOAD_SHARED(mig->grace_done))
+		return;
+
+	/* still asleep with the queue armed */
+	if ((mig->src_intr_seq & 1) &&
+	    CMM_LOAD_SHARED(lcore_conf[mig->src]->rx_intr_seq) ==
+	    mig->src_intr_seq)
+		return;
+
+	rte_timer_stop(timer);
+	rxq_migration = NULL;
+
+	if (mig->cancelled) {
+		free(mig);
+		return;
+	}
+
+	dst = mig->dst;
+	if (lcore_add_rxq(lcore_conf[dst], mig->portid, mig->queueid) < 0) {
+		/* put it back where it was */
+		dst = mig->src;
+		if (lcore_add_rxq(lcore_conf[dst], mig->portid,
+				  mig->queueid) < 0) {
+			RTE_LOG(ERR, DATAPLANE,
+				"Lost RX port %u queue %u moving off core %u\n",
+				mig->portid, mig->queueid, mig->src);
+			free(mig);
+			return;
+		}
+	}
+
+	DP_DEBUG(INIT, DEBUG, DATAPLANE,
+		 "Move RX port %u queue %u from core %u to core %u\n",
+		 mig->portid, mig->queueid, mig->src, dst);
+
+	start_cpus();
+	stop_cpus();
+	free(mig);
+}
+
+/* The port's queues are being unassigned, so drop any pending move */
+static void rxq_migrate_cancel(portid_t portid)
+{
+	if (rxq_migration && rxq_migration->portid == portid)
+		rxq_migration->cancelled = true;
+}
+
+/* Start moving an RX queue between lcores */
+static int rxq_migrate(unsigned int src, unsigned int idx, unsigned int dst)
+{
+	struct lcore_conf *sconf = lcore_conf[src];
+	struct lcore_rx_queue *rxq = &sconf->rx_poll[idx];
+	struct rxq_migration *mig;
+
+	mig = calloc(1, sizeof(*mig));
+	if (!mig)
+		return -ENOMEM;
+
+	mig->src = src;
+	mig->dst = dst;
+	mig->portid = rxq->portid;
+	mig->queueid = rxq->queueid;
+
+	_CMM_STORE_SHARED(rxq->portid, NO_OWNER);
+	/*
+	 * Either the source sees the queue gone when it next arms its
+	 * interrupts, or we see that it may have armed it already.
+	 */
+	cmm_smp_mb();
+	mig->src_intr_seq = CMM_LOAD_SHARED(sconf->rx_intr_seq);
+
+	CMM_STORE_SHARED(sconf->num_rxq, sconf->num_rxq - 1);
+	if (!lcore_uses_port(sconf, mig->portid))
+		bitmask_clear(&sconf->portmask, mig->portid);
+
+	rxq_migration = mig;
+	call_rcu(&mig->rcu, rxq_migrate_grace_done);
+
+	rte_timer_init(&rxq_migrate_timer);
+	rte_timer_reset(&rxq_migrate_timer,
+			rte_get_timer_hz() / REBALANCE_POLL_HZ, PERIODICAL,
+			rte_get_master_lcore(), rxq_migrate_finish, NULL);
+	return 0;
+}
+
+/*
+ * Move an RX queue to another lcore, as the rebalancer would. Returns
+ * -EBUSY if a move is in progress, or -ENOENT if the queue isn't
+ * polled by any forwarding lcore.
+ */
+int rxq_migrate_queue(portid_t portid, uint8_t queueid, unsigned int dst)
+{
+	unsigned int lcore, i;
+
+	if (rxq_migration)
+		return -EBUSY;
+
+	FOREACH_FORWARD_LCORE(lcore) {
+		const struct lcore_conf *conf = lcore_conf[lcore];
+
+		for (i = 0; i < conf->high_rxq; i++)
+			if (conf->rx_poll[i].portid == portid &&
+			    conf->rx_poll[i].queueid == queueid)
+				return rxq_migrate(lcore, i, dst);
+	}
+
+	return -ENOENT;
+}
+
+/* Is an RX queue move waiting to be installed on its destination? */
+bool rxq_migrate_pending(void)
+{
+	return rxq_migration != NULL;
+}
+
+/* Times the lcore has started or finished waiting for RX interrupts */
+unsigned long lcore_rx_intr_seq(unsigned int lcore)
+{
+	return CMM_LOAD_SHARED(lcore_conf[lcore]->rx_intr_seq);
+}
+
+/*
+ * Find the move of one RX queue off the busiest lcore that best evens
+ * out the load, honouring the port's RX affinity and NUMA node.
+ */
+static void rxq_rebalance(void)
+{
+	uint64_t load[RTE_MAX_LCORE] = { 0 };
+	uint64_t hot_load = 0, best_peak;
+	unsigned int lcore, hot = 0, i;
+	int best_idx = -1, best_dst = -1;
+	bool have_hot = false;
+
+	if (!platform_cfg.rx_rebalance || single_cpu || rxq_migration)
+		return;
+
+	if (rebalance_holdoff) {
+		rebalance_holdoff--;
+		return;
+	}
+
+	FOREACH_FORWARD_LCORE(lcore) {
+		const struct lcore_conf *conf = lcore_conf[lcore];
+
+		if (conf->ded_to_feature)
+			continue;
+
+		load[lcore] = lcore_load(conf);
+		if (conf->num_rxq && load[lcore] > hot_load) {
+			hot = lcore;
+			hot_load = load[lcore];
+			have_hot = true;
+		}
+	}
+
+	if (!have_hot || hot_load < REBALANCE_MIN_PPS)
+		goto balanced;
+
+	best_peak = hot_load;
+	for (i = 0; i < lcore_conf[hot]->high_rxq; i++) {
+		const struct lcore_rx_queue *rxq = &lcore_conf[hot]->rx_poll[i];
+		uint64_t rate = lcore_conf[hot]->rx_poll_stats[i].packet_rate;
+		const struct port_alloc *port_alloc;
+		bitmask_t allowed;
+
+		if (rxq->portid == NO_OWNER || rate == 0)
+			continue;
+
+		port_alloc = &port_allocations[rxq->portid];
+		allowed = cpu_affinity_online(&port_alloc->rx_cpu_affinity);
+
+		FOREACH_FORWARD_LCORE(lcore) {
+			uint64_t peak;
+
+			if (lcore == hot || !bitmask_isset(&allowed, lcore) ||
+			    lcore_conf[lcore]->ded_to_feature)
+				continue;
+
+			if (port_alloc->socketid != SOCKET_ID_ANY &&
+			    (unsigned int)port_alloc->socketid !=
+			    rte_lcore_to_socket_id(lcore))
+				continue;
+
+			if (!rxq_move_improves(hot_load, load[lcore], rate,
+					       &peak))
+				continue;
+
+			if (peak < best_peak) {
+				best_peak = peak;
+				best_idx = i;
+				best_dst = lcore;
+			}
+		}
+	}
+
+	if (best_idx < 0)
+		goto balanced;
+
+	if (++rebalance_persist < REBALANCE_PERSIST)
+		return;
+
+	if (rxq_migrate(hot, best_idx, best_dst) == 0)
+		rebalance_holdoff = REBALANCE_HOLDOFF;
+
+balanced:
+	rebalance_persist = 0;
+}
+
 /* Update packets per second value */
 void load_estimator(void)
 {
@@ -3788,6 +4348,8 @@ void load_estimator(void)
 		packets = crypto_fwd[id].fwd_cnt;
 		scale_rate_stats(&conf->crypt_fwd_stats, &packets, NULL);
 	}
+
+	rxq_rebalance();
 }
 
 /* Display per-core info in JSON
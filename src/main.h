@@ -105,8 +105,18 @@ void device_server_init(void);
 void device_server_destroy(void);
 int eth_port_config(portid_t portid);
 int eth_port_configure(portid_t portid, struct rte_eth_conf *dev_conf);
+void eth_port_rx_intr_init(portid_t portid);
+bool eth_port_rx_intr_enabled(portid_t portid);
+bool eth_port_rx_intr_fallback(portid_t portid);
+bool eth_port_rx_intr_check(portid_t portid);
+bool rxq_move_improves(uint64_t hot_load, uint64_t dst_load,
+		       uint64_t rate, uint64_t *peak);
+int rxq_migrate_queue(portid_t portid, uint8_t queueid, unsigned int dst);
+bool rxq_migrate_pending(void);
+unsigned long lcore_rx_intr_seq(unsigned int lcore);
 unsigned int probe_crypto_engines(bool *sticky);
 int set_crypto_engines(const uint8_t *bytes, uint8_t len, bool *sticky);
+bitmask_t crypto_engine_cores(void);
 int crypto_assign_engine(int crypto_dev_id, int lcore);
 void crypto_unassign_from_engine(int lcore);
 void register_forwarding_cores(void);
@@ -1557,7 +1557,7 @@ mpls_labeled_forward(struct ifnet *input_ifp, bool local,
 {
 	enum mpls_payload_type payload_type;
 	struct mpls_label_cache cache;
-	struct cds_lfht *label_table;
+	struct mpls_label_table *label_table;
 	struct mplshdr *hdr;
 	enum nh_fwd_ret ret;
 	uint32_t in_label;
@@ -28,6 +28,7 @@
 #include <urcu/list.h>
 #include <urcu/uatomic.h>
 
+#include "compiler.h"
 #include "fal.h"
 #include "json_writer.h"
 #include "main.h"
@@ -68,18 +69,53 @@ struct label_table_node {
  * the underlying infra in case we ever have more.
  */
 int global_label_space_id;
-struct cds_lfht *global_label_table;
+struct mpls_label_table *global_label_table;
 
 /* set of labelspaces, for each labelspaces there is label table */
 static struct cds_list_head label_table_set;
 
 static struct rte_mempool *mpls_oam_pool;
 
-struct label_table_set_entry {
+/*
+ * Dense index of a label table for the forwarding path, so that a
+ * label lookup is a direct array load rather than a hash lookup.  The
+ * label range is split into leaves which are only allocated once a
+ * label within them is in use, so a sparse label space stays small.
+ * The hash table remains the control plane's view of the table.
+ */
+#define LABEL_INDEX_LEAF_BITS	10
+#define LABEL_INDEX_LEAF_SIZE	(1 << LABEL_INDEX_LEAF_BITS)
+#define LABEL_INDEX_LEAF_MASK	(LABEL_INDEX_LEAF_SIZE - 1)
+
+union label_index_entry {
+	struct {
+		uint32_t next_hop; /* idx of output info */
+		uint8_t nh_type;
+		uint8_t payload_type;
+		uint8_t valid;
+		uint8_t padding;
+	};
+	uint64_t u64; /* entries are read and written as a whole */
+};
+
+struct label_index_leaf {
+	union label_index_entry entry[LABEL_INDEX_LEAF_SIZE];
+	uint32_t used; /* valid entries, only touched by the master thread */
+	struct rcu_head rcu_head;
+};
+
+struct label_index {
+	uint32_t nleaves;
+	struct rcu_head rcu_head;
+	struct label_index_leaf *leaf[];
+};
+
+struct mpls_label_table {
 	struct cds_list_head entry;
 	int labelspace; /* labelspace indentificator  */
 	int refcount;
 	struct cds_lfht *label_table;
+	struct label_index *label_index;
 	struct rcu_head rcu_head;
 };
 
@@ -164,11 +200,189 @@ static void free_label_table_node(struct label_table_node *label_table_entry)
 		 free_label_table_node_rcu);
 }
 
+static void
+label_index_free_rcu(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct label_index, rcu_head));
+}
+
+static void
+label_index_leaf_free_rcu(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct label_index_leaf, rcu_head));
+}
+
+static void
+label_index_destroy(struct label_index *index)
+{
+	uint32_t i;
+
+	if (!index)
+		return;
+
+	for (i = 0; i < index->nleaves; i++)
+		free(index->leaf[i]);
+	free(index);
+}
+
+/*
+ * Replace the index with one covering all labels below max_label.
+ * Leaves that are still in range are shared with the new index.
+ */
+static int
+mpls_label_index_resize(struct mpls_label_table *ls_entry, uint32_t max_label)
+{
+	struct label_index *old = ls_entry->label_index;
+	struct label_index *index;
+	uint32_t nleaves;
+	uint32_t i;
+
+	if (max_label > MPLS_LABEL_ALL)
+		max_label = MPLS_LABEL_ALL;
+	nleaves = (max_label + LABEL_INDEX_LEAF_MASK) >> LABEL_INDEX_LEAF_BITS;
+
+	index = zmalloc_aligned(sizeof(*index) +
+				nleaves * sizeof(index->leaf[0]));
+	if (!index)
+		return -ENOMEM;
+
+	index->nleaves = nleaves;
+	for (i = 0; old && i < old->nleaves && i < nleaves; i++)
+		index->leaf[i] = old->leaf[i];
+
+	rcu_assign_pointer(ls_entry->label_index, index);
+
+	if (!old)
+		return 0;
+
+	for (i = nleaves; i < old->nleaves; i++)
+		if (old->leaf[i])
+			call_rcu(&old->leaf[i]->rcu_head,
+				 label_index_leaf_free_rcu);
+	call_rcu(&old->rcu_head, label_index_free_rcu);
+	return 0;
+}
+
+/*
+ * Make sure there is an index slot for the label, so that setting it
+ * after the label has been added to the hash table can't fail.
+ */
+static int
+mpls_label_index_reserve(struct mpls_label_table *ls_entry, uint32_t in_label)
+{
+	struct label_index *index = ls_entry->label_index;
+	uint32_t l1 = in_label >> LABEL_INDEX_LEAF_BITS;
+	struct label_index_leaf *leaf;
+	int rc;
+
+	if (!index || l1 >= index->nleaves) {
+		rc = mpls_label_index_resize(ls_entry, in_label + 1);
+		if (rc < 0)
+			return rc;
+		index = ls_entry->label_index;
+	}
+
+	if (index->leaf[l1])
+		return 0;
+
+	leaf = zmalloc_aligned(sizeof(*leaf));
+	if (!leaf)
+		return -ENOMEM;
+
+	rcu_assign_pointer(index->leaf[l1], leaf);
+	return 0;
+}
+
+/*
+ * Set or clear the index entry for a label.  A leaf is freed once the
+ * last label in it is cleared.
+ */
+static void
+mpls_label_index_set(struct mpls_label_table *ls_entry, uint32_t in_label,
+		     const struct label_table_node *node)
+{
+	struct label_index *index = ls_entry->label_index;
+	uint32_t l1 = in_label >> LABEL_INDEX_LEAF_BITS;
+	union label_index_entry entry = { .u64 = 0 };
+	union label_index_entry *slot;
+	struct label_index_leaf *leaf;
+	bool was_valid;
+
+	if (!index || l1 >= index->nleaves)
+		return;
+
+	leaf = index->leaf[l1];
+	if (!leaf)
+		return;
+
+	if (node) {
+		entry.next_hop = node->next_hop;
+		entry.nh_type = node->nh_type;
+		entry.payload_type = node->payload_type;
+		entry.valid = 1;
+	}
+	slot = &leaf->entry[in_label & LABEL_INDEX_LEAF_MASK];
+	was_valid = slot->valid;
+	CMM_STORE_SHARED(slot->u64, entry.u64);
+
+	if (node) {
+		if (!was_valid)
+			leaf->used++;
+		return;
+	}
+
+	if (!was_valid || --leaf->used)
+		return;
+
+	rcu_assign_pointer(index->leaf[l1], NULL);
+	call_rcu(&leaf->rcu_head, label_index_leaf_free_rcu);
+}
+
+/*
+ * Read the index entry for a label, returning an invalid entry if
+ * there is none.
+ */
+static ALWAYS_INLINE union label_index_entry
+mpls_label_index_get(const struct mpls_label_table *ls_entry,
+		     uint32_t in_label)
+{
+	uint32_t l1 = in_label >> LABEL_INDEX_LEAF_BITS;
+	union label_index_entry entry = { .u64 = 0 };
+	const struct label_index_leaf *leaf;
+	const struct label_index *index;
+
+	index = rcu_dereference(ls_entry->label_index);
+	if (unlikely(!index || l1 >= index->nleaves))
+		return entry;
+
+	leaf = rcu_dereference(index->leaf[l1]);
+	if (unlikely(!leaf))
+		return entry;
+
+	entry.u64 = CMM_LOAD_SHARED(
+		leaf->entry[in_label & LABEL_INDEX_LEAF_MASK].u64);
+	return entry;
+}
+
+/* Count the leaves allocated in the index */
+static uint32_t
+mpls_label_index_leaves(const struct mpls_label_table *ls_entry)
+{
+	const struct label_index *index;
+	uint32_t i, leaves = 0;
+
+	index = rcu_dereference(ls_entry->label_index);
+	for (i = 0; index && i < index->nleaves; i++)
+		if (rcu_dereference(index->leaf[i]))
+			leaves++;
+	return leaves;
+}
+
 static void
 free_label_table_set_entry_rcu(struct rcu_head *head)
 {
-	struct label_table_set_entry *ls_entry =
-		caa_container_of(head, struct label_table_set_entry, rcu_head);
+	struct mpls_label_table *ls_entry =
+		caa_container_of(head, struct mpls_label_table, rcu_head);
 
 	/*
 	 * Every label table entry added should have resulted in the
@@ -180,6 +394,7 @@ free_label_table_set_entry_rcu(struct rcu_head *head)
 	assert(!mpls_label_table_count(ls_entry->label_table));
 
 	dp_ht_destroy_deferred(ls_entry->label_table);
+	label_index_destroy(ls_entry->label_index);
 	free(ls_entry);
 }
 
@@ -260,7 +475,7 @@ mpls_label_table_fal_create_or_upd(struct label_table_node *label_table_node,
 }
 
 static bool
-mpls_label_table_ins_lbl_internal(struct cds_lfht *label_table,
+mpls_label_table_ins_lbl_internal(struct mpls_label_table *ls_entry,
 				  uint32_t in_label, enum nh_type nh_type,
 				  enum mpls_payload_type payload_type,
 				  struct next_hop *hops,
@@ -268,12 +483,13 @@ mpls_label_table_ins_lbl_internal(struct cds_lfht *label_table,
 {
 	struct label_table_node *old_label_table_node;
 	struct label_table_node *label_table_node;
+	struct cds_lfht *label_table;
 	struct cds_lfht_node *node;
 	bool added_new = false;
 	uint32_t nextu_idx;
 	int rc;
 
-	if (!label_table) {
+	if (!ls_entry) {
 		RTE_LOG(ERR, MPLS,
 			"There is no label table for this insertion\n");
 		return false;
@@ -302,6 +518,15 @@ mpls_label_table_ins_lbl_internal(struct cds_lfht *label_table,
 		return false;
 	}
 
+	rc = mpls_label_index_reserve(ls_entry, in_label);
+	if (rc < 0) {
+		RTE_LOG(ERR, MPLS,
+			"Failed to create label index for label %u: %s\n",
+			in_label, strerror(-rc));
+		free(label_table_node);
+		return false;
+	}
+
 	rc = nexthop_new(nh_type == NH_TYPE_V4GW ? AF_INET : AF_INET6,
 			 hops, size, RTPROT_UNSPEC,
 			 FAL_NHG_USE_MPLS_LABEL_SWITCH,
@@ -321,6 +546,7 @@ mpls_label_table_ins_lbl_internal(struct cds_lfht *label_table,
 	label_table_node->payload_type = (uint8_t)payload_type;
 	label_table_node->pd_created = false;
 
+	label_table = ls_entry->label_table;
 	dp_rcu_read_lock();
 	node = cds_lfht_add_replace(label_table,
 				    mpls_label_table_node_hash(
@@ -341,6 +567,7 @@ mpls_label_table_ins_lbl_internal(struct cds_lfht *label_table,
 	} else {
 		added_new = true;
 	}
+	mpls_label_index_set(ls_entry, in_label, label_table_node);
 
 	mpls_label_table_fal_create_or_upd(label_table_node, added_new);
 
@@ -352,12 +579,13 @@ mpls_label_table_ins_lbl_internal(struct cds_lfht *label_table,
 }
 
 static int
-mpls_label_table_rem_lbl_internal(struct cds_lfht *label_table,
+mpls_label_table_rem_lbl_internal(struct mpls_label_table *ls_entry,
 				  uint32_t in_label)
 {
 	struct fal_mpls_route_t fal_mpls_route = {
 		.label = in_label,
 	};
+	struct cds_lfht *label_table = ls_entry->label_table;
 	struct label_table_node *out, in;
 	struct cds_lfht_iter iter;
 	struct cds_lfht_node *node;
@@ -383,8 +611,10 @@ mpls_label_table_rem_lbl_internal(struct cds_lfht *label_table,
 			}
 		}
 
-		if (!cds_lfht_del(label_table, &out->node))
+		if (!cds_lfht_del(label_table, &out->node)) {
+			mpls_label_index_set(ls_entry, in_label, NULL);
 			free_label_table_node(out);
+		}
 
 		rc = 0;
 	} else {
@@ -401,7 +631,7 @@ mpls_label_table_rem_lbl_internal(struct cds_lfht *label_table,
  * Delete entries for the various mpls reserved label values.
  */
 static void
-mpls_label_table_del_reserved_labels(struct cds_lfht *table)
+mpls_label_table_del_reserved_labels(struct mpls_label_table *table)
 {
 	mpls_label_table_rem_lbl_internal(table, MPLS_IPV4EXPLICITNULL);
 	mpls_label_table_rem_lbl_internal(table, MPLS_IPV6EXPLICITNULL);
@@ -412,7 +642,7 @@ mpls_label_table_del_reserved_labels(struct cds_lfht *table)
  * Add entries for the various mpls reserved label values.
  */
 static bool
-mpls_label_table_add_reserved_labels(struct cds_lfht *table)
+mpls_label_table_add_reserved_labels(struct mpls_label_table *table)
 {
 	struct next_hop *nhop;
 	struct ip_addr addr_any = {
@@ -454,10 +684,10 @@ error:
 	return false;
 }
 
-static struct label_table_set_entry *
+static struct mpls_label_table *
 mpls_label_space_entry_get(int labelspace)
 {
-	struct label_table_set_entry *ls_entry;
+	struct mpls_label_table *ls_entry;
 
 	cds_list_for_each_entry_rcu(ls_entry, &label_table_set, entry) {
 		if (ls_entry->labelspace == labelspace)
@@ -470,7 +700,7 @@ mpls_label_space_entry_get(int labelspace)
 static struct cds_lfht *
 mpls_label_table_get_rcu(int labelspace)
 {
-	struct label_table_set_entry *ls_entry;
+	struct mpls_label_table *ls_entry;
 
 	ls_entry = mpls_label_space_entry_get(labelspace);
 	if (ls_entry) {
@@ -495,11 +725,11 @@ mpls_label_table_get_rcu(int labelspace)
  * pointer or by any references held by RCU readers such as the
  * forwarding path.
  */
-struct cds_lfht *
+struct mpls_label_table *
 mpls_label_table_get_and_lock(int labelspace)
 {
 	static bool first_time_alloc = true;
-	struct label_table_set_entry *ls_entry;
+	struct mpls_label_table *ls_entry;
 
 	if (first_time_alloc) {
 		if (!mpls_oam_pool_init()) {
@@ -515,11 +745,11 @@ mpls_label_table_get_and_lock(int labelspace)
 			 "label table found for labelspace %d\n",
 			labelspace);
 		ls_entry->refcount++;
-		return ls_entry->label_table;
+		return ls_entry;
 	}
 
 	DP_DEBUG(MPLS_CTRL, DEBUG, MPLS, "label table not found\n");
-	ls_entry = malloc(sizeof(*ls_entry));
+	ls_entry = zmalloc_aligned(sizeof(*ls_entry));
 	if (!ls_entry) {
 		RTE_LOG(ERR, MPLS,
 			"Failed to create label table set entry for labelspace %d\n",
@@ -539,7 +769,7 @@ mpls_label_table_get_and_lock(int labelspace)
 		return NULL;
 	}
 	ls_entry->refcount = 1;
-	if (!mpls_label_table_add_reserved_labels(ls_entry->label_table)) {
+	if (!mpls_label_table_add_reserved_labels(ls_entry)) {
 		free_label_table_set_entry_rcu(&ls_entry->rcu_head);
 		return NULL;
 	}
@@ -553,11 +783,10 @@ mpls_label_table_get_and_lock(int labelspace)
 	if (labelspace == global_label_space_id) {
 		assert(!global_label_table);
 		dp_rcu_read_lock();
-		rcu_assign_pointer(global_label_table,
-				   ls_entry->label_table);
+		rcu_assign_pointer(global_label_table, ls_entry);
 		dp_rcu_read_unlock();
 	}
-	return ls_entry->label_table;
+	return ls_entry;
 }
 
 /*
@@ -575,7 +804,7 @@ mpls_label_table_get_and_lock(int labelspace)
  * before doing the delete.
  */
 static void
-mpls_label_table_unlock_internal(struct label_table_set_entry *ls_entry)
+mpls_label_table_unlock_internal(struct mpls_label_table *ls_entry)
 {
 	DP_DEBUG(MPLS_CTRL, DEBUG, MPLS,
 		 "unlocking label table for labelspace %d\n",
@@ -596,7 +825,7 @@ mpls_label_table_unlock_internal(struct label_table_set_entry *ls_entry)
 		DP_DEBUG(MPLS_CTRL, DEBUG, MPLS,
 			 "label table for labelspace %d is being deleted\n",
 			 ls_entry->labelspace);
-		mpls_label_table_del_reserved_labels(ls_entry->label_table);
+		mpls_label_table_del_reserved_labels(ls_entry);
 		cds_list_del_rcu(&ls_entry->entry);
 
 		call_rcu(&ls_entry->rcu_head, free_label_table_set_entry_rcu);
@@ -605,7 +834,7 @@ mpls_label_table_unlock_internal(struct label_table_set_entry *ls_entry)
 
 void mpls_label_table_unlock(int labelspace)
 {
-	struct label_table_set_entry *ls_entry;
+	struct mpls_label_table *ls_entry;
 
 	ls_entry = mpls_label_space_entry_get(labelspace);
 	if (!ls_entry)
@@ -620,14 +849,14 @@ void mpls_label_table_insert_label(int labelspace, uint32_t in_label,
 			     struct next_hop *hops,
 			     size_t size)
 {
-	struct cds_lfht *label_table =
+	struct mpls_label_table *ls_entry =
 		mpls_label_table_get_and_lock(labelspace);
 
 	/*
 	 * if we inserted a new entry then keep lock on table for
 	 * it - otherwise release the refcount we took above.
 	 */
-	if (!mpls_label_table_ins_lbl_internal(label_table, in_label,
+	if (!mpls_label_table_ins_lbl_internal(ls_entry, in_label,
 					       nh_type, payload_type,
 					       hops, size))
 		mpls_label_table_unlock(labelspace);
@@ -662,34 +891,35 @@ static inline int nh_type_to_address_family(enum nh_type type)
 }
 
 struct next_hop *
-mpls_label_table_lookup(struct cds_lfht *label_table, uint32_t in_label,
-			const struct rte_mbuf *m, uint16_t ether_type,
-			enum nh_type *nht,
+mpls_label_table_lookup(const struct mpls_label_table *label_table,
+			uint32_t in_label, const struct rte_mbuf *m,
+			uint16_t ether_type, enum nh_type *nht,
 			enum mpls_payload_type *payload_type)
 {
-	struct label_table_node *out;
-	struct next_hop *nh = NULL;
+	union label_index_entry entry;
 
-	out = mpls_label_table_lookup_internal(label_table, in_label);
-	if (likely(out != NULL)) {
-		*nht = out->nh_type;
-		*payload_type = out->payload_type;
-		nh = nexthop_select(nh_type_to_address_family(*nht),
-				    out->next_hop, m, ether_type);
-		return nh;
-	}
-	return nh;
+	if (unlikely(!label_table))
+		return NULL;
+
+	entry = mpls_label_index_get(label_table, in_label);
+	if (unlikely(!entry.valid))
+		return NULL;
+
+	*nht = entry.nh_type;
+	*payload_type = entry.payload_type;
+	return nexthop_select(nh_type_to_address_family(*nht),
+			      entry.next_hop, m, ether_type);
 }
 
 void mpls_label_table_remove_label(int labelspace, uint32_t in_label)
 {
-	struct label_table_set_entry *ls_entry;
+	struct mpls_label_table *ls_entry;
 
 	ls_entry = mpls_label_space_entry_get(labelspace);
 	if (!ls_entry)
 		return;
 
-	if (!mpls_label_table_rem_lbl_internal(ls_entry->label_table, in_label))
+	if (!mpls_label_table_rem_lbl_internal(ls_entry, in_label))
 		/*
 		 * Deleted an entry so lose its lock on the table
 		 */
@@ -699,7 +929,7 @@ void mpls_label_table_remove_label(int labelspace, uint32_t in_label)
 void mpls_label_table_resize(int labelspace, uint32_t max_label)
 {
 	struct label_table_node *label_table_entry;
-	struct label_table_set_entry *ls_entry;
+	struct mpls_label_table *ls_entry;
 	struct cds_lfht_iter iter;
 
 	DP_DEBUG(MPLS_CTRL, INFO, MPLS, "mpls label table resize to %u\n",
@@ -721,20 +951,34 @@ void mpls_label_table_resize(int labelspace, uint32_t max_label)
 			DP_DEBUG(MPLS_CTRL, DEBUG, MPLS,
 				 "purging label %u due to resize\n",
 				 label_table_entry->in_label);
+			mpls_label_index_set(ls_entry,
+					     label_table_entry->in_label, NULL);
 			free_label_table_node(label_table_entry);
 			/* release lock on table for presence of route */
 			mpls_label_table_unlock_internal(ls_entry);
 		}
 	}
 
+	/*
+	 * The table may have been released by the purge above, in
+	 * which case the index goes with it.
+	 */
+	if (mpls_label_space_entry_get(labelspace) == ls_entry &&
+	    mpls_label_index_resize(ls_entry, max_label) < 0)
+		RTE_LOG(ERR, MPLS,
+			"Failed to resize label index to %u\n", max_label);
+
 	dp_rcu_read_unlock();
 }
 
 static void
-mpls_label_table_dump(struct cds_lfht *label_table, json_writer_t *json,
+mpls_label_table_dump(const struct mpls_label_table *ls_entry,
+		      json_writer_t *json,
 		      enum pd_obj_state pd_state, uint32_t label_filter)
 {
+	struct cds_lfht *label_table = ls_entry->label_table;
 	struct label_table_node *label_table_entry;
+	union label_index_entry entry;
 	enum rt_print_nexthop_verbosity nh_v =
 		label_filter == MPLS_LABEL_ALL ? RT_PRINT_NH_BRIEF :
 		RT_PRINT_NH_DETAIL;
@@ -772,6 +1016,21 @@ mpls_label_table_dump(struct cds_lfht *label_table, json_writer_t *json,
 		jsonw_uint_field(json, "nexthop_type",
 				 label_table_entry->nh_type);
 
+		/* What the forwarding path sees for a single label */
+		if (label_filter != MPLS_LABEL_ALL) {
+			entry = mpls_label_index_get(
+				ls_entry, label_table_entry->in_label);
+			jsonw_name(json, "index");
+			jsonw_start_object(json);
+			jsonw_bool_field(json, "valid", entry.valid);
+			jsonw_bool_field(json, "nexthop_match",
+					 entry.next_hop ==
+					 label_table_entry->next_hop);
+			jsonw_uint_field(json, "payload", entry.payload_type);
+			jsonw_uint_field(json, "nexthop_type", entry.nh_type);
+			jsonw_end_object(json);
+		}
+
 		jsonw_end_object(json);
 	}
 	dp_rcu_read_unlock();
@@ -781,7 +1040,7 @@ mpls_label_table_dump(struct cds_lfht *label_table, json_writer_t *json,
 void
 mpls_label_table_set_dump(FILE *fp, int labelspace, uint32_t label_filter)
 {
-	struct label_table_set_entry *ls_entry;
+	struct mpls_label_table *ls_entry;
 	json_writer_t *json = jsonw_new(fp);
 
 	jsonw_name(json, "mpls_tables");
@@ -792,7 +1051,9 @@ mpls_label_table_set_dump(FILE *fp, int labelspace, uint32_t label_filter)
 
 		jsonw_start_object(json);
 		jsonw_uint_field(json, "lblspc", ls_entry->labelspace);
-		mpls_label_table_dump(ls_entry->label_table, json,
+		jsonw_uint_field(json, "index_leaves",
+				 mpls_label_index_leaves(ls_entry));
+		mpls_label_table_dump(ls_entry, json,
 				      PD_OBJ_STATE_LAST, label_filter);
 		jsonw_end_object(json);
 	}
@@ -803,12 +1064,12 @@ mpls_label_table_set_dump(FILE *fp, int labelspace, uint32_t label_filter)
 int mpls_label_table_get_pd_subset_data(json_writer_t *json,
 					enum pd_obj_state subset)
 {
-	struct label_table_set_entry *ls_entry;
+	struct mpls_label_table *ls_entry;
 
 	cds_list_for_each_entry_rcu(ls_entry, &label_table_set, entry) {
 		jsonw_start_object(json);
 		jsonw_uint_field(json, "lblspc", ls_entry->labelspace);
-		mpls_label_table_dump(ls_entry->label_table, json,
+		mpls_label_table_dump(ls_entry, json,
 				      subset, MPLS_LABEL_ALL);
 		jsonw_end_object(json);
 	}
@@ -984,7 +1245,7 @@ void
 mpls_update_all_routes_for_nh_change(int family, uint32_t nhl_idx)
 {
 	struct label_table_node *label_table_entry;
-	struct label_table_set_entry *ls_entry;
+	struct mpls_label_table *ls_entry;
 	struct cds_lfht_iter iter;
 
 	cds_list_for_each_entry_rcu(ls_entry, &label_table_set, entry) {
@@ -26,7 +26,7 @@
 
 #define MPLS_LABEL_ALL (1 << 20)
 
-struct cds_lfht;
+struct mpls_label_table;
 struct rte_mbuf;
 
 #define MPLS_OAM_MAX_FANOUT     (16)
@@ -39,12 +39,12 @@ struct mpls_oam_outinfo {
 };
 
 extern int global_label_space_id;
-extern struct cds_lfht *global_label_table;
+extern struct mpls_label_table *global_label_table;
 
 void mpls_init(void);
 void mpls_netlink_init(void);
 
-struct cds_lfht *mpls_label_table_get_and_lock(int labelspace);
+struct mpls_label_table *mpls_label_table_get_and_lock(int labelspace);
 void mpls_label_table_unlock(int labelspace);
 void mpls_label_table_insert_label(int labelspace, uint32_t in_label,
 				   enum nh_type nh_type,
@@ -54,9 +54,9 @@ void mpls_label_table_insert_label(int labelspace, uint32_t in_label,
 void mpls_label_table_remove_label(int labelspace, uint32_t in_label);
 
 struct next_hop *
-mpls_label_table_lookup(struct cds_lfht *label_table, uint32_t in_label,
-			const struct rte_mbuf *m, uint16_t ether_type,
-			enum nh_type *nht,
+mpls_label_table_lookup(const struct mpls_label_table *label_table,
+			uint32_t in_label, const struct rte_mbuf *m,
+			uint16_t ether_type, enum nh_type *nht,
 			enum mpls_payload_type *payload_type)
 	__hot_func;
 
@@ -266,9 +266,27 @@ static int mfc_match(struct cds_lfht_node *node, const void *_key)
 static void mfc_free(struct rcu_head *head)
 {
 	struct mfc *rt = caa_container_of(head, struct mfc, rcu_head);
+
+	free(rt->mfc_olist);
+	free(rt->mfc_stats);
 	free(rt);
 }
 
+static struct mfc *mfc_alloc(void)
+{
+	struct mfc *rt = calloc(1, sizeof(*rt));
+
+	if (!rt)
+		return NULL;
+
+	rt->mfc_stats = mcast_lcore_stats_alloc();
+	if (!rt->mfc_stats) {
+		free(rt);
+		return NULL;
+	}
+	return rt;
+}
+
 static int vif_match(struct cds_lfht_node *node, const void *_key)
 {
 	struct vif *vifp = caa_container_of(node, struct vif, node);
@@ -279,9 +297,68 @@ static int vif_match(struct cds_lfht_node *node, const void *_key)
 static void vif_free(struct rcu_head *head)
 {
 	struct vif *vifp = caa_container_of(head, struct vif, rcu_head);
+
+	free(vifp->v_stats_in);
 	free(vifp);
 }
 
+static void mfc_olist_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct mfc_olist, rcu_head));
+}
+
+/*
+ * Rebuild the list of vifs an mfc entry forwards on from its ifset
+ * and the vif table. If the list can't be allocated the entry is left
+ * without one and its packets are punted.
+ */
+static void mfc_olist_update(struct mcast_vrf *mvrf, struct mfc *rt)
+{
+	struct mfc_olist *olist, *old;
+	struct cds_lfht_iter iter;
+	struct vif *vifp;
+	unsigned int count = 0;
+
+	cds_lfht_for_each_entry(mvrf->viftable, &iter, vifp, node) {
+		if (vifp->v_ifp && IF_ISSET(vifp->v_vif_index, &rt->mfc_ifset))
+			count++;
+	}
+
+	olist = malloc(sizeof(*olist) + count * sizeof(olist->vifs[0]));
+	if (olist) {
+		olist->count = 0;
+		cds_lfht_for_each_entry(mvrf->viftable, &iter, vifp, node) {
+			if (olist->count == count)
+				break;
+			if (vifp->v_ifp &&
+			    IF_ISSET(vifp->v_vif_index, &rt->mfc_ifset))
+				olist->vifs[olist->count++] = vifp;
+		}
+	} else {
+		RTE_LOG(ERR, MCAST, "Failed to allocate MFC olist\n");
+	}
+
+	old = rcu_xchg_pointer(&rt->mfc_olist, olist);
+	if (old)
+		call_rcu(&old->rcu_head, mfc_olist_free);
+}
+
+/*
+ * The olists hold vif pointers, so they must be rebuilt after a vif is
+ * added to or removed from the table and before the old vif is freed.
+ */
+static void mfc_olist_update_all(struct mcast_vrf *mvrf)
+{
+	struct cds_lfht_iter iter;
+	struct mfc *rt;
+
+	if (!mvrf->mfchashtbl)
+		return;
+
+	cds_lfht_for_each_entry(mvrf->mfchashtbl, &iter, rt, node)
+		mfc_olist_update(mvrf, rt);
+}
+
 /*
  * Find a route for a given origin IP address and multicast group address.
  * Statistics must be updated by the caller.
@@ -430,6 +507,13 @@ int add_vif(int ifindex)
 		 vif_index, ifindex);
 
 	vifp = calloc(1, sizeof(struct vif));
+	if (vifp) {
+		vifp->v_stats_in = mcast_lcore_stats_alloc();
+		if (!vifp->v_stats_in) {
+			free(vifp);
+			vifp = NULL;
+		}
+	}
 	if (!vifp) {
 		IF_CLR(vif_index, &vrf->v_mvrf4.mfc_ifset);
 		return -ENOMEM;
@@ -447,6 +531,7 @@ int add_vif(int ifindex)
 	cds_lfht_node_init(&vifp->node);
 	retnode = cds_lfht_add_replace(viftable, vifp->v_if_index,
 			vif_match, &vifp->v_if_index, &vifp->node);
+	mfc_olist_update_all(&vrf->v_mvrf4);
 	if (retnode) {
 		vifp = caa_container_of(retnode, struct vif, node);
 		IF_CLR(vifp->v_vif_index, &vrf->v_mvrf4.mfc_ifset);
@@ -492,6 +577,7 @@ int del_vif(vifi_t vifi)
 
 	IF_CLR(vifp->v_vif_index, &vrf->v_mvrf4.mfc_ifset);
 	if (!cds_lfht_del(vrf->v_mvrf4.viftable, &vifp->node)) {
+		mfc_olist_update_all(&vrf->v_mvrf4);
 		ip_mcast_fal_int_disable(vifp, vrf->v_mvrf4.viftable);
 		call_rcu(&vifp->rcu_head, vif_free);
 	}
@@ -611,13 +697,14 @@ static void update_mfc_params(vrfid_t vrf_id, struct mfc *rt,
 			  &rt->mfc_mcastgrp,
 			  "Cannot forward on this mroute in data plane; punting all packets.");
 	}
+
+	mfc_olist_update(&vrf->v_mvrf4, rt);
 }
 
 static inline void init_mfc_counters(struct mfc *rt)
 {
 	/* initialize pkt counters per src-grp */
-	rt->mfc_pkt_cnt       = 0;
-	rt->mfc_byte_cnt      = 0;
+	mcast_lcore_stats_clear(rt->mfc_stats);
 	rt->mfc_wrong_if      = 0;
 	rt->mfc_ctrl_pkts     = 0;
 	rt->mfc_expire        = 0;
@@ -780,7 +867,7 @@ int add_mfc(vrfid_t vrf_id, struct vmfcctl *mfccp)
 	}
 
 	/* It is possible that an entry is being inserted without an upcall */
-	rt = calloc(1, sizeof(*rt));
+	rt = mfc_alloc();
 	if (!rt) {
 		/* decrement ref cnt when first mfc insertion is failed */
 		if (!mvrf_mfc_size(&vrf->v_mvrf4))
@@ -977,7 +1064,7 @@ static int ip_mforward(vrfid_t vrf_id, struct mcast_vrf *mvrf,
 			return -EINVAL;
 
 		/* no upcall, so make a new entry */
-		rt = calloc(1, sizeof(*rt));
+		rt = mfc_alloc();
 		if (!rt)
 			return -ENOMEM;
 
@@ -1149,8 +1236,9 @@ static int ip_mdq(struct mcast_vrf *mvrf, struct rte_mbuf *m, struct ip *ip,
 {
 	struct vif *vifp;
 	int plen = ntohs(ip->ip_len);
-	struct cds_lfht_iter iter;
+	struct mfc_olist *olist;
 	struct rte_mbuf *md, *mh;
+	unsigned int i;
 
 	/* Don't forward if it didn't arrive on parent vif for its origin. */
 	vifp = get_vif_by_ifindex(rt->mfc_parent);
@@ -1177,10 +1265,14 @@ static int ip_mdq(struct mcast_vrf *mvrf, struct rte_mbuf *m, struct ip *ip,
 		return RTF_SLOWPATH;
 	}
 
-	vifp->v_pkt_in++;
-	vifp->v_bytes_in += plen;
-	rt->mfc_pkt_cnt++;
-	rt->mfc_byte_cnt += plen;
+	olist = rcu_dereference(rt->mfc_olist);
+	if (unlikely(!olist)) {
+		rt->mfc_ctrl_pkts++;
+		return RTF_SLOWPATH;
+	}
+
+	mcast_lcore_stats_inc(vifp->v_stats_in, plen);
+	mcast_lcore_stats_inc(rt->mfc_stats, plen);
 
 	/* Take a reference to the data portion of the packet (beyond the
 	 * IP header). This allows this to be shared over all replications
@@ -1191,29 +1283,23 @@ static int ip_mdq(struct mcast_vrf *mvrf, struct rte_mbuf *m, struct ip *ip,
 
 	rte_pktmbuf_adj(md, dp_pktmbuf_l2_len(md) + sizeof(struct iphdr));
 
-	/* For each dataplane vif, forward if:
-	 *	- the ifset bit is set for this interface.
-	 *	- there are group members downstream on interface */
-	cds_lfht_for_each_entry(mvrf->viftable, &iter, vifp, node) {
-		if (IF_ISSET(vifp->v_vif_index, &rt->mfc_ifset) &&
-		    ip->ip_ttl > vifp->v_threshold) {
-			struct ifnet *out_ifp = vifp->v_ifp;
-
-			if (!out_ifp)
-				continue;
-			const bool if_up = (out_ifp->if_flags & IFF_UP);
-			if (!if_up)
-				continue;
+	/* For each dataplane vif in the olist, forward if:
+	 *	- the ttl is above the vif threshold.
+	 *	- the interface is up */
+	for (i = 0; i < olist->count; i++) {
+		vifp = olist->vifs[i];
+		if (ip->ip_ttl <= vifp->v_threshold)
+			continue;
+		if (!(vifp->v_ifp->if_flags & IFF_UP))
+			continue;
 
-			mh = mcast_create_l2l3_header(m, md,
-						      sizeof(struct iphdr));
-			if (mh) {
-				/* send the newly created packet chain */
-				vif_send(in_ifp, vifp, mh, plen);
-			} else {
-				rte_pktmbuf_free(md);
-				return -ENOBUFS;
-			}
+		mh = mcast_create_l2l3_header(m, md, sizeof(struct iphdr));
+		if (mh) {
+			/* send the newly created packet chain */
+			vif_send(in_ifp, vifp, mh, plen);
+		} else {
+			rte_pktmbuf_free(md);
+			return -ENOBUFS;
 		}
 	}
 	/* We still hold a lock on the newly created initial data segment and
@@ -1237,6 +1323,7 @@ static void sg_cnt_update(struct vrf *vrf, struct mfc *rt,
 		FAL_IP_MCAST_GROUP_STAT_IN_OCTETS
 	};
 	uint64_t cntrs[ARRAY_SIZE(cntr_ids)];
+	uint64_t pkts, bytes;
 	int ret;
 
 	ret = fal_ip_mcast_get_stats(rt->mfc_fal_obj, ARRAY_SIZE(cntr_ids),
@@ -1255,8 +1342,9 @@ static void sg_cnt_update(struct vrf *vrf, struct mfc *rt,
 
 	req.src = rt->mfc_origin;
 	req.grp = rt->mfc_mcastgrp;
-	req.pktcnt = rt->mfc_pkt_cnt + rt->mfc_hw_pkt_cnt;
-	req.bytecnt = rt->mfc_byte_cnt + rt->mfc_hw_byte_cnt;
+	mcast_lcore_stats_sum(rt->mfc_stats, &pkts, &bytes);
+	req.pktcnt = pkts + rt->mfc_hw_pkt_cnt;
+	req.bytecnt = bytes + rt->mfc_hw_byte_cnt;
 	req.wrong_if = rt->mfc_wrong_if;
 
 	/*
@@ -1371,6 +1459,7 @@ void mfc_stat(FILE *f, struct vrf *vrf)
 	struct cds_lfht_iter iter;
 	char oa[INET_ADDRSTRLEN];
 	char ga[INET_ADDRSTRLEN];
+	uint64_t pkts, bytes;
 
 	json_writer_t *wr = jsonw_new(f);
 	if (!wr)
@@ -1386,8 +1475,9 @@ void mfc_stat(FILE *f, struct vrf *vrf)
 			inet_ntop(AF_INET, &rt->mfc_origin, oa, sizeof(oa)));
 		jsonw_string_field(wr, "group",
 			inet_ntop(AF_INET, &rt->mfc_mcastgrp, ga, sizeof(ga)));
-		jsonw_uint_field(wr, "packets", rt->mfc_pkt_cnt);
-		jsonw_uint_field(wr, "bytes", rt->mfc_byte_cnt);
+		mcast_lcore_stats_sum(rt->mfc_stats, &pkts, &bytes);
+		jsonw_uint_field(wr, "packets", pkts);
+		jsonw_uint_field(wr, "bytes", bytes);
 		jsonw_uint_field(wr, "hw_packets", rt->mfc_hw_pkt_cnt);
 		jsonw_uint_field(wr, "hw_bytes", rt->mfc_hw_byte_cnt);
 		jsonw_uint_field(wr, "wrong_if", rt->mfc_wrong_if);
@@ -1399,6 +1489,7 @@ void mfc_stat(FILE *f, struct vrf *vrf)
 			rt->mfc_punts_dropped);
 		jsonw_uint_field(wr, "punt", rt->mfc_punt);
 		jsonw_uint_field(wr, "olist_size", rt->mfc_olist_size);
+		mcast_lcore_stats_json(wr, rt->mfc_stats);
 		jsonw_end_object(wr);
 	}
 	jsonw_end_array(wr);
@@ -1436,6 +1527,7 @@ void mvif_dump(FILE *f, __unused struct vrf *vrf)
 {
 	struct cds_lfht_iter iter;
 	struct vif *vifp;
+	uint64_t pkts, bytes;
 
 	json_writer_t *wr = jsonw_new(f);
 	if (!wr)
@@ -1452,12 +1544,14 @@ void mvif_dump(FILE *f, __unused struct vrf *vrf)
 		jsonw_int_field(wr, "if_index",	vifp->v_vif_index);
 		jsonw_int_field(wr, "threshold", vifp->v_threshold);
 		jsonw_int_field(wr, "flags", vifp->v_flags);
-		jsonw_uint_field(wr, "pkt_in", vifp->v_pkt_in);
+		mcast_lcore_stats_sum(vifp->v_stats_in, &pkts, &bytes);
+		jsonw_uint_field(wr, "pkt_in", pkts);
 		jsonw_uint_field(wr, "pkt_out",	vifp->v_pkt_out);
 		jsonw_uint_field(wr, "pkt_out_punt", vifp->v_pkt_out_punt);
-		jsonw_uint_field(wr, "bytes_in", vifp->v_bytes_in);
+		jsonw_uint_field(wr, "bytes_in", bytes);
 		jsonw_uint_field(wr, "bytes_out", vifp->v_bytes_out);
 		jsonw_uint_field(wr, "bytes_out_punt", vifp->v_bytes_out_punt);
+		mcast_lcore_stats_json(wr, vifp->v_stats_in);
 		jsonw_end_object(wr);
 	}
 	jsonw_end_array(wr);
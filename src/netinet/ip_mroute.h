@@ -55,6 +55,8 @@
 
 #include "urcu.h"
 
+struct mcast_lcore_stats;
+
 /*
  * Definitions for IP multicast forwarding.
  *
@@ -136,14 +138,24 @@ struct vif {
 	struct ifnet	*v_ifp;		   /* pointer to interface           */
 	uint32_t	v_if_index;	   /* interface device index	     */
 	unsigned char   v_vif_index;       /* per vrf vif index              */
-	uint64_t	v_pkt_in;	   /* # pkts in on interface         */
+	struct mcast_lcore_stats *v_stats_in; /* per-lcore in counters  */
 	uint64_t	v_pkt_out;	   /* # pkts out on interface        */
 	uint64_t	v_pkt_out_punt;	   /* # pkts punted at output intf   */
-	uint64_t	v_bytes_in;	   /* # bytes in on interface	     */
 	uint64_t	v_bytes_out;	   /* # bytes out on interface       */
 	uint64_t	v_bytes_out_punt;  /* # bytes punted at output intf  */
 };
 
+/*
+ * Outgoing vifs of an mfc entry that have a dataplane interface,
+ * rebuilt whenever the entry or the vif table changes so that the
+ * forwarding path doesn't have to walk the vif table per packet.
+ */
+struct mfc_olist {
+	struct rcu_head	rcu_head;
+	unsigned int	count;
+	struct vif	*vifs[];
+};
+
 struct mfc_key {
 	struct in_addr  mfc_origin;             /* IP origin of mcasts       */
 	struct in_addr  mfc_mcastgrp;           /* multicast group associated*/
@@ -164,8 +176,8 @@ struct mfc {
 	struct if_set	mfc_ifset;		/* set of outgoing IFs   */
 	unsigned char   mfc_olist_size;         /* number of intfs in olist  */
 	struct rte_meter_srtcm meter;		/* punt rate meter           */
-	uint64_t	mfc_pkt_cnt;		/* pkt count for src-grp     */
-	uint64_t	mfc_byte_cnt;		/* byte count for src-grp    */
+	struct mfc_olist *mfc_olist;		/* forwarding vifs (RCU)     */
+	struct mcast_lcore_stats *mfc_stats;	/* per-lcore src-grp counts  */
 	uint64_t	mfc_hw_pkt_cnt;		/* HW pkt count for src-grp  */
 	uint64_t	mfc_hw_byte_cnt;	/* HW byte count for src-grp */
 	uint64_t	mfc_wrong_if;		/* wrong if for src-grp	     */
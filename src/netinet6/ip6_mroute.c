@@ -291,9 +291,27 @@ static int mf6c_match(struct cds_lfht_node *node, const void *_key)
 static void mf6c_free(struct rcu_head *head)
 {
 	struct mf6c *rt = caa_container_of(head, struct mf6c, rcu_head);
+
+	free(rt->mf6c_olist);
+	free(rt->mf6c_stats);
 	free(rt);
 }
 
+static struct mf6c *mf6c_alloc(void)
+{
+	struct mf6c *rt = calloc(1, sizeof(*rt));
+
+	if (!rt)
+		return NULL;
+
+	rt->mf6c_stats = mcast_lcore_stats_alloc();
+	if (!rt->mf6c_stats) {
+		free(rt);
+		return NULL;
+	}
+	return rt;
+}
+
 static int mif6_match(struct cds_lfht_node *node, const void *_key)
 {
 	struct mif6 *mifp = caa_container_of(node, struct mif6, node);
@@ -306,9 +324,68 @@ static void mif6_free(struct rcu_head *head)
 {
 	struct mif6 *mifp = caa_container_of(head, struct mif6, rcu_head);
 
+	free(mifp->m6_stats_in);
 	free(mifp);
 }
 
+static void mf6c_olist_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct mf6c_olist, rcu_head));
+}
+
+/*
+ * Rebuild the list of mifs an mf6c entry forwards on from its ifset
+ * and the mif table. If the list can't be allocated the entry is left
+ * without one and its packets are punted.
+ */
+static void mf6c_olist_update(struct mcast6_vrf *mvrf6, struct mf6c *rt)
+{
+	struct mf6c_olist *olist, *old;
+	struct cds_lfht_iter iter;
+	struct mif6 *mifp;
+	unsigned int count = 0;
+
+	cds_lfht_for_each_entry(mvrf6->mif6table, &iter, mifp, node) {
+		if (mifp->m6_ifp &&
+		    IF_ISSET(mifp->m6_mif_index, &rt->mf6c_ifset))
+			count++;
+	}
+
+	olist = malloc(sizeof(*olist) + count * sizeof(olist->mifs[0]));
+	if (olist) {
+		olist->count = 0;
+		cds_lfht_for_each_entry(mvrf6->mif6table, &iter, mifp, node) {
+			if (olist->count == count)
+				break;
+			if (mifp->m6_ifp &&
+			    IF_ISSET(mifp->m6_mif_index, &rt->mf6c_ifset))
+				olist->mifs[olist->count++] = mifp;
+		}
+	} else {
+		RTE_LOG(ERR, MCAST, "Failed to allocate MF6C olist\n");
+	}
+
+	old = rcu_xchg_pointer(&rt->mf6c_olist, olist);
+	if (old)
+		call_rcu(&old->rcu_head, mf6c_olist_free);
+}
+
+/*
+ * The olists hold mif pointers, so they must be rebuilt after a mif is
+ * added to or removed from the table and before the old mif is freed.
+ */
+static void mf6c_olist_update_all(struct mcast6_vrf *mvrf6)
+{
+	struct cds_lfht_iter iter;
+	struct mf6c *rt;
+
+	if (!mvrf6->mf6ctable)
+		return;
+
+	cds_lfht_for_each_entry(mvrf6->mf6ctable, &iter, rt, node)
+		mf6c_olist_update(mvrf6, rt);
+}
+
 /*
  * Find a route for a given origin IPv6 address and Multicast group address.
  */
@@ -448,6 +525,13 @@ int add_m6if(mifi_t ifindex)
 		 mif6_index, ifindex);
 
 	mifp = calloc(1, sizeof(struct mif6));
+	if (mifp) {
+		mifp->m6_stats_in = mcast_lcore_stats_alloc();
+		if (!mifp->m6_stats_in) {
+			free(mifp);
+			mifp = NULL;
+		}
+	}
 	if (!mifp) {
 		IF_CLR(mif6_index, &vrf->v_mvrf6.mf6c_ifset);
 		return -ENOMEM;
@@ -463,6 +547,7 @@ int add_m6if(mifi_t ifindex)
 	cds_lfht_node_init(&mifp->node);
 	retnode = cds_lfht_add_replace(mif6table, mifp->m6_if_index,
 			mif6_match, &mifp->m6_if_index, &mifp->node);
+	mf6c_olist_update_all(&vrf->v_mvrf6);
 	if (retnode) {
 		mifp = caa_container_of(retnode, struct mif6, node);
 		IF_CLR(mifp->m6_mif_index, &vrf->v_mvrf6.mf6c_ifset);
@@ -601,6 +686,8 @@ static void update_mfc6_params(vrfid_t vrf_id, struct mf6c *rt,
 		mfc6_debug(vrf_id, &rt->mf6c_origin, &rt->mf6c_mcastgrp,
 			   "Cannot forward on this mroute in data plane; punting all packets.");
 	}
+
+	mf6c_olist_update(&vrf->v_mvrf6, rt);
 }
 
 /*
@@ -632,6 +719,7 @@ int del_m6if(mifi_t mifi)
 
 	IF_CLR(mifp->m6_mif_index, &vrf->v_mvrf6.mf6c_ifset);
 	if (!cds_lfht_del(vrf->v_mvrf6.mif6table, &mifp->node)) {
+		mf6c_olist_update_all(&vrf->v_mvrf6);
 		ip6_mcast_fal_int_disable(mifp, vrf->v_mvrf6.mif6table);
 		call_rcu(&mifp->rcu_head, mif6_free);
 	}
@@ -642,8 +730,7 @@ int del_m6if(mifi_t mifi)
 static inline void init_m6fc_counters(struct mf6c *rt)
 {
 	/* initialize pkt counters per src-grp */
-	rt->mf6c_pkt_cnt     = 0;
-	rt->mf6c_byte_cnt    = 0;
+	mcast_lcore_stats_clear(rt->mf6c_stats);
 	rt->mf6c_wrong_if    = 0;
 	rt->mf6c_expire      = 0;
 	rt->mf6c_last_assert = 0;
@@ -773,7 +860,7 @@ int add_m6fc(vrfid_t vrf_id, struct vmf6cctl *mfccp)
 	}
 
 	/* It is possible that an entry is being inserted without an upcall */
-	rt = calloc(1, sizeof(*rt));
+	rt = mf6c_alloc();
 	if (!rt) {
 		/* decrement vrf ref cnt when first mrt add failed */
 		if (!mvrf_m6fc_size(&vrf->v_mvrf6))
@@ -925,7 +1012,7 @@ static int ip6_mforward(vrfid_t vrf_id, struct mcast6_vrf *mvrf6,
 			return -EINVAL;
 
 		/* no upcall, so make a new entry */
-		rt = calloc(1, sizeof(*rt));
+		rt = mf6c_alloc();
 		if (!rt)
 			return -ENOMEM;
 
@@ -1103,8 +1190,9 @@ static int ip6_mdq(struct mcast6_vrf *mvrf6, struct rte_mbuf *m,
 	struct mif6 *mifp;
 	int plen = rte_pktmbuf_pkt_len(m);
 	u_int32_t iszone, idzone;
-	struct cds_lfht_iter iter;
+	struct mf6c_olist *olist;
 	struct rte_mbuf *md, *mh;
+	unsigned int i;
 
 	/* Don't forward if it didn't arrive on parent mif* for its origin.  */
 	mifp = get_mif_by_ifindex(rt->mf6c_parent);
@@ -1151,10 +1239,12 @@ static int ip6_mdq(struct mcast6_vrf *mvrf6, struct rte_mbuf *m,
 	    in6_setscope(&ip6->ip6_dst, in_ifp, &idzone))
 		return RTF_REJECT;
 
-	mifp->m6_pkt_in++;
-	mifp->m6_bytes_in += plen;
-	rt->mf6c_pkt_cnt++;
-	rt->mf6c_byte_cnt += plen;
+	olist = rcu_dereference(rt->mf6c_olist);
+	if (unlikely(!olist))
+		return RTF_SLOWPATH;
+
+	mcast_lcore_stats_inc(mifp->m6_stats_in, plen);
+	mcast_lcore_stats_inc(rt->mf6c_stats, plen);
 
 	/* Take a reference to the data portion of the packet (beyond the
 	 *  IP header). This allows this to be shared over all replications
@@ -1165,27 +1255,20 @@ static int ip6_mdq(struct mcast6_vrf *mvrf6, struct rte_mbuf *m,
 
 	rte_pktmbuf_adj(md, dp_pktmbuf_l2_len(md) + sizeof(struct ip6_hdr));
 
-	/* For each mif, forward a copy of the packet if there are group
-	 * members downstream on the interface. */
-	cds_lfht_for_each_entry(mvrf6->mif6table, &iter, mifp, node) {
-		if (IF_ISSET(mifp->m6_mif_index, &rt->mf6c_ifset)) {
-			struct ifnet *out_ifp = mifp->m6_ifp;
-
-			if (!out_ifp)
-				continue;
-			const bool if_up = (out_ifp->if_flags & IFF_UP);
-			if (!if_up)
-				continue;
-
-			mh = mcast_create_l2l3_header(m, md,
-						      sizeof(struct ip6_hdr));
-			if (mh) {
-				/* send the newly created packet chain */
-				mif6_send(in_ifp, mifp, mh, plen);
-			} else {
-				rte_pktmbuf_free(md);
-				return -ENOBUFS;
-			}
+	/* For each mif in the olist, forward a copy of the packet if the
+	 * interface is up. */
+	for (i = 0; i < olist->count; i++) {
+		mifp = olist->mifs[i];
+		if (!(mifp->m6_ifp->if_flags & IFF_UP))
+			continue;
+
+		mh = mcast_create_l2l3_header(m, md, sizeof(struct ip6_hdr));
+		if (mh) {
+			/* send the newly created packet chain */
+			mif6_send(in_ifp, mifp, mh, plen);
+		} else {
+			rte_pktmbuf_free(md);
+			return -ENOBUFS;
 		}
 	}
 	rte_pktmbuf_free(md);
@@ -1206,6 +1289,7 @@ static void sg6_cnt_update(struct vrf *vrf, struct mf6c *rt,
 		FAL_IP_MCAST_GROUP_STAT_IN_OCTETS
 	};
 	uint64_t cntrs[ARRAY_SIZE(cntr_ids)];
+	uint64_t pkts, bytes;
 	int ret;
 
 	memset(&sr, 0, sizeof(sr));
@@ -1226,8 +1310,9 @@ static void sg6_cnt_update(struct vrf *vrf, struct mf6c *rt,
 
 	sr.src.sin6_addr = rt->mf6c_origin;
 	sr.grp.sin6_addr = rt->mf6c_mcastgrp;
-	sr.pktcnt = rt->mf6c_pkt_cnt + rt->mf6c_hw_pkt_cnt;
-	sr.bytecnt = rt->mf6c_byte_cnt + rt->mf6c_hw_byte_cnt;
+	mcast_lcore_stats_sum(rt->mf6c_stats, &pkts, &bytes);
+	sr.pktcnt = pkts + rt->mf6c_hw_pkt_cnt;
+	sr.bytecnt = bytes + rt->mf6c_hw_byte_cnt;
 	sr.wrong_if = rt->mf6c_wrong_if;
 
 	/*
@@ -1348,6 +1433,7 @@ void mfc6_stat(FILE *f, struct vrf *vrf)
 	struct cds_lfht_iter iter;
 	char oa[INET6_ADDRSTRLEN];
 	char ga[INET6_ADDRSTRLEN];
+	uint64_t pkts, bytes;
 
 	json_writer_t *wr = jsonw_new(f);
 	if (!wr)
@@ -1367,8 +1453,9 @@ void mfc6_stat(FILE *f, struct vrf *vrf)
 
 		jsonw_string_field(wr, "origin", oa);
 		jsonw_string_field(wr, "group", ga);
-		jsonw_uint_field(wr, "packets", rt->mf6c_pkt_cnt);
-		jsonw_uint_field(wr, "bytes", rt->mf6c_byte_cnt);
+		mcast_lcore_stats_sum(rt->mf6c_stats, &pkts, &bytes);
+		jsonw_uint_field(wr, "packets", pkts);
+		jsonw_uint_field(wr, "bytes", bytes);
 		jsonw_uint_field(wr, "hw_packets", rt->mf6c_hw_pkt_cnt);
 		jsonw_uint_field(wr, "hw_bytes", rt->mf6c_hw_byte_cnt);
 		jsonw_uint_field(wr, "wrongif", rt->mf6c_wrong_if);
@@ -1378,6 +1465,7 @@ void mfc6_stat(FILE *f, struct vrf *vrf)
 		jsonw_uint_field(wr, "punts_dropped", rt->mf6c_punts_dropped);
 		jsonw_uint_field(wr, "punt", rt->mf6c_punt);
 		jsonw_uint_field(wr, "olist_size", rt->mf6c_olist_size);
+		mcast_lcore_stats_json(wr, rt->mf6c_stats);
 		jsonw_end_object(wr);
 	}
 	jsonw_end_array(wr);
@@ -1412,6 +1500,7 @@ void mvif6_dump(FILE *f, __unused struct vrf *vrf)
 {
 	struct cds_lfht_iter iter;
 	struct mif6 *mifp;
+	uint64_t pkts, bytes;
 
 	json_writer_t *wr = jsonw_new(f);
 	if (!wr)
@@ -1428,14 +1517,17 @@ void mvif6_dump(FILE *f, __unused struct vrf *vrf)
 					  mifp->m6_ifp->if_name : "non-vplane");
 			jsonw_int_field(wr, "if_index", mifp->m6_mif_index);
 			jsonw_int_field(wr, "flags", mifp->m6_flags);
-			jsonw_uint_field(wr, "pkt_in", mifp->m6_pkt_in);
+			mcast_lcore_stats_sum(mifp->m6_stats_in,
+					      &pkts, &bytes);
+			jsonw_uint_field(wr, "pkt_in", pkts);
 			jsonw_uint_field(wr, "pkt_out",	mifp->m6_pkt_out);
 			jsonw_uint_field(wr, "pkt_out_punt",
 					 mifp->m6_pkt_out_punt);
-			jsonw_uint_field(wr, "bytes_in", mifp->m6_bytes_in);
+			jsonw_uint_field(wr, "bytes_in", bytes);
 			jsonw_uint_field(wr, "bytes_out", mifp->m6_bytes_out);
 			jsonw_uint_field(wr, "bytes_out_punt",
 					 mifp->m6_bytes_out_punt);
+			mcast_lcore_stats_json(wr, mifp->m6_stats_in);
 			jsonw_end_object(wr);
 		}
 	}
@@ -62,6 +62,8 @@
 
 #include "urcu.h"
 
+struct mcast_lcore_stats;
+
 #define MIFI_INVALID		ALL_MIFS
 #define MF6C_INCOMPLETE_PARENT	ALL_MIFS
 
@@ -117,14 +119,23 @@ struct mif6 {
 	struct ifnet	     *m6_ifp;		/* pointer to interface       */
 	unsigned int	     m6_if_index;	/* interface device index     */
 	unsigned char        m6_mif_index;      /* per-vrf mif index */
-	uint64_t	     m6_pkt_in;	        /* # pkts in on interface     */
+	struct mcast_lcore_stats *m6_stats_in;	/* per-lcore in counters */
 	uint64_t	     m6_pkt_out;	/* # pkts out on interface    */
 	uint64_t	     m6_pkt_out_punt;	/* # pkts punted at output    */
-	uint64_t	     m6_bytes_in;	/* # bytes in on interface    */
 	uint64_t	     m6_bytes_out;	/* # bytes out on interface   */
 	uint64_t	     m6_bytes_out_punt;	/* # bytes punted at output   */
 };
 
+/*
+ * Outgoing mifs of an mf6c entry that have a dataplane interface,
+ * rebuilt whenever the entry or the mif table changes.
+ */
+struct mf6c_olist {
+	struct rcu_head	rcu_head;
+	unsigned int	count;
+	struct mif6	*mifs[];
+};
+
 struct mf6c_key {
 	struct in6_addr		mf6c_origin;
 	struct in6_addr	mf6c_mcastgrp;
@@ -145,8 +156,8 @@ struct mf6c {
 	unsigned char           mf6c_olist_size; /* number of intfs in olist  */
 	struct rte_meter_srtcm  meter;		 /* punt rate meter          */
 	int			mf6c_controller; /* forward via controller   */
-	uint64_t		mf6c_pkt_cnt;	 /* pkt count for src-grp    */
-	uint64_t		mf6c_byte_cnt;	 /* byte count for src-grp   */
+	struct mf6c_olist	*mf6c_olist;	 /* forwarding mifs (RCU)    */
+	struct mcast_lcore_stats *mf6c_stats;	 /* per-lcore src-grp counts */
 	uint64_t		mf6c_hw_pkt_cnt; /* HW pkt count for src-grp */
 	uint64_t		mf6c_hw_byte_cnt;/* HW byte count for src-grp */
 	uint64_t		mf6c_wrong_if;	 /* wrong if for src-grp     */
@@ -1175,7 +1175,7 @@ lookup:
 	la = in6_lltable_lookup(ifp, 0, addr);
 	if (likely(la && (la->la_flags & LLE_VALID))) {
 resolved:
-		rte_atomic16_clear(&la->ll_idle);
+		llentry_mark_used(la);
 		rte_ether_addr_copy(&la->ll_addr, desten);
 		return 0;
 	}
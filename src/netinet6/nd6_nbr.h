@@ -103,7 +103,7 @@ nd6_resolve_fast(struct ifnet *in_ifp, struct ifnet *ifp, struct rte_mbuf *m,
 
 	la = in6_lltable_find(ifp, addr);
 	if (likely(la && (la->la_flags & LLE_VALID))) {
-		rte_atomic16_clear(&la->ll_idle);
+		llentry_mark_used(la);
 		rte_ether_addr_copy(&la->ll_addr, desten);
 		return 0;
 	}
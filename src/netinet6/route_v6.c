@@ -93,7 +93,9 @@
 static struct cds_lfht *nexthop6_hash;
 
 /* Nexthop entry table, could be per-namespace */
-static struct nexthop_table nh6_tbl;
+static struct nexthop_table nh6_tbl = {
+	.max_size = NEXTHOP_TBL_MAX_SIZE_V6,
+};
 
 /* Well-known blackhole next_hop_u for failure cases */
 static struct next_hop_list *nextl6_blackhole;
@@ -704,7 +706,7 @@ int dp_nh6_lookup_by_index(uint32_t nhindex, uint32_t hash,
 	struct ifnet *ifp;
 	uint32_t size;
 
-	nextl = rcu_dereference(nh6_tbl.entry[nhindex]);
+	nextl = nexthop_table_get(&nh6_tbl, nhindex);
 	if (nextl == NULL)
 		return -1;
 
@@ -789,7 +791,7 @@ static inline bool rt6_is_nh_local(int nhindex)
 	struct next_hop_list *nextl;
 	struct next_hop *next;
 
-	nextl = rcu_dereference(nh6_tbl.entry[nhindex]);
+	nextl = nexthop_table_get(&nh6_tbl, nhindex);
 	if (unlikely(!nextl))
 		return false;
 
@@ -941,7 +943,7 @@ void nexthop_v6_tbl_init(void)
 			&idx))
 		rte_panic("%s: can't create drop nexthop\n", __func__);
 	nextl6_blackhole =
-		rcu_dereference(nh6_tbl.entry[idx]);
+		nexthop_table_get(&nh6_tbl, idx);
 	if (!nextl6_blackhole)
 		rte_panic("%s: can't create drop nexthop\n", __func__);
 }
@@ -961,7 +963,7 @@ static void subtree_walk_route_cleanup_cb(struct lpm6 *lpm,
 					  void *arg)
 {
 	struct subtree_walk_arg *changing = arg;
-	struct next_hop_list *nextl = rcu_dereference(nh6_tbl.entry[idx]);
+	struct next_hop_list *nextl = nexthop_table_get(&nh6_tbl, idx);
 	uint8_t cover_ip[LPM6_IPV6_ADDR_SIZE];
 	struct in6_addr inaddr;
 	uint8_t cover_depth;
@@ -1175,7 +1177,7 @@ static void route6_change_process_nh(struct next_hop_list *nhl,
 			 * replaced by prev func, and will not
 			 * then be found in hash table.
 			 */
-			nhl = rcu_dereference(nh6_tbl.entry[index]);
+			nhl = nexthop_table_get(&nh6_tbl, index);
 			if (!nhl)
 				break;
 		}
@@ -1260,7 +1262,7 @@ route_change_link_neigh(struct vrf *vrf, struct lpm6 *lpm,
 	 * as the cover need to be checked to see if they are still accurate,
 	 * and removed if not.
 	 */
-	nextl = rcu_dereference(nh6_tbl.entry[next_hop]);
+	nextl = nexthop_table_get(&nh6_tbl, next_hop);
 	if (next_hop_list_is_any_connected(nextl)) {
 		memcpy(&subtree_arg.ip, ip,
 		       LPM6_IPV6_ADDR_SIZE);
@@ -1270,7 +1272,7 @@ route_change_link_neigh(struct vrf *vrf, struct lpm6 *lpm,
 			&subtree_arg);
 	} else if (lpm6_find_cover(lpm, ip, depth, (uint8_t *)&cover_ip,
 				   &cover_depth, &cover_idx) == 0) {
-		cover_nextl = rcu_dereference(nh6_tbl.entry[cover_idx]);
+		cover_nextl = nexthop_table_get(&nh6_tbl, cover_idx);
 		if (next_hop_list_is_any_connected(cover_nextl)) {
 			memcpy(&subtree_arg.ip, ip,
 			       LPM6_IPV6_ADDR_SIZE);
@@ -1335,7 +1337,7 @@ route_delete_unlink_neigh(struct vrf *vrf, struct lpm6 *lpm,
 	if (lpm6_lookup_exact(lpm, ip, depth, &nh_idx))
 		return;
 
-	nextl = rcu_dereference(nh6_tbl.entry[nh_idx]);
+	nextl = nexthop_table_get(&nh6_tbl, nh_idx);
 	if (next_hop_list_is_any_connected(nextl)) {
 		memcpy(&subtree_arg.ip, ip, LPM6_IPV6_ADDR_SIZE);
 		subtree_walk_route_cleanup_cb(lpm, (uint8_t *)ip,
@@ -1348,8 +1350,7 @@ route_delete_unlink_neigh(struct vrf *vrf, struct lpm6 *lpm,
 				   &cover_depth, &cover_idx) == 0) {
 		const struct next_hop_list *cover_nextl;
 
-		cover_nextl = rcu_dereference(
-			nh6_tbl.entry[cover_idx]);
+		cover_nextl = nexthop_table_get(&nh6_tbl, cover_idx);
 		if (next_hop_list_is_any_connected(cover_nextl)) {
 			memcpy(&subtree_arg.ip, ip,
 			       LPM6_IPV6_ADDR_SIZE);
@@ -1386,7 +1387,7 @@ route_delete_relink_neigh(struct lpm6 *lpm, uint8_t *ip, uint8_t depth)
 	}
 
 	/* Walk all the interfaces neigh entries to do /128 processing */
-	nextl = rcu_dereference(nh6_tbl.entry[cover_nh_idx]);
+	nextl = nexthop_table_get(&nh6_tbl, cover_nh_idx);
 	array = rcu_dereference(nextl->siblings);
 	for (i = 0; i < nextl->nsiblings; i++) {
 		const struct next_hop *next = array + i;
@@ -1655,7 +1656,7 @@ void rt6_print_nexthop(json_writer_t *json, uint32_t next_hop,
 		       enum rt_print_nexthop_verbosity v)
 {
 	const struct next_hop_list *nextl =
-		rcu_dereference(nh6_tbl.entry[next_hop]);
+		nexthop_table_get(&nh6_tbl, next_hop);
 	const struct next_hop *array;
 	unsigned int i, j;
 	const char *use_str = NULL;
@@ -1797,7 +1798,7 @@ static void rt6_display(struct lpm6_walk_params *params,
 {
 	json_writer_t *json = arg;
 	const struct next_hop_list *nextl =
-		rcu_dereference(nh6_tbl.entry[params->next_hop]);
+		nexthop_table_get(&nh6_tbl, params->next_hop);
 	const struct next_hop *next;
 
 	if (unlikely(!nextl))
@@ -1825,7 +1826,7 @@ static void rt6_display_all(struct lpm6_walk_params *params,
 {
 	json_writer_t *json = arg;
 	const struct next_hop_list *nextl =
-		rcu_dereference(nh6_tbl.entry[params->next_hop]);
+		nexthop_table_get(&nh6_tbl, params->next_hop);
 
 	if (unlikely(!nextl))
 		return;
@@ -1841,7 +1842,7 @@ static void rt6_local_display(
 	FILE *f = arg;
 	char b1[INET6_ADDRSTRLEN];
 	const struct next_hop_list *nextl =
-		rcu_dereference(nh6_tbl.entry[params->next_hop]);
+		nexthop_table_get(&nh6_tbl, params->next_hop);
 	const struct next_hop *next;
 
 	if (unlikely(!nextl))
@@ -1934,7 +1935,7 @@ static void rt6_if_dead(struct vrf *vrf, uint32_t table_id,
 			void *arg)
 {
 	struct next_hop_list *nextl =
-		rcu_dereference(nh6_tbl.entry[params->next_hop]);
+		nexthop_table_get(&nh6_tbl, params->next_hop);
 	const struct ifnet *ifp = arg;
 	unsigned int i, matches = 0;
 	struct in6_addr inaddr;
@@ -1978,7 +1979,7 @@ static void rt6_if_clear_slowpath_flag(
 	void *arg)
 {
 	const struct next_hop_list *nextl =
-		rcu_dereference(nh6_tbl.entry[params->next_hop]);
+		nexthop_table_get(&nh6_tbl, params->next_hop);
 	const struct ifnet *ifp = arg;
 	unsigned int i;
 
@@ -1998,7 +1999,7 @@ static void rt6_if_set_slowpath_flag(
 	void *arg)
 {
 	const struct next_hop_list *nextl =
-		rcu_dereference(nh6_tbl.entry[params->next_hop]);
+		nexthop_table_get(&nh6_tbl, params->next_hop);
 	const struct ifnet *ifp = arg;
 	unsigned int i;
 
@@ -2106,7 +2107,7 @@ static void rt6_summarize(struct lpm6_walk_params *params,
 	const struct next_hop *nh;
 	uint32_t *rt_used = arg;
 
-	nextl = rcu_dereference(nh6_tbl.entry[params->next_hop]);
+	nextl = nexthop_table_get(&nh6_tbl, params->next_hop);
 	if (unlikely(!nextl))
 		return;
 
@@ -2155,7 +2156,8 @@ static int rt6_stats(struct route6_head *rt6_head, json_writer_t *json,
 	jsonw_name(json, "nexthop");
 	jsonw_start_object(json);
 	jsonw_uint_field(json, "used", nh6_tbl.in_use);
-	jsonw_uint_field(json, "free", NEXTHOP_HASH_TBL_SIZE - nh6_tbl.in_use);
+	jsonw_uint_field(json, "free", nh6_tbl.max_size - nh6_tbl.in_use);
+	jsonw_uint_field(json, "size", nexthop_table_size(&nh6_tbl));
 	jsonw_uint_field(json, "neigh_present", nh6_tbl.neigh_present);
 	jsonw_uint_field(json, "neigh_created", nh6_tbl.neigh_created);
 	jsonw_end_object(json);
@@ -2430,7 +2432,7 @@ struct ifnet *nhif_dst_lookup6(const struct vrf *vrf,
 			    dst->s6_addr, &nhindex) != 0)
 		return NULL;
 
-	nextl = nh6_tbl.entry[nhindex];
+	nextl = nexthop_table_get(&nh6_tbl, nhindex);
 	if (nextl == NULL)
 		return NULL;
 
@@ -2459,7 +2461,7 @@ route6_create_neigh(struct vrf *vrf, struct lpm6 *lpm,
 	int size;
 
 	if (lpm6_lookup(lpm, ip->s6_addr, &nh_idx) == 0) {
-		nextl = rcu_dereference(nh6_tbl.entry[nh_idx]);
+		nextl = nexthop_table_get(&nh6_tbl, nh_idx);
 
 		/*
 		 * Note that this does not support a connected with multiple
@@ -2642,7 +2644,7 @@ void routing6_insert_neigh_safe(struct llentry *lle, bool neigh_change)
 	pthread_mutex_lock(&route6_mutex);
 	if (lpm6_lookup_exact(lpm, ip->s6_addr, 128, &nh_idx) == 0) {
 		/* We already have a /128 so add the shortcut if connected */
-		nextl = rcu_dereference(nh6_tbl.entry[nh_idx]);
+		nextl = nexthop_table_get(&nh6_tbl, nh_idx);
 
 		/*
 		 * Do we already have a nh for this interface?
@@ -2699,7 +2701,7 @@ void routing6_remove_neigh_safe(struct llentry *lle)
 	pthread_mutex_lock(&route6_mutex);
 	if (lpm6_lookup_exact(lpm, ip->s6_addr, 128, &nh_idx) == 0) {
 		/* We have a /128 so unlink the arp (if there) */
-		nextl = rcu_dereference(nh6_tbl.entry[nh_idx]);
+		nextl = nexthop_table_get(&nh6_tbl, nh_idx);
 		if (unlikely(!nextl))
 			goto unlock;
 
@@ -2819,7 +2821,7 @@ static void route6_fal_upd_for_changed_nhl(
 		return;
 
 	struct next_hop_list *nextl =
-		rcu_dereference(nh6_tbl.entry[params->next_hop]);
+		nexthop_table_get(&nh6_tbl, params->next_hop);
 
 	memcpy(&ip.s6_addr, params->prefix, sizeof(ip.s6_addr));
 
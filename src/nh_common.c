@@ -4,7 +4,9 @@
  * SPDX-License-Identifier: LGPL-2.1-only
  */
 
+#include <assert.h>
 #include <urcu/list.h>
+#include <rte_common.h>
 #include <rte_debug.h>
 
 #include "ecmp.h"
@@ -12,6 +14,8 @@
 #include "if_llatbl.h"
 #include "ip_route.h"
 #include "lcore_sched.h"
+#include "lpm/lpm.h"
+#include "lpm/lpm6.h"
 #include "nh_common.h"
 #include "urcu.h"
 #include "vplane_debug.h"
@@ -1229,6 +1233,122 @@ static void next_hop_list_add_hardware_resolution(struct next_hop_list *nhl)
 	}
 }
 
+/* Table indices must fit in the LPM next hop */
+static_assert(NEXTHOP_TBL_MAX_SIZE_V4 <= (1u << LPM_NEXT_HOP_BITS),
+	      "IPv4 nexthop table larger than LPM next hop");
+static_assert(NEXTHOP_TBL_MAX_SIZE_V6 <= (1u << LPM6_NEXT_HOP_BITS),
+	      "IPv6 nexthop table larger than LPM6 next hop");
+
+static void nexthop_entries_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct nexthop_entries, rcu));
+}
+
+/*
+ * Replace the entry array with one of a new size, keeping the entries
+ * below the new size. Readers may still be using the old array, so it
+ * is freed after a grace period.
+ */
+static int nexthop_table_resize(struct nexthop_table *nh_table,
+				uint32_t size)
+{
+	struct nexthop_entries *old = nh_table->entries;
+	struct nexthop_entries *new;
+	uint32_t keep = old ? RTE_MIN(old->size, size) : 0;
+	uint64_t *used;
+
+	new = zmalloc_aligned(sizeof(*new) + size * sizeof(new->entry[0]));
+	if (!new)
+		return -ENOMEM;
+
+	used = calloc(size / 64, sizeof(*used));
+	if (!used) {
+		free(new);
+		return -ENOMEM;
+	}
+
+	new->size = size;
+	if (old) {
+		memcpy(new->entry, old->entry, keep * sizeof(new->entry[0]));
+		memcpy(used, nh_table->used, keep / 64 * sizeof(*used));
+	}
+
+	free(nh_table->used);
+	nh_table->used = used;
+	if (nh_table->rover >= size)
+		nh_table->rover = 0;
+
+	rcu_assign_pointer(nh_table->entries, new);
+	if (old)
+		call_rcu(&old->rcu, nexthop_entries_free);
+
+	return 0;
+}
+
+/*
+ * Allocate a free slot, growing the table if full. Slots are handed
+ * out next-fit from the rover so that a freed index is not reused
+ * straight away.
+ */
+static int nexthop_table_slot_alloc(struct nexthop_table *nh_table,
+				    uint32_t *slot)
+{
+	uint32_t size = nexthop_table_size(nh_table);
+	uint32_t nwords, word, i, idx;
+	uint64_t bits;
+	int ret;
+
+	if (nh_table->in_use == size) {
+		if (size >= nh_table->max_size)
+			return -ENOSPC;
+		ret = nexthop_table_resize(nh_table,
+					   size ? RTE_MIN(size * 2,
+							  nh_table->max_size) :
+					   NEXTHOP_TBL_MIN_SIZE);
+		if (ret < 0)
+			return ret;
+		size = nexthop_table_size(nh_table);
+	}
+
+	nwords = size / 64;
+	word = nh_table->rover / 64;
+	/* Treat slots behind the rover as used until we wrap */
+	bits = nh_table->used[word] | ((1ull << (nh_table->rover % 64)) - 1);
+
+	for (i = 0; i <= nwords; i++) {
+		if (~bits) {
+			idx = word * 64 + __builtin_ctzll(~bits);
+			nh_table->used[word] |= 1ull << (idx % 64);
+			nh_table->rover = idx + 1 < size ? idx + 1 : 0;
+			*slot = idx;
+			return 0;
+		}
+		word = word + 1 < nwords ? word + 1 : 0;
+		bits = nh_table->used[word];
+	}
+
+	return -ENOSPC;
+}
+
+static void nexthop_table_slot_free(struct nexthop_table *nh_table,
+				    uint32_t slot)
+{
+	uint32_t size = nexthop_table_size(nh_table);
+	uint32_t word;
+
+	nh_table->used[slot / 64] &= ~(1ull << (slot % 64));
+
+	/* Halve the table once it is mostly empty and the top half unused */
+	if (size <= NEXTHOP_TBL_MIN_SIZE || nh_table->in_use > size / 4)
+		return;
+
+	for (word = size / 2 / 64; word < size / 64; word++)
+		if (nh_table->used[word])
+			return;
+
+	nexthop_table_resize(nh_table, size / 2);
+}
+
 /* Lookup (or create) nexthop based on hop information */
 int nexthop_new(int family, const struct next_hop *nh, uint16_t size,
 		uint8_t proto, enum fal_next_hop_group_use use, uint32_t *slot)
@@ -1240,8 +1360,7 @@ int nexthop_new(int family, const struct next_hop *nh, uint16_t size,
 		.use = use,
 	};
 	struct next_hop_list *nextl;
-	uint32_t rover;
-	uint32_t nh_iter;
+	uint32_t idx;
 	int ret;
 	struct nexthop_table *nh_table = nh_common_get_nh_table(family);
 
@@ -1251,27 +1370,28 @@ int nexthop_new(int family, const struct next_hop *nh, uint16_t size,
 			return -EINVAL;
 	}
 
-	rover = nh_table->rover;
 	nextl = nexthop_reuse(family, &key, slot);
 	if (nextl)
 		return 0;
 
-	if (unlikely(nh_table->in_use == NEXTHOP_HASH_TBL_SIZE)) {
+	ret = nexthop_table_slot_alloc(nh_table, &idx);
+	if (unlikely(ret < 0)) {
 		RTE_LOG(ERR, ROUTE, "IPv%d next hop table full\n",
 			family == AF_INET ? 4 : 6);
-		return -ENOSPC;
+		return ret;
 	}
 
 	nextl = nexthop_alloc(size);
 	if (!nextl) {
 		RTE_LOG(ERR, ROUTE, "IPv%d next hop table alloc failed\n",
 			family == AF_INET ? 4 : 6);
+		nexthop_table_slot_free(nh_table, idx);
 		return -ENOMEM;
 	}
 
 	nextl->nsiblings = size;
 	nextl->refcount = 1;
-	nextl->index = rover;
+	nextl->index = idx;
 	nextl->proto = proto;
 	nextl->use = use;
 	if (size == 1)
@@ -1282,11 +1402,13 @@ int nexthop_new(int family, const struct next_hop *nh, uint16_t size,
 
 	if (next_hop_list_init_map(nextl)) {
 		__nexthop_destroy(nextl);
+		nexthop_table_slot_free(nh_table, idx);
 		return -ENOMEM;
 	}
 
 	if (unlikely(nexthop_hash_insert(family, nextl, &key))) {
 		__nexthop_destroy(nextl);
+		nexthop_table_slot_free(nh_table, idx);
 		return -ENOMEM;
 	}
 
@@ -1305,19 +1427,10 @@ int nexthop_new(int family, const struct next_hop *nh, uint16_t size,
 
 	next_hop_list_track_protected_nh(nextl);
 
-	nh_iter = rover;
-	do {
-		nh_iter++;
-		if (nh_iter >= NEXTHOP_HASH_TBL_SIZE)
-			nh_iter = 0;
-	} while ((rcu_dereference(nh_table->entry[nh_iter]) != NULL) &&
-		 likely(nh_iter != rover));
-
-	nh_table->rover = nh_iter;
-	*slot = rover;
+	*slot = idx;
 	nh_table->in_use++;
 
-	rcu_assign_pointer(nh_table->entry[rover], nextl);
+	rcu_assign_pointer(nh_table->entries->entry[idx], nextl);
 
 	return 0;
 }
@@ -1358,7 +1471,7 @@ void nexthop_put(int family, uint32_t idx)
 		return;
 	}
 
-	nextl = rcu_dereference(nh_table->entry[idx]);
+	nextl = nexthop_table_get(nh_table, idx);
 	if (unlikely(!nextl))
 		return;
 	if (--nextl->refcount == 0) {
@@ -1366,8 +1479,9 @@ void nexthop_put(int family, uint32_t idx)
 		int ret;
 		int i;
 
-		rcu_assign_pointer(nh_table->entry[idx],  NULL);
+		rcu_assign_pointer(nh_table->entries->entry[idx], NULL);
 		--nh_table->in_use;
+		nexthop_table_slot_free(nh_table, idx);
 
 		for (i = 0; i < nextl->nsiblings; i++) {
 			struct next_hop *nh = array + i;
@@ -1667,7 +1781,7 @@ ALWAYS_INLINE struct next_hop *nexthop_select(int family, uint32_t nh_idx,
 	uint32_t size;
 	struct nexthop_table *nh_table = nh_common_get_nh_table(family);
 
-	nextl = rcu_dereference(nh_table->entry[nh_idx]);
+	nextl = nexthop_table_get(nh_table, nh_idx);
 	if (unlikely(!nextl))
 		return NULL;
 
@@ -1681,6 +1795,22 @@ ALWAYS_INLINE struct next_hop *nexthop_select(int family, uint32_t nh_idx,
 				 ecmp_mbuf_hash(m, ether_type));
 }
 
+/*
+ * Return the path of a single path nexthop list, or NULL if the list
+ * is multipath and so needs a per-packet hash to choose the path.
+ */
+struct next_hop *nexthop_select_single(int family, uint32_t nh_idx)
+{
+	struct next_hop_list *nextl;
+	struct nexthop_table *nh_table = nh_common_get_nh_table(family);
+
+	nextl = nexthop_table_get(nh_table, nh_idx);
+	if (unlikely(!nextl) || nextl->nsiblings != 1)
+		return NULL;
+
+	return nextl->siblings;
+}
+
 struct next_hop_list *
 next_hop_list_create_copy_start(int family __unused,
 				struct next_hop_list *old)
@@ -1756,8 +1886,8 @@ next_hop_list_create_copy_finish(int family,
 
 	next_hop_list_add_hardware_resolution(new);
 
-	assert(nh_table->entry[old_idx] == old);
-	rcu_xchg_pointer(&nh_table->entry[old_idx], new);
+	assert(nh_table->entries->entry[old_idx] == old);
+	rcu_xchg_pointer(&nh_table->entries->entry[old_idx], new);
 
 	next_hop_fixup_protected_tracking(old, new);
 	/*
@@ -1912,7 +2042,7 @@ fal_object_t next_hop_list_get_fal_obj(int family, uint32_t nhl_idx,
 	struct nexthop_table *nh_table = nh_common_get_nh_table(family);
 	struct next_hop_list *nextl;
 
-	nextl = rcu_dereference(nh_table->entry[nhl_idx]);
+	nextl = nexthop_table_get(nh_table, nhl_idx);
 	*pd_state = nextl->pd_state;
 
 	if (nextl->pd_state != PD_OBJ_STATE_FULL &&
@@ -1929,7 +2059,7 @@ next_hop_list_get_fal_nhs(int family, uint32_t nhl_idx,
 	struct nexthop_table *nh_table = nh_common_get_nh_table(family);
 	struct next_hop_list *nextl;
 
-	nextl = rcu_dereference(nh_table->entry[nhl_idx]);
+	nextl = nexthop_table_get(nh_table, nhl_idx);
 
 	if (nextl->pd_state != PD_OBJ_STATE_FULL &&
 	    nextl->pd_state != PD_OBJ_STATE_NOT_NEEDED)
@@ -83,14 +83,51 @@ struct nexthop_hash_key {
 #define NEXTHOP_HASH_TBL_SIZE RTE_FBK_HASH_ENTRIES_MAX
 #define NEXTHOP_HASH_TBL_MIN  (UINT8_MAX + 1)
 
+/*
+ * The nexthop table starts small and is doubled as it fills, up to
+ * the width of the nexthop in the family's LPM, and halved again as
+ * it empties. The entry array is replaced and published via RCU when
+ * resized.
+ */
+#define NEXTHOP_TBL_MIN_SIZE     1024
+#define NEXTHOP_TBL_MAX_SIZE_V4  (1u << 22)
+#define NEXTHOP_TBL_MAX_SIZE_V6  (1u << 21)
+
+struct nexthop_entries {
+	struct rcu_head rcu;
+	uint32_t size;
+	struct next_hop_list *entry[]; /* entry array */
+};
+
 struct nexthop_table {
+	uint32_t max_size; /* limit on the entry array size */
 	uint32_t in_use;  /* # of entries used */
 	uint32_t rover;   /* next free slot to look at */
-	struct next_hop_list *entry[NEXTHOP_HASH_TBL_SIZE]; /* entry array */
+	struct nexthop_entries *entries;
+	uint64_t *used;   /* bitmap of used slots */
 	uint32_t neigh_present;
 	uint32_t neigh_created;
 };
 
+static inline struct next_hop_list *
+nexthop_table_get(struct nexthop_table *nh_table, uint32_t idx)
+{
+	struct nexthop_entries *entries = rcu_dereference(nh_table->entries);
+
+	if (!entries || idx >= entries->size)
+		return NULL;
+
+	return rcu_dereference(entries->entry[idx]);
+}
+
+static inline uint32_t
+nexthop_table_size(const struct nexthop_table *nh_table)
+{
+	const struct nexthop_entries *entries = nh_table->entries;
+
+	return entries ? entries->size : 0;
+}
+
 enum nh_type {
 	NH_TYPE_V4GW, /* struct next_hop  */
 	NH_TYPE_V6GW, /* struct next_hop */
@@ -310,6 +347,8 @@ struct next_hop *nexthop_select(int family, uint32_t nh_idx,
 				const struct rte_mbuf *m,
 				uint16_t ether_type);
 
+struct next_hop *nexthop_select_single(int family, uint32_t nh_idx);
+
 bool nh_is_connected(const struct next_hop *nh);
 bool nh_is_local(const struct next_hop *nh);
 bool nh_is_gw(const struct next_hop *nh);
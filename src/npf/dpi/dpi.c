@@ -12,10 +12,13 @@
 #include <errno.h>
 #include <stdbool.h>
 #include <string.h>
+#include <sys/sysinfo.h>
+#include <rte_lcore.h>
 #include "npf/npf_session.h"
 #include "dpi.h"
 #include "npf/dpi/dpi_internal.h"
 #include "pktmbuf_internal.h"
+#include "vplane_debug.h"
 #include "vplane_log.h"
 #include "util.h"
 #include "npf/npf_rule_gen.h"
@@ -43,10 +46,6 @@ struct id_entry {
 	uint8_t id;
 };
 
-/* DPI engine dpi_engine_procs instances */
-extern struct dpi_engine_procs ndpi_engine_procs;
-extern struct dpi_engine_procs user_engine_procs;
-
 /* Array of known DPI engine dpi_engine_procs */
 static struct dpi_engine_procs *engine_procs[] = {
 	&user_engine_procs,
@@ -270,6 +269,72 @@ dpi_terminate(uint8_t engine_id)
 	return engine ? engine->terminate() : false;
 }
 
+/*
+ * Is the given CPU running one of the dataplane's lcores?  The lcore
+ * ids are not the CPU ids when the EAL is given an lcore to CPU map.
+ */
+static bool
+dpi_cpu_is_dataplane(unsigned int cpu)
+{
+	unsigned int lcore;
+
+	RTE_LCORE_FOREACH(lcore) {
+		if (rte_lcore_to_cpu_id(lcore) == (int)cpu)
+			return true;
+	}
+
+	return false;
+}
+
+int
+dpi_set_worker_cores(const uint8_t *bytes, uint8_t len)
+{
+	bitmask_t cores;
+	char tmp[BITMASK_STRSZ];
+	int rc;
+
+	rc = bitmask_parse_bytes(&cores, bytes, len);
+	if (rc) {
+		RTE_LOG(ERR, DATAPLANE,
+			"Failed to parse cpumask for DPI workers\n");
+		return rc;
+	}
+
+	/*
+	 * Workers spin on their cores, so mustn't share them with the
+	 * master or forwarding threads.
+	 */
+	for (unsigned int cpu = 0; cpu < BITMASK_BITS; cpu++) {
+		if (!bitmask_isset(&cores, cpu))
+			continue;
+
+		if (cpu >= (unsigned int)get_nprocs_conf()) {
+			RTE_LOG(ERR, DATAPLANE,
+				"DPI worker core %u does not exist\n", cpu);
+			return -EINVAL;
+		}
+		if (dpi_cpu_is_dataplane(cpu)) {
+			RTE_LOG(ERR, DATAPLANE,
+				"DPI worker core %u is a dataplane core\n",
+				cpu);
+			return -EINVAL;
+		}
+	}
+
+	bitmask_sprint(&cores, tmp, sizeof(tmp));
+	DP_DEBUG(INIT, INFO, DATAPLANE, "DPI worker cores set: %s\n", tmp);
+
+	for (unsigned int i = 0; i < engine_procs_len; i++) {
+		if (engine_procs[i] && engine_procs[i]->set_workers) {
+			rc = engine_procs[i]->set_workers(&cores);
+			if (rc)
+				return rc;
+		}
+	}
+
+	return 0;
+}
+
 void
 dpi_session_flow_destroy(struct dpi_flow *flow)
 {
@@ -16,6 +16,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <rte_mbuf.h>
+#include "bitmask.h"
 #include "json_writer.h"
 #include "npf/npf_cache.h"
 
@@ -156,6 +157,16 @@ int dpi_init(uint8_t engine_id);
  */
 bool dpi_terminate(uint8_t engine_id);
 
+/**
+ * Set the cores, as a CPU mask, for engines which support running
+ * detection asynchronously to the forwarding cores. An empty mask
+ * returns them to inline detection. The cores must not be used by
+ * the dataplane's own threads.
+ *
+ * Returns zero on success; errno otherwise.
+ */
+int dpi_set_worker_cores(const uint8_t *bytes, uint8_t len);
+
 /**
  * Destroy the given flow using the given engine's flow destructor.
  */
@@ -314,6 +325,12 @@ struct dpi_engine_procs {
 	 */
 	bool (*terminate)(void);
 
+	/**
+	 * Set the cores on which the engine runs its detection, off the
+	 * forwarding path. An empty set means detect inline.
+	 * Returns zero on success; errno otherwise.
+	 */
+	int (*set_workers)(const bitmask_t *cores);
 
 	/**
 	 * Refcount.
@@ -408,6 +425,10 @@ struct dpi_engine_procs {
 			   size_t buf_len);
 };
 
+/* DPI engine dpi_engine_procs instances */
+extern struct dpi_engine_procs ndpi_engine_procs;
+extern struct dpi_engine_procs user_engine_procs;
+
 
 bool no_app_id(uint32_t app_id);
 bool no_app_type(uint32_t app_type);
@@ -14,13 +14,22 @@
  */
 
 #include <errno.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
+#include <unistd.h>
 #include <rte_config.h>
+#include <rte_errno.h>
 #include <rte_lcore.h>
 #include <rte_log.h>
 #include <rte_mbuf.h>
+#include <rte_mempool.h>
+#include <rte_ring.h>
+#include <urcu/uatomic.h>
 
+#include "bitmask.h"
 #include "compiler.h"
 #include "npf/npf.h"
 #include "npf/npf_session.h"
@@ -33,6 +42,7 @@
 #include "npf/dpi/app_cmds.h"
 #include "npf/dpi/dpi_internal.h"
 #include "ndpi_main.h"
+#include "rcu.h"
 #include "vplane_log.h"
 #include "util.h"
 #include "vplane_debug.h"
@@ -42,6 +52,19 @@
 
 #define NDPI_FLOW_PKT_MAX 10
 
+/*
+ * Asynchronous mode: the forwarding cores copy the early packets of a
+ * flow into a request and pass it to a DPI worker thread over a ring.
+ * The packet keeps being forwarded with the flow's current (provisional)
+ * determination, which the worker updates when it has processed it.
+ */
+#define NDPI_ASYNC_RING_SZ	1024
+#define NDPI_ASYNC_POOL_SZ	4095
+#define NDPI_ASYNC_POOL_CACHE	32
+#define NDPI_ASYNC_BURST	32
+#define NDPI_ASYNC_SNAPLEN	1536
+#define NDPI_ASYNC_IDLE_US	50
+
 #define DPI_INTERNAL_UNKNOWN (DPI_ENGINE_NDPI | NDPI_PROTOCOL_UNKNOWN)
 
 /* Count of all nDPI uses. */
@@ -65,9 +88,40 @@ struct ndpi_flow {
 	struct ndpi_id_struct *src_id;
 	struct ndpi_id_struct *dest_id;
 	rte_spinlock_t fl_lock;
+	uint32_t refcnt;	/* session, plus requests in flight */
+	uint32_t seen;		/* packets run through nDPI */
 	struct rcu_head n_rcu_head;
 };
 
+struct ndpi_async_req {
+	struct ndpi_flow *flow;
+	uint16_t data_len;
+	unsigned char data[NDPI_ASYNC_SNAPLEN];
+};
+
+struct ndpi_async;
+
+struct ndpi_async_worker {
+	struct ndpi_async *async;
+	pthread_t tid;
+	unsigned int cpu;
+	bool running;
+	struct rte_ring *ring;
+	struct ndpi_detection_module_struct *detect;
+};
+
+struct ndpi_async {
+	struct rte_mempool *pool;
+	unsigned int n_workers;
+	struct ndpi_async_worker workers[];
+};
+
+/* Cores to run DPI workers on; empty to run nDPI inline */
+static bitmask_t ndpi_worker_cores;
+
+/* Running DPI workers, if any. */
+static struct ndpi_async *ndpi_async;
+
 #define NDPI_FLOW_ENGINE_ID	ef.engine_id
 #define NDPI_FLOW_STATS		ef.stats
 #define NDPI_FLOW_UPDATE_STATS	ef.update_stats
@@ -122,17 +176,12 @@ dpi_ndpi_flow_pkt_count_maxed(const struct ndpi_flow *flow, uint32_t max)
  */
 static bool
 dpi_ndpi_process(struct ndpi_detection_module_struct *detect,
-		struct rte_mbuf *mbuf, struct ndpi_flow *flow)
+		 const unsigned char *data, uint16_t data_len,
+		 struct ndpi_flow *flow)
 {
 	if (unlikely(!detect))
 		return false;
 
-	uint16_t offset = dp_pktmbuf_l2_len(mbuf);
-	uint16_t data_len = rte_pktmbuf_data_len(mbuf) - offset;
-
-	const unsigned char *data =
-		rte_pktmbuf_mtod(mbuf, const unsigned char *) + offset;
-
 	ndpi_protocol proto = ndpi_detection_process_packet(detect, flow->key,
 			data, data_len, (uint64_t) get_time_uptime(),
 			flow->src_id, flow->dest_id);
@@ -175,23 +224,117 @@ dpi_ndpi_process(struct ndpi_detection_module_struct *detect,
 
 	if (unlikely(dp_debug & DP_DBG_DPI)) {
 		RTE_LOG(DEBUG, DATAPLANE, "ndpi: P='%s' A='%s' C='%s'\n",
-			ndpi_get_proto_name(detection_modules[dp_lcore_id()],
-					    proto.master_protocol),
-			ndpi_get_proto_name(detection_modules[dp_lcore_id()],
-					    proto.app_protocol),
-			ndpi_category_get_name(detection_modules[dp_lcore_id()],
-					       proto.category));
+			ndpi_get_proto_name(detect, proto.master_protocol),
+			ndpi_get_proto_name(detect, proto.app_protocol),
+			ndpi_category_get_name(detect, proto.category));
 	}
 
 	return true;
 }
 
+/*
+ * Process the packet data under the flow lock, placing the flow in an
+ * error state if the DPI engine is invalid.
+ */
+static void
+dpi_ndpi_process_locked(struct ndpi_detection_module_struct *detect,
+			const unsigned char *data, uint16_t data_len,
+			struct ndpi_flow *flow)
+{
+	rte_spinlock_lock(&flow->fl_lock);
+	CMM_STORE_SHARED(flow->seen, flow->seen + 1);
+	if (!flow->offloaded &&
+	    !dpi_ndpi_process(detect, data, data_len, flow)) {
+		flow->protocol = DPI_APP_ERROR;
+		flow->offloaded = true;
+		flow->error = true;
+	}
+
+	rte_spinlock_unlock(&flow->fl_lock);
+}
+
+/**
+ * Free the dpi flow. Called from RCU callback.
+ */
+static void
+dpi_ndpi_free(struct rcu_head *head)
+{
+	struct ndpi_flow *flow = caa_container_of(head, struct ndpi_flow,
+						  n_rcu_head);
+
+	ndpi_free_flow(flow->key);
+	ndpi_free(flow->src_id);
+	ndpi_free(flow->dest_id);
+	free(flow);
+}
+
+/*
+ * Drop a reference on the flow, freeing it when the session and all
+ * outstanding worker requests are done with it.
+ */
+static void
+dpi_ndpi_flow_put(struct ndpi_flow *flow)
+{
+	if (uatomic_sub_return(&flow->refcnt, 1) == 0)
+		call_rcu(&flow->n_rcu_head, dpi_ndpi_free);
+}
+
+/*
+ * Hand the packet to a DPI worker.  Returns false if the request
+ * could not be queued.
+ *
+ * The worker gives up on the flow once it has seen NDPI_FLOW_PKT_MAX
+ * packets, so no more than that are let into the pipeline: the
+ * requests in flight (the references beyond the session's own) plus
+ * those the worker has already seen.  The reference is taken first so
+ * that cores racing on the same flow can't both claim the last slot;
+ * the worker counts a packet as seen before dropping its reference.
+ */
+static bool
+dpi_ndpi_async_enqueue(struct ndpi_async *async, struct ndpi_flow *flow,
+		       const unsigned char *data, uint16_t data_len)
+{
+	struct ndpi_async_worker *worker;
+	struct ndpi_async_req *req;
+	uint32_t inflight;
+
+	inflight = uatomic_add_return(&flow->refcnt, 1) - 1;
+	if (inflight + CMM_LOAD_SHARED(flow->seen) > NDPI_FLOW_PKT_MAX)
+		goto fail;
+
+	/* Keep all of a flow's requests on one worker, and so in order */
+	worker = &async->workers[((uintptr_t)flow / RTE_CACHE_LINE_SIZE) %
+				 async->n_workers];
+
+	if (rte_mempool_get(async->pool, (void **)&req) < 0)
+		goto fail;
+
+	req->flow = flow;
+	req->data_len = RTE_MIN(data_len, NDPI_ASYNC_SNAPLEN);
+	memcpy(req->data, data, req->data_len);
+
+	if (rte_ring_mp_enqueue(worker->ring, req) != 0) {
+		rte_mempool_put(async->pool, req);
+		goto fail;
+	}
+
+	return true;
+
+fail:
+	/* the session still holds a reference */
+	uatomic_dec(&flow->refcnt);
+	return false;
+}
+
 /**
  * Process the given packet with nDPI
  *
  * The flow attached to the given session will be placed in an error state if
  * the DPI engine is invalid.
  *
+ * When DPI workers are running, a copy of the packet is queued to one
+ * and this returns straight away.
+ *
  * @return false if the flow attached to the given session has an invalid key,
  * true otherwise.
  */
@@ -200,19 +343,33 @@ dpi_ndpi_process_pkt(struct dpi_engine_flow *engine_flow,
 		struct rte_mbuf *mbuf, int dir __unused)
 {
 	struct ndpi_flow *flow = (struct ndpi_flow *) engine_flow;
+	struct ndpi_async *async;
 
 	if (unlikely(!flow->key))
 		return false;
 
-	rte_spinlock_lock(&flow->fl_lock);
-	if (!dpi_ndpi_process(detection_modules[dp_lcore_id()],
-				mbuf, flow)) {
-		flow->protocol = DPI_APP_ERROR;
-		flow->offloaded = true;
-		flow->error = true;
+	uint16_t offset = dp_pktmbuf_l2_len(mbuf);
+	uint16_t data_len = rte_pktmbuf_data_len(mbuf) - offset;
+	const unsigned char *data =
+		rte_pktmbuf_mtod(mbuf, const unsigned char *) + offset;
+
+	async = rcu_dereference(ndpi_async);
+	if (async) {
+		if (CMM_LOAD_SHARED(flow->offloaded))
+			return true;
+
+		/*
+		 * If the worker is full, or already has as many of the
+		 * flow's packets as it will look at, skip the packet
+		 * rather than process it inline, ahead of the flow's
+		 * earlier packets still queued to the worker.
+		 */
+		dpi_ndpi_async_enqueue(async, flow, data, data_len);
+		return true;
 	}
 
-	rte_spinlock_unlock(&flow->fl_lock);
+	dpi_ndpi_process_locked(detection_modules[dp_lcore_id()],
+				data, data_len, flow);
 	return true;
 }
 
@@ -220,6 +377,220 @@ static bool initialised;
 
 static bool dpi_ndpi_terminate(void);
 
+/*
+ * Create a detection module with all protocols enabled and the
+ * configured protocol and category files loaded.
+ */
+static struct ndpi_detection_module_struct *
+dpi_ndpi_detection_module_create(void)
+{
+	struct ndpi_detection_module_struct *detect;
+	NDPI_PROTOCOL_BITMASK all;
+	FILE *file;
+
+	detect = ndpi_init_detection_module(ndpi_no_prefs);
+	if (!detect)
+		return NULL;
+
+	NDPI_BITMASK_SET_ALL(all);
+	ndpi_set_protocol_detection_bitmask2(detect, &all);
+
+	if ((file = fopen(NDPI_PROTOCOLS_PATH, "r")) != NULL) {
+		ndpi_load_protocols_file(detect, NDPI_PROTOCOLS_PATH);
+		fclose(file);
+	}
+
+	if ((file = fopen(NDPI_CATEGORIES_PATH, "r")) != NULL) {
+		ndpi_load_categories_file(detect, NDPI_CATEGORIES_PATH);
+		fclose(file);
+	}
+
+	ndpi_finalize_initalization(detect);
+	return detect;
+}
+
+/*
+ * Complete a request on the worker: run it through nDPI unless the flow
+ * has been determined in the meantime, then release the flow and the
+ * request.
+ */
+static void
+dpi_ndpi_async_req_process(struct ndpi_async *async,
+			   struct ndpi_detection_module_struct *detect,
+			   struct ndpi_async_req *req)
+{
+	struct ndpi_flow *flow = req->flow;
+
+	if (detect)
+		dpi_ndpi_process_locked(detect, req->data, req->data_len, flow);
+
+	dpi_ndpi_flow_put(flow);
+	rte_mempool_put(async->pool, req);
+}
+
+static void *
+dpi_ndpi_worker(void *arg)
+{
+	struct ndpi_async_worker *worker = arg;
+	struct ndpi_async *async = worker->async;
+	void *reqs[NDPI_ASYNC_BURST];
+	unsigned int n, i;
+
+	pthread_setname_np(pthread_self(), "dp/dpi");
+	dp_rcu_register_thread();
+
+	while (CMM_LOAD_SHARED(worker->running)) {
+		dp_rcu_thread_online();
+		n = rte_ring_sc_dequeue_burst(worker->ring, reqs,
+					      NDPI_ASYNC_BURST, NULL);
+		for (i = 0; i < n; i++)
+			dpi_ndpi_async_req_process(async, worker->detect,
+						   reqs[i]);
+		dp_rcu_thread_offline();
+
+		if (n == 0)
+			usleep(NDPI_ASYNC_IDLE_US);
+	}
+
+	dp_rcu_unregister_thread();
+	return NULL;
+}
+
+/*
+ * Stop the workers and release everything they were given.  No
+ * forwarding core may be able to reach the workers by now.
+ */
+static void
+dpi_ndpi_async_free(struct ndpi_async *async)
+{
+	struct ndpi_async_worker *worker;
+	void *req;
+	unsigned int i;
+
+	for (i = 0; i < async->n_workers; i++) {
+		worker = &async->workers[i];
+		if (worker->running) {
+			CMM_STORE_SHARED(worker->running, false);
+			pthread_join(worker->tid, NULL);
+		}
+
+		/* Release anything the worker didn't get to */
+		if (worker->ring) {
+			while (rte_ring_sc_dequeue(worker->ring, &req) == 0)
+				dpi_ndpi_async_req_process(async, NULL, req);
+			rte_ring_free(worker->ring);
+		}
+
+		if (worker->detect)
+			ndpi_exit_detection_module(worker->detect);
+	}
+
+	rte_mempool_free(async->pool);
+	free(async);
+}
+
+/*
+ * Stop the DPI workers, if running, and go back to processing
+ * packets inline on the forwarding cores.
+ */
+static void
+dpi_ndpi_async_stop(void)
+{
+	struct ndpi_async *async = ndpi_async;
+
+	if (!async)
+		return;
+
+	rcu_assign_pointer(ndpi_async, NULL);
+	dp_rcu_synchronize();
+	dpi_ndpi_async_free(async);
+}
+
+/*
+ * Start a DPI worker on each of the configured cores.
+ */
+static int
+dpi_ndpi_async_start(void)
+{
+	struct ndpi_async *async;
+	struct ndpi_async_worker *worker;
+	unsigned int n_workers, cpu, i;
+	char name[RTE_RING_NAMESIZE];
+	cpu_set_t cpuset;
+	int rc;
+
+	n_workers = bitmask_numset(&ndpi_worker_cores);
+	if (n_workers == 0)
+		return 0;
+
+	async = calloc(1, sizeof(*async) + n_workers * sizeof(*worker));
+	if (!async)
+		return -ENOMEM;
+
+	async->pool = rte_mempool_create("dpi-async",
+					 NDPI_ASYNC_POOL_SZ,
+					 sizeof(struct ndpi_async_req),
+					 NDPI_ASYNC_POOL_CACHE, 0,
+					 NULL, NULL, NULL, NULL,
+					 SOCKET_ID_ANY, 0);
+	if (!async->pool) {
+		RTE_LOG(ERR, DATAPLANE,
+			"dpi: could not create request pool: %s\n",
+			rte_strerror(rte_errno));
+		free(async);
+		return -ENOMEM;
+	}
+
+	i = 0;
+	for (cpu = 0; cpu < BITMASK_BITS && i < n_workers; cpu++) {
+		if (!bitmask_isset(&ndpi_worker_cores, cpu))
+			continue;
+
+		worker = &async->workers[i++];
+		async->n_workers = i;
+		worker->async = async;
+		worker->cpu = cpu;
+
+		snprintf(name, sizeof(name), "dpi-async-%u", cpu);
+		worker->ring = rte_ring_create(name, NDPI_ASYNC_RING_SZ,
+					       SOCKET_ID_ANY, RING_F_SC_DEQ);
+		worker->detect = dpi_ndpi_detection_module_create();
+		if (!worker->ring || !worker->detect) {
+			rc = -ENOMEM;
+			goto fail;
+		}
+
+		worker->running = true;
+		if (pthread_create(&worker->tid, NULL, dpi_ndpi_worker,
+				   worker) != 0) {
+			worker->running = false;
+			rc = -ENOMEM;
+			goto fail;
+		}
+
+		CPU_ZERO(&cpuset);
+		CPU_SET(cpu, &cpuset);
+		rc = pthread_setaffinity_np(worker->tid, sizeof(cpuset),
+					    &cpuset);
+		if (rc != 0) {
+			RTE_LOG(ERR, DATAPLANE,
+				"dpi: could not pin worker to core %u: %s\n",
+				cpu, strerror(rc));
+			rc = -rc;
+			goto fail;
+		}
+	}
+
+	rcu_assign_pointer(ndpi_async, async);
+	return 0;
+
+fail:
+	RTE_LOG(ERR, DATAPLANE,
+		"dpi: could not start worker on core %u\n", cpu);
+	dpi_ndpi_async_free(async);
+	return rc;
+}
+
 /**
  * Initialise nDPI's detection modules.
  *
@@ -229,18 +600,15 @@ static int
 dpi_ndpi_init(void)
 {
 	unsigned int lcore;
-	NDPI_PROTOCOL_BITMASK all;
-	FILE *file;
 
 	if (initialised)
 		return 0;
 
 	set_ndpi_malloc(zmalloc_aligned);
-	NDPI_BITMASK_SET_ALL(all);
 
 	FOREACH_DP_LCORE(lcore) {
 		struct ndpi_detection_module_struct *detect
-			= ndpi_init_detection_module(ndpi_no_prefs);
+			= dpi_ndpi_detection_module_create();
 		if (!detect) {
 			RTE_LOG(ERR, DATAPLANE,
 				"Failed to initialise detection module: %d\n",
@@ -248,24 +616,14 @@ dpi_ndpi_init(void)
 			dpi_ndpi_terminate();
 			return -ENOMEM;
 		}
-		ndpi_set_protocol_detection_bitmask2(detect, &all);
-
-		if ((file = fopen(NDPI_PROTOCOLS_PATH, "r")) != NULL) {
-			ndpi_load_protocols_file(detect, NDPI_PROTOCOLS_PATH);
-			fclose(file);
-		}
-
-		if ((file = fopen(NDPI_CATEGORIES_PATH, "r")) != NULL) {
-			ndpi_load_categories_file(detect, NDPI_CATEGORIES_PATH);
-			fclose(file);
-		}
-
-		ndpi_finalize_initalization(detect);
 
 		detection_modules[lcore] = detect;
 	}
 
 	initialised = true;
+
+	/* Fall back to inline detection if the workers can't be started */
+	dpi_ndpi_async_start();
 	return 0;
 }
 
@@ -278,6 +636,9 @@ static bool
 dpi_ndpi_terminate(void)
 {
 	unsigned int lcore;
+
+	dpi_ndpi_async_stop();
+
 	RTE_LCORE_FOREACH(lcore) {
 		if (detection_modules[lcore]) {
 			ndpi_exit_detection_module(detection_modules[lcore]);
@@ -289,6 +650,25 @@ dpi_ndpi_terminate(void)
 	return true;
 }
 
+/*
+ * Set the cores to run DPI workers on, restarting any running workers.
+ * An empty set returns to inline detection on the forwarding cores.
+ */
+static int
+dpi_ndpi_set_workers(const bitmask_t *cores)
+{
+	if (bitmask_equal(&ndpi_worker_cores, cores))
+		return 0;
+
+	dpi_ndpi_async_stop();
+	bitmask_copy(&ndpi_worker_cores, cores);
+
+	if (!initialised)
+		return 0;
+
+	return dpi_ndpi_async_start();
+}
+
 /**
  * Increment the refcount.
  */
@@ -312,21 +692,6 @@ dpi_ndpi_refcount_dec(void)
 	return ndpi_refcount;
 }
 
-/**
- * Free the dpi flow. Called from RCU callback.
- */
-static void
-dpi_ndpi_free(struct rcu_head *head)
-{
-	struct ndpi_flow *flow = caa_container_of(head, struct ndpi_flow,
-						  n_rcu_head);
-
-	ndpi_free_flow(flow->key);
-	ndpi_free(flow->src_id);
-	ndpi_free(flow->dest_id);
-	free(flow);
-}
-
 /*
  * Destroy the given flow, which can be NULL.
  */
@@ -336,8 +701,7 @@ dpi_ndpi_session_flow_destroy(struct dpi_engine_flow *dpi_flow)
 	if (!dpi_flow)
 		return;
 
-	struct ndpi_flow *flow = (struct ndpi_flow *) dpi_flow;
-	call_rcu(&flow->n_rcu_head, dpi_ndpi_free);
+	dpi_ndpi_flow_put((struct ndpi_flow *) dpi_flow);
 }
 
 /*
@@ -360,6 +724,7 @@ dpi_ndpi_session_first_packet(struct npf_session *se __unused,
 	flow->type = DPI_APP_TYPE_NONE;
 	flow->error = false;
 	flow->offloaded = false;
+	flow->refcnt = 1;
 	rte_spinlock_init(&flow->fl_lock);
 
 	flow->key = ndpi_flow_malloc(SIZEOF_FLOW_STRUCT);
@@ -580,6 +945,7 @@ struct dpi_engine_procs ndpi_engine_procs = {
 	.id = IANA_NDPI,
 	.init = dpi_ndpi_init,
 	.terminate = dpi_ndpi_terminate,
+	.set_workers = dpi_ndpi_set_workers,
 	.refcount_inc = dpi_ndpi_refcount_inc,
 	.refcount_dec = dpi_ndpi_refcount_dec,
 	.destructor = dpi_ndpi_session_flow_destroy,
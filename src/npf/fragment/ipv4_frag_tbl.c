@@ -50,6 +50,7 @@
 #include <rte_timer.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <urcu/uatomic.h>
 
 #include "ipv4_frag_tbl.h"
 #include "ipv4_rsmbl.h"
@@ -62,6 +63,123 @@ struct cds_lfht;
 
 static struct rte_timer ipv4_timer;
 static uint32_t hash_seed;
+static uint32_t src_hash_seed;
+
+/* Memory held in fragment sets by a source address */
+struct ipv4_frag_src {
+	uint32_t addr;
+	uint32_t sets;		/* fragment sets, way is free if 0 */
+	uint32_t bytes;		/* mbuf bytes held by them */
+};
+
+struct ipv4_frag_src_bucket {
+	rte_spinlock_t lock;
+	struct ipv4_frag_src way[IPV4_FRAG_SRC_WAYS];
+	struct ipv4_frag_src overflow;	/* sources without a way */
+} __rte_cache_aligned;
+
+static struct ipv4_frag_src_bucket ipv4_frag_srcs[IPV4_FRAG_SRC_BUCKETS];
+
+static struct ipv4_frag_src_bucket *ipv4_frag_src_bucket(uint32_t addr)
+{
+	return &ipv4_frag_srcs[rte_jhash_1word(addr, src_hash_seed) &
+			       (IPV4_FRAG_SRC_BUCKETS - 1)];
+}
+
+static struct ipv4_frag_src *
+ipv4_frag_src_entry(struct ipv4_frag_src_bucket *b, unsigned int way)
+{
+	return way < IPV4_FRAG_SRC_WAYS ? &b->way[way] : &b->overflow;
+}
+
+/*
+ * Find the way for the source in its bucket, or claim a free one.
+ * Called with the bucket lock held.
+ */
+static unsigned int
+ipv4_frag_src_way(struct ipv4_frag_src_bucket *b, uint32_t addr)
+{
+	unsigned int way;
+
+	for (way = 0; way < IPV4_FRAG_SRC_WAYS; way++)
+		if (b->way[way].sets && b->way[way].addr == addr)
+			return way;
+
+	for (way = 0; way < IPV4_FRAG_SRC_WAYS; way++)
+		if (!b->way[way].sets) {
+			b->way[way].addr = addr;
+			return way;
+		}
+
+	return IPV4_FRAG_SRC_WAYS;
+}
+
+/* Attach a new fragment set to the accounting for its source */
+static void ipv4_frag_src_get(struct ipv4_frag_pkt *pkt, uint32_t addr)
+{
+	struct ipv4_frag_src_bucket *b = ipv4_frag_src_bucket(addr);
+
+	pkt->src_bucket = b - ipv4_frag_srcs;
+
+	rte_spinlock_lock(&b->lock);
+	pkt->src_way = ipv4_frag_src_way(b, addr);
+	ipv4_frag_src_entry(b, pkt->src_way)->sets++;
+	rte_spinlock_unlock(&b->lock);
+}
+
+/* Release the memory held by a fragment set and detach it */
+static void ipv4_frag_src_put(struct ipv4_frag_pkt *pkt)
+{
+	struct ipv4_frag_src_bucket *b = &ipv4_frag_srcs[pkt->src_bucket];
+	struct ipv4_frag_src *src;
+
+	rte_spinlock_lock(&b->lock);
+	src = ipv4_frag_src_entry(b, pkt->src_way);
+	src->bytes -= pkt->held_bytes;
+	src->sets--;
+	rte_spinlock_unlock(&b->lock);
+}
+
+/*
+ * Account for a fragment about to be held by a set.  Returns false if
+ * that would take the source of the set over its memory limit.
+ */
+bool ipv4_frag_src_hold(struct ipv4_frag_pkt *pkt, uint32_t bytes)
+{
+	struct ipv4_frag_src_bucket *b = &ipv4_frag_srcs[pkt->src_bucket];
+	struct ipv4_frag_src *src;
+	bool ok;
+
+	rte_spinlock_lock(&b->lock);
+	src = ipv4_frag_src_entry(b, pkt->src_way);
+	ok = src->bytes + bytes <= IPV4_FRAG_SRC_MAX_BYTES;
+	if (ok)
+		src->bytes += bytes;
+	rte_spinlock_unlock(&b->lock);
+
+	if (ok)
+		pkt->held_bytes += bytes;
+	return ok;
+}
+
+/* Bytes held in fragment sets by a source, or by its overflow entry */
+uint32_t ipv4_frag_src_held(uint32_t addr)
+{
+	struct ipv4_frag_src_bucket *b = ipv4_frag_src_bucket(addr);
+	unsigned int way;
+	uint32_t bytes;
+
+	rte_spinlock_lock(&b->lock);
+	bytes = b->overflow.bytes;
+	for (way = 0; way < IPV4_FRAG_SRC_WAYS; way++)
+		if (b->way[way].sets && b->way[way].addr == addr) {
+			bytes = b->way[way].bytes;
+			break;
+		}
+	rte_spinlock_unlock(&b->lock);
+
+	return bytes;
+}
 
 /* free a pkt */
 static void ipv4_frag_free_pkt(struct rcu_head *head)
@@ -74,6 +192,7 @@ static void ipv4_frag_free_pkt(struct rcu_head *head)
 		if (pkt->frags[i].mb)
 			rte_pktmbuf_free(pkt->frags[i].mb);
 	}
+	ipv4_frag_src_put(pkt);
 	free(pkt);
 }
 
@@ -92,10 +211,27 @@ static void ipv4_frag_timeout_stats(struct ipv4_frag_pkt *pkt)
 }
 
 /* Delete a frag packet struct from the hash table */
-void ipv4_frag_free(struct cds_lfht *frag_table, struct ipv4_frag_pkt *pkt)
+void ipv4_frag_free(struct vrf *vrf, struct ipv4_frag_pkt *pkt)
 {
-	if (!cds_lfht_del(frag_table, &pkt->pkt_node))
+	if (!cds_lfht_del(vrf->v_ipv4_frag_table, &pkt->pkt_node)) {
+		uatomic_dec(&vrf->v_ipv4_frag_cnt);
 		call_rcu(&pkt->pkt_rcu_head, ipv4_frag_free_pkt);
+	}
+}
+
+/* Free the expired frag pkts of a vrf */
+static void ipv4_frag_expire(struct vrf *vrf, uint64_t current)
+{
+	struct cds_lfht_iter iter;
+	struct ipv4_frag_pkt *pkt;
+
+	cds_lfht_for_each_entry(vrf->v_ipv4_frag_table, &iter, pkt,
+				pkt_node) {
+		if (pkt->pkt_expire < current) {
+			ipv4_frag_timeout_stats(pkt);
+			ipv4_frag_free(vrf, pkt);
+		}
+	}
 }
 
 /*
@@ -106,21 +242,12 @@ void ipv4_frag_free(struct cds_lfht *frag_table, struct ipv4_frag_pkt *pkt)
  */
 static void ipv4_gc(struct rte_timer *t __rte_unused, void *arg __rte_unused)
 {
-	struct cds_lfht_iter iter;
-	struct ipv4_frag_pkt *pkt;
 	uint64_t current = rte_get_timer_cycles();
 	vrfid_t vrfid;
 	struct vrf *vrf;
 
-	VRF_FOREACH(vrf, vrfid) {
-		cds_lfht_for_each_entry(vrf->v_ipv4_frag_table, &iter, pkt,
-					pkt_node) {
-			if (pkt->pkt_expire < current) {
-				ipv4_frag_timeout_stats(pkt);
-				ipv4_frag_free(vrf->v_ipv4_frag_table, pkt);
-			}
-		}
-	}
+	VRF_FOREACH(vrf, vrfid)
+		ipv4_frag_expire(vrf, current);
 }
 
 /* Clear the rte_mbufs from a pkt */
@@ -160,29 +287,25 @@ static int ipv4_match(struct cds_lfht_node *node, const void *data)
 	return rc;
 }
 
-/* Count nodes */
-static unsigned long ipv4_frag_count(struct cds_lfht *frag_table)
-{
-	unsigned long count;
-	long dummy;
-
-	cds_lfht_count_nodes(frag_table, &dummy, &count, &dummy);
-	return count;
-}
-
 /* Add a new pkt if max not reached */
 static struct ipv4_frag_pkt *
-ipv4_frag_create(struct cds_lfht *frag_table, unsigned long hash,
-		 const struct ipv4_frag_key *key)
+ipv4_frag_create(struct vrf *vrf, unsigned long hash,
+		 const struct ipv4_frag_key *key, uint64_t current)
 {
 	struct ipv4_frag_pkt *pkt;
 	struct cds_lfht_node *node;
-	unsigned long count;
+	const uint32_t *src_dst;
 
-	/* Max packets reached? */
-	count = ipv4_frag_count(frag_table);
-	if (count >= IPV4_MAX_FRAG_SETS)
-		return NULL;
+	/*
+	 * Max packets reached?  Reclaim any expired sets before giving
+	 * up rather than waiting for the next gc run.
+	 */
+	if (CMM_LOAD_SHARED(vrf->v_ipv4_frag_cnt) >= IPV4_MAX_FRAG_SETS) {
+		ipv4_frag_expire(vrf, current);
+		if (CMM_LOAD_SHARED(vrf->v_ipv4_frag_cnt) >=
+		    IPV4_MAX_FRAG_SETS)
+			return NULL;
+	}
 
 	pkt = calloc(1, sizeof(struct ipv4_frag_pkt));
 	if (!pkt)
@@ -193,19 +316,22 @@ ipv4_frag_create(struct cds_lfht *frag_table, unsigned long hash,
 	pkt->pkt_key.id = key->id;
 	pkt->last_idx = FIRST_INTERMEDIATE_FRAG_IDX;
 	cds_lfht_node_init(&pkt->pkt_node);
-	pkt->pkt_expire = rte_get_timer_cycles() +
-		(rte_get_timer_hz() * IPV4_FRAG_SET_TTL);
+	pkt->pkt_expire = current + (rte_get_timer_hz() * IPV4_FRAG_SET_TTL);
+	src_dst = (const uint32_t *)&key->src_dst;
+	ipv4_frag_src_get(pkt, src_dst[0]);
 
 	/*
 	 * Now try to add the new pkt, if somebody beat us to it,
 	 * use that one.
 	 */
-	node = cds_lfht_add_unique(frag_table, hash, ipv4_match,
+	node = cds_lfht_add_unique(vrf->v_ipv4_frag_table, hash, ipv4_match,
 				key, &pkt->pkt_node);
 	if (node != &pkt->pkt_node) {
+		ipv4_frag_src_put(pkt);
 		free(pkt);
 		pkt = caa_container_of(node, struct ipv4_frag_pkt, pkt_node);
-	}
+	} else
+		uatomic_inc(&vrf->v_ipv4_frag_cnt);
 
 	return pkt;
 }
@@ -238,11 +364,22 @@ struct ipv4_frag_pkt *ipv4_frag_find(struct vrf *vrf,
 {
 	struct ipv4_frag_pkt *pkt;
 	unsigned long hash = ipv4_hash(key);
-	struct cds_lfht *frag_table = vrf->v_ipv4_frag_table;
+	uint64_t current = rte_get_timer_cycles();
+
+	pkt = ipv4_frag_lookup(vrf->v_ipv4_frag_table, hash, key);
+
+	/*
+	 * An expired set is stale, e.g. the ID has wrapped, so free it
+	 * here and start a new one rather than adding to it.
+	 */
+	if (pkt && pkt->pkt_expire < current) {
+		ipv4_frag_timeout_stats(pkt);
+		ipv4_frag_free(vrf, pkt);
+		pkt = NULL;
+	}
 
-	pkt = ipv4_frag_lookup(frag_table, hash, key);
 	if (!pkt)
-		pkt = ipv4_frag_create(frag_table, hash, key);
+		pkt = ipv4_frag_create(vrf, hash, key, current);
 	return pkt;
 }
 
@@ -257,7 +394,7 @@ ipv4_fragment_table_uninit(struct vrf *vrf)
 
 	cds_lfht_for_each_entry(vrf->v_ipv4_frag_table, &iter, pkt,
 				pkt_node) {
-		ipv4_frag_free(vrf->v_ipv4_frag_table, pkt);
+		ipv4_frag_free(vrf, pkt);
 	}
 
 	dp_ht_destroy_deferred(vrf->v_ipv4_frag_table);
@@ -316,6 +453,13 @@ void fragment_tables_uninit(struct vrf *vrf)
 static void
 ipv4_fragment_tables_timer_init(void)
 	{
+	unsigned int i;
+
+	/* Seeded once, per-source accounting is shared by all VRFs */
+	src_hash_seed = random();
+	for (i = 0; i < IPV4_FRAG_SRC_BUCKETS; i++)
+		rte_spinlock_init(&ipv4_frag_srcs[i].lock);
+
 	/*
 	 * Creat a timer for cleanup of stale entries.
 	 */
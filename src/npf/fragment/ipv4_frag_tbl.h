@@ -46,6 +46,7 @@
 
 #include <rte_memory.h>
 #include <rte_spinlock.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <urcu.h>
 
@@ -79,6 +80,18 @@ struct vrf;
 /* Timeout period for incomplete fragment sets */
 #define IPV4_FRAG_SET_TTL       15
 
+/*
+ * Memory held in incomplete fragment sets is accounted per source
+ * address, so that a single source cannot consume all of the fragment
+ * sets.  Sources are kept in a set associative table of
+ * IPV4_FRAG_SRC_BUCKETS buckets, each holding IPV4_FRAG_SRC_WAYS exact
+ * addresses.  Sources that don't fit in their bucket share its
+ * overflow entry.  IPV4_FRAG_SRC_BUCKETS must be a power of two.
+ */
+#define IPV4_FRAG_SRC_BUCKETS	256
+#define IPV4_FRAG_SRC_WAYS	4
+#define IPV4_FRAG_SRC_MAX_BYTES	(512 * 1024)
+
 struct ipv4_frag {
 	uint16_t ofs;
 	uint16_t len;
@@ -106,13 +119,18 @@ struct ipv4_frag_pkt {
 	uint32_t		total_size;	/* expected reassembled size */
 	uint32_t		frag_size;	/* size of fragments received */
 	uint32_t		last_idx;	/* next entry to fill */
+	uint32_t		held_bytes;	/* mbuf bytes held by set */
+	uint16_t		src_bucket;	/* per-source accounting */
+	uint8_t			src_way;	/* WAYS for overflow */
 	struct ipv4_frag	frags[IPV4_MAX_FRAGS_PER_SET];
 } __rte_cache_aligned;
 
 
 void ipv4_frag_tbl_create(void);
-void ipv4_frag_free(struct cds_lfht *frag_table, struct ipv4_frag_pkt *);
+void ipv4_frag_free(struct vrf *vrf, struct ipv4_frag_pkt *);
 void ipv4_frag_clear(struct ipv4_frag_pkt *);
+bool ipv4_frag_src_hold(struct ipv4_frag_pkt *pkt, uint32_t bytes);
+uint32_t ipv4_frag_src_held(uint32_t addr);
 struct ipv4_frag_pkt *ipv4_frag_find(struct vrf *vrf,
 				     const struct ipv4_frag_key *);
 
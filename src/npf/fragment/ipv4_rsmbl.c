@@ -61,8 +61,6 @@
 #include "util.h"
 #include "vrf_internal.h"
 
-struct cds_lfht;
-
 /*
  * Helper function.
  * Takes 2 mbufs that represents two fragments of the same packet and
@@ -171,7 +169,7 @@ static struct rte_mbuf *ipv4_frag_reassemble(struct ipv4_frag_pkt *fp)
  *	 - mbuf was added to the table, and held for later
  */
 static struct rte_mbuf *
-ipv4_frag_process(struct cds_lfht *frag_tables, struct ipv4_frag_pkt *fp,
+ipv4_frag_process(struct vrf *vrf, struct ipv4_frag_pkt *fp,
 		  struct rte_mbuf *mb, uint16_t ofs, uint16_t len,
 		  uint16_t more_frags)
 {
@@ -244,13 +242,22 @@ ipv4_frag_process(struct cds_lfht *frag_tables, struct ipv4_frag_pkt *fp,
 
 	/* errorneous packet: exceeded max allowed number of fragments */
 	if (idx >= ARRAY_SIZE(fp->frags)) {
-		ipv4_frag_free(frag_tables, fp);
+		ipv4_frag_free(vrf, fp);
 		IPSTAT_INC(vrf_id, IPSTATS_MIB_REASMFAILS);
 		rte_pktmbuf_free(mb);	/* drop bad packet as well */
 		mb = NULL;
 		goto done;
 	}
 
+	/* source is holding too much memory in fragment sets */
+	if (!ipv4_frag_src_hold(fp, rte_pktmbuf_pkt_len(mb))) {
+		ipv4_frag_free(vrf, fp);
+		IPSTAT_INC(vrf_id, IPSTATS_MIB_REASMFAILS);
+		rte_pktmbuf_free(mb);
+		mb = NULL;
+		goto done;
+	}
+
 	if (unlikely(!pipeline_fused_l2_consume(&pkt))) {
 		mb = NULL;
 		goto done;
@@ -281,7 +288,7 @@ ipv4_frag_process(struct cds_lfht *frag_tables, struct ipv4_frag_pkt *fp,
 		mb = ipv4_frag_reassemble(fp);
 		if (!mb) {
 			IPSTAT_INC(vrf_id, IPSTATS_MIB_REASMFAILS);
-			ipv4_frag_free(frag_tables, fp);
+			ipv4_frag_free(vrf, fp);
 		} else {
 			/*
 			 * On successful reassembly, NULL out the
@@ -290,7 +297,7 @@ ipv4_frag_process(struct cds_lfht *frag_tables, struct ipv4_frag_pkt *fp,
 			ipv4_frag_clear(fp);
 
 			/* Delete this pkt from the table */
-			ipv4_frag_free(frag_tables, fp);
+			ipv4_frag_free(vrf, fp);
 			IPSTAT_INC(vrf_id, IPSTATS_MIB_REASMOKS);
 		}
 	}
@@ -343,8 +350,7 @@ static struct rte_mbuf *ipv4_frag_mbuf(struct rte_mbuf *mb)
 	}
 
 	/* process the fragmented packet. */
-	mb = ipv4_frag_process(vrf->v_ipv4_frag_table,
-			       fp, mb, ip_ofs, ip_len, ip_flag);
+	mb = ipv4_frag_process(vrf, fp, mb, ip_ofs, ip_len, ip_flag);
 
 	return mb;
 }
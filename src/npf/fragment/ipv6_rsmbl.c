@@ -30,8 +30,6 @@
 #include "util.h"
 #include "vrf_internal.h"
 
-struct cds_lfht;
-
 /*
  * Helper function.  Takes 2 mbufs that represents two fragments of
  * the same packet and chains them into one mbuf.
@@ -222,7 +220,7 @@ ipv6_frag_reassemble(struct ipv6_frag_pkt *fp)
  *	 - mbuf was added to the table, and held for later
  */
 static struct rte_mbuf *
-ipv6_frag_process(struct cds_lfht *frag_table, struct ipv6_frag_pkt *fp,
+ipv6_frag_process(struct vrf *vrf, struct ipv6_frag_pkt *fp,
 		  struct rte_mbuf *m, npf_cache_t *npc, uint16_t *gleaned_mtu)
 {
 	struct ip6_hdr	*ip6;
@@ -367,13 +365,22 @@ ipv6_frag_process(struct cds_lfht *frag_table, struct ipv6_frag_pkt *fp,
 	 */
 	if (idx >= ARRAY_SIZE(fp->frags) ||
 		fp->frags[idx].mb != NULL) {
-		ipv6_frag_free(frag_table, fp);
+		ipv6_frag_free(vrf, fp);
 		IP6STAT_INC(vrf_id, IPSTATS_MIB_REASMFAILS);
 		rte_pktmbuf_free(m);	/* drop bad packet as well */
 		m = NULL;
 		goto done;
 	}
 
+	/* source is holding too much memory in fragment sets */
+	if (!ipv6_frag_src_hold(fp, rte_pktmbuf_pkt_len(m))) {
+		ipv6_frag_free(vrf, fp);
+		IP6STAT_INC(vrf_id, IPSTATS_MIB_REASMFAILS);
+		rte_pktmbuf_free(m);
+		m = NULL;
+		goto done;
+	}
+
 	if (unlikely(!pipeline_fused_l2_consume(&pkt))) {
 		m = NULL;
 		goto done;
@@ -402,7 +409,7 @@ ipv6_frag_process(struct cds_lfht *frag_table, struct ipv6_frag_pkt *fp,
 		m = ipv6_frag_reassemble(fp);
 		if (!m) {
 			IP6STAT_INC(vrf_id, IPSTATS_MIB_REASMFAILS);
-			ipv6_frag_free(frag_table, fp);
+			ipv6_frag_free(vrf, fp);
 		} else {
 			/*
 			 * Pass the values we cached from the first
@@ -433,7 +440,7 @@ ipv6_frag_process(struct cds_lfht *frag_table, struct ipv6_frag_pkt *fp,
 			ipv6_frag_clear(fp);
 
 			/* Delete this pkt from the table */
-			ipv6_frag_free(frag_table, fp);
+			ipv6_frag_free(vrf, fp);
 			IP6STAT_INC(vrf_id, IPSTATS_MIB_REASMOKS);
 		}
 	}
@@ -485,7 +492,7 @@ ipv6_frag_mbuf(struct rte_mbuf *m, npf_cache_t *npc,
 	}
 
 	/* process the fragmented packet. */
-	m = ipv6_frag_process(vrf->v_ipv6_frag_table, fp, m, npc, gleaned_mtu);
+	m = ipv6_frag_process(vrf, fp, m, npc, gleaned_mtu);
 
 	return m;
 }
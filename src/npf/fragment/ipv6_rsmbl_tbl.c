@@ -14,6 +14,8 @@
 #include <rte_mbuf.h>
 #include <rte_timer.h>
 #include <stdlib.h>
+#include <string.h>
+#include <urcu/uatomic.h>
 
 #include "compiler.h"
 #include "npf/fragment/ipv4_rsmbl.h"
@@ -30,6 +32,25 @@ struct cds_lfht;
  */
 static struct rte_timer ipv6_timer;
 static uint32_t ipv6_hash_seed;
+static uint32_t ipv6_src_hash_seed;
+
+/* Source address is the first half of the key */
+#define IPV6_FRAG_SRC_WORDS	(IPV6_FRAG_KEY_WORDS / 2)
+
+/* Memory held in fragment sets by a source address */
+struct ipv6_frag_src {
+	uint32_t addr[IPV6_FRAG_SRC_WORDS];
+	uint32_t sets;		/* fragment sets, way is free if 0 */
+	uint32_t bytes;		/* mbuf bytes held by them */
+};
+
+struct ipv6_frag_src_bucket {
+	rte_spinlock_t lock;
+	struct ipv6_frag_src way[IPV6_FRAG_SRC_WAYS];
+	struct ipv6_frag_src overflow;	/* sources without a way */
+} __rte_cache_aligned;
+
+static struct ipv6_frag_src_bucket ipv6_frag_srcs[IPV6_FRAG_SRC_BUCKETS];
 
 static inline void
 ipv6_frag_key_copy(struct ipv6_frag_key *dst,
@@ -74,6 +95,121 @@ ipv6_frag_timeout_stats(struct ipv6_frag_pkt *fp __unused)
 {
 }
 
+static struct ipv6_frag_src_bucket *
+ipv6_frag_src_bucket(const uint32_t *addr)
+{
+	return &ipv6_frag_srcs[rte_jhash_32b(addr, IPV6_FRAG_SRC_WORDS,
+					     ipv6_src_hash_seed) &
+			       (IPV6_FRAG_SRC_BUCKETS - 1)];
+}
+
+static struct ipv6_frag_src *
+ipv6_frag_src_entry(struct ipv6_frag_src_bucket *b, unsigned int way)
+{
+	return way < IPV6_FRAG_SRC_WAYS ? &b->way[way] : &b->overflow;
+}
+
+static bool
+ipv6_frag_src_match(const struct ipv6_frag_src *src, const uint32_t *addr)
+{
+	return src->sets &&
+		memcmp(src->addr, addr, sizeof(src->addr)) == 0;
+}
+
+/*
+ * Find the way for the source in its bucket, or claim a free one.
+ * Called with the bucket lock held.
+ */
+static unsigned int
+ipv6_frag_src_way(struct ipv6_frag_src_bucket *b, const uint32_t *addr)
+{
+	unsigned int way;
+
+	for (way = 0; way < IPV6_FRAG_SRC_WAYS; way++)
+		if (ipv6_frag_src_match(&b->way[way], addr))
+			return way;
+
+	for (way = 0; way < IPV6_FRAG_SRC_WAYS; way++)
+		if (!b->way[way].sets) {
+			memcpy(b->way[way].addr, addr,
+			       sizeof(b->way[way].addr));
+			return way;
+		}
+
+	return IPV6_FRAG_SRC_WAYS;
+}
+
+/* Attach a new fragment set to the accounting for its source */
+static void
+ipv6_frag_src_get(struct ipv6_frag_pkt *fp, const uint32_t *addr)
+{
+	struct ipv6_frag_src_bucket *b = ipv6_frag_src_bucket(addr);
+
+	fp->src_bucket = b - ipv6_frag_srcs;
+
+	rte_spinlock_lock(&b->lock);
+	fp->src_way = ipv6_frag_src_way(b, addr);
+	ipv6_frag_src_entry(b, fp->src_way)->sets++;
+	rte_spinlock_unlock(&b->lock);
+}
+
+/* Release the memory held by a fragment set and detach it */
+static void
+ipv6_frag_src_put(struct ipv6_frag_pkt *fp)
+{
+	struct ipv6_frag_src_bucket *b = &ipv6_frag_srcs[fp->src_bucket];
+	struct ipv6_frag_src *src;
+
+	rte_spinlock_lock(&b->lock);
+	src = ipv6_frag_src_entry(b, fp->src_way);
+	src->bytes -= fp->held_bytes;
+	src->sets--;
+	rte_spinlock_unlock(&b->lock);
+}
+
+/*
+ * Account for a fragment about to be held by a set.  Returns false if
+ * that would take the source of the set over its memory limit.
+ */
+bool
+ipv6_frag_src_hold(struct ipv6_frag_pkt *fp, uint32_t bytes)
+{
+	struct ipv6_frag_src_bucket *b = &ipv6_frag_srcs[fp->src_bucket];
+	struct ipv6_frag_src *src;
+	bool ok;
+
+	rte_spinlock_lock(&b->lock);
+	src = ipv6_frag_src_entry(b, fp->src_way);
+	ok = src->bytes + bytes <= IPV6_FRAG_SRC_MAX_BYTES;
+	if (ok)
+		src->bytes += bytes;
+	rte_spinlock_unlock(&b->lock);
+
+	if (ok)
+		fp->held_bytes += bytes;
+	return ok;
+}
+
+/* Bytes held in fragment sets by a source, or by its overflow entry */
+uint32_t
+ipv6_frag_src_held(const uint32_t *addr)
+{
+	struct ipv6_frag_src_bucket *b = ipv6_frag_src_bucket(addr);
+	unsigned int way;
+	uint32_t bytes;
+
+	rte_spinlock_lock(&b->lock);
+	bytes = b->overflow.bytes;
+	for (way = 0; way < IPV6_FRAG_SRC_WAYS; way++)
+		if (ipv6_frag_src_match(&b->way[way], addr)) {
+			bytes = b->way[way].bytes;
+			break;
+		}
+	rte_spinlock_unlock(&b->lock);
+
+	return bytes;
+}
+
 /*
  * free a fragmentation packet
  */
@@ -91,6 +227,7 @@ static void ipv6_frag_free_pkt(struct rcu_head *head)
 			fp->frags[i].mb = NULL;
 		}
 	}
+	ipv6_frag_src_put(fp);
 	free(fp);
 }
 
@@ -98,10 +235,30 @@ static void ipv6_frag_free_pkt(struct rcu_head *head)
  * Delete a frag packet struct from the hash table
  */
 void
-ipv6_frag_free(struct cds_lfht *frag_table, struct ipv6_frag_pkt *fp)
+ipv6_frag_free(struct vrf *vrf, struct ipv6_frag_pkt *fp)
 {
-	if (!cds_lfht_del(frag_table, &fp->pkt_node))
+	if (!cds_lfht_del(vrf->v_ipv6_frag_table, &fp->pkt_node)) {
+		uatomic_dec(&vrf->v_ipv6_frag_cnt);
 		call_rcu(&fp->pkt_rcu_head, ipv6_frag_free_pkt);
+	}
+}
+
+/*
+ * Free the expired frag pkts of a vrf
+ */
+static void
+ipv6_frag_expire(struct vrf *vrf, uint64_t current)
+{
+	struct cds_lfht_iter iter;
+	struct ipv6_frag_pkt *fp;
+
+	cds_lfht_for_each_entry(vrf->v_ipv6_frag_table, &iter, fp,
+				pkt_node) {
+		if (fp->pkt_expire < current) {
+			ipv6_frag_timeout_stats(fp);
+			ipv6_frag_free(vrf, fp);
+		}
+	}
 }
 
 /*
@@ -113,8 +270,6 @@ ipv6_frag_free(struct cds_lfht *frag_table, struct ipv6_frag_pkt *fp)
 static void
 ipv6_gc(struct rte_timer *t __rte_unused, void *arg __rte_unused)
 {
-	struct cds_lfht_iter iter;
-	struct ipv6_frag_pkt *fp;
 	uint64_t current = get_time_uptime(); /* uptime in secs */
 	vrfid_t vrfid;
 	struct vrf *vrf;
@@ -123,13 +278,7 @@ ipv6_gc(struct rte_timer *t __rte_unused, void *arg __rte_unused)
 		if (!vrf)
 			continue;
 
-		cds_lfht_for_each_entry(vrf->v_ipv6_frag_table, &iter, fp,
-					pkt_node) {
-			if (fp->pkt_expire < current) {
-				ipv6_frag_timeout_stats(fp);
-				ipv6_frag_free(vrf->v_ipv6_frag_table, fp);
-			}
-		}
+		ipv6_frag_expire(vrf, current);
 	}
 }
 
@@ -167,32 +316,26 @@ ipv6_match(struct cds_lfht_node *node, const void *data)
 	return ipv6_frag_key_cmp(key, &fp->pkt_key) == 0 ? 1 : 0;
 }
 
-/* Count nodes */
-static unsigned long
-ipv6_frag_count(struct cds_lfht *frag_table)
-{
-	unsigned long count;
-	long dummy;
-
-	cds_lfht_count_nodes(frag_table, &dummy, &count, &dummy);
-	return count;
-}
-
 /*
  * Add a new pkt if max not reached
  */
 static struct ipv6_frag_pkt *
-ipv6_frag_create(struct cds_lfht *frag_table, unsigned long hash,
-		 const struct ipv6_frag_key *key)
+ipv6_frag_create(struct vrf *vrf, unsigned long hash,
+		 const struct ipv6_frag_key *key, uint64_t current)
 {
 	struct cds_lfht_node *node;
 	struct ipv6_frag_pkt *fp;
-	unsigned long count;
 
-	/* Max packets reached? */
-	count = ipv6_frag_count(frag_table);
-	if (count >= IPV6_MAX_FRAG_SETS)
-		return NULL;
+	/*
+	 * Max packets reached?  Reclaim any expired sets before giving
+	 * up rather than waiting for the next gc run.
+	 */
+	if (CMM_LOAD_SHARED(vrf->v_ipv6_frag_cnt) >= IPV6_MAX_FRAG_SETS) {
+		ipv6_frag_expire(vrf, current);
+		if (CMM_LOAD_SHARED(vrf->v_ipv6_frag_cnt) >=
+		    IPV6_MAX_FRAG_SETS)
+			return NULL;
+	}
 
 	fp = calloc(1, sizeof(struct ipv6_frag_pkt));
 	if (!fp)
@@ -202,18 +345,21 @@ ipv6_frag_create(struct cds_lfht *frag_table, unsigned long hash,
 	ipv6_frag_key_copy(&fp->pkt_key, key);
 	fp->last_idx = FIRST_INTERMEDIATE_FRAG_IDX;
 	cds_lfht_node_init(&fp->pkt_node);
-	fp->pkt_expire = get_time_uptime() + IPV6_FRAG_SET_TTL;
+	fp->pkt_expire = current + IPV6_FRAG_SET_TTL;
+	ipv6_frag_src_get(fp, key->src_dst);
 
 	/*
 	 * Now try to add the new pkt, if somebody beat us to it, use
 	 * that one.
 	 */
-	node = cds_lfht_add_unique(frag_table, hash, ipv6_match,
+	node = cds_lfht_add_unique(vrf->v_ipv6_frag_table, hash, ipv6_match,
 				   key, &fp->pkt_node);
 	if (node != &fp->pkt_node) {
+		ipv6_frag_src_put(fp);
 		free(fp);
 		fp = caa_container_of(node, struct ipv6_frag_pkt, pkt_node);
-	}
+	} else
+		uatomic_inc(&vrf->v_ipv6_frag_cnt);
 
 	return fp;
 }
@@ -248,11 +394,22 @@ ipv6_frag_find_or_create(struct vrf *vrf, const struct ipv6_frag_key *key)
 {
 	struct ipv6_frag_pkt *fp;
 	unsigned long hash = ipv6_hash(key);
-	struct cds_lfht *frag_table = vrf->v_ipv6_frag_table;
+	uint64_t current = get_time_uptime();
+
+	fp = ipv6_frag_lookup(vrf->v_ipv6_frag_table, hash, key);
+
+	/*
+	 * An expired set is stale, so free it here and start a new one
+	 * rather than adding to it.
+	 */
+	if (fp && fp->pkt_expire < current) {
+		ipv6_frag_timeout_stats(fp);
+		ipv6_frag_free(vrf, fp);
+		fp = NULL;
+	}
 
-	fp = ipv6_frag_lookup(frag_table, hash, key);
 	if (!fp)
-		fp = ipv6_frag_create(frag_table, hash, key);
+		fp = ipv6_frag_create(vrf, hash, key, current);
 
 	return fp;
 }
@@ -268,7 +425,7 @@ ipv6_fragment_table_uninit(struct vrf *vrf)
 
 	cds_lfht_for_each_entry(vrf->v_ipv6_frag_table, &iter, pkt,
 				pkt_node) {
-		ipv6_frag_free(vrf->v_ipv6_frag_table, pkt);
+		ipv6_frag_free(vrf, pkt);
 	}
 
 	dp_ht_destroy_deferred(vrf->v_ipv6_frag_table);
@@ -306,6 +463,13 @@ ipv6_fragment_table_init(struct vrf *vrf)
 
 void ipv6_fragment_tables_timer_init(void)
 {
+	unsigned int i;
+
+	/* Seeded once, per-source accounting is shared by all VRFs */
+	ipv6_src_hash_seed = random();
+	for (i = 0; i < IPV6_FRAG_SRC_BUCKETS; i++)
+		rte_spinlock_init(&ipv6_frag_srcs[i].lock);
+
 	/*
 	 * Create a timer for cleanup of stale entries.
 	 */
@@ -10,6 +10,7 @@
 #define IPV6_FRAG_TBL_H
 
 #include <rte_spinlock.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "npf/fragment/ipv6_rsmbl.h"
@@ -40,6 +41,17 @@ struct vrf;
 /* Timeout period for incomplete fragment sets */
 #define IPV6_FRAG_SET_TTL       15
 
+/*
+ * Memory held in incomplete fragment sets is accounted per source
+ * address, in a set associative table of IPV6_FRAG_SRC_BUCKETS buckets
+ * of IPV6_FRAG_SRC_WAYS exact addresses.  Sources that don't fit in
+ * their bucket share its overflow entry.  IPV6_FRAG_SRC_BUCKETS must be
+ * a power of two.
+ */
+#define IPV6_FRAG_SRC_BUCKETS	256
+#define IPV6_FRAG_SRC_WAYS	4
+#define IPV6_FRAG_SRC_MAX_BYTES	(512 * 1024)
+
 /*
  * IPv6 reassembly fragment
  */
@@ -97,12 +109,17 @@ struct ipv6_frag_pkt {
 	uint8_t                 first_frg_proto;
 	/* Senders MTU gleaned from the largest fragment */
 	uint16_t                mtu;
+	uint32_t		held_bytes;	/* mbuf bytes held by set */
+	uint16_t		src_bucket;	/* per-source accounting */
+	uint8_t			src_way;	/* WAYS for overflow */
 	struct ipv6_frag	frags[IPV6_MAX_FRAGS_PER_SET];
 };
 
 struct ipv6_frag_pkt *
 ipv6_frag_find_or_create(struct vrf *vrf, const struct ipv6_frag_key *);
-void ipv6_frag_free(struct cds_lfht *frag_table, struct ipv6_frag_pkt *);
+void ipv6_frag_free(struct vrf *vrf, struct ipv6_frag_pkt *);
 void ipv6_frag_clear(struct ipv6_frag_pkt *);
+bool ipv6_frag_src_hold(struct ipv6_frag_pkt *fp, uint32_t bytes);
+uint32_t ipv6_frag_src_held(const uint32_t *addr);
 
 #endif
@@ -10,7 +10,10 @@
 #include <errno.h>
 #include <netinet/in.h>
 #include <rte_branch_prediction.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
 #include <rte_rwlock.h>
+#include <rte_timer.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -20,6 +23,7 @@
 
 #include "compiler.h"
 #include "json_writer.h"
+#include "main.h"
 #include "npf/npf.h"
 #include "npf_addrgrp.h"
 #include "npf_cidr_util.h"
@@ -74,6 +78,15 @@ struct ptree_table;
  * There is one 'writer' (main thread) and multiple 'readers' (forwarding
  * threads).  The readers are only blocked when the writer holds the lock.
  *
+ * The forwarding threads do not normally use the ptree or the lock though.
+ * Shortly after a ptree changes, it is compiled on the main thread into a
+ * sorted array of disjoint address ranges which is published via RCU
+ * (ag_comp).  A lookup is then a binary search of that array.  Any change to
+ * the ptree unpublishes the compiled array, and readers fall back to the
+ * locked ptree lookup until it has been recompiled.  Recompiles are delayed
+ * by AG_COMPILE_DELAY_MS so that a group being populated with many entries
+ * is only compiled a few times.
+ *
  *
  * g_addrgrp_table[]
  *      |
@@ -111,6 +124,14 @@ static struct npf_tbl *g_addrgrp_table;
 #define NPF_ADDRGRP_SZ_MAX 1024
 #define NPF_ADDRGRP_CTL    TS_TBL_RESIZE
 
+#define AG_KLEN_IPv4 4
+#define AG_KLEN_IPv6 16
+
+/* Delay from a ptree change to it being recompiled */
+#define AG_COMPILE_DELAY_MS 100
+
+static struct rte_timer ag_compile_timer;
+
 /*
  * Allow two types of entry in the address-group lists:
  *
@@ -191,6 +212,28 @@ struct npf_addrgrp_entry {
 /* range entry */
 #define ar_list  u.range.pfx_list
 
+/*
+ * Compiled address-group ranges.  IPv4 addresses are in host byte order so
+ * they may be compared directly, IPv6 addresses are in network byte order and
+ * compared with memcmp.
+ */
+struct ag_crange_v4 {
+	uint32_t	start;
+	uint32_t	end;
+};
+
+struct ag_crange_v6 {
+	uint8_t		start[AG_KLEN_IPv6];
+	uint8_t		end[AG_KLEN_IPv6];
+};
+
+struct ag_compiled {
+	struct rcu_head		ac_rcu;
+	uint32_t		ac_count;
+	struct ag_crange_v4	*ac_v4;
+	struct ag_crange_v6	*ac_v6;
+};
+
 /*
  * address-group
  *
@@ -214,17 +257,16 @@ struct npf_addrgrp {
 	bool                ag_any[AG_MAX];  /* 0.0.0.0/0 or ::/0 */
 	zlist_t            *ag_list[AG_MAX];
 	struct ptree_table *ag_tree[AG_MAX];
+	struct ag_compiled *ag_comp[AG_MAX];
 };
 
-#define AG_KLEN_IPv4 4
-#define AG_KLEN_IPv6 16
-
 #define AG_ALEN2AF(_alen) ((_alen) == 4 ? AG_IPv4 : AG_IPv6)
 #define AG_AF2ALEN(_af)   ((_af) == AG_IPv4 ? AG_KLEN_IPv4 : AG_KLEN_IPv6)
 #define AG_AF2INET(_af)   ((_af) == AG_IPv4 ? AF_INET : AF_INET6)
 
 /* Forward reference */
 static void npf_tbl_entry_free_cb(void *data);
+static void set_host_bits(uint8_t *a, int alen, int mask);
 
 /*
  * We store NPF_NO_NETMASK (255) in the prefix list to allow for the user to
@@ -283,6 +325,49 @@ static struct npf_addrgrp *npf_addrgrp_tid_lookup(int tid)
 	return npf_tbl_id_lookup(table, tid);
 }
 
+/*
+ * Find the last range starting at or below addr, and check if addr is within
+ * it.  The loop has a fixed trip count for a given array size, and the
+ * compiler turns the select into a conditional move.
+ */
+static ALWAYS_INLINE bool
+ag_compiled_match_v4(const struct ag_compiled *ac, uint32_t addr)
+{
+	const struct ag_crange_v4 *base = ac->ac_v4;
+	uint32_t n = ac->ac_count;
+
+	if (n == 0)
+		return false;
+
+	while (n > 1) {
+		uint32_t half = n / 2;
+
+		base = (base[half].start <= addr) ? &base[half] : base;
+		n -= half;
+	}
+	return base->start <= addr && addr <= base->end;
+}
+
+static inline bool
+ag_compiled_match_v6(const struct ag_compiled *ac, const uint8_t *addr)
+{
+	const struct ag_crange_v6 *base = ac->ac_v6;
+	uint32_t n = ac->ac_count;
+
+	if (n == 0)
+		return false;
+
+	while (n > 1) {
+		uint32_t half = n / 2;
+
+		if (memcmp(base[half].start, addr, AG_KLEN_IPv6) <= 0)
+			base = &base[half];
+		n -= half;
+	}
+	return memcmp(base->start, addr, AG_KLEN_IPv6) <= 0 &&
+		memcmp(addr, base->end, AG_KLEN_IPv6) <= 0;
+}
+
 /*
  * Lookup an address in an address-group.  Called from forwarding thread.
  */
@@ -290,6 +375,7 @@ int
 npf_addrgrp_lookup(enum npf_addrgrp_af af, uint32_t tid, npf_addr_t *addr)
 {
 	struct npf_addrgrp *ag;
+	struct ag_compiled *ac;
 	struct ptree_node *pn;
 
 	if (unlikely(!npf_tbl_id_is_valid(tid)))
@@ -305,6 +391,21 @@ npf_addrgrp_lookup(enum npf_addrgrp_af af, uint32_t tid, npf_addr_t *addr)
 	if (ag->ag_any[af])
 		return 0;
 
+	ac = rcu_dereference(ag->ag_comp[af]);
+	if (likely(ac != NULL)) {
+		bool match;
+
+		if (af == AG_IPv4) {
+			uint32_t a;
+
+			memcpy(&a, addr->s6_addr, sizeof(a));
+			match = ag_compiled_match_v4(ac, ntohl(a));
+		} else
+			match = ag_compiled_match_v6(ac, addr->s6_addr);
+
+		return match ? 0 : -ENOENT;
+	}
+
 	rte_rwlock_read_lock(&ag->ag_lock);
 
 	pn = ptree_shortest_match(ag->ag_tree[af], addr->s6_addr);
@@ -319,6 +420,7 @@ npf_addrgrp_lookup(enum npf_addrgrp_af af, uint32_t tid, npf_addr_t *addr)
  */
 static ALWAYS_INLINE int ag_lookup_v4(struct npf_addrgrp *ag, uint32_t addr)
 {
+	struct ag_compiled *ac;
 	struct ptree_node *pn;
 
 	if (unlikely(!ag))
@@ -328,6 +430,10 @@ static ALWAYS_INLINE int ag_lookup_v4(struct npf_addrgrp *ag, uint32_t addr)
 	if (ag->ag_any[AG_IPv4])
 		return 0;
 
+	ac = rcu_dereference(ag->ag_comp[AG_IPv4]);
+	if (likely(ac != NULL))
+		return ag_compiled_match_v4(ac, ntohl(addr)) ? 0 : -ENOENT;
+
 	rte_rwlock_read_lock(&ag->ag_lock);
 
 	pn = ptree_shortest_match(ag->ag_tree[AG_IPv4], (uint8_t *)&addr);
@@ -346,6 +452,203 @@ int npf_addrgrp_lookup_v4_by_handle(struct npf_addrgrp *ag, uint32_t addr)
 	return ag_lookup_v4(ag, addr);
 }
 
+static int ag_crange_v4_cmp(const void *a, const void *b)
+{
+	const struct ag_crange_v4 *r1 = a, *r2 = b;
+
+	return (r1->start > r2->start) - (r1->start < r2->start);
+}
+
+static int ag_crange_v6_cmp(const void *a, const void *b)
+{
+	const struct ag_crange_v6 *r1 = a, *r2 = b;
+
+	return memcmp(r1->start, r2->start, AG_KLEN_IPv6);
+}
+
+static int ag_compile_v4_cb(struct ptree_node *n, void *data)
+{
+	struct ag_compiled *ac = data;
+	struct ag_crange_v4 *r = &ac->ac_v4[ac->ac_count++];
+	uint8_t masklen = ptree_get_mask(n);
+	uint32_t mask, addr;
+
+	memcpy(&addr, ptree_get_key(n), sizeof(addr));
+	addr = ntohl(addr);
+	mask = masklen ? ~0u << (32 - masklen) : 0;
+
+	r->start = addr & mask;
+	r->end = addr | ~mask;
+	return 0;
+}
+
+static int ag_compile_v6_cb(struct ptree_node *n, void *data)
+{
+	struct ag_compiled *ac = data;
+	struct ag_crange_v6 *r = &ac->ac_v6[ac->ac_count++];
+	uint8_t masklen = ptree_get_mask(n);
+	int i;
+
+	memcpy(r->start, ptree_get_key(n), AG_KLEN_IPv6);
+	for (i = 0; i < AG_KLEN_IPv6; i++) {
+		int bits = MIN(MAX(masklen - i * 8, 0), 8);
+
+		r->start[i] &= (uint8_t)(0xFF00 >> bits);
+	}
+	memcpy(r->end, r->start, AG_KLEN_IPv6);
+	set_host_bits(r->end, AG_KLEN_IPv6, masklen);
+	return 0;
+}
+
+/*
+ * Sort the ranges, and merge any that overlap or are adjacent so that the
+ * lookup only ever has to check one range.
+ */
+static void ag_compiled_merge_v4(struct ag_compiled *ac)
+{
+	struct ag_crange_v4 *r = ac->ac_v4;
+	uint32_t i, j;
+
+	if (ac->ac_count < 2)
+		return;
+
+	qsort(r, ac->ac_count, sizeof(*r), ag_crange_v4_cmp);
+
+	for (i = 0, j = 1; j < ac->ac_count; j++) {
+		if (r[i].end == UINT32_MAX || r[j].start <= r[i].end + 1) {
+			r[i].end = MAX(r[i].end, r[j].end);
+			continue;
+		}
+		r[++i] = r[j];
+	}
+	ac->ac_count = i + 1;
+}
+
+static void ag_compiled_merge_v6(struct ag_compiled *ac)
+{
+	struct ag_crange_v6 *r = ac->ac_v6;
+	uint32_t i, j;
+
+	if (ac->ac_count < 2)
+		return;
+
+	qsort(r, ac->ac_count, sizeof(*r), ag_crange_v6_cmp);
+
+	for (i = 0, j = 1; j < ac->ac_count; j++) {
+		if (memcmp(r[j].start, r[i].end, AG_KLEN_IPv6) <= 0) {
+			if (memcmp(r[j].end, r[i].end, AG_KLEN_IPv6) > 0)
+				memcpy(r[i].end, r[j].end, AG_KLEN_IPv6);
+			continue;
+		}
+		r[++i] = r[j];
+	}
+	ac->ac_count = i + 1;
+}
+
+static void ag_compiled_free_rcu(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct ag_compiled, ac_rcu));
+}
+
+/*
+ * Compile an address-group ptree, and publish the result to the forwarding
+ * threads.  Called on the main thread.  If this fails then lookups carry on
+ * using the ptree.
+ */
+static void npf_addrgrp_compile(struct npf_addrgrp *ag,
+				enum npf_addrgrp_af af)
+{
+	struct ptree_table *pt = ag->ag_tree[af];
+	struct ag_compiled *ac, *old;
+	size_t rsz;
+	uint32_t n;
+
+	rte_rwlock_read_lock(&ag->ag_lock);
+
+	n = ptree_get_table_leaf_count(pt);
+	rsz = (af == AG_IPv4) ? sizeof(struct ag_crange_v4) :
+		sizeof(struct ag_crange_v6);
+
+	ac = malloc(sizeof(*ac) + (size_t)n * rsz);
+	if (!ac) {
+		rte_rwlock_read_unlock(&ag->ag_lock);
+		return;
+	}
+
+	ac->ac_count = 0;
+	ac->ac_v4 = (struct ag_crange_v4 *)(ac + 1);
+	ac->ac_v6 = (struct ag_crange_v6 *)(ac + 1);
+
+	if (af == AG_IPv4) {
+		ptree_walk(pt, PT_UP, ag_compile_v4_cb, ac);
+		ag_compiled_merge_v4(ac);
+	} else {
+		ptree_walk(pt, PT_UP, ag_compile_v6_cb, ac);
+		ag_compiled_merge_v6(ac);
+	}
+
+	old = ag->ag_comp[af];
+	rcu_assign_pointer(ag->ag_comp[af], ac);
+
+	rte_rwlock_read_unlock(&ag->ag_lock);
+
+	if (old)
+		call_rcu(&old->ac_rcu, ag_compiled_free_rcu);
+}
+
+static int npf_addrgrp_compile_cb(const char *name __unused, uint id __unused,
+				  void *data, void *ctx __unused)
+{
+	struct npf_addrgrp *ag = data;
+	int af;
+
+	for (af = AG_IPv4; af <= AG_IPv6; af++)
+		if (!ag->ag_comp[af])
+			npf_addrgrp_compile(ag, af);
+	return 0;
+}
+
+/*
+ * Compile any address-groups that have changed since they were last
+ * compiled.
+ */
+void npf_addrgrp_compile_all(void)
+{
+	if (g_addrgrp_table)
+		npf_tbl_walk(g_addrgrp_table, npf_addrgrp_compile_cb, NULL);
+}
+
+static void
+npf_addrgrp_compile_timer(struct rte_timer *timer __rte_unused,
+			  void *arg __rte_unused)
+{
+	npf_addrgrp_compile_all();
+}
+
+/*
+ * An address-group ptree has changed.  Called with ag_lock write-locked.
+ *
+ * Unpublish the compiled ranges so that lookups use the ptree, and schedule
+ * a recompile.  Address-groups that are being destroyed are no longer in the
+ * tableset, and are torn down on the RCU thread, so do not need compiling.
+ */
+static void
+npf_addrgrp_tree_changed(struct npf_addrgrp *ag, enum npf_addrgrp_af af)
+{
+	struct ag_compiled *ac = ag->ag_comp[af];
+
+	if (ac) {
+		rcu_assign_pointer(ag->ag_comp[af], NULL);
+		call_rcu(&ac->ac_rcu, ag_compiled_free_rcu);
+	}
+
+	if (is_main_thread() && !rte_timer_pending(&ag_compile_timer))
+		rte_timer_reset(&ag_compile_timer,
+				AG_COMPILE_DELAY_MS * rte_get_timer_hz() / 1000,
+				SINGLE, rte_get_master_lcore(),
+				npf_addrgrp_compile_timer, NULL);
+}
+
 /*
  * Create an address-group tableset
  */
@@ -364,6 +667,7 @@ npf_addrgrp_tbl_create(void)
 
 		npf_tbl_set_entry_freefn(table, npf_tbl_entry_free_cb);
 
+		rte_timer_init(&ag_compile_timer);
 		rcu_assign_pointer(g_addrgrp_table, table);
 	}
 	return 0;
@@ -386,6 +690,8 @@ npf_addrgrp_tbl_destroy(void)
 	/* Remove each entry from table and free memory */
 	npf_tbl_destroy(table);
 
+	rte_timer_stop(&ag_compile_timer);
+
 	return 0;
 }
 
@@ -585,6 +891,9 @@ struct npf_addrgrp *npf_addrgrp_cfg_add(const char *name)
 	if (rc < 0)
 		goto error;
 
+	npf_addrgrp_compile(ag, AG_IPv4);
+	npf_addrgrp_compile(ag, AG_IPv6);
+
 	return ag;
 
 error:
@@ -626,6 +935,10 @@ static void npf_addrgrp_destroy(struct npf_addrgrp *ag)
 
 	rte_rwlock_write_unlock(&ag->ag_lock);
 
+	/* An RCU period has already elapsed since ag was unreachable */
+	free(ag->ag_comp[AG_IPv4]);
+	free(ag->ag_comp[AG_IPv6]);
+
 	if (ag->ag_name) {
 		free(ag->ag_name);
 		ag->ag_name = NULL;
@@ -793,6 +1106,7 @@ npf_addrgrp_prefix_mask_insert(struct npf_addrgrp_entry *ae, uint8_t mask)
 		ptree_insert(ag->ag_tree[ae->ae_af], ap_prefix(ae),
 			     ag_ptree_mask(ae->ae_af, ae->ap_mask[0]));
 
+		npf_addrgrp_tree_changed(ag, ae->ae_af);
 		rte_rwlock_write_unlock(&ag->ag_lock);
 	}
 	return 0;
@@ -840,6 +1154,7 @@ npf_addrgrp_prefix_mask_remove(struct npf_addrgrp_entry *ae, uint8_t mask)
 		ptree_insert(ag->ag_tree[ae->ae_af], ap_prefix(ae),
 			     ag_ptree_mask(ae->ae_af, ae->ap_mask[1]));
 
+		npf_addrgrp_tree_changed(ag, ae->ae_af);
 		rte_rwlock_write_unlock(&ag->ag_lock);
 	}
 
@@ -1116,6 +1431,7 @@ static void npf_addrgrp_entry_free(void *item)
 		if (rc == 0)
 			ae->ae_ptree = 0;
 
+		npf_addrgrp_tree_changed(ag, ae->ae_af);
 		rte_rwlock_write_unlock(&ag->ag_lock);
 	}
 
@@ -1335,6 +1651,7 @@ int npf_addrgrp_prefix_insert(const char *name, npf_addr_t *addr,
 	if (rc == 0)
 		ae->ae_ptree = 1;
 
+	npf_addrgrp_tree_changed(ag, af);
 	rte_rwlock_write_unlock(&ag->ag_lock);
 
 	assert(rc == 0);
@@ -1410,6 +1727,7 @@ npf_addrgrp_range_pfx_list_ptree_insert(struct npf_addrgrp *ag,
 			ap->ae_ptree = 1;
 	}
 
+	npf_addrgrp_tree_changed(ag, ae->ae_af);
 	rte_rwlock_write_unlock(&ag->ag_lock);
 }
 
@@ -1560,10 +1878,13 @@ npf_addrgrp_range_update(struct npf_addrgrp *ag,
 				ap_prefix(new), alen, new->ap_mask[0], ag);
 
 			/* .. add to ptree */
+			rte_rwlock_write_lock(&ag->ag_lock);
 			rc = ptree_insert(ag->ag_tree[af], ap_prefix(tmp),
 					  ag_ptree_mask(af, tmp->ap_mask[0]));
 			if (rc == 0)
 				tmp->ae_ptree = 1;
+			npf_addrgrp_tree_changed(ag, af);
+			rte_rwlock_write_unlock(&ag->ag_lock);
 		}
 	}
 
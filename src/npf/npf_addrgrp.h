@@ -145,6 +145,15 @@ int npf_addrgrp_cfg_delete(const char *name);
  */
 int npf_addrgrp_tbl_destroy(void);
 
+/**
+ * @brief Compile changed address-groups for lock-free lookup
+ *
+ * This normally happens from a timer shortly after a change.
+ *
+ * Only used by UTs.
+ */
+void npf_addrgrp_compile_all(void);
+
 
 /*************************************************************************
  * Address-group management api
@@ -14,6 +14,7 @@
 #include <rte_config.h>
 #include <rte_debug.h>
 #include <rte_jhash.h>
+#include <rte_lcore.h>
 #include <rte_log.h>
 #include <rte_malloc.h>
 #include <rte_spinlock.h>
@@ -21,10 +22,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <urcu/uatomic.h>
 #include <values.h>
 
 #include "compiler.h"
 #include "json_writer.h"
+#include "lcore_sched.h"
 #include "npf/npf_addrgrp.h"
 #include "npf/npf_apm.h"
 #include "npf/npf_nat.h"
@@ -55,8 +58,19 @@
  * zero of a portmap cannot be allocated, so the bits of the portmap are
  * a one-to-one correspondence with a port.
  *
- * A spin lock is involved in protecting sections, since multiple users
- * could be attempting to update the same portmap concurrently.
+ * Ports are claimed and released with atomic operations on the section
+ * bitmap words, so that users allocating different ports from the same
+ * portmap do not serialise.  The per-portmap spin lock protects section
+ * creation and the count of used ports.
+ *
+ * Each forwarding lcore holds small leases of that count (APM_LEASE_PORTS
+ * ports at a time) against the portmaps it is allocating from, and only
+ * takes the portmap lock to refill its lease.  Ports released on an lcore
+ * holding a lease for the portmap go back to that lease.  The leases are
+ * only used for single port requests and for large port ranges, so that
+ * ports sitting in idle leases cannot starve other lcores.  Leases that
+ * have not been used for a garbage collection interval are returned to the
+ * portmap.
  *
  * Since heavy usage, with a large number of translations could result in
  * huge memory allocation, a simple loose maximum memory limit is used.
@@ -89,6 +103,14 @@
  * flags during port allocation.  Because of the two-phase deletion approach,
  * requiring 3 passes,these races are handled correctly.
  *
+ * Leases keep a portmap pointer outside of an RCU read-side section, which
+ * is only safe while the lease holds credits (and so the portmap cannot be
+ * removed).  A portmap is flagged UNLINKED, under its lock, when it is
+ * removed from the hash table and no ports may then be reserved from it,
+ * so a lease cannot be refilled from a portmap that is about to be freed.
+ * Leases are not taken against DEAD portmaps at all.  When the portmaps are
+ * forcibly deleted they are all unlinked before the leases are flushed.
+ *
  * The allocation algorithm enforces the following SNAT behaviors:
  *
  * - The original port is allocated if possible
@@ -136,21 +158,30 @@ rte_atomic64_t		pm_mem_used;
 #define PM_SECTION_WORDS	(PM_SECTION_BITS / LONGBITS)
 #define PM_SECTION_CNT          ((PORT_MAX+1) / PM_SECTION_BITS)
 
+/* Ports reserved from a portmap per lease refill */
+#define APM_LEASE_PORTS		64
+
+/* Ports a lease may hold before returning some to the portmap */
+#define APM_LEASE_MAX		(2 * APM_LEASE_PORTS)
+
+/* Leases per lcore, each for one portmap and protocol */
+#define APM_LEASE_SLOTS		8
+
 /* portmap entry removal bits. */
 #define PM_FLAG_REMOVABLE	01
 #define PM_FLAG_DEAD		02
+#define PM_FLAG_UNLINKED	04	/* removed from the hash table */
 
 /* using a table? */
 #define APM_USES_TABLE(a)	((a)->apm_table_id != NPF_TBLID_NONE)
 
 struct port_section {
 	unsigned long	ps_bm[PM_SECTION_WORDS];/* section bitmap */
-	uint16_t	ps_used;		/* bits allocated */
 };
 
 struct port_prot {
 	struct port_section	*pp_sections[PM_SECTION_CNT];
-	uint16_t		pp_used;	/* # allocated ports */
+	uint16_t		pp_used;	/* # allocated or leased ports */
 };
 
 struct port_map {
@@ -186,9 +217,28 @@ struct npf_apm {
 	uint32_t		apm_table_id;	/* Addr table id */
 	uint8_t			apm_type;	/* NPF_NATIN/NPF_NATOUT */
 	rte_atomic64_t		apm_dnat_used;	/* Dnat translation count */
-	rte_spinlock_t		apm_dnat_lock;	/* Lock expressly for dnat */
 };
 
+/*
+ * An lcores lease of ports against a portmap.  The lock is only contended
+ * by the garbage collector.  If al_pm is set then the lease holds credits,
+ * which keeps the portmap in use.
+ */
+struct apm_lease {
+	rte_spinlock_t		al_lock;
+	bool			al_active;	/* used since last GC pass */
+	uint8_t			al_nprot;
+	uint16_t		al_credits;	/* reserved, unallocated ports */
+	struct port_map		*al_pm;
+};
+
+struct apm_lease_lcore {
+	struct apm_lease	all_lease[APM_LEASE_SLOTS];
+} __rte_cache_aligned;
+
+static struct apm_lease_lcore	*apm_leases;
+static uint32_t			apm_lease_min_range;
+
 /* Struct for walking a table address range */
 struct apm_table_params {
 	struct npf_apm		*ap_apm;
@@ -201,20 +251,41 @@ struct apm_table_params {
 	enum nat_proto		ap_nprot;
 };
 
-/* Set bits in a section, span words if needed */
-static void set_bits(unsigned long bit, int nr_bits, unsigned long *addr)
+/* Atomically set bits in a word, if none of them are already set */
+static bool claim_word(unsigned long *a, unsigned long mask)
+{
+	unsigned long old = CMM_LOAD_SHARED(*a);
+	unsigned long prev;
+
+	while (!(old & mask)) {
+		prev = uatomic_cmpxchg(a, old, old | mask);
+		if (prev == old)
+			return true;
+		old = prev;
+	}
+	return false;
+}
+
+/* Claim bits in a section, span words if needed */
+static bool claim_bits(unsigned long bit, int nr_bits, unsigned long *addr)
 {
 	unsigned long mask = BIT_MASK(bit, nr_bits);
 	unsigned long *a = ((unsigned long *) addr) + BIT_WORD(bit);
 	int span = npf_apm_span_word(bit, nr_bits);
 
-	*a |= mask;
+	if (!claim_word(a, mask))
+		return false;
 
 	if (unlikely(span)) {
-		a++;
-		mask = BIT_MASK((bit + (nr_bits - span)), (span));
-		*a |= mask;
+		unsigned long mask2 = BIT_MASK((bit + (nr_bits - span)),
+					       (span));
+
+		if (!claim_word(a + 1, mask2)) {
+			uatomic_and(a, ~mask);
+			return false;
+		}
 	}
+	return true;
 }
 
 /* Clear bits in a section, span words if needed */
@@ -224,12 +295,12 @@ static void clear_bits(unsigned long bit, int nr_bits, unsigned long *addr)
 	unsigned long *a = ((unsigned long *) addr) + BIT_WORD(bit);
 	int span = npf_apm_span_word(bit, nr_bits);
 
-	*a &= ~mask;
+	uatomic_and(a, ~mask);
 
 	if (unlikely(span)) {
 		a++;
 		mask = BIT_MASK((bit + (nr_bits - span)), (span));
-		*a &= ~mask;
+		uatomic_and(a, ~mask);
 	}
 }
 
@@ -249,18 +320,200 @@ static int test_bits(unsigned long bit, int nr_bits, unsigned long *addr)
 	return (*a & mask) != 0;
 }
 
-static void port_stats_inc(int nr_ports, struct port_map *pm,
-		enum nat_proto nprot, struct port_section *ps)
+/* Is a section empty? */
+static bool section_empty(struct port_section *ps)
+{
+	int i;
+
+	for (i = 0; i < PM_SECTION_WORDS; i++)
+		if (ps->ps_bm[i])
+			return false;
+	return true;
+}
+
+/*
+ * Reserve room for ports in a portmap.  The flags are reset so that a
+ * portmap being used is not removed.
+ */
+static bool map_reserve(struct port_map *pm, enum nat_proto nprot,
+			uint16_t range, int nr_ports)
+{
+	struct port_prot *pp = &pm->pm_nprot[nprot];
+	bool ok;
+
+	rte_spinlock_lock(&pm->pm_lock);
+
+	ok = !(pm->pm_flags & PM_FLAG_UNLINKED) &&
+		(pp->pp_used + nr_ports) <= range;
+	if (ok) {
+		pp->pp_used += nr_ports;
+		if (pm->pm_flags)
+			pm->pm_flags = 0;
+	}
+
+	rte_spinlock_unlock(&pm->pm_lock);
+
+	return ok;
+}
+
+static void map_unreserve(struct port_map *pm, enum nat_proto nprot,
+			  int nr_ports)
+{
+	rte_spinlock_lock(&pm->pm_lock);
+	pm->pm_nprot[nprot].pp_used -= nr_ports;
+	rte_spinlock_unlock(&pm->pm_lock);
+}
+
+/*
+ * Get the lease slot for a portmap and protocol on this lcore.  Threads
+ * other than the forwarding and main threads may share a slot, which is
+ * safe as it is locked.
+ */
+static struct apm_lease *apm_lease_slot(struct port_map *pm,
+					enum nat_proto nprot)
+{
+	unsigned int lcore = dp_lcore_id();
+
+	if (unlikely(!apm_leases || lcore > get_lcore_max()))
+		return NULL;
+
+	return &apm_leases[lcore].all_lease[(pm->pm_addr + nprot) %
+					    APM_LEASE_SLOTS];
+}
+
+/* Return a lease's credits to its portmap.  Lease lock must be held. */
+static void apm_lease_drop(struct apm_lease *al)
 {
-	pm->pm_nprot[nprot].pp_used += nr_ports;
-	ps->ps_used += nr_ports;
+	if (al->al_pm && al->al_credits)
+		map_unreserve(al->al_pm, al->al_nprot, al->al_credits);
+
+	al->al_pm = NULL;
+	al->al_credits = 0;
 }
 
-static void port_stats_dec(struct port_map *pm, enum nat_proto nprot,
-		struct port_section *ps)
+/*
+ * Reserve a port from this lcores lease for the portmap, refilling the
+ * lease from the portmap when it is empty.  Returns false if the lease
+ * cannot be used, in which case the caller reserves from the portmap.
+ */
+static bool apm_lease_take(const struct npf_apm_range *ar,
+			   struct port_map *pm, enum nat_proto nprot)
+{
+	struct apm_lease *al;
+	bool ok = true;
+
+	if (ar->ar_port_range < apm_lease_min_range)
+		return false;
+
+	/* Don't keep a portmap that is going away */
+	if (CMM_LOAD_SHARED(pm->pm_flags) & (PM_FLAG_DEAD | PM_FLAG_UNLINKED))
+		return false;
+
+	al = apm_lease_slot(pm, nprot);
+	if (!al)
+		return false;
+
+	rte_spinlock_lock(&al->al_lock);
+
+	if (al->al_pm != pm || al->al_nprot != nprot) {
+		apm_lease_drop(al);
+		al->al_pm = pm;
+		al->al_nprot = nprot;
+	}
+
+	if (!al->al_credits) {
+		if (map_reserve(pm, nprot, ar->ar_port_range,
+				APM_LEASE_PORTS))
+			al->al_credits = APM_LEASE_PORTS;
+		else
+			ok = false;
+	}
+
+	if (ok) {
+		al->al_credits--;
+		al->al_active = true;
+	}
+
+	if (!al->al_credits)
+		al->al_pm = NULL;
+
+	rte_spinlock_unlock(&al->al_lock);
+
+	return ok;
+}
+
+/*
+ * Give back a reserved port, to this lcores lease if it holds one for the
+ * portmap, else to the portmap.
+ */
+static void apm_lease_give(struct port_map *pm, enum nat_proto nprot)
 {
-	pm->pm_nprot[nprot].pp_used--;
-	ps->ps_used--;
+	struct apm_lease *al = apm_lease_slot(pm, nprot);
+
+	if (al) {
+		rte_spinlock_lock(&al->al_lock);
+		if (al->al_pm == pm && al->al_nprot == nprot) {
+			if (++al->al_credits > APM_LEASE_MAX) {
+				map_unreserve(pm, nprot, APM_LEASE_PORTS);
+				al->al_credits -= APM_LEASE_PORTS;
+			}
+			rte_spinlock_unlock(&al->al_lock);
+			return;
+		}
+		rte_spinlock_unlock(&al->al_lock);
+	}
+
+	map_unreserve(pm, nprot, 1);
+}
+
+/*
+ * Return leases which have not been used since the last pass to their
+ * portmaps.
+ */
+static void apm_lease_gc(void)
+{
+	struct apm_lease *al;
+	unsigned int lcore;
+	int i;
+
+	if (!apm_leases)
+		return;
+
+	FOREACH_DP_LCORE(lcore) {
+		for (i = 0; i < APM_LEASE_SLOTS; i++) {
+			al = &apm_leases[lcore].all_lease[i];
+
+			rte_spinlock_lock(&al->al_lock);
+			if (al->al_active)
+				al->al_active = false;
+			else if (al->al_pm)
+				apm_lease_drop(al);
+			rte_spinlock_unlock(&al->al_lock);
+		}
+	}
+}
+
+/* Forget all leases, when the portmaps are being forcibly deleted */
+static void apm_lease_flush(void)
+{
+	struct apm_lease *al;
+	unsigned int lcore;
+	int i;
+
+	if (!apm_leases)
+		return;
+
+	FOREACH_DP_LCORE(lcore) {
+		for (i = 0; i < APM_LEASE_SLOTS; i++) {
+			al = &apm_leases[lcore].all_lease[i];
+
+			rte_spinlock_lock(&al->al_lock);
+			al->al_pm = NULL;
+			al->al_credits = 0;
+			al->al_active = false;
+			rte_spinlock_unlock(&al->al_lock);
+		}
+	}
 }
 
 /*
@@ -277,14 +530,13 @@ static void apm_free_map_sanity(struct port_map *pm)
 		pp_sections = pm->pm_nprot[nprot].pp_sections;
 
 		for (i = 0; i < PM_SECTION_CNT; i++) {
-			assert((pp_sections[i] && pp_sections[i]->ps_used)
-			       == 0);
-			if (pp_sections[i] && pp_sections[i]->ps_used &&
+			assert(!pp_sections[i] ||
+			       section_empty(pp_sections[i]));
+			if (pp_sections[i] && !section_empty(pp_sections[i]) &&
 			    net_ratelimit())
 				RTE_LOG(ERR, FIREWALL,
-					"NPF port map: prot %s: section: %d used: %d\n",
-					nat_proto_lc_str(nprot), i,
-					pp_sections[i]->ps_used);
+					"NPF port map: prot %s: section: %d in use\n",
+					nat_proto_lc_str(nprot), i);
 		}
 	}
 }
@@ -294,6 +546,7 @@ static void map_rcu_free(struct rcu_head *head)
 {
 	struct port_map *pm = caa_container_of(head, struct port_map,
 					       pm_rcu_head);
+	int nprot, i;
 
 	/*
 	 * Perform a sanity check if marked as dead, as it means it
@@ -305,15 +558,30 @@ static void map_rcu_free(struct rcu_head *head)
 	if ((pm->pm_flags & PM_FLAG_DEAD) != 0)
 		apm_free_map_sanity(pm);
 
+	/* Sections are kept for the life of the portmap */
+	for (nprot = NAT_PROTO_FIRST; nprot < NAT_PROTO_COUNT; nprot++) {
+		for (i = 0; i < PM_SECTION_CNT; i++) {
+			struct port_section *ps;
+
+			ps = pm->pm_nprot[nprot].pp_sections[i];
+			if (ps) {
+				rte_atomic64_sub(&pm_mem_used, sizeof(*ps));
+				rte_free(ps);
+			}
+		}
+	}
+
 	rte_free(pm);
 }
 
 /* Hash table GC - eliminate stale port maps.  */
-static void map_gc(struct rte_timer *timer __rte_unused, void *arg __rte_unused)
+static void map_gc_pass(void)
 {
 	struct cds_lfht_iter iter;
 	struct port_map *pm;
 
+	apm_lease_gc();
+
 	/*
 	 * two-phase approach to deleting dead portmaps.
 	 *
@@ -327,6 +595,7 @@ static void map_gc(struct rte_timer *timer __rte_unused, void *arg __rte_unused)
 
 		if (pm->pm_flags & PM_FLAG_DEAD) {
 			if (!cds_lfht_del(apm_ht, &pm->pm_node)) {
+				pm->pm_flags |= PM_FLAG_UNLINKED;
 				call_rcu(&pm->pm_rcu_head, map_rcu_free);
 				rte_atomic64_sub(&pm_mem_used,
 						sizeof(struct port_map));
@@ -349,6 +618,11 @@ static void map_gc(struct rte_timer *timer __rte_unused, void *arg __rte_unused)
 
 		rte_spinlock_unlock(&pm->pm_lock);
 	}
+}
+
+static void map_gc(struct rte_timer *timer __rte_unused, void *arg __rte_unused)
+{
+	map_gc_pass();
 
 	/* Reset timer if dataplane is up */
 	if (running)
@@ -361,10 +635,20 @@ static void apm_delete_all(void)
 	struct cds_lfht_iter iter;
 	struct port_map *pm;
 
+	/*
+	 * Unlink first, so that leases can no longer be refilled from the
+	 * portmaps, then forget those already held.
+	 */
 	cds_lfht_for_each_entry(apm_ht, &iter, pm, pm_node) {
-		if (!cds_lfht_del(apm_ht, &pm->pm_node))
+		rte_spinlock_lock(&pm->pm_lock);
+		if (!cds_lfht_del(apm_ht, &pm->pm_node)) {
+			pm->pm_flags |= PM_FLAG_UNLINKED;
 			call_rcu(&pm->pm_rcu_head, map_rcu_free);
+		}
+		rte_spinlock_unlock(&pm->pm_lock);
 	}
+
+	apm_lease_flush();
 }
 
 /* Hash table match. */
@@ -445,37 +729,43 @@ static struct port_map *map_get(uint32_t addr, vrfid_t vrfid, bool create)
 	return pm;
 }
 
-/* Get a portmap section, allocate if needed */
+/*
+ * Get a portmap section, allocate if needed.  Sections are kept until the
+ * portmap is freed, so may be used without the lock.
+ */
 static struct port_section *map_get_section(struct port_map *pm,
 		enum nat_proto nprot, int n, bool create)
 {
 	struct port_section **pp_sections = pm->pm_nprot[nprot].pp_sections;
+	struct port_section *ps;
 
 	size_t sz = sizeof(struct port_section);
 
-	if (pp_sections[n] || !create)
-		return pp_sections[n];
+	ps = rcu_dereference(pp_sections[n]);
+	if (ps || !create)
+		return ps;
+
+	rte_spinlock_lock(&pm->pm_lock);
+
+	ps = pp_sections[n];
+	if (ps)
+		goto done;
 
 	/* memory limit.  Yes, this is racy */
 	if (rte_atomic64_add_return(&pm_mem_used, sz) > PM_MEM_LIMIT) {
 		rte_atomic64_sub(&pm_mem_used, sz);
-		return NULL;
+		goto done;
 	}
 
-	pp_sections[n] = rte_zmalloc("apm", sz, RTE_CACHE_LINE_SIZE);
-
-	return pp_sections[n];
-}
+	ps = rte_zmalloc("apm", sz, RTE_CACHE_LINE_SIZE);
+	if (ps)
+		rcu_assign_pointer(pp_sections[n], ps);
+	else
+		rte_atomic64_sub(&pm_mem_used, sz);
 
-/* Put a port section, free if unused.  assumes lock held */
-static void map_put_section(struct port_map *pm, enum nat_proto nprot,
-		struct port_section *ps, int n)
-{
-	if (!ps->ps_used) {
-		pm->pm_nprot[nprot].pp_sections[n] = NULL;
-		rte_atomic64_sub(&pm_mem_used, sizeof(struct port_section));
-		rte_free(ps);
-	}
+done:
+	rte_spinlock_unlock(&pm->pm_lock);
+	return ps;
 }
 
 static bool ports_in_range(const struct npf_apm_range *ar, int nr_ports,
@@ -514,14 +804,13 @@ static inline int port_alloc_ports(struct port_map *pm, enum nat_proto nprot,
 	if (!ps)
 		return -NPF_RC_NAT_ENOMEM;
 
-	if (ps->ps_used >= PM_SECTION_BITS)
-		return -NPF_RC_NAT_ENOSPC;
-
-	if (test_bits(bit, nr_bits, ps->ps_bm))
+	if (!claim_bits(bit, nr_bits, ps->ps_bm)) {
+		/* Skip the rest of a full word */
+		if (CMM_LOAD_SHARED(ps->ps_bm[BIT_WORD(bit)]) == ULONG_MAX)
+			*port += LONGBITS - 1 - (bit % LONGBITS);
 		return -NPF_RC_NAT_EADDRINUSE;
+	}
 
-	set_bits(bit, nr_bits, ps->ps_bm);
-	port_stats_inc(nr_bits, pm, nprot, ps);
 	*port = PM_BIT_TO_PORT(bit) + (section * PM_SECTION_BITS);
 
 	return 0;
@@ -532,6 +821,7 @@ static int map_allocate_ports(struct npf_apm_range *ar, uint32_t map_flags,
 		struct port_map *pm, enum nat_proto nprot,
 		int nr_ports, uint16_t *port)
 {
+	bool leased;
 	int rc = 0;
 	uint16_t i;
 
@@ -560,17 +850,17 @@ static int map_allocate_ports(struct npf_apm_range *ar, uint32_t map_flags,
 			*port = ar->ar_port_start;
 	}
 
-	rte_spinlock_lock(&pm->pm_lock);
-
-	/* Room at the Inn? */
-	if ((pm->pm_nprot[nprot].pp_used + nr_ports) > ar->ar_port_range) {
-		rte_spinlock_unlock(&pm->pm_lock);
+	/*
+	 * Room at the Inn?  Single ports are reserved from this lcores lease
+	 * where possible, so the portmap lock is only taken to refill it.
+	 */
+	leased = nr_ports == 1 && apm_lease_take(ar, pm, nprot);
+	if (!leased && !map_reserve(pm, nprot, ar->ar_port_range, nr_ports))
 		/*
 		 * Note that this is the failure path most likely taken when
 		 * we run out of SNAT mappings.
 		 */
 		return -NPF_RC_NAT_ENOSPC;
-	}
 
 	/*
 	 * Loop through the range.
@@ -588,12 +878,12 @@ static int map_allocate_ports(struct npf_apm_range *ar, uint32_t map_flags,
 		switch (rc) {
 		case 0:
 			/* Success! */
-			goto done;
+			return 0;
 		case -NPF_RC_NAT_ENOMEM:
 			/* Failed to create new map section */
-			goto done;
+			goto fail;
 		case -NPF_RC_NAT_ENOSPC:
-			/* Map section is full, skip to next one */
+			/* Request would span sections, skip to next one */
 			*port = PM_SECTION_SPAN_NEXT(*port);
 			break;
 		case -NPF_RC_NAT_EADDRINUSE:
@@ -618,12 +908,11 @@ static int map_allocate_ports(struct npf_apm_range *ar, uint32_t map_flags,
 	if ((rc == -NPF_RC_NAT_EADDRINUSE) && (nr_ports > 1))
 		rc = -NPF_RC_NAT_ENOSPC;
 
-done:
-	/* Reset the flags, if we allocated */
-	if (!rc && pm->pm_flags)
-		pm->pm_flags = 0;
-
-	rte_spinlock_unlock(&pm->pm_lock);
+fail:
+	if (leased)
+		apm_lease_give(pm, nprot);
+	else
+		map_unreserve(pm, nprot, nr_ports);
 
 	return rc;
 }
@@ -695,38 +984,43 @@ static int map_snat(struct npf_apm_range *ar, int nr_ports,
 	return rc;
 }
 
-/* Get dnat translation addr/port */
-static int map_dnat(npf_apm_t *apm, struct npf_apm_range *ar,
-		int nr_ports, uint32_t *addr, in_port_t *port)
+/*
+ * Get dnat translation addr/port.  The next port is advanced with a
+ * cmpxchg rather than under a lock.
+ */
+static int map_dnat(struct npf_apm_range *ar, int nr_ports,
+		uint32_t *addr, in_port_t *port)
 {
-	int rc = 0;
-
-	rte_spinlock_lock(&apm->apm_dnat_lock);
+	in_port_t old, prev, next;
 
 	*addr = map_translate_addr(ar, *addr);
 
 	if (!nr_ports)
-		goto done;
+		return 0;
 
 	/* Are requested port(s) in range? */
 	if (ports_in_range(ar, nr_ports, *port))
-		goto done;
-
-	if (nr_ports > ar->ar_port_range) {
-		rc = -NPF_RC_NAT_ERANGE;
-		goto done;
-	}
+		return 0;
 
-	if ((ar->ar_port_next + nr_ports) > ar->ar_port_stop)
-		ar->ar_port_next = ar->ar_port_start;
+	if (nr_ports > ar->ar_port_range)
+		return -NPF_RC_NAT_ERANGE;
 
-	*port = ar->ar_port_next;
+	old = CMM_LOAD_SHARED(ar->ar_port_next);
+	for (;;) {
+		next = old;
+		if (next < ar->ar_port_start ||
+		    (next + nr_ports) > ar->ar_port_stop)
+			next = ar->ar_port_start;
 
-	ar->ar_port_next += nr_ports;
+		prev = uatomic_cmpxchg(&ar->ar_port_next, old,
+				       next + nr_ports);
+		if (prev == old)
+			break;
+		old = prev;
+	}
 
-done:
-	rte_spinlock_unlock(&apm->apm_dnat_lock);
-	return rc;
+	*port = next;
+	return 0;
 }
 
 static int map_release_port(struct port_section *ps, uint16_t port)
@@ -736,10 +1030,10 @@ static int map_release_port(struct port_section *ps, uint16_t port)
 	if (!ps)
 		return -ENOENT;
 
-	if (test_bits(bit, 1, ps->ps_bm))
-		clear_bits(bit, 1, ps->ps_bm);
-	else
+	if (!test_bits(bit, 1, ps->ps_bm))
 		return -EINVAL;
+
+	clear_bits(bit, 1, ps->ps_bm);
 	return 0;
 }
 
@@ -776,16 +1070,11 @@ int npf_apm_put_map(npf_apm_t *apm, uint32_t map_flags, uint8_t ip_prot,
 		return -ENOENT;
 
 	n = PM_SECTION_OF_PORT(port);
-	rte_spinlock_lock(&pm->pm_lock);
 
 	ps = map_get_section(pm, nprot, n, false);
 	rc = map_release_port(ps, port);
-	if (!rc) {
-		port_stats_dec(pm, nprot, ps);
-		map_put_section(pm, nprot, ps, n);
-	}
-
-	rte_spinlock_unlock(&pm->pm_lock);
+	if (!rc)
+		apm_lease_give(pm, nprot);
 
 	return rc;
 }
@@ -800,7 +1089,7 @@ static int map_allocate_from_range(struct npf_apm *apm,
 
 	switch (apm->apm_type) {
 	case NPF_NATIN:
-		rc = map_dnat(apm, ar, nr_ports, addr, port);
+		rc = map_dnat(ar, nr_ports, addr, port);
 		break;
 	case NPF_NATOUT:
 		rc = map_snat(ar, nr_ports, vrfid, addr, port, nprot,
@@ -981,7 +1270,6 @@ npf_apm_t *npf_apm_create(uint32_t match_mask, uint32_t table_id,
 		return NULL;
 	}
 
-	rte_spinlock_init(&apm->apm_dnat_lock);
 	npf_apm_update(apm, match_mask,
 			type, a_start, a_stop, p_start, p_stop);
 
@@ -1001,17 +1289,34 @@ npf_apm_t *npf_apm_clone(npf_apm_t *apm)
 		return NULL;
 
 	memcpy(clone, apm, sizeof(struct npf_apm));
-	rte_spinlock_init(&clone->apm_dnat_lock);
 	return clone;
 }
 
 void npf_apm_init(void)
 {
+	unsigned int lcore;
+	int i;
+
 	apm_ht = cds_lfht_new(PM_HT_INIT, PM_HT_MIN, PM_HT_MAX,
 			CDS_LFHT_AUTO_RESIZE | CDS_LFHT_ACCOUNTING, NULL);
 	if (!apm_ht)
 		return;
 
+	/*
+	 * Without leases allocation still works, it just takes the portmap
+	 * lock every time.  Only lease when leases of all lcores could hold
+	 * at most a quarter of the port range.
+	 */
+	apm_leases = zmalloc_aligned((get_lcore_max() + 1) *
+				     sizeof(struct apm_lease_lcore));
+	if (apm_leases) {
+		FOREACH_DP_LCORE(lcore)
+			for (i = 0; i < APM_LEASE_SLOTS; i++)
+				rte_spinlock_init(
+					&apm_leases[lcore].all_lease[i].al_lock);
+	}
+	apm_lease_min_range = 4 * APM_LEASE_MAX * rte_lcore_count();
+
 	rte_timer_init(&apm_timer);
 	rte_timer_reset(&apm_timer, APM_INTERVAL * rte_get_timer_hz(),
 			SINGLE, rte_get_master_lcore(), map_gc, NULL);
@@ -1022,6 +1327,9 @@ void npf_apm_uninit(void)
 	/* Ensure all is deleted */
 	apm_delete_all();
 
+	free(apm_leases);
+	apm_leases = NULL;
+
 	dp_rcu_read_unlock();
 	cds_lfht_destroy(apm_ht, NULL);
 	dp_rcu_read_lock();
@@ -1040,6 +1348,26 @@ static void json_ps(json_writer_t *json, struct port_section *ps,
 	}
 }
 
+/*
+ * Number of ports allocated from a portmap.  pp_used also counts ports held
+ * in leases, so count the bitmaps instead.
+ */
+static uint32_t map_ports_used(struct port_map *pm, enum nat_proto nprot)
+{
+	struct port_section *ps;
+	uint32_t used = 0;
+	int i, w;
+
+	for (i = 0; i < PM_SECTION_CNT; i++) {
+		ps = rcu_dereference(pm->pm_nprot[nprot].pp_sections[i]);
+		if (!ps)
+			continue;
+		for (w = 0; w < PM_SECTION_WORDS; w++)
+			used += __builtin_popcountl(ps->ps_bm[w]);
+	}
+	return used;
+}
+
 /* Jsonify a pm */
 static void json_pm(json_writer_t *json, struct port_map *pm)
 {
@@ -1066,13 +1394,15 @@ static void json_pm(json_writer_t *json, struct port_map *pm)
 	jsonw_start_array(json);
 
 	for (nprot = NAT_PROTO_FIRST; nprot < NAT_PROTO_COUNT; nprot++) {
+		uint32_t used = map_ports_used(pm, nprot);
 
 		jsonw_start_object(json);
 		jsonw_string_field(json, "protocol", nat_proto_lc_str(nprot));
-		jsonw_uint_field(json, "ports_used",
-			pm->pm_nprot[nprot].pp_used);
+		jsonw_uint_field(json, "ports_used", used);
+		jsonw_uint_field(json, "ports_reserved",
+				 pm->pm_nprot[nprot].pp_used);
 
-		if (pm->pm_nprot[nprot].pp_used) {
+		if (used) {
 			jsonw_name(json, "ports");
 			jsonw_start_array(json);
 			for (i = 0; i < PM_SECTION_CNT; i++) {
@@ -1118,7 +1448,7 @@ void npf_apm_dump(FILE *fp)
 		json_pm(json, pm);
 		for (nprot = NAT_PROTO_FIRST; nprot < NAT_PROTO_COUNT;
 		     nprot++) {
-			count[nprot] += pm->pm_nprot[nprot].pp_used;
+			count[nprot] += map_ports_used(pm, nprot);
 		}
 		rte_spinlock_unlock(&pm->pm_lock);
 	}
@@ -1150,3 +1480,9 @@ void npf_apm_flush_all(void)
 	apm_delete_all();
 }
 
+/* Run a garbage collection pass now, for the unit tests */
+void npf_apm_gc(void)
+{
+	map_gc_pass();
+}
+
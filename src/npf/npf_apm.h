@@ -91,6 +91,7 @@ void npf_apm_update(npf_apm_t *apm, uint32_t match_mask, uint8_t type,
 void npf_apm_destroy(npf_apm_t *apm);
 npf_apm_t *npf_apm_clone(npf_apm_t *apm);
 void npf_apm_flush_all(void);
+void npf_apm_gc(void);
 void npf_apm_dump(FILE *fp);
 
 #endif /* NPF_APM_H */
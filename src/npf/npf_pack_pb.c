@@ -5,6 +5,9 @@
  */
 
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <rte_common.h>
 #include <rte_log.h>
 
 #include "dp_session.h"
@@ -67,6 +70,64 @@ static int npf_pack_session_pb(struct session *s,
 	return full_copy ? rc : 0;
 }
 
+/*
+ * Storage for a single session's DPSessionMsg and all of its sub
+ * messages, repeated fields and strings.
+ */
+struct npf_pack_pb_msg {
+	DPSessionMsg		dps;
+	DPSessionKeyMsg		sk;
+	DPSessionStateMsg	dps_state;
+	DPSessionCounterMsg	dps_counters;
+	NPFSessionMsg		npfsm;
+	NPFSessionStateMsg	npfssm;
+	TCPWindowMsg		tcpwinarray[NPF_FLOW_SZ];
+	TCPWindowMsg		*tcpwinptrs[NPF_FLOW_SZ];
+	char			ifname[IFNAMSIZ];
+	uint32_t		addrids[SENTRY_LEN_IPV6];
+};
+
+/*
+ * Initialise a npf_pack_pb_msg so that all pointers to sub messages,
+ * repeated fields and strings point to valid memory.
+ */
+static void npf_pack_pb_msg_init(struct npf_pack_pb_msg *msg)
+{
+	int i;
+
+	memset(msg, 0, sizeof(*msg));
+	dpsession_msg__init(&msg->dps);
+	dpsession_key_msg__init(&msg->sk);
+	dpsession_state_msg__init(&msg->dps_state);
+	dpsession_counter_msg__init(&msg->dps_counters);
+	npfsession_msg__init(&msg->npfsm);
+	npfsession_state_msg__init(&msg->npfssm);
+
+	msg->sk.sk_ifname = msg->ifname;
+	msg->sk.sk_addrids = msg->addrids;
+	msg->dps.ds_key = &msg->sk;
+	msg->dps.ds_state = &msg->dps_state;
+	msg->dps.ds_counters = &msg->dps_counters;
+
+	for (i = 0; i < NPF_FLOW_SZ; ++i) {
+		tcpwindow_msg__init(&msg->tcpwinarray[i]);
+		msg->tcpwinptrs[i] = &msg->tcpwinarray[i];
+	}
+	msg->npfssm.nss_tcpwins = msg->tcpwinptrs;
+	msg->npfsm.ns_state = &msg->npfssm;
+	msg->dps.ds_npf_session = &msg->npfsm;
+}
+
+/*
+ * Right now packing is supported only on firewall sessions
+ */
+static bool npf_pack_pb_supported(struct session *s)
+{
+	return !(session_is_nat(s) || session_is_nat64(s) ||
+		 session_is_nat46(s) || session_is_alg(s) ||
+		 session_is_app(s));
+}
+
 /*
  * Fills up the pb_buf with a packed protobuf PackedDPSessionMsg message.
  *
@@ -83,50 +144,22 @@ static int npf_pack_pb(struct session *s, void *pb_buf, size_t size,
 		       struct session **peer)
 {
 	PackedDPSessionMsg pds = PACKED_DPSESSION_MSG__INIT;
-	DPSessionMsg dps = DPSESSION_MSG__INIT;
-	DPSessionMsg *dps_ptr[1] = {&dps, };
-	DPSessionKeyMsg sk = DPSESSION_KEY_MSG__INIT;
-	DPSessionStateMsg dps_state = DPSESSION_STATE_MSG__INIT;
-	DPSessionCounterMsg dps_counters = DPSESSION_COUNTER_MSG__INIT;
-	NPFSessionMsg npfsm = NPFSESSION_MSG__INIT;
-	NPFSessionStateMsg npfssm = NPFSESSION_STATE_MSG__INIT;
-	TCPWindowMsg tcpwinarray[NPF_FLOW_SZ];
-	TCPWindowMsg * tcpwinptrs[NPF_FLOW_SZ];
-	char ifname[IFNAMSIZ] = {0,};
-	uint32_t addrids[SENTRY_LEN_IPV6] = {0,};
-
-	int i;
+	struct npf_pack_pb_msg msg;
+	DPSessionMsg *dps_ptr[1] = {&msg.dps, };
 	int rc;
 	size_t packed_size;
 
-	/*
-	 * Right now packing is supported only on firewall sessions
-	 */
-	if (session_is_nat(s) || session_is_nat64(s) ||
-	    session_is_nat46(s) || session_is_alg(s) ||
-	    session_is_app(s))
+	if (!npf_pack_pb_supported(s))
 		return -ENOTSUP;
 
 	/* Set up message for packing */
-	sk.sk_ifname = ifname;
-	sk.sk_addrids = addrids;
-	dps.ds_key = &sk;
-	dps.ds_state = &dps_state;
-	dps.ds_counters = &dps_counters;
-
-	for (i = 0; i < NPF_FLOW_SZ; ++i) {
-		tcpwindow_msg__init(&tcpwinarray[i]);
-		tcpwinptrs[i] = &tcpwinarray[i];
-	}
-	npfssm.nss_tcpwins = tcpwinptrs;
-	npfsm.ns_state = &npfssm;
-	dps.ds_npf_session = &npfsm;
+	npf_pack_pb_msg_init(&msg);
 
 	pds.has_pds_pack_type = 1;
 	pds.pds_pack_type = spt;
 
 	/* Packs a single session */
-	rc = npf_pack_session_pb(s, &dps, spt == SESSION_PACK_FULL);
+	rc = npf_pack_session_pb(s, &msg.dps, spt == SESSION_PACK_FULL);
 
 	if (rc < 0)
 		return rc;
@@ -177,6 +210,110 @@ int dp_session_pack_pb(struct session *session,
 	return sph->sph_len;
 }
 
+/* Encoded size of a varint */
+static size_t npf_pack_pb_varint_size(size_t v)
+{
+	size_t n = 1;
+
+	while (v >= 0x80) {
+		v >>= 7;
+		n++;
+	}
+	return n;
+}
+
+int dp_session_pack_pb_bulk(struct session **sessions, unsigned int count,
+			    void *buf, uint32_t size,
+			    enum session_pack_type spt,
+			    unsigned int *consumed)
+{
+	PackedDPSessionMsg pds = PACKED_DPSESSION_MSG__INIT;
+	struct dp_session_pack_hdr *sph = buf;
+	struct npf_pack_pb_msg *msgs = NULL;
+	DPSessionMsg **dps_ptrs = NULL;
+	size_t avail, used, len = 0;
+	unsigned int i, n = 0;
+	int rc;
+
+	*consumed = 0;
+
+	if (size < sizeof(*sph))
+		return -ENOSPC;
+
+	if (spt != SESSION_PACK_FULL && spt != SESSION_PACK_UPDATE)
+		return -EINVAL;
+
+	count = RTE_MIN(count, DP_SESSION_PACK_BULK_MAX);
+	if (!count)
+		return 0;
+
+	msgs = malloc(count * sizeof(*msgs));
+	dps_ptrs = malloc(count * sizeof(*dps_ptrs));
+	if (!msgs || !dps_ptrs) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	pds.has_pds_pack_type = 1;
+	pds.pds_pack_type = spt;
+	pds.has_pds_flags = 1;
+	pds.pds_flags = SESSION_TYPE_FW;
+	pds.pds_sessions = dps_ptrs;
+
+	/*
+	 * Track the encoded size as sessions are added, rather than
+	 * re-sizing the whole message each time.
+	 */
+	avail = size - sizeof(*sph);
+	used = packed_dpsession_msg__get_packed_size(&pds);
+
+	for (i = 0; i < count; i++) {
+		struct npf_pack_pb_msg *msg = &msgs[n];
+
+		if (!npf_pack_pb_supported(sessions[i]))
+			continue;
+
+		npf_pack_pb_msg_init(msg);
+		if (npf_pack_session_pb(sessions[i], &msg->dps,
+					spt == SESSION_PACK_FULL) < 0)
+			continue;
+
+		/* tag, length and the embedded message */
+		len = dpsession_msg__get_packed_size(&msg->dps);
+		len += 1 + npf_pack_pb_varint_size(len);
+		if (used + len > avail)
+			break;
+
+		used += len;
+		dps_ptrs[n++] = &msg->dps;
+	}
+
+	*consumed = i;
+	if (!n) {
+		if (i == 0) {
+			RTE_LOG(ERR, FIREWALL,
+				"too small buffer need %zu got %zu\n",
+				used + len, avail);
+			rc = -ENOSPC;
+		} else
+			rc = 0;
+		goto out;
+	}
+
+	pds.n_pds_sessions = n;
+	len = packed_dpsession_msg__pack(&pds, (uint8_t *)&sph[1]);
+
+	sph->sph_len = len + sizeof(*sph);
+	sph->sph_version = NPF_PACK_PB_VERSION;
+	sph->sph_flags = pds.pds_flags;
+	sph->sph_type = spt;
+	rc = sph->sph_len;
+out:
+	free(dps_ptrs);
+	free(msgs);
+	return rc;
+}
+
 PackedDPSessionMsg *npf_unpack_pb(void *buf, uint32_t size)
 {
 	PackedDPSessionMsg *pds = NULL;
@@ -355,12 +492,18 @@ error:
 	return rc;
 }
 
+/*
+ * Restore or update every session in the buffer.  A failure to restore
+ * one session does not stop the rest being restored; the first error
+ * is returned.
+ */
 int npf_pack_restore_pb(void *buf, uint32_t size, enum session_pack_type *spt)
 {
 	struct session *rs = NULL;
 	struct npf_session *rns = NULL;
 	int rc = -EINVAL;
-	DPSessionMsg *dpsm;
+	int err;
+	size_t i;
 	PackedDPSessionMsg *pds = npf_unpack_pb(buf, size);
 
 	if (pds == NULL) {
@@ -372,12 +515,18 @@ int npf_pack_restore_pb(void *buf, uint32_t size, enum session_pack_type *spt)
 
 	if (pds->pds_pack_type != SESSION_PACK_FULL
 		&& pds->pds_pack_type != SESSION_PACK_UPDATE)
-		return rc;
+		goto out;
 
 	*spt = pds->pds_pack_type;
-	dpsm = pds->pds_sessions[0];
+	rc = 0;
 
-	rc = dp_session_msg_restore(dpsm, pds->pds_pack_type, &rs, &rns);
+	for (i = 0; i < pds->n_pds_sessions; i++) {
+		err = dp_session_msg_restore(pds->pds_sessions[i],
+					     pds->pds_pack_type, &rs, &rns);
+		if (err && !rc)
+			rc = err;
+	}
+out:
 	npf_unpack_free_pb(pds);
 	return rc;
 }
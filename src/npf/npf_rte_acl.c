@@ -1448,6 +1448,24 @@ int npf_rte_acl_del_rule(int af, npf_match_ctx_t *m_ctx, uint32_t rule_no,
 	return err;
 }
 
+/*
+ * The rte_acl field layouts start at the protocol field of the IP header
+ */
+static inline const uint8_t *
+npf_rte_acl_pkt_data(int af, struct rte_mbuf *m)
+{
+	uint8_t *nlp;
+
+	if (af == AF_INET) {
+		nlp = (uint8_t *)iphdr(m);
+		nlp = RTE_PTR_ADD(nlp, offsetof(struct ip, ip_p));
+	} else {
+		nlp = (uint8_t *)ip6hdr(m);
+		nlp = RTE_PTR_ADD(nlp, offsetof(struct rte_ipv6_hdr, proto));
+	}
+	return nlp;
+}
+
 static int
 npf_rte_acl_trie_match(int af, struct npf_match_ctx_trie *m_trie,
 		       npf_cache_t *npc __rte_unused,
@@ -1457,20 +1475,11 @@ npf_rte_acl_trie_match(int af, struct npf_match_ctx_trie *m_trie,
 	int ret;
 	uint32_t results = 0;
 	const uint8_t *pkt_data[1];
-	struct rte_mbuf *m = data->mbuf;
-	uint8_t *nlp;
 
 	if (!m_trie->num_rules)
 		return -ENOENT;
 
-	if (af == AF_INET) {
-		nlp = (uint8_t *)iphdr(m);
-		nlp = RTE_PTR_ADD(nlp, offsetof(struct ip, ip_p));
-	} else {
-		nlp = (uint8_t *)ip6hdr(m);
-		nlp = RTE_PTR_ADD(nlp, offsetof(struct rte_ipv6_hdr, proto));
-	}
-	pkt_data[0] = nlp;
+	pkt_data[0] = npf_rte_acl_pkt_data(af, data->mbuf);
 
 	ret = rte_acl_classify(m_trie->acl_ctx, pkt_data, &results, 1, 1);
 	if (ret)
@@ -1537,6 +1546,78 @@ int npf_rte_acl_match(int af, npf_match_ctx_t *m_ctx,
 	return err;
 }
 
+/*
+ * Classify a burst of packets. Each trie is walked once for up to
+ * NPF_RTE_ACL_BULK_MAX packets at a time, so that rte_acl can use its
+ * multi-flow search, rather than once per packet.
+ *
+ * rule_no[i] is set to the highest priority matching rule for m[i],
+ * or to 0 if no rule matched that packet.
+ */
+int npf_rte_acl_match_bulk(int af, npf_match_ctx_t *m_ctx,
+			   struct rte_mbuf *m[], uint32_t num_packets,
+			   npf_rte_acl_prio_map_cb_t prio_map_cb,
+			   void *prio_map_userdata,
+			   uint32_t rule_no[])
+{
+	const uint8_t *pkt_data[NPF_RTE_ACL_BULK_MAX];
+	uint32_t results[NPF_RTE_ACL_BULK_MAX];
+	uint32_t priority[NPF_RTE_ACL_BULK_MAX];
+	struct cds_list_head *list_entry, *next;
+	struct npf_match_ctx_trie *m_trie;
+	uint32_t i, n, base, tmp_priority = 0;
+	bool matched = false;
+	int err;
+
+	for (i = 0; i < num_packets; i++)
+		rule_no[i] = 0;
+
+	if (!m_ctx->num_rules || !rte_atomic16_read(&m_ctx->num_tries))
+		return -ENOENT;
+
+	for (base = 0; base < num_packets; base += n) {
+		n = RTE_MIN(num_packets - base,
+			    (uint32_t)NPF_RTE_ACL_BULK_MAX);
+
+		for (i = 0; i < n; i++) {
+			pkt_data[i] = npf_rte_acl_pkt_data(af, m[base + i]);
+			priority[i] = 0;
+		}
+
+		cds_list_for_each_safe(list_entry, next, &m_ctx->trie_list) {
+			m_trie = cds_list_entry(list_entry,
+						struct npf_match_ctx_trie,
+						trie_link);
+
+			if (m_trie->trie_state == TRIE_STATE_WRITABLE ||
+			    !m_trie->num_rules)
+				continue;
+
+			if (rte_acl_classify(m_trie->acl_ctx, pkt_data,
+					     results, n, 1))
+				return -EINVAL;
+
+			for (i = 0; i < n; i++) {
+				if (!results[i])
+					continue;
+
+				err = prio_map_cb(prio_map_userdata,
+						  results[i], &tmp_priority);
+				if (err)
+					return err;
+
+				if (tmp_priority > priority[i]) {
+					priority[i] = tmp_priority;
+					rule_no[base + i] = results[i];
+					matched = true;
+				}
+			}
+		}
+	}
+
+	return matched ? 0 : -ENOENT;
+}
+
 int npf_rte_acl_start_transaction(int af __unused, npf_match_ctx_t *m_ctx)
 {
 	if (m_ctx->tr_in_progress) {
@@ -42,6 +42,15 @@ int npf_rte_acl_match(int af, npf_match_ctx_t *m_ctx, npf_cache_t *npc,
 		      void *prio_map_userdata,
 		      uint32_t *rule_no);
 
+/* maximum number of packets passed to a single rte_acl_classify() call */
+#define NPF_RTE_ACL_BULK_MAX 32
+
+int npf_rte_acl_match_bulk(int af, npf_match_ctx_t *m_ctx,
+			   struct rte_mbuf *m[], uint32_t num_packets,
+			   npf_rte_acl_prio_map_cb_t prio_map_cb,
+			   void *prio_map_userdata,
+			   uint32_t rule_no[]);
+
 int npf_rte_acl_destroy(int af, npf_match_ctx_t **m_ctx);
 
 size_t npf_rte_acl_rule_size(int af);
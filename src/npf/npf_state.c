@@ -48,6 +48,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <urcu/system.h>
 
 #include "json_writer.h"
 #include "vrf_internal.h"
@@ -237,7 +238,7 @@ npf_state_set_tcp(npf_state_t *nst, enum tcp_session_state state,
 		stats_dec_tcp(old_state);
 		stats_inc_tcp(state);
 
-		nst->nst_tcp_state = state;
+		CMM_STORE_SHARED(nst->nst_tcp_state, state);
 		nst->nst_gen_state = npf_state_tcp2gen(state);
 		*state_changed = true;
 	}
@@ -283,6 +284,10 @@ npf_state_inspect_tcp(const npf_cache_t *npc, struct rte_mbuf *nbuf,
 	enum tcp_session_state old_state, new_state;
 	int rc = 0;
 
+	/* Established and in-window, so no transition to serialise */
+	if (likely(npf_state_tcp_fast(npc, nst, flow_dir)))
+		return 0;
+
 	rte_spinlock_lock(&nst->nst_lock);
 
 	old_state = nst->nst_tcp_state;
@@ -115,6 +115,10 @@ static_assert(sizeof(struct npf_tcp_window) == 16,
 
 /*
  * npf session state and timeout
+ *
+ * nst_lock serialises state transitions. Established TCP segments that
+ * fall within the window are tracked without it, see
+ * npf_state_tcp_fast().
  */
 typedef struct {
 	rte_spinlock_t		nst_lock;
@@ -206,6 +210,8 @@ void npf_state_tcp_init(void);
 enum tcp_session_state npf_state_tcp(const npf_cache_t *npc,
 				     struct rte_mbuf *nbuf, npf_state_t *nst,
 				     const enum npf_flow_dir di, int *error);
+bool npf_state_tcp_fast(const npf_cache_t *npc, npf_state_t *nst,
+			const enum npf_flow_dir di);
 
 void npf_state_set_tcp_strict(bool value);
 
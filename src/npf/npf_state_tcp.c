@@ -48,6 +48,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <urcu/system.h>
+#include <urcu/uatomic.h>
 
 #include "npf/npf_cache.h"
 #include "npf/npf_rc.h"
@@ -406,6 +408,45 @@ void npf_state_tcp_init(void)
 }
 
 
+/*
+ * Advance a sequence boundary from the value 'old' the segment was
+ * checked against. Boundaries of one direction are also pushed forward
+ * by segments in the other direction, which may be handled on another
+ * lcore without the state lock, so never move one backwards.
+ *
+ * A boundary only goes backwards, or to zero, when a SYN re-initialises
+ * the window under the state lock. Stop if that is seen, rather than
+ * carry the old connection's sequence space into the new one.
+ */
+static inline void
+npf_tcp_seq_advance(uint32_t *boundary, uint32_t old, tcp_seq seq)
+{
+	uint32_t cur;
+
+	while (SEQ_GT(seq, old)) {
+		cur = uatomic_cmpxchg(boundary, old, seq);
+		if (cur == old || !cur || SEQ_LT(cur, old))
+			break;
+		old = cur;
+	}
+}
+
+/*
+ * Raise the maximum window seen, as for npf_tcp_seq_advance.
+ */
+static inline void
+npf_tcp_maxwin_raise(uint32_t *maxwin, uint32_t old, uint32_t win)
+{
+	uint32_t cur;
+
+	while (old < win) {
+		cur = uatomic_cmpxchg(maxwin, old, win);
+		if (cur == old || cur < old)
+			break;
+		old = cur;
+	}
+}
+
 /*
  * npf_tcp_inwindow: determine whether the packet is in the TCP window
  * and thus part of the connection we are tracking.
@@ -417,8 +458,10 @@ npf_tcp_inwindow(const npf_cache_t *npc, struct rte_mbuf *nbuf,
 	const struct tcphdr * const th = &npc->npc_l4.tcp;
 	const uint8_t tcpfl = th->th_flags;
 	struct npf_tcp_window *fstate, *tstate;
+	uint32_t f_end, t_end;
 	int tcpdlen, ackskew;
 	tcp_seq seq, ack, end;
+	uint8_t wscale;
 	uint32_t win;
 
 	assert(npf_cache_ipproto(npc) == IPPROTO_TCP);
@@ -453,11 +496,16 @@ npf_tcp_inwindow(const npf_cache_t *npc, struct rte_mbuf *nbuf,
 
 	fstate = &nst->nst_tcp_win[di];
 	tstate = &nst->nst_tcp_win[!di];
-	win = win ? (win << fstate->nst_wscale) : 1;
+	win = win ? (win << CMM_LOAD_SHARED(fstate->nst_wscale)) : 1;
 
 	/*
 	 * Initialise if the first packet.
 	 * Note: only case when nst_maxwin is zero.
+	 *
+	 * Segments on an established session may be advancing the window
+	 * boundaries on another lcore without the state lock (see
+	 * npf_state_tcp_fast), so every field it touches is written with
+	 * a shared store.
 	 */
 	if (unlikely(((tcpfl & CORE_TCP_FLAGS) == TH_SYN))) {
 		/*
@@ -465,21 +513,22 @@ npf_tcp_inwindow(const npf_cache_t *npc, struct rte_mbuf *nbuf,
 		 * of SYN.  The state of the other side will get set with a
 		 * SYN-ACK reply (see below).
 		 */
-		fstate->nst_end = end;
-		fstate->nst_maxend = end;
-		fstate->nst_maxwin = win;
-		tstate->nst_end = 0;
-		tstate->nst_maxend = 0;
-		tstate->nst_maxwin = 1;
+		CMM_STORE_SHARED(fstate->nst_end, end);
+		CMM_STORE_SHARED(fstate->nst_maxend, end);
+		CMM_STORE_SHARED(fstate->nst_maxwin, win);
+		CMM_STORE_SHARED(tstate->nst_end, 0);
+		CMM_STORE_SHARED(tstate->nst_maxend, 0);
+		CMM_STORE_SHARED(tstate->nst_maxwin, 1);
 
 		/*
 		 * Handle TCP Window Scaling (RFC 1323).  Both sides may
 		 * send this option in their SYN packets.
 		 */
-		fstate->nst_wscale = 0;
-		(void)npf_fetch_tcpopts(npc, nbuf, NULL, &fstate->nst_wscale);
+		wscale = 0;
+		(void)npf_fetch_tcpopts(npc, nbuf, NULL, &wscale);
+		CMM_STORE_SHARED(fstate->nst_wscale, wscale);
 
-		tstate->nst_wscale = 0;
+		CMM_STORE_SHARED(tstate->nst_wscale, 0);
 
 		/* Done. */
 		return true;
@@ -489,43 +538,45 @@ npf_tcp_inwindow(const npf_cache_t *npc, struct rte_mbuf *nbuf,
 		 * Should be a SYN-ACK reply to SYN.  If SYN is not set,
 		 * then we cannot track, so abort here,
 		 */
-		if (!tstate->nst_end)
+		if (!CMM_LOAD_SHARED(tstate->nst_end))
 			return true;
 
-		fstate->nst_end = end;
-		fstate->nst_maxend = end + 1;
-		fstate->nst_maxwin = win;
-		fstate->nst_wscale = 0;
+		CMM_STORE_SHARED(fstate->nst_end, end);
+		CMM_STORE_SHARED(fstate->nst_maxend, end + 1);
+		CMM_STORE_SHARED(fstate->nst_maxwin, win);
 
 		/* Handle TCP Window Scaling */
-		(void)npf_fetch_tcpopts(npc, nbuf, NULL,
-					&fstate->nst_wscale);
+		wscale = 0;
+		(void)npf_fetch_tcpopts(npc, nbuf, NULL, &wscale);
+		CMM_STORE_SHARED(fstate->nst_wscale, wscale);
 	}
 
 	/*
 	 * If either side is not initialized, ignore
 	 * window bounds checking.
 	 */
-	if (!fstate->nst_end || !tstate->nst_end)
+	f_end = CMM_LOAD_SHARED(fstate->nst_end);
+	t_end = CMM_LOAD_SHARED(tstate->nst_end);
+	if (!f_end || !t_end)
 		return true;
 
 	if ((tcpfl & TH_ACK) == 0) {
 		/* Pretend that an ACK was sent. */
-		ack = tstate->nst_end;
+		ack = t_end;
 	} else if ((tcpfl & (TH_ACK|TH_RST)) == (TH_ACK|TH_RST) && ack == 0) {
 		/* Workaround for some TCP stacks. */
-		ack = tstate->nst_end;
+		ack = t_end;
 	}
 
 	if (unlikely(tcpfl & TH_RST)) {
 		/* RST to the initial SYN may have zero SEQ - fix it up. */
 		if (seq == 0 && nst->nst_tcp_state == NPF_TCPS_SYN_SENT) {
-			end = fstate->nst_end;
+			end = f_end;
 			seq = end;
 		}
 
 		/* Strict in-order sequence for RST packets. */
-		if (npf_strict_order_rst && (fstate->nst_end - seq) > 1) {
+		if (npf_strict_order_rst && (f_end - seq) > 1) {
 			return false;
 		}
 	}
@@ -534,12 +585,12 @@ npf_tcp_inwindow(const npf_cache_t *npc, struct rte_mbuf *nbuf,
 	 * Determine whether the data is within previously noted window,
 	 * that is, upper boundary for valid data (I).
 	 */
-	if (!SEQ_LEQ(end, fstate->nst_maxend)) {
+	if (!SEQ_LEQ(end, CMM_LOAD_SHARED(fstate->nst_maxend))) {
 		return false;
 	}
 
 	/* Lower boundary (II), which is no more than one window back. */
-	if (!SEQ_GEQ(seq, fstate->nst_end - tstate->nst_maxwin)) {
+	if (!SEQ_GEQ(seq, f_end - CMM_LOAD_SHARED(tstate->nst_maxwin))) {
 		return false;
 	}
 
@@ -547,7 +598,7 @@ npf_tcp_inwindow(const npf_cache_t *npc, struct rte_mbuf *nbuf,
 	 * Boundaries for valid acknowledgments (III, IV) - one predicted
 	 * window up or down, since packets may be fragmented.
 	 */
-	ackskew = tstate->nst_end - ack;
+	ackskew = t_end - ack;
 	if (ackskew < -NPF_TCP_MAXACKWIN ||
 	    ackskew > (NPF_TCP_MAXACKWIN << fstate->nst_wscale)) {
 		return false;
@@ -560,20 +611,97 @@ npf_tcp_inwindow(const npf_cache_t *npc, struct rte_mbuf *nbuf,
 	 * total length of the packet is unknown - bump the boundary.
 	 */
 
-	if (ackskew < 0) {
-		tstate->nst_end = ack;
-	}
+	if (ackskew < 0)
+		npf_tcp_seq_advance(&tstate->nst_end, t_end, ack);
+
 	/* Keep track of the maximum window seen. */
-	if (fstate->nst_maxwin < win) {
-		fstate->nst_maxwin = win;
-	}
-	if (SEQ_GT(end, fstate->nst_end)) {
-		fstate->nst_end = end;
-	}
+	npf_tcp_maxwin_raise(&fstate->nst_maxwin,
+			     CMM_LOAD_SHARED(fstate->nst_maxwin), win);
+
+	npf_tcp_seq_advance(&fstate->nst_end, f_end, end);
+
 	/* Note the window for upper boundary. */
-	if (SEQ_GEQ(ack + win, tstate->nst_maxend)) {
-		tstate->nst_maxend = ack + win;
-	}
+	npf_tcp_seq_advance(&tstate->nst_maxend,
+			    CMM_LOAD_SHARED(tstate->nst_maxend), ack + win);
+
+	return true;
+}
+
+/*
+ * npf_state_tcp_fast: lock-free inspection of an in-window segment on an
+ * established connection, with no state change.
+ *
+ * The window boundaries only ever move forwards, and each is mostly
+ * advanced by one direction, so these can be tracked without the state
+ * lock while the two directions are handled on different lcores.  The
+ * boundaries are advanced from the snapshot the segment was checked
+ * against, so a SYN re-initialising the window meanwhile isn't undone.
+ *
+ * Returns false if the segment needs the full, locked, inspection.
+ */
+bool
+npf_state_tcp_fast(const npf_cache_t *npc, npf_state_t *nst,
+		   const enum npf_flow_dir di)
+{
+	const struct tcphdr * const th = &npc->npc_l4.tcp;
+	const uint8_t tcpfl = th->th_flags;
+	struct npf_tcp_window *fstate, *tstate;
+	uint32_t f_end, f_maxend, f_maxwin, t_end, t_maxend, t_maxwin;
+	int tcpdlen, ackskew;
+	tcp_seq seq, ack, end;
+	uint8_t wscale;
+	uint32_t win;
+
+	if (CMM_LOAD_SHARED(nst->nst_tcp_state) != NPF_TCPS_ESTABLISHED)
+		return false;
+
+	/* Plain ACK, i.e. no SYN, FIN or RST */
+	if (npf_tcpfl2case(tcpfl) != TCPFC_ACK ||
+	    npf_tcp_fsm[NPF_TCPS_ESTABLISHED][di][TCPFC_ACK] !=
+	    NPF_TCPS_ESTABLISHED)
+		return false;
+
+	if (npf_state_tcp_strict &&
+	    !npf_tcp_strict_is_valid[di][TCPFC_ACK][NPF_TCPS_ESTABLISHED])
+		return false;
+
+	fstate = &nst->nst_tcp_win[di];
+	tstate = &nst->nst_tcp_win[!di];
+
+	f_end = CMM_LOAD_SHARED(fstate->nst_end);
+	f_maxend = CMM_LOAD_SHARED(fstate->nst_maxend);
+	f_maxwin = CMM_LOAD_SHARED(fstate->nst_maxwin);
+	t_end = CMM_LOAD_SHARED(tstate->nst_end);
+	t_maxend = CMM_LOAD_SHARED(tstate->nst_maxend);
+	t_maxwin = CMM_LOAD_SHARED(tstate->nst_maxwin);
+	wscale = CMM_LOAD_SHARED(fstate->nst_wscale);
+
+	if (!f_end || !t_end || !t_maxend)
+		return false;
+
+	tcpdlen = npf_tcpsaw(npc, &seq, &ack, &win);
+	end = seq + tcpdlen;
+	win = win ? (win << wscale) : 1;
+
+	/* Same boundaries (I) to (IV) as npf_tcp_inwindow */
+	if (!SEQ_LEQ(end, f_maxend))
+		return false;
+
+	if (!SEQ_GEQ(seq, f_end - t_maxwin))
+		return false;
+
+	ackskew = t_end - ack;
+	if (ackskew < -NPF_TCP_MAXACKWIN ||
+	    ackskew > (NPF_TCP_MAXACKWIN << wscale))
+		return false;
+
+	if (ackskew < 0)
+		npf_tcp_seq_advance(&tstate->nst_end, t_end, ack);
+
+	npf_tcp_maxwin_raise(&fstate->nst_maxwin, f_maxwin, win);
+	npf_tcp_seq_advance(&fstate->nst_end, f_end, end);
+	npf_tcp_seq_advance(&tstate->nst_maxend, t_maxend, ack + win);
+
 	return true;
 }
 
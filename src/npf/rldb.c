@@ -631,6 +631,9 @@ static int rldb_rule_no_to_priority(void *userdata,
 
 /*
  * match packets against rules in the specified database
+ *
+ * result[i] describes the match for m[i]; an rldb_rule_no of 0 means
+ * no rule matched that packet. Returns -ENOENT if no packet matched.
  */
 int rldb_match(struct rldb_db_handle *db,
 	       /* array of packets to be matched */
@@ -638,36 +641,55 @@ int rldb_match(struct rldb_db_handle *db,
 	       /* number of packets */
 	       uint32_t num_packets, struct rldb_result *result)
 {
-	uint32_t rule_no = 0;
+	uint32_t rule_no[RLDB_MATCH_BULK_MAX];
 	struct rldb_rule_handle *rh;
 	struct npf_match_cb_data data = { 0 };
+	uint32_t i;
 	int rc = 0;
 
-	if (!db || !m || num_packets != 1)
+	if (!db || !m || !num_packets || num_packets > RLDB_MATCH_BULK_MAX)
 		return -EINVAL;
 
 	if (rldb_disabled)
 		return -ENODEV;
 
 	/* non-npc variant. Supports only standard 5-tuple packets */
-	data.mbuf = m[0];
-	rc = npf_rte_acl_match(db->af, db->match_ctx, NULL, &data,
-			       rldb_rule_no_to_priority, (void *)db, &rule_no);
-	if (rc == -ENOENT)
-		goto error;
+	if (num_packets == 1) {
+		data.mbuf = m[0];
+		rule_no[0] = 0;
+		rc = npf_rte_acl_match(db->af, db->match_ctx, NULL, &data,
+				       rldb_rule_no_to_priority, (void *)db,
+				       &rule_no[0]);
+		if (rc)
+			rule_no[0] = 0;
+	} else
+		rc = npf_rte_acl_match_bulk(db->af, db->match_ctx, m,
+					    num_packets,
+					    rldb_rule_no_to_priority,
+					    (void *)db, rule_no);
 
 	if (rc != 0 && rc != -ENOENT)
 		goto error;
 
-	if (result) {
-		rc = rldb_find_rule(db, rule_no, &rh);
+	if (!result)
+		return rc;
+
+	for (i = 0; i < num_packets; i++) {
+		result[i].rldb_rule_no = rule_no[i];
+		result[i].rldb_user_data = 0;
+
+		if (!rule_no[i])
+			continue;
+
+		rc = rldb_find_rule(db, rule_no[i], &rh);
 		if (rc < 0)
 			goto error;
 
-		result->rldb_rule_no = rule_no;
-		result->rldb_user_data = rh->rule.rldb_user_data;
+		result[i].rldb_user_data = rh->rule.rldb_user_data;
 	}
 
+	return rc;
+
 error:
 	db->stats.rldb_err.rule_match_failed++;
 	return rc;
@@ -125,6 +125,9 @@ int rldb_del_rule(struct rldb_db_handle *db, struct rldb_rule_handle *rh);
 int rldb_find_rule(struct rldb_db_handle *db, uint32_t rule_no,
 		   struct rldb_rule_handle **out_rh);
 
+/* maximum number of packets passed to a single rldb_match() call */
+#define RLDB_MATCH_BULK_MAX 64
+
 /*
  * match packets against rules in the specified database
  */
@@ -7,7 +7,6 @@
 #include <limits.h>
 #include <linux/if_ether.h>
 #include <inttypes.h>
-#include <rte_jhash.h>
 
 #include "dp_event.h"
 #include "ether.h"
@@ -15,8 +14,6 @@
 #include "pppoe.h"
 #include "vplane_log.h"
 
-static struct pppoe_map_tbl *pppoe_map_tbl;
-
 static bool pppoe_track_underlying;
 CDS_LIST_HEAD(pppoe_conn_list);
 
@@ -28,19 +25,6 @@ struct cds_list_head *pppoe_get_conn_list(void)
 	return &pppoe_conn_list;
 }
 
-static struct cds_lfht *
-pppoe_map_get_ht(void)
-{
-	struct pppoe_map_tbl *tbl;
-
-	tbl = rcu_dereference(pppoe_map_tbl);
-
-	if (tbl)
-		return rcu_dereference(tbl->ht);
-
-	return NULL;
-}
-
 static void
 pppoe_softc_free_rcu(struct rcu_head *head)
 {
@@ -81,13 +65,13 @@ static void pppoe_validate_conn(struct ifnet *ifp, struct ifnet *new_ifp)
  * The underlying interface is going away, so mark this connection
  * as invalid, and get rid of the associated session.
  */
-static void pppoe_invalidate_conn(struct ifnet *ifp, uint32_t old_ifindex)
+static void pppoe_invalidate_conn(struct ifnet *ifp)
 {
 	struct pppoe_connection *old_conn;
 	struct pppoe_connection *new_conn;
 
 	old_conn = ifp->if_softc;
-	ppp_remove_ses(old_ifindex, old_conn->session);
+	ppp_remove_ses(old_conn->underlying_interface, old_conn->session);
 	new_conn = zmalloc_aligned(sizeof(struct pppoe_connection));
 	if (!new_conn) {
 		RTE_LOG(ERR, PPPOE,
@@ -131,27 +115,17 @@ pppoe_track_if_index_set(struct ifnet *new_ifp)
  * interface as not valid.
  */
 static void
-pppoe_track_if_index_unset(struct ifnet *going_ifp, uint32_t ifindex)
+pppoe_track_if_index_unset(struct ifnet *going_ifp,
+			   uint32_t ifindex __unused)
 {
-	struct cds_lfht *pppoe_tbl = pppoe_map_get_ht();
-	struct cds_lfht_iter iter;
-	struct pppoe_map_node *pnode = NULL;
-	struct ifnet *ifp;
 	struct pppoe_connection *conn;
 
-	if (pppoe_tbl)
-		cds_lfht_for_each_entry(pppoe_tbl, &iter, pnode, pnode) {
-			if (!pnode->ppp)
-				continue;
-
-			ifp = pnode->ppp;
-			conn = ifp->if_softc;
-
-			if (conn && conn->underlying_interface == going_ifp) {
-				/* Underlying interface is going away */
-				pppoe_invalidate_conn(ifp, ifindex);
-			}
+	cds_list_for_each_entry_rcu(conn, pppoe_get_conn_list(), list_node) {
+		if (conn->valid && conn->underlying_interface == going_ifp) {
+			/* Underlying interface is going away */
+			pppoe_invalidate_conn(conn->ifp);
 		}
+	}
 }
 
 static const struct dp_event_ops pppoe_tracking_event_ops = {
@@ -175,149 +149,107 @@ static void pppoe_no_track_underlying_interfaces(void)
 	}
 }
 
-static int
-pppoe_classify_map_hash(const struct pppoe_session_key *key)
-{
-	return rte_jhash_2words(key->session, key->underlying_ifindex, 0);
-}
-
-static int
-pppoe_classify_map_match(struct cds_lfht_node *node, const void *_key)
-{
-	struct pppoe_map_node *pnode =
-		caa_container_of(node, struct pppoe_map_node, pnode);
-	const struct pppoe_session_key *key = _key;
-	struct pppoe_connection *conn = rcu_dereference(pnode->ppp->if_softc);
-
-	return key->session == pnode->session && conn &&
-		key->underlying_ifindex == conn->underlying_ifindex;
-}
-
 struct ifnet *
 ppp_lookup_ses(struct ifnet *underlying_interface, uint16_t session)
 {
-	struct pppoe_session_key key = {
-		.session = session,
-		.underlying_ifindex = underlying_interface->if_index,
-	};
+	struct pppoe_ses_tbl *tbl;
+	struct pppoe_ses_leaf *leaf;
 
-	struct cds_lfht *p_map_htbl = pppoe_map_get_ht();
-	if (!p_map_htbl)
+	tbl = rcu_dereference(underlying_interface->if_pppoe_ses);
+	if (!tbl)
 		return NULL;
 
-	struct cds_lfht_iter iter;
-
-	dp_rcu_read_lock();
-	cds_lfht_lookup(p_map_htbl, pppoe_classify_map_hash(&key),
-			pppoe_classify_map_match, &key, &iter);
-	struct cds_lfht_node *node = cds_lfht_iter_get_node(&iter);
+	leaf = rcu_dereference(tbl->leaf[session >> PPPOE_SES_LEAF_BITS]);
+	if (!leaf)
+		return NULL;
 
-	if (node) {
-		struct pppoe_map_node *pnode =
-			caa_container_of(node, struct pppoe_map_node, pnode);
-		if (pnode->ppp) {
-			dp_rcu_read_unlock();
-			return pnode->ppp;
-		}
-	}
-	dp_rcu_read_unlock();
-	return NULL;
+	return rcu_dereference(leaf->ppp[session & PPPOE_SES_LEAF_MASK]);
 }
 
 static void
-pppoe_entry_free(struct rcu_head *head)
+pppoe_ses_tbl_free(struct rcu_head *head)
 {
-	free(caa_container_of(head, struct pppoe_map_node, pppoe_rcu));
+	struct pppoe_ses_tbl *tbl =
+		caa_container_of(head, struct pppoe_ses_tbl, rcu_head);
+	unsigned int i;
+
+	for (i = 0; i < PPPOE_SES_LEAF_SIZE; i++)
+		free(tbl->leaf[i]);
+	free(tbl);
 }
 
 void
-ppp_remove_ses(uint32_t ifindex, uint16_t session)
+ppp_remove_ses(struct ifnet *underlying_interface, uint16_t session)
 {
-	struct pppoe_session_key key = {
-		.session = session,
-		.underlying_ifindex = ifindex,
-	};
+	struct pppoe_ses_tbl *tbl;
+	struct pppoe_ses_leaf *leaf;
+	unsigned int idx = session & PPPOE_SES_LEAF_MASK;
 
-	struct cds_lfht *p_map_htbl = pppoe_map_get_ht();
-
-	if (!p_map_htbl)
+	if (!underlying_interface)
 		return;
 
-	struct cds_lfht_iter iter;
+	tbl = underlying_interface->if_pppoe_ses;
+	if (!tbl)
+		return;
 
-	dp_rcu_read_lock();
-	cds_lfht_lookup(p_map_htbl, pppoe_classify_map_hash(&key),
-			pppoe_classify_map_match, &key, &iter);
-	struct cds_lfht_node *node = cds_lfht_iter_get_node(&iter);
+	leaf = tbl->leaf[session >> PPPOE_SES_LEAF_BITS];
+	if (!leaf || !leaf->ppp[idx])
+		return;
 
-	if (node) {
-		struct pppoe_map_node *pnode =
-			caa_container_of(node, struct pppoe_map_node, pnode);
+	rcu_assign_pointer(leaf->ppp[idx], NULL);
 
-		cds_lfht_del(p_map_htbl, node);
-		call_rcu(&pnode->pppoe_rcu, pppoe_entry_free);
+	/* Last session on this interface, so drop the whole table */
+	if (--tbl->count == 0) {
+		rcu_assign_pointer(underlying_interface->if_pppoe_ses, NULL);
+		call_rcu(&tbl->rcu_head, pppoe_ses_tbl_free);
 	}
-
-	dp_rcu_read_unlock();
 }
 
 bool
 pppoe_init_session(struct ifnet *ppp_dev, uint16_t session)
 {
 	struct pppoe_connection *conn = ppp_dev->if_softc;
-	struct pppoe_session_key key = {
-		.session = session,
-		.underlying_ifindex =
-			conn->underlying_ifindex,
-	};
+	struct ifnet *underlying = conn->underlying_interface;
+	struct pppoe_ses_tbl *tbl;
+	struct pppoe_ses_leaf *leaf;
+	unsigned int idx = session & PPPOE_SES_LEAF_MASK;
 
-	struct cds_lfht *pppoe_tbl = pppoe_map_get_ht();
+	if (!underlying)
+		return false;
 
 	/* Create PPPoE Session table if it doesn't exist */
-	if (!pppoe_tbl) {
-		struct pppoe_map_tbl *tbl;
-
+	tbl = underlying->if_pppoe_ses;
+	if (!tbl) {
 		tbl = zmalloc_aligned(sizeof(*tbl));
-
 		if (!tbl)
 			return false;
-		pppoe_tbl = cds_lfht_new(PPPOE_HASH_MIN_BUCKETS,
-			PPPOE_HASH_MIN_BUCKETS, PPPOE_HASH_MAX_BUCKETS,
-				CDS_LFHT_AUTO_RESIZE, NULL);
-		if (!pppoe_tbl) {
-			free(tbl);
+		rcu_assign_pointer(underlying->if_pppoe_ses, tbl);
+	}
+
+	leaf = tbl->leaf[session >> PPPOE_SES_LEAF_BITS];
+	if (!leaf) {
+		leaf = zmalloc_aligned(sizeof(*leaf));
+		if (!leaf) {
+			if (tbl->count == 0) {
+				rcu_assign_pointer(underlying->if_pppoe_ses,
+						   NULL);
+				call_rcu(&tbl->rcu_head, pppoe_ses_tbl_free);
+			}
 			return false;
 		}
-		tbl->ht = pppoe_tbl;
-		rcu_set_pointer(&pppoe_map_tbl, tbl);
+		rcu_assign_pointer(tbl->leaf[session >> PPPOE_SES_LEAF_BITS],
+				   leaf);
 	}
 
-	struct cds_lfht_iter iter;
-	struct pppoe_map_node *pnode = NULL;
-	struct cds_lfht_node *node;
-
 	/* Does session already exist? */
-	dp_rcu_read_lock();
-	cds_lfht_lookup(pppoe_tbl, pppoe_classify_map_hash(&key),
-			pppoe_classify_map_match, &key, &iter);
-	node = cds_lfht_iter_get_node(&iter);
-
-	if (!node) {
-		pnode = zmalloc_aligned(sizeof(*pnode));
-		if (pnode) {
-			cds_lfht_node_init(&pnode->pnode);
-			pnode->session = session;
-			pnode->ppp = ppp_dev;
-			cds_lfht_add(pppoe_tbl, pppoe_classify_map_hash(&key),
-					&pnode->pnode);
-		}
+	if (!leaf->ppp[idx]) {
+		rcu_assign_pointer(leaf->ppp[idx], ppp_dev);
+		tbl->count++;
 	}
-	dp_rcu_read_unlock();
 
 	return true;
 }
 
-
 /* Global PPPoE encap function. Generally you want to set output = true
  * as this is the defacto way this encap function should work, however
  * there is a corner case where we have to re-encap a pipeline packet after
@@ -417,7 +349,7 @@ ppp_tunnel_delete(struct ifnet *ifp)
 	struct pppoe_connection *conn = ifp->if_softc;
 
 	if (conn->valid)
-		ppp_remove_ses(conn->underlying_ifindex,
+		ppp_remove_ses(conn->underlying_interface,
 			       conn->session);
 	cds_list_del_rcu(&conn->list_node);
 	call_rcu(&conn->scpppoe_rcu, pppoe_softc_free_rcu);
@@ -57,25 +57,23 @@ struct pppoe_connection {
 	struct ifnet *ifp; /* pointer back to containing ifp */
 };
 
-/* cds_lfht_hash helpers follow */
-#define PPPOE_HASH_MIN_BUCKETS 4
-#define PPPOE_HASH_MAX_BUCKETS 16
+/*
+ * Sessions are demuxed through a two-level table hung off the underlying
+ * interface and indexed directly by session id. Leaves are only allocated
+ * for the id ranges in use.
+ */
+#define PPPOE_SES_LEAF_BITS 8
+#define PPPOE_SES_LEAF_SIZE (1 << PPPOE_SES_LEAF_BITS)
+#define PPPOE_SES_LEAF_MASK (PPPOE_SES_LEAF_SIZE - 1)
 
-struct pppoe_session_key {
-	uint16_t session;
-	uint32_t underlying_ifindex;
+struct pppoe_ses_leaf {
+	struct ifnet *ppp[PPPOE_SES_LEAF_SIZE];
 };
 
-struct pppoe_map_tbl {
+struct pppoe_ses_tbl {
 	struct rcu_head rcu_head;
-	struct cds_lfht *ht;
-};
-
-struct pppoe_map_node {
-	uint16_t session;
-	struct rcu_head pppoe_rcu;
-	struct ifnet *ppp;
-	struct cds_lfht_node pnode;
+	unsigned int count;
+	struct pppoe_ses_leaf *leaf[PPPOE_SES_LEAF_SIZE];
 };
 
 bool ppp_do_encap(struct rte_mbuf *m,
@@ -85,7 +83,7 @@ void ppp_tunnel_output(struct ifnet *ifp, struct rte_mbuf *m,
 int cmd_pppoe(FILE *f, int argc, char **argv);
 struct ifnet *ppp_lookup_ses(struct ifnet *underlying_interface,
 	uint16_t session);
-void ppp_remove_ses(uint32_t ifindex, uint16_t session);
+void ppp_remove_ses(struct ifnet *underlying_interface, uint16_t session);
 bool pppoe_init_session(struct ifnet *ppp_dev, uint16_t session);
 struct cds_list_head *pppoe_get_conn_list(void);
 void pppoe_track_underlying_interfaces(void);
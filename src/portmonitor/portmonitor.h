@@ -139,6 +139,12 @@ struct portmonitor_session {
 	zlist_t			*filter_list;		/* in and out filters */
 	struct rcu_head		session_rcu;		/* Chain for rcu free */
 	fal_object_t		fal_obj;		/* Fal object */
+	uint16_t		snaplen;		/* truncate to, 0 = all */
+	bool			zero_copy;		/* share frame data */
+	uint32_t		rate;			/* max pkts/sec, 0 = all */
+	uint32_t		rate_count;		/* pkts this interval */
+	uint64_t		rate_window;		/* interval start */
+	uint64_t		rate_drops;		/* over rate */
 };
 
 struct portmonitor_info {
@@ -11,6 +11,7 @@
 #include <linux/if_ether.h>
 #include <netinet/in.h>
 #include <rte_branch_prediction.h>
+#include <rte_cycles.h>
 #include <rte_ether.h>
 #include <rte_mbuf.h>
 #include <stdbool.h>
@@ -18,6 +19,7 @@
 #include <string.h>
 #include <sys/time.h>
 #include <time.h>
+#include <urcu/uatomic.h>
 
 #include "capture.h"
 #include "ether.h"
@@ -34,6 +36,16 @@
 #include "portmonitor/portmonitor_hw.h"
 #include "urcu.h"
 
+/*
+ * Bytes at the start of each transmitted frame copied, rather than shared
+ * with the original, by a zero-copy mirror.  The mirror encapsulation is
+ * prepended to this copy, leaving the shared data untouched.
+ */
+#define PORTMONITOR_ZC_COPY_LEN	128
+
+/* ERSPAN truncated bit, in cos_en_t_id or cos_bso_t_id */
+#define ERSPAN_TRUNCATED	(1 << 10)
+
 /* Forward packet to SPAN port.
  * Returns 1 if packet was consumed.
  *         0 if span not enabled on port.
@@ -126,7 +138,8 @@ drop:
 
 static int portmonitor_encap_erspan_hdr(struct ifnet *ifp,
 					struct portmonitor_session *pmsess,
-					struct rte_mbuf *m, uint8_t direction)
+					struct rte_mbuf *m, uint8_t direction,
+					bool truncated)
 {
 	struct erspan_v2_hdr *v2_hdr;
 	struct erspan_v3_hdr *v3_hdr;
@@ -162,6 +175,8 @@ static int portmonitor_encap_erspan_hdr(struct ifnet *ifp,
 		}
 		v2_hdr->cos_en_t_id = htons((pktmbuf_get_vlan_pcp(m) << 13) |
 					    (en << 11) | pmsess->erspan_id);
+		if (truncated)
+			v2_hdr->cos_en_t_id |= htons(ERSPAN_TRUNCATED);
 		v2_hdr->index = htonl((ifp->if_port << 4) | direction);
 	} else if (pmsess->erspan_hdr_type == ERSPAN_TYPE_III) {
 		if (clock_gettime(CLOCK_REALTIME, &ts))
@@ -199,6 +214,8 @@ static int portmonitor_encap_erspan_hdr(struct ifnet *ifp,
 				htons((pktmbuf_get_vlan_pcp(m) << 13) |
 				      pmsess->erspan_id);
 		}
+		if (truncated)
+			v3_hdr->cos_bso_t_id |= htons(ERSPAN_TRUNCATED);
 		v3_hdr->p_ft_hwid_d_gra_o = htons((1 << 15) |
 						(ERSPAN_HARDWARE_ID << 4) |
 						(direction << 3) |
@@ -211,28 +228,186 @@ static int portmonitor_encap_erspan_hdr(struct ifnet *ifp,
 	return 1;
 }
 
-static void portmonitor_source_output(struct ifnet *ifp,
-					const struct portmonitor_info *pminfo,
-					struct rte_mbuf **m, uint8_t direction)
+/*
+ * Admit a packet to be mirrored if within the session's rate.  The
+ * interval restart can race between cores, so the rate is approximate.
+ */
+static bool portmonitor_rate_allow(struct portmonitor_session *pmsess)
+{
+	uint64_t now, window;
+
+	if (!pmsess->rate)
+		return true;
+
+	now = rte_get_timer_cycles();
+	window = CMM_LOAD_SHARED(pmsess->rate_window);
+	if (now - window >= rte_get_timer_hz() &&
+	    uatomic_cmpxchg(&pmsess->rate_window, window, now) == window)
+		uatomic_set(&pmsess->rate_count, 0);
+
+	if (uatomic_add_return(&pmsess->rate_count, 1) > pmsess->rate) {
+		uatomic_inc(&pmsess->rate_drops);
+		return false;
+	}
+	return true;
+}
+
+/* Truncate a, possibly chained, packet to len bytes */
+static void portmonitor_truncate(struct rte_mbuf *m, uint32_t len)
+{
+	struct rte_mbuf *seg = m;
+	uint32_t left = len;
+	uint16_t nb_segs = 1;
+
+	if (rte_pktmbuf_pkt_len(m) <= len)
+		return;
+
+	while (seg->data_len < left) {
+		left -= seg->data_len;
+		seg = seg->next;
+		nb_segs++;
+	}
+
+	seg->data_len = left;
+	if (seg->next) {
+		rte_pktmbuf_free(seg->next);
+		seg->next = NULL;
+	}
+	m->nb_segs = nb_segs;
+	m->pkt_len = len;
+}
+
+/*
+ * Copy the first len bytes of a packet.  Only those bytes are copied, so
+ * a snaplen shorter than the frame is not paid for in full.
+ */
+static struct rte_mbuf *
+portmonitor_mirror_copy(struct rte_mbuf *m, uint32_t len)
 {
-	enum npf_ruleset_type ruleset_type;
-	bool filter_active = false;
-	int filter_dir;
-	npf_result_t result;
 	struct rte_mbuf *mirror_pkt;
-	struct ifnet *dest_ifp;
+	const char *src;
+	char *data;
+
+	if (len > rte_pktmbuf_data_room_size(m->pool) - RTE_PKTMBUF_HEADROOM) {
+		mirror_pkt = pktmbuf_copy(m, m->pool);
+		if (mirror_pkt)
+			portmonitor_truncate(mirror_pkt, len);
+		return mirror_pkt;
+	}
+
+	mirror_pkt = pktmbuf_alloc(m->pool, pktmbuf_get_vrf(m));
+	if (!mirror_pkt)
+		return NULL;
+
+	pktmbuf_copy_meta(mirror_pkt, m);
+	data = rte_pktmbuf_append(mirror_pkt, len);
+	if (!data) {
+		rte_pktmbuf_free(mirror_pkt);
+		return NULL;
+	}
+
+	/* Copies into data itself if the bytes span segments */
+	src = rte_pktmbuf_read(m, 0, len, data);
+	if (src != data)
+		memcpy(data, src, len);
+
+	return mirror_pkt;
+}
+
+/*
+ * Create the packet to be mirrored.
+ *
+ * This is normally a copy of the first snaplen bytes of the original.
+ * In zero-copy mode, and only for the transmit direction where the
+ * mirror is taken after forwarding has made its last change to the
+ * frame, only the headers are copied, into a new mbuf which also leaves
+ * headroom for the mirror encapsulation, and the rest of the frame is
+ * attached from the original as indirect mbufs.  Received frames are
+ * always copied, as NAT, IPsec and the like may still rewrite them in
+ * place after they have been mirrored.
+ */
+static struct rte_mbuf *
+portmonitor_mirror_alloc(const struct portmonitor_session *pmsess,
+			 struct rte_mbuf *m, uint8_t direction)
+{
+	struct rte_mbuf *mirror_pkt, *clone;
+	uint32_t len = rte_pktmbuf_pkt_len(m);
+	uint32_t copy_len;
+	char *data;
+
+	if (pmsess->snaplen)
+		len = RTE_MIN(len, pmsess->snaplen);
+
+	if (!pmsess->zero_copy || direction != PORTMONITOR_DIRECTION_TX)
+		return portmonitor_mirror_copy(m, len);
+
+	copy_len = RTE_MIN(len, PORTMONITOR_ZC_COPY_LEN);
+	copy_len = RTE_MIN(copy_len, rte_pktmbuf_data_len(m));
+
+	mirror_pkt = pktmbuf_alloc(m->pool, pktmbuf_get_vrf(m));
+	if (!mirror_pkt)
+		return NULL;
+
+	pktmbuf_copy_meta(mirror_pkt, m);
+	data = rte_pktmbuf_append(mirror_pkt, copy_len);
+	if (!data) {
+		rte_pktmbuf_free(mirror_pkt);
+		return NULL;
+	}
+	memcpy(data, rte_pktmbuf_mtod(m, char *), copy_len);
+
+	if (len > copy_len) {
+		clone = rte_pktmbuf_clone(m, m->pool);
+		if (!clone) {
+			rte_pktmbuf_free(mirror_pkt);
+			return NULL;
+		}
+		rte_pktmbuf_adj(clone, copy_len);
+		if (rte_pktmbuf_chain(mirror_pkt, clone) != 0) {
+			rte_pktmbuf_free(clone);
+			rte_pktmbuf_free(mirror_pkt);
+			return NULL;
+		}
+		portmonitor_truncate(mirror_pkt, len);
+	}
+
+	return mirror_pkt;
+}
+
+/*
+ * Find the session and destination to mirror to, once per burst.
+ */
+static struct portmonitor_session *
+portmonitor_source_session(const struct portmonitor_info *pminfo,
+			   struct ifnet **dest_ifp)
+{
 	struct portmonitor_session *pmsess;
 
 	if (!pminfo || pminfo->hw_mirroring)
-		return;
+		return NULL;
 
 	pmsess = pminfo->pm_session;
 	if (!pmsess || pmsess->disabled)
-		return;
+		return NULL;
 
-	dest_ifp = rcu_dereference(pmsess->dest_ifp);
-	if (!dest_ifp)
-		return;
+	*dest_ifp = rcu_dereference(pmsess->dest_ifp);
+	if (!*dest_ifp)
+		return NULL;
+
+	return pmsess;
+}
+
+static void portmonitor_source_output(struct ifnet *ifp,
+				      struct portmonitor_session *pmsess,
+				      struct ifnet *dest_ifp,
+				      struct rte_mbuf **m, uint8_t direction)
+{
+	enum npf_ruleset_type ruleset_type;
+	bool filter_active = false;
+	bool truncated;
+	int filter_dir;
+	npf_result_t result;
+	struct rte_mbuf *mirror_pkt;
 
 	dp_pktmbuf_l2_len(*m) = RTE_ETHER_HDR_LEN;
 
@@ -256,7 +431,12 @@ static void portmonitor_source_output(struct ifnet *ifp,
 			return;
 	}
 
-	mirror_pkt = pktmbuf_copy(*m, (*m)->pool);
+	if (!portmonitor_rate_allow(pmsess))
+		return;
+
+	truncated = pmsess->snaplen &&
+		rte_pktmbuf_pkt_len(*m) > pmsess->snaplen;
+	mirror_pkt = portmonitor_mirror_alloc(pmsess, *m, direction);
 	if (!mirror_pkt)
 		return;
 
@@ -282,7 +462,7 @@ static void portmonitor_source_output(struct ifnet *ifp,
 		if (unlikely(dest_ifp->capturing))
 			capture_burst(dest_ifp, &mirror_pkt, 1);
 		if (!portmonitor_encap_erspan_hdr(ifp, pmsess, mirror_pkt,
-							direction)) {
+						  direction, truncated)) {
 			rte_pktmbuf_free(mirror_pkt);
 			return;
 		}
@@ -297,6 +477,8 @@ static void portmonitor_source_output(struct ifnet *ifp,
 void portmonitor_src_vif_rx_output(struct ifnet *ifp, struct rte_mbuf **m)
 {
 	struct portmonitor_info *pminfo;
+	struct portmonitor_session *pmsess;
+	struct ifnet *dest_ifp;
 
 	if (ifp->if_type != IFT_L2VLAN)
 		return;
@@ -309,12 +491,19 @@ void portmonitor_src_vif_rx_output(struct ifnet *ifp, struct rte_mbuf **m)
 		pminfo->pm_iftype != PM_SRC_SESSION_SRC_IF)
 		return;
 
-	portmonitor_source_output(ifp, pminfo, m, PORTMONITOR_DIRECTION_RX);
+	pmsess = portmonitor_source_session(pminfo, &dest_ifp);
+	if (!pmsess)
+		return;
+
+	portmonitor_source_output(ifp, pmsess, dest_ifp, m,
+				  PORTMONITOR_DIRECTION_RX);
 }
 
 void portmonitor_src_vif_tx_output(struct ifnet *ifp, struct rte_mbuf **m)
 {
 	struct portmonitor_info *pminfo;
+	struct portmonitor_session *pmsess;
+	struct ifnet *dest_ifp;
 
 	if (ifp->if_type != IFT_L2VLAN)
 		return;
@@ -327,13 +516,20 @@ void portmonitor_src_vif_tx_output(struct ifnet *ifp, struct rte_mbuf **m)
 		pminfo->pm_iftype != PM_SRC_SESSION_SRC_IF)
 		return;
 
-	portmonitor_source_output(ifp, pminfo, m, PORTMONITOR_DIRECTION_TX);
+	pmsess = portmonitor_source_session(pminfo, &dest_ifp);
+	if (!pmsess)
+		return;
+
+	portmonitor_source_output(ifp, pmsess, dest_ifp, m,
+				  PORTMONITOR_DIRECTION_TX);
 }
 
 void portmonitor_src_phy_rx_output(struct ifnet *ifp, struct rte_mbuf *mbi[],
 					unsigned int n)
 {
 	struct portmonitor_info *pminfo;
+	struct portmonitor_session *pmsess;
+	struct ifnet *dest_ifp;
 	unsigned int i;
 
 	pminfo = rcu_dereference(ifp->pminfo);
@@ -344,15 +540,21 @@ void portmonitor_src_phy_rx_output(struct ifnet *ifp, struct rte_mbuf *mbi[],
 		pminfo->pm_iftype != PM_SRC_SESSION_SRC_IF)
 		return;
 
+	pmsess = portmonitor_source_session(pminfo, &dest_ifp);
+	if (!pmsess)
+		return;
+
 	for (i = 0; i < n; i++)
-		portmonitor_source_output(ifp, pminfo, &(mbi[i]),
-						PORTMONITOR_DIRECTION_RX);
+		portmonitor_source_output(ifp, pmsess, dest_ifp, &(mbi[i]),
+					  PORTMONITOR_DIRECTION_RX);
 }
 
 void portmonitor_src_phy_tx_output(struct ifnet *ifp, struct rte_mbuf *mbi[],
 					unsigned int n)
 {
 	struct portmonitor_info *pminfo;
+	struct portmonitor_session *pmsess;
+	struct ifnet *dest_ifp;
 	unsigned int i;
 
 	if (ifp->if_type == IFT_L2VLAN)
@@ -366,9 +568,13 @@ void portmonitor_src_phy_tx_output(struct ifnet *ifp, struct rte_mbuf *mbi[],
 		pminfo->pm_iftype != PM_SRC_SESSION_SRC_IF)
 		return;
 
+	pmsess = portmonitor_source_session(pminfo, &dest_ifp);
+	if (!pmsess)
+		return;
+
 	for (i = 0; i < n; i++)
-		portmonitor_source_output(ifp, pminfo, &(mbi[i]),
-						PORTMONITOR_DIRECTION_TX);
+		portmonitor_source_output(ifp, pmsess, dest_ifp, &(mbi[i]),
+					  PORTMONITOR_DIRECTION_TX);
 }
 
 /* Forward packet to SPAN port.
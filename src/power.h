@@ -28,6 +28,10 @@ struct power_profile {
 /* Time to sleep for when all links down */
 #define LCORE_IDLE_SLEEP_SECS		1
 
+/* Longest wait for an RX interrupt before polling again */
+#define LCORE_INTR_TIMEOUT_MS		(USLEEP_MAX / 1000)
+#define LCORE_INTR_MAX_EVENTS		8
+
 struct pm_governor {
 	bool	  overrun;	/* got more than one packet */
 	uint32_t  idle;		/* # of times poll ret no packets */
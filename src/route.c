@@ -75,7 +75,9 @@ struct rte_mbuf;
  */
 
 /* Nexthop entry table, could be per-namespace */
-static struct nexthop_table nh_tbl __hot_data;
+static struct nexthop_table nh_tbl __hot_data = {
+	.max_size = NEXTHOP_TBL_MAX_SIZE_V4,
+};
 
 /* Index for next hop table */
 static struct cds_lfht *nexthop_hash;
@@ -642,7 +644,7 @@ struct next_hop *nexthop_get(uint32_t nh_idx, uint8_t *size)
 {
 	struct next_hop_list *nextl;
 
-	nextl = rcu_dereference(nh_tbl.entry[nh_idx]);
+	nextl = nexthop_table_get(&nh_tbl, nh_idx);
 	*size = nextl->nsiblings;
 	return nextl->siblings;
 }
@@ -719,7 +721,7 @@ inline bool is_local_ipv4(vrfid_t vrf_id, in_addr_t dst)
 	if (unlikely(lpm_lookup(lpm, ntohl(dst), &idx) != 0))
 		return false;
 
-	nextl = rcu_dereference(nh_tbl.entry[idx]);
+	nextl = nexthop_table_get(&nh_tbl, idx);
 	if (unlikely(!nextl))
 		return false;
 
@@ -897,7 +899,7 @@ static void subtree_walk_route_cleanup_cb(struct lpm *lpm,
 					  void *arg)
 {
 	struct subtree_walk_arg *changing = arg;
-	struct next_hop_list *nextl = rcu_dereference(nh_tbl.entry[idx]);
+	struct next_hop_list *nextl = nexthop_table_get(&nh_tbl, idx);
 	uint32_t cover_ip;
 	uint8_t cover_depth;
 	uint32_t cover_nh_idx;
@@ -1014,7 +1016,7 @@ static void route_change_process_nh(struct next_hop_list *nhl,
 			 * replaced by prev func, and will not
 			 * then be found in hash table.
 			 */
-			nhl = rcu_dereference(nh_tbl.entry[index]);
+			nhl = nexthop_table_get(&nh_tbl, index);
 			if (!nhl)
 				break;
 		}
@@ -1098,7 +1100,7 @@ route_change_link_arp(struct vrf *vrf, struct lpm *lpm,
 	 * as the cover need to be checked to see if they are still accurate,
 	 * and removed if not.
 	 */
-	nextl = rcu_dereference(nh_tbl.entry[next_hop]);
+	nextl = nexthop_table_get(&nh_tbl, next_hop);
 	if (next_hop_list_is_any_connected(nextl)) {
 		lpm_subtree_walk(lpm, ip, depth,
 				 subtree_walk_route_cleanup_cb,
@@ -1107,7 +1109,7 @@ route_change_link_arp(struct vrf *vrf, struct lpm *lpm,
 				  &cover_depth, &cover_idx) == 0) {
 		const struct next_hop_list *cover_nextl;
 
-		cover_nextl = rcu_dereference(nh_tbl.entry[cover_idx]);
+		cover_nextl = nexthop_table_get(&nh_tbl, cover_idx);
 		if (next_hop_list_is_any_connected(cover_nextl)) {
 			lpm_subtree_walk(lpm, ip, depth,
 					 subtree_walk_route_cleanup_cb,
@@ -1167,7 +1169,7 @@ route_delete_unlink_arp(struct vrf *vrf, struct lpm *lpm, uint32_t ip,
 	if (lpm_lookup_exact(lpm, ip, depth, &nh_idx))
 		return;
 
-	nextl = rcu_dereference(nh_tbl.entry[nh_idx]);
+	nextl = nexthop_table_get(&nh_tbl, nh_idx);
 	if (next_hop_list_is_any_connected(nextl)) {
 		subtree_walk_route_cleanup_cb(lpm, ip, depth, nh_idx,
 					      &subtree_arg);
@@ -1178,7 +1180,7 @@ route_delete_unlink_arp(struct vrf *vrf, struct lpm *lpm, uint32_t ip,
 				  &cover_depth, &cover_idx) == 0) {
 		const struct next_hop_list *cover_nextl;
 
-		cover_nextl = rcu_dereference(nh_tbl.entry[cover_idx]);
+		cover_nextl = nexthop_table_get(&nh_tbl, cover_idx);
 		if (next_hop_list_is_any_connected(cover_nextl)) {
 			lpm_subtree_walk(lpm, ip, depth,
 					 subtree_walk_route_cleanup_cb,
@@ -1212,7 +1214,7 @@ route_delete_relink_arp(struct lpm *lpm, uint32_t ip, uint8_t depth)
 	}
 
 	/* Walk all the interfaces arp entries to do /32 processing */
-	nextl = rcu_dereference(nh_tbl.entry[cover_nh_idx]);
+	nextl = nexthop_table_get(&nh_tbl, cover_nh_idx);
 	array = rcu_dereference(nextl->siblings);
 	for (i = 0; i < nextl->nsiblings; i++) {
 		const struct next_hop *next = array + i;
@@ -1509,7 +1511,7 @@ void nexthop_tbl_init(void)
 			&idx))
 		rte_panic("%s: can't create drop nexthop\n", __func__);
 	nextl_blackhole =
-		rcu_dereference(nh_tbl.entry[idx]);
+		nexthop_table_get(&nh_tbl, idx);
 	if (!nextl_blackhole)
 		rte_panic("%s: can't create drop nexthop\n", __func__);
 }
@@ -1560,7 +1562,7 @@ void rt_print_nexthop(json_writer_t *json, uint32_t next_hop,
 		      enum rt_print_nexthop_verbosity v)
 {
 	const struct next_hop_list *nextl =
-		rcu_dereference(nh_tbl.entry[next_hop]);
+		nexthop_table_get(&nh_tbl, next_hop);
 	const struct next_hop *array;
 	unsigned int i, j;
 
@@ -1672,7 +1674,7 @@ static void rt_local_display(
 	in_addr_t dst = htonl(params->ip);
 	char b[INET_ADDRSTRLEN];
 	const struct next_hop_list *nextl =
-		rcu_dereference(nh_tbl.entry[params->next_hop]);
+		nexthop_table_get(&nh_tbl, params->next_hop);
 	const struct next_hop *nh;
 
 	if (unlikely(!nextl))
@@ -1724,7 +1726,7 @@ static void rt_display(struct lpm *lpm __rte_unused,
 	in_addr_t dst = htonl(params->ip);
 
 	const struct next_hop_list *nextl =
-		rcu_dereference(nh_tbl.entry[params->next_hop]);
+		nexthop_table_get(&nh_tbl, params->next_hop);
 	const struct next_hop *nh;
 
 	if (unlikely(!nextl))
@@ -1753,7 +1755,7 @@ static void rt_display_all(struct lpm *lpm __rte_unused,
 	json_writer_t *json = arg;
 	in_addr_t dst = htonl(params->ip);
 	const struct next_hop_list *nextl =
-		rcu_dereference(nh_tbl.entry[params->next_hop]);
+		nexthop_table_get(&nh_tbl, params->next_hop);
 
 	if (unlikely(!nextl))
 		return;
@@ -1795,7 +1797,7 @@ static void rt_if_dead(struct lpm *lpm, struct vrf *vrf,
 		       void *arg, enum if_state_rx state_rx)
 {
 	struct next_hop_list *nextl =
-		rcu_dereference(nh_tbl.entry[params->next_hop]);
+		nexthop_table_get(&nh_tbl, params->next_hop);
 	const struct ifnet *ifp = arg;
 	unsigned int i, matches = 0;
 
@@ -1847,7 +1849,7 @@ static void rt_if_clear_slowpath_flag(
 	void *arg)
 {
 	struct next_hop_list *nextl =
-		rcu_dereference(nh_tbl.entry[params->next_hop]);
+		nexthop_table_get(&nh_tbl, params->next_hop);
 	const struct ifnet *ifp = arg;
 	unsigned int i;
 
@@ -1867,7 +1869,7 @@ static void rt_if_set_slowpath_flag(
 	void *arg)
 {
 	struct next_hop_list *nextl =
-		rcu_dereference(nh_tbl.entry[params->next_hop]);
+		nexthop_table_get(&nh_tbl, params->next_hop);
 	const struct ifnet *ifp = arg;
 	unsigned int i;
 
@@ -2081,7 +2083,7 @@ static void rt_summarize(struct lpm *lpm __rte_unused,
 {
 	uint32_t *rt_used = arg;
 	const struct next_hop_list *nextl =
-		rcu_dereference(nh_tbl.entry[params->next_hop]);
+		nexthop_table_get(&nh_tbl, params->next_hop);
 	const struct next_hop *nh;
 
 	if (unlikely(!nextl))
@@ -2145,7 +2147,8 @@ int rt_stats(struct route_head *rt_head, json_writer_t *json, uint32_t id)
 	jsonw_name(json, "nexthop");
 	jsonw_start_object(json);
 	jsonw_uint_field(json, "used", nh_tbl.in_use);
-	jsonw_uint_field(json, "free", NEXTHOP_HASH_TBL_SIZE - nh_tbl.in_use);
+	jsonw_uint_field(json, "free", nh_tbl.max_size - nh_tbl.in_use);
+	jsonw_uint_field(json, "size", nexthop_table_size(&nh_tbl));
 	jsonw_uint_field(json, "hash",
 			 (unsigned int) (100. * nexthop_hash_load_factor()));
 	jsonw_uint_field(json, "neigh_present", nh_tbl.neigh_present);
@@ -2174,7 +2177,7 @@ struct ifnet *nhif_dst_lookup(const struct vrf *vrf,
 			   ntohl(dst), &nhindex) != 0)
 		return NULL;
 
-	nextl = nh_tbl.entry[nhindex];
+	nextl = nexthop_table_get(&nh_tbl, nhindex);
 	if (nextl == NULL)
 		return NULL;
 
@@ -2209,7 +2212,7 @@ int dp_nh_lookup_by_index(uint32_t nhindex, uint32_t hash, in_addr_t *nh,
 	struct ifnet *ifp;
 	uint32_t size;
 
-	nextl = rcu_dereference(nh_tbl.entry[nhindex]);
+	nextl = nexthop_table_get(&nh_tbl, nhindex);
 	if (nextl == NULL)
 		return -1;
 
@@ -2247,7 +2250,7 @@ route_create_arp(struct vrf *vrf, struct lpm *lpm,
 	int size;
 
 	if (lpm_lookup(lpm, ntohl(ip->s_addr), &nh_idx) == 0) {
-		nextl = rcu_dereference(nh_tbl.entry[nh_idx]);
+		nextl = nexthop_table_get(&nh_tbl, nh_idx);
 
 		/*
 		 * Note that this does not support a connected with multiple
@@ -2447,7 +2450,7 @@ routing_insert_arp_safe(struct llentry *lle, bool arp_change)
 	pthread_mutex_lock(&route_mutex);
 	if (lpm_lookup_exact(lpm, ntohl(ip->s_addr), 32, &nh_idx) == 0) {
 		/* We already have a /32 so add the shortcut if connected */
-		nextl = rcu_dereference(nh_tbl.entry[nh_idx]);
+		nextl = nexthop_table_get(&nh_tbl, nh_idx);
 
 		/*
 		 * Do we already have a nh for this interface?
@@ -2506,7 +2509,7 @@ routing_remove_arp_safe(struct llentry *lle)
 	pthread_mutex_lock(&route_mutex);
 	if (lpm_lookup_exact(lpm, ntohl(ip->s_addr), 32, &nh_idx) == 0) {
 		/* We have a /32 so unlink the arp (if there) */
-		nextl = rcu_dereference(nh_tbl.entry[nh_idx]);
+		nextl = nexthop_table_get(&nh_tbl, nh_idx);
 		if (unlikely(!nextl))
 			goto unlock;
 
@@ -2627,7 +2630,7 @@ static void route_fal_upd_for_changed_nhl(
 		return;
 
 	struct next_hop_list *nextl =
-		rcu_dereference(nh_tbl.entry[params->next_hop]);
+		nexthop_table_get(&nh_tbl, params->next_hop);
 
 	rc = fal_ip4_upd_route(vrf->v_id, vrf->v_fal_obj,
 			       htonl(params->ip), params->depth,
@@ -138,6 +138,15 @@
 /* Session id */
 static rte_atomic64_t	session_id;
 
+/*
+ * Change generation.  Sessions are stamped with the current generation
+ * when they are created, change state or count packets, so that a sync
+ * agent can pack only those changed since it last closed a generation.
+ * The stamp is written by whichever core makes the change, so needs no
+ * journal.
+ */
+uint64_t		session_change_gen = 1;
+
 /*
  * For UT cleanup, we need to wait until the call_rcu context
  * executes and cleansup everything.  Use a counter so
@@ -204,6 +213,12 @@ static void session_rcu_free(struct rcu_head *h)
 {
 	struct session *s = caa_container_of(h, struct session, se_rcu_head);
 
+	/* Requeue until the watch exporter has finished with it */
+	if (rte_atomic32_read(&s->se_watch_refs)) {
+		call_rcu(&s->se_rcu_head, session_rcu_free);
+		return;
+	}
+
 	/*
 	 * Feature destroy references sessions, so just requeue if
 	 * features are outstanding
@@ -344,8 +359,10 @@ void se_expire(struct session *s)
 {
 	uint16_t exp = s->se_flags & ~SESSION_EXPIRED;
 
-	if (rte_atomic16_cmpset(&s->se_flags, exp, (exp | SESSION_EXPIRED)))
+	if (rte_atomic16_cmpset(&s->se_flags, exp, (exp | SESSION_EXPIRED))) {
+		se_changed(s);
 		session_feature_session_expire(s);
+	}
 }
 
 static inline void sl_unlink(struct session_link *sl)
@@ -1221,6 +1238,7 @@ static struct session *se_alloc(void)
 	if (s) {
 		cds_lfht_node_init(&s->se_node);
 		s->se_id = rte_atomic64_add_return(&session_id, 1);
+		se_changed(s);
 	}
 
 	return s;
@@ -1302,6 +1320,7 @@ void session_set_protocol_state_timeout(struct session *s, uint8_t state,
 	s->se_timeout = timeout;
 	s->se_protocol_state = state;
 	s->se_gen_state = gen_state;
+	se_changed(s);
 }
 
 /* Set the custom timeout */
@@ -1961,6 +1980,19 @@ enum dp_session_state dp_session_get_state(const struct session *session)
 	return session->se_gen_state;
 }
 
+uint64_t dp_session_generation_next(void)
+{
+	/* Implies a full barrier, so orders the walk after the close */
+	return uatomic_add_return(&session_change_gen, 1) - 1;
+}
+
+bool dp_session_changed_since(const struct session *session, uint64_t gen)
+{
+	if (!session)
+		return false;
+	return CMM_LOAD_SHARED(session->se_change_gen) > gen;
+}
+
 uint64_t dp_session_unique_id(const struct session *session)
 {
 	if (!session)
@@ -32,6 +32,9 @@ struct npf_pack_dp_sess_stats;
  */
 extern rte_atomic32_t session_rcu_counter;
 
+/* Current change generation, see dp_session_generation_next() */
+extern uint64_t session_change_gen;
+
 /* Sentry Match Lengths in 32bit words */
 #define SENTRY_LEN_IPV4		3
 #define SENTRY_LEN_IPV6		9
@@ -219,6 +222,8 @@ struct session {
 	rte_atomic64_t		se_pkts_out;
 	rte_atomic64_t		se_bytes_out;
 	void			*se_private;
+	uint64_t		se_change_gen;	/* generation of last change */
+	rte_atomic32_t		se_watch_refs;	/* queued watch events */
 };
 
 static_assert(offsetof(struct session, se_rcu_head) == 64,
@@ -948,6 +953,26 @@ static inline uint64_t session_get_id(struct session *s)
 	return 0;
 }
 
+/*
+ * Record that the session has changed in the current generation.
+ *
+ * The stamp must be visible before the generation it records is
+ * closed.  Otherwise a sync pass could close that generation and walk
+ * past the session before the stamp lands, and the next pass would not
+ * see the change.  So the generation is re-read after the store, and
+ * the session re-stamped if it has moved on.
+ */
+static inline void se_changed(struct session *s)
+{
+	uint64_t gen;
+
+	do {
+		gen = CMM_LOAD_SHARED(session_change_gen);
+		CMM_STORE_SHARED(s->se_change_gen, gen);
+		cmm_smp_mb();
+	} while (CMM_LOAD_SHARED(session_change_gen) != gen);
+}
+
 /**
  * Save session stats.
  *
@@ -971,6 +996,11 @@ static inline void se_save_stats(struct session *s,
 		rte_atomic64_inc(&s->se_pkts_out);
 		rte_atomic64_add(&s->se_bytes_out, bytes);
 	}
+
+	/* Counters are synced too, but only stamp once per generation */
+	if (CMM_LOAD_SHARED(s->se_change_gen) !=
+	    CMM_LOAD_SHARED(session_change_gen))
+		se_changed(s);
 }
 
 #endif /* _SESSION_H_ */
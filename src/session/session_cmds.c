@@ -27,6 +27,7 @@
 #include "session_feature.h"
 #include "session_op.h"
 #include "session_private.h"
+#include "session_watch.h"
 #include "urcu.h"
 #include "util.h"
 #include "vplane_log.h"
@@ -341,6 +342,7 @@ static void cmd_session_show_summary(FILE *fp)
 	jsonw_uint_field(json, "nat", sc.sc_nat);
 	jsonw_uint_field(json, "nat64", sc.sc_nat64);
 	jsonw_uint_field(json, "nat46", sc.sc_nat46);
+	jsonw_uint_field(json, "watch_dropped", session_watch_dropped());
 
 	npf_print_state_stats(json);
 
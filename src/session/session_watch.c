@@ -4,58 +4,137 @@
  * SPDX-License-Identifier: LGPL-2.1-only
  */
 #include <errno.h>
+#include <pthread.h>
+#include <rte_atomic.h>
+#include <rte_lcore.h>
+#include <rte_log.h>
+#include <rte_memory.h>
+#include <rte_ring.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <unistd.h>
 #include <urcu-qsbr.h>
 
+#include "dp_event.h"
 #include "dp_session.h"
 #include "npf/npf_state.h"
 #include "session/session.h"
 #include "session/session_watch.h"
+#include "rcu.h"
+#include "urcu.h"
+#include "util.h"
+#include "vplane_log.h"
 
 /*
- * Hold session watch pointer.
+ * Session event export.
+ *
+ * Forwarding cores don't call the watchers themselves, as that puts
+ * the watchers' latency on the packet path. Instead they queue the
+ * event to an export thread, holding a watch reference on the session
+ * so that it is not freed while queued. Events for a session come from
+ * whichever thread handled it (forwarding lcores, the master thread for
+ * expiry and GC, other non-EAL threads) so the rings are multi-producer
+ * and a session always uses the same ring, which keeps its events in
+ * order. The export thread drains the rings in batches, drops stats
+ * updates that are superseded by a later one for the same session in
+ * the batch, and hands each event to every registered watcher for that
+ * session type. If a ring is full the event is dropped and counted
+ * rather than delivered inline, which would reorder it.
+ */
+#define SESSION_WATCH_MAX	4
+#define SESSION_WATCH_RINGS	8	/* power of 2 */
+#define SESSION_WATCH_RING_SZ	4096
+#define SESSION_WATCH_BURST	64
+#define SESSION_WATCH_IDLE_US	100
+
+struct session_watch_event {
+	struct session		*session;
+	enum dp_session_hook	hook;
+};
+
+/*
+ * Hold session watch pointers.
  */
 struct session_watch_info {
-	struct session_watch *watch;
+	struct session_watch *watch[SESSION_WATCH_MAX];
+	unsigned int types;	/* union of watched types */
 	bool watch_on;
+	bool exporting;
+	bool stopping;
+	pthread_t exporter;
 };
 
 static struct session_watch_info watch_ctx;
+static struct rte_ring *session_watch_rings[SESSION_WATCH_RINGS];
+static rte_atomic64_t session_watch_drops;
+
+static int session_watch_export_init(void);
+
+static void session_watch_update_types(void)
+{
+	unsigned int i, types = 0;
+	bool on = false;
+
+	for (i = 0; i < SESSION_WATCH_MAX; i++) {
+		if (watch_ctx.watch[i]) {
+			types |= watch_ctx.watch[i]->types;
+			on = true;
+		}
+	}
+
+	CMM_STORE_SHARED(watch_ctx.types, types);
+	CMM_STORE_SHARED(watch_ctx.watch_on, on);
+}
 
 int dp_session_watch_register(struct session_watch *se_watch)
 {
-	if (!rcu_cmpxchg_pointer(&watch_ctx.watch, NULL, se_watch)) {
-		watch_ctx.watch_on = true;
-		return 0;
+	unsigned int i;
+	int rc;
+
+	for (i = 0; i < SESSION_WATCH_MAX; i++) {
+		if (!rcu_cmpxchg_pointer(&watch_ctx.watch[i], NULL,
+					 se_watch)) {
+			if (!watch_ctx.exporting) {
+				rc = session_watch_export_init();
+				if (rc < 0) {
+					rcu_assign_pointer(watch_ctx.watch[i],
+							   NULL);
+					return rc;
+				}
+			}
+			session_watch_update_types();
+			return i;
+		}
 	}
 
 	return -EBUSY;
 }
 
-int dp_session_watch_unregister(int watcher_id __unused)
+int dp_session_watch_unregister(int watcher_id)
 {
-	struct session_watch **p = &watch_ctx.watch;
-	uint8_t old = watch_ctx.watch_on;
+	if (watcher_id < 0 || watcher_id >= SESSION_WATCH_MAX)
+		return -ENOENT;
 
-	watch_ctx.watch_on = false;
-	if (rcu_xchg_pointer(p, NULL) != NULL)
-		return 0;
-	watch_ctx.watch_on = old;
-	return -ENOENT;
+	if (rcu_xchg_pointer(&watch_ctx.watch[watcher_id], NULL) == NULL)
+		return -ENOENT;
+
+	session_watch_update_types();
+
+	/* Wait out the export thread, so the caller may free the watcher */
+	dp_rcu_synchronize();
+	return 0;
 }
 
 bool is_watch_on(void)
 {
-	return watch_ctx.watch_on;
+	return CMM_LOAD_SHARED(watch_ctx.watch_on);
 }
 
-static struct session_watch *session_watch_get(void)
+uint64_t session_watch_dropped(void)
 {
-	struct session_watch *p = rcu_dereference(watch_ctx.watch);
-	return p;
+	return rte_atomic64_read(&session_watch_drops);
 }
 
 static bool check_session_type(struct session *session, unsigned int flags)
@@ -74,24 +153,187 @@ static bool check_session_type(struct session *session, unsigned int flags)
 	return false;
 }
 
+/* Hand an event to each watcher interested in this session type */
+static void session_watch_deliver(struct session *session,
+				  enum dp_session_hook hook)
+{
+	struct session_watch *wt;
+	unsigned int i;
+
+	for (i = 0; i < SESSION_WATCH_MAX; i++) {
+		wt = rcu_dereference(watch_ctx.watch[i]);
+		if (!wt || !wt->fn)
+			continue;
+
+		if (!check_session_type(session, wt->types))
+			continue;
+
+		wt->fn(session, hook, wt->data);
+	}
+}
+
+/* All events for a session go through the same ring */
+static inline struct rte_ring *session_watch_ring(struct session *session)
+{
+	uintptr_t h = (uintptr_t)session / RTE_CACHE_LINE_SIZE;
+
+	return session_watch_rings[h & (SESSION_WATCH_RINGS - 1)];
+}
+
 /*
- * call notfication function for established sessions.
- * The call back function is called unconditionally.
+ * Queue notification of a session event to the watchers.
  */
 void session_do_watch(struct session *session, enum dp_session_hook hook)
 {
-	struct session_watch *wt = session_watch_get();
+	struct session_watch_event ev = {
+		.session = session,
+		.hook = hook,
+	};
+	struct rte_ring *ring;
 
-	if (wt == NULL)
+	if (!check_session_type(session, CMM_LOAD_SHARED(watch_ctx.types)))
 		return;
 
-	if (!check_session_type(session, wt->types))
+	ring = session_watch_ring(session);
+	if (unlikely(!ring))
 		return;
 
-	if (wt->fn)
-		wt->fn(session, hook, wt->data);
+	rte_atomic32_inc(&session->se_watch_refs);
+	if (likely(rte_ring_mp_enqueue_elem(ring, &ev, sizeof(ev)) == 0))
+		return;
+
+	/* Exporter is behind */
+	rte_atomic32_dec(&session->se_watch_refs);
+	rte_atomic64_inc(&session_watch_drops);
 }
 
+/*
+ * A stats update is redundant if a later one for the same session
+ * is in the same batch.
+ */
+static bool
+session_watch_superseded(const struct session_watch_event *evs,
+			 unsigned int n, unsigned int idx)
+{
+	unsigned int i;
+
+	if (evs[idx].hook != SESSION_STATS_UPDATE)
+		return false;
+
+	for (i = idx + 1; i < n; i++)
+		if (evs[i].session == evs[idx].session &&
+		    evs[i].hook == SESSION_STATS_UPDATE)
+			return true;
+
+	return false;
+}
+
+/* Export thread, draining the event rings */
+static void *
+session_watch_exporter(void *arg __unused)
+{
+	struct session_watch_event evs[SESSION_WATCH_BURST];
+	unsigned int r, n, i, total;
+
+	pthread_setname_np(pthread_self(), "dp/se-watch");
+	dp_rcu_register_thread();
+
+	while (!CMM_LOAD_SHARED(watch_ctx.stopping)) {
+		total = 0;
+
+		dp_rcu_thread_online();
+		for (r = 0; r < SESSION_WATCH_RINGS; r++) {
+			n = rte_ring_sc_dequeue_burst_elem(
+				session_watch_rings[r], evs, sizeof(evs[0]),
+				SESSION_WATCH_BURST, NULL);
+			for (i = 0; i < n; i++) {
+				if (!session_watch_superseded(evs, n, i))
+					session_watch_deliver(evs[i].session,
+							      evs[i].hook);
+				rte_atomic32_dec(&evs[i].session->se_watch_refs);
+			}
+			total += n;
+		}
+		dp_rcu_thread_offline();
+
+		if (total == 0)
+			usleep(SESSION_WATCH_IDLE_US);
+	}
+
+	dp_rcu_unregister_thread();
+	return NULL;
+}
+
+/* Free the rings, releasing the sessions held by undelivered events */
+static void session_watch_rings_free(void)
+{
+	struct session_watch_event ev;
+	struct rte_ring *ring;
+	unsigned int r;
+
+	for (r = 0; r < SESSION_WATCH_RINGS; r++) {
+		ring = session_watch_rings[r];
+		if (!ring)
+			continue;
+
+		session_watch_rings[r] = NULL;
+		while (rte_ring_sc_dequeue_elem(ring, &ev, sizeof(ev)) == 0)
+			rte_atomic32_dec(&ev.session->se_watch_refs);
+		rte_ring_free(ring);
+	}
+}
+
+/*
+ * Set up the event rings and start the exporter.
+ */
+static int session_watch_export_init(void)
+{
+	char name[RTE_RING_NAMESIZE];
+	unsigned int r;
+
+	for (r = 0; r < SESSION_WATCH_RINGS; r++) {
+		snprintf(name, sizeof(name), "se-watch-%u", r);
+		session_watch_rings[r] =
+			rte_ring_create_elem(name,
+					sizeof(struct session_watch_event),
+					SESSION_WATCH_RING_SZ, SOCKET_ID_ANY,
+					RING_F_SC_DEQ);
+		if (!session_watch_rings[r])
+			goto fail;
+	}
+
+	watch_ctx.stopping = false;
+	if (pthread_create(&watch_ctx.exporter, NULL,
+			   session_watch_exporter, NULL) != 0)
+		goto fail;
+
+	watch_ctx.exporting = true;
+	return 0;
+
+fail:
+	RTE_LOG(ERR, DATAPLANE, "Failed to start session watch exporter\n");
+	session_watch_rings_free();
+	return -ENOMEM;
+}
+
+/* Stop the exporter on shutdown */
+static void session_watch_uninit(void)
+{
+	if (!watch_ctx.exporting)
+		return;
+
+	CMM_STORE_SHARED(watch_ctx.stopping, true);
+	pthread_join(watch_ctx.exporter, NULL);
+	watch_ctx.exporting = false;
+	session_watch_rings_free();
+}
+
+static const struct dp_event_ops session_watch_events = {
+	.uninit = session_watch_uninit,
+};
+
+DP_STARTUP_EVENT_REGISTER(session_watch_events);
+
 struct dp_session_walk_data {
 	unsigned int types;
 	dp_session_walk_t *fn;
@@ -7,10 +7,15 @@
 #define SESSION_WATCH_H
 
 #include <stdbool.h>
+#include <stdint.h>
+
 #include "dp_session.h"
 
 bool is_watch_on(void);
 
+/* Events dropped because the exporter fell behind */
+uint64_t session_watch_dropped(void);
+
 /*
  * call notfication function for established sessions.
  * skip closed/closing sessions if the sessions were never
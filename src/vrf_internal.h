@@ -55,6 +55,8 @@ struct vrf {
 	uint32_t  *v_pbrtablemap;
 	struct cds_lfht *v_ipv4_frag_table;
 	struct cds_lfht *v_ipv6_frag_table;
+	unsigned long v_ipv4_frag_cnt;	/* sets in v_ipv4_frag_table */
+	unsigned long v_ipv6_frag_cnt;	/* sets in v_ipv6_frag_table */
 	struct mcast_vrf v_mvrf4;
 	struct mcast6_vrf v_mvrf6;
 	struct crypto_vrf_ctx *crypto;
@@ -9,7 +9,9 @@
  */
 
 #include "dp_test.h"
+#include "dp_test/dp_test_cmd_check.h"
 #include "dp_test_console.h"
+#include "dp_test_json_utils.h"
 #include "dp_test_lib_internal.h"
 #include "dp_test_lib_exp.h"
 #include "dp_test_lib_intf_internal.h"
@@ -1492,3 +1494,113 @@ DP_START_TEST(bridge_flush, bridge_flush)
 	dp_test_intf_bridge_remove_port("br1", "dp2T1");
 	dp_test_intf_bridge_del("br1");
 } DP_END_TEST;
+
+static void
+bridge_learn_send(const char *smac, const char *rx_intf, const char *tx_intf)
+{
+	struct dp_test_expected *exp;
+	struct rte_mbuf *test_pak;
+	int len = 64;
+
+	/* Unknown destination, so flooded to the other port */
+	test_pak = dp_test_create_l2_pak("00:00:a4:00:00:ff", smac,
+					 DP_TEST_ET_LLDP, 1, &len);
+	exp = dp_test_exp_create(test_pak);
+	dp_test_exp_set_oif_name(exp, tx_intf);
+	dp_test_pak_receive(test_pak, rx_intf, exp);
+}
+
+static void
+bridge_learn_check(const char *mac, const char *port, bool gone)
+{
+	json_object *expected;
+	char cmd[100];
+
+	expected = dp_test_json_create(
+		"{\"name\" : \"br1\",\"mac_table\" : ["
+		"{\"port\" : \"%s\","
+		"\"dynamic\" : true,"
+		"\"mac\" : \"%s\""
+		"}]}", port, mac);
+	snprintf(cmd, sizeof(cmd), "bridge br1 macs show port %s", port);
+	dp_test_check_json_state(cmd, expected,
+				 DP_TEST_JSON_CHECK_SUBSET, gone);
+	json_object_put(expected);
+}
+
+static void
+bridge_learner_check(bool running)
+{
+	json_object *expected;
+
+	expected = dp_test_json_create(
+		"{\"learn\" : {\"learner\" : %s}}",
+		running ? "true" : "false");
+	dp_test_check_json_state("bridge learn show", expected,
+				 DP_TEST_JSON_CHECK_SUBSET, false);
+	json_object_put(expected);
+}
+
+/*
+ * Sources are learned, and moved between ports, by the learner, which
+ * only runs while there are bridges.
+ */
+DP_DECL_TEST_CASE(bridge_suite, bridge_learn, NULL, NULL);
+DP_START_TEST(bridge_learn, learner)
+{
+	const char *mac_a = "0:0:a4:0:0:aa";
+
+	bridge_learner_check(false);
+
+	dp_test_intf_bridge_create("br1");
+	dp_test_intf_bridge_add_port("br1", "dp1T0");
+	dp_test_intf_bridge_add_port("br1", "dp2T1");
+	bridge_learner_check(true);
+
+	bridge_learn_send(mac_a, "dp1T0", "dp2T1");
+	bridge_learn_check(mac_a, "dp1T0", false);
+
+	/* Move to the other port */
+	bridge_learn_send(mac_a, "dp2T1", "dp1T0");
+	bridge_learn_check(mac_a, "dp2T1", false);
+	bridge_learn_check(mac_a, "dp1T0", true);
+
+	dp_test_intf_bridge_remove_port("br1", "dp1T0");
+	dp_test_intf_bridge_remove_port("br1", "dp2T1");
+	dp_test_intf_bridge_del("br1");
+
+	bridge_learner_check(false);
+} DP_END_TEST;
+
+/*
+ * Addresses over the per-port learn rate are not learned.
+ */
+DP_START_TEST(bridge_learn, rate)
+{
+	const char *mac_a = "0:0:a4:0:0:aa";
+	const char *mac_b = "0:0:a4:0:0:bb";
+	const char *mac_c = "0:0:a4:0:0:cc";
+
+	dp_test_intf_bridge_create("br1");
+	dp_test_intf_bridge_add_port("br1", "dp1T0");
+	dp_test_intf_bridge_add_port("br1", "dp2T1");
+
+	dp_test_console_request_reply("bridge learn rate 1", false);
+	bridge_learn_send(mac_a, "dp1T0", "dp2T1");
+	bridge_learn_send(mac_b, "dp1T0", "dp2T1");
+
+	/*
+	 * Requests are handled in order, so once mac_c is learned
+	 * without a limit mac_b must have been refused.
+	 */
+	dp_test_console_request_reply("bridge learn rate 0", false);
+	bridge_learn_send(mac_c, "dp1T0", "dp2T1");
+	bridge_learn_check(mac_c, "dp1T0", false);
+	bridge_learn_check(mac_a, "dp1T0", false);
+	bridge_learn_check(mac_b, "dp1T0", true);
+
+	dp_test_console_request_reply("bridge learn rate 1000", false);
+	dp_test_intf_bridge_remove_port("br1", "dp1T0");
+	dp_test_intf_bridge_remove_port("br1", "dp2T1");
+	dp_test_intf_bridge_del("br1");
+} DP_END_TEST;
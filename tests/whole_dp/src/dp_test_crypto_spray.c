@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Unit-tests for spraying an outbound SA across crypto cores
+ */
+
+#include <rte_cycles.h>
+
+#include "dp_test.h"
+#include "dp_test_lib_internal.h"
+
+#include "crypto/crypto_internal.h"
+#include "crypto/crypto_main.h"
+#include "crypto/crypto_sadb.h"
+
+DP_DECL_TEST_SUITE(crypto_spray_suite);
+
+DP_DECL_TEST_CASE(crypto_spray_suite, crypto_spray_seq, NULL, NULL);
+
+/*
+ * Are sequence numbers handed out once each, and spread over the
+ * SA's PMDs in runs?
+ */
+DP_START_TEST(crypto_spray_seq, spray_assign)
+{
+	struct sadb_sa sa;
+	uint32_t seq, i;
+	uint8_t slot;
+	int pmd;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.spray_cnt = 3;
+	sa.spray_slot = 2;
+	sa.spray_dev_ids[0] = 5;
+	sa.spray_dev_ids[1] = 6;
+	sa.spray_dev_ids[2] = 7;
+
+	for (i = 1; i <= 100; i++) {
+		seq = 0;
+		slot = 0;
+		pmd = crypto_sadb_spray_assign(&sa, 5, &seq, &slot);
+		dp_test_fail_unless(seq == i, "Expected seq %u, got %u",
+				    i, seq);
+		dp_test_fail_unless(slot == 2, "Expected slot 2, got %u",
+				    slot);
+		dp_test_fail_unless(pmd == 5 + (int)((i >> 4) % 3),
+				    "seq %u on pmd %d", i, pmd);
+	}
+	dp_test_fail_unless(sa.seq == 100, "SA seq %u, expected 100",
+			    sa.seq);
+
+	/* A blocked SA stays on its own PMD and gets no sequence number */
+	sa.blocked = true;
+	seq = 0;
+	pmd = crypto_sadb_spray_assign(&sa, 5, &seq, &slot);
+	dp_test_fail_unless(pmd == 5 && seq == 0,
+			    "Blocked SA sprayed: pmd %d seq %u", pmd, seq);
+	dp_test_fail_unless(sa.seq == 100, "Blocked SA seq advanced");
+
+	sa.blocked = false;
+	sa.spray_cnt = 1;
+	pmd = crypto_sadb_spray_assign(&sa, 5, &seq, &slot);
+	dp_test_fail_unless(pmd == 5 && seq == 0,
+			    "Unsprayed SA sprayed: pmd %d seq %u", pmd, seq);
+} DP_END_TEST;
+
+#define SPRAY_TEST_PKTS 16
+
+static uint32_t spray_emitted[SPRAY_TEST_PKTS];
+static unsigned int spray_emit_cnt;
+
+static void spray_test_emit(struct crypto_pkt_ctx *ctx)
+{
+	if (spray_emit_cnt < SPRAY_TEST_PKTS)
+		spray_emitted[spray_emit_cnt] = ctx->seq;
+	spray_emit_cnt++;
+}
+
+static void spray_test_insert(struct crypto_fwd_info *fwd_info,
+			      struct crypto_pkt_ctx *ctx, uint32_t spi,
+			      uint32_t seq)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->spi = spi;
+	ctx->seq = seq;
+	ctx->spray_slot = 1;
+	crypto_reorder_insert(fwd_info, ctx);
+}
+
+static void spray_test_check(const uint32_t *exp, unsigned int cnt)
+{
+	unsigned int i;
+
+	dp_test_fail_unless(spray_emit_cnt == cnt,
+			    "Expected %u packets forwarded, got %u",
+			    cnt, spray_emit_cnt);
+	for (i = 0; i < cnt; i++)
+		dp_test_fail_unless(spray_emitted[i] == exp[i],
+				    "Packet %u has seq %u, expected %u",
+				    i, spray_emitted[i], exp[i]);
+	spray_emit_cnt = 0;
+}
+
+DP_DECL_TEST_CASE(crypto_spray_suite, crypto_spray_reorder, NULL, NULL);
+
+/*
+ * Are packets coming back from several crypto cores forwarded in
+ * sequence number order, with gaps skipped?
+ */
+DP_START_TEST(crypto_spray_reorder, reorder)
+{
+	struct crypto_pkt_ctx ctx[SPRAY_TEST_PKTS];
+	struct crypto_fwd_info fwd_info;
+	const uint32_t spi = htonl(0x1000);
+
+	memset(&fwd_info, 0, sizeof(fwd_info));
+	dp_test_fail_unless(crypto_reorder_init(&fwd_info, 0,
+						spray_test_emit) == 0,
+			    "Failed to set up reorder window");
+	spray_emit_cnt = 0;
+
+	/* Out of order, held until the first arrives */
+	spray_test_insert(&fwd_info, &ctx[0], spi, 3);
+	spray_test_insert(&fwd_info, &ctx[1], spi, 2);
+	spray_test_check(NULL, 0);
+	spray_test_insert(&fwd_info, &ctx[2], spi, 1);
+	spray_test_check((uint32_t []){ 1, 2, 3 }, 3);
+
+	/* A gap at 4 is skipped once it has stalled */
+	spray_test_insert(&fwd_info, &ctx[3], spi, 6);
+	spray_test_insert(&fwd_info, &ctx[4], spi, 5);
+	spray_test_check(NULL, 0);
+	rte_delay_us_block(1000);
+	crypto_reorder_check_stalled(&fwd_info);
+	spray_test_check((uint32_t []){ 5, 6 }, 2);
+
+	/* The missing packet turning up late isn't held */
+	spray_test_insert(&fwd_info, &ctx[5], spi, 4);
+	spray_test_check((uint32_t []){ 4 }, 1);
+
+	/* A packet beyond the window pushes the head out */
+	spray_test_insert(&fwd_info, &ctx[6], spi, 9);
+	spray_test_insert(&fwd_info, &ctx[7], spi, 9 + 1024);
+	spray_test_check((uint32_t []){ 9 }, 1);
+	spray_test_insert(&fwd_info, &ctx[8], spi, 10);
+	spray_test_check((uint32_t []){ 10 }, 1);
+	rte_delay_us_block(1000);
+	crypto_reorder_check_stalled(&fwd_info);
+	spray_test_check((uint32_t []){ 9 + 1024 }, 1);
+
+	/* A new SA in the slot starts again from 1 */
+	spray_test_insert(&fwd_info, &ctx[9], htonl(0x2000), 2);
+	spray_test_check(NULL, 0);
+	spray_test_insert(&fwd_info, &ctx[10], htonl(0x2000), 1);
+	spray_test_check((uint32_t []){ 1, 2 }, 2);
+
+	dp_test_fail_unless(fwd_info.reorder_held == 0,
+			    "%u packets left in reorder window",
+			    fwd_info.reorder_held);
+	crypto_reorder_fini(&fwd_info);
+} DP_END_TEST;
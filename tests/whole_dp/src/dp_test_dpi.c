@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Unit-tests for DPI worker core configuration and asynchronous detection
+ */
+
+#include <string.h>
+#include <sys/sysinfo.h>
+#include <unistd.h>
+#include <rte_lcore.h>
+
+#include "bitmask.h"
+#include "dp_test.h"
+#include "dp_test_lib_internal.h"
+#include "dp_test_pktmbuf_lib_internal.h"
+
+#include "npf/dpi/dpi_internal.h"
+
+DP_DECL_TEST_SUITE(dpi_suite);
+
+DP_DECL_TEST_CASE(dpi_suite, dpi_workers, NULL, NULL);
+
+/*
+ * Worker cores may not be dataplane cores, or cores that don't exist.
+ */
+DP_START_TEST(dpi_workers, worker_cores)
+{
+	uint8_t bytes[BITMASK_BYTESZ];
+	int master = rte_lcore_to_cpu_id(rte_get_master_lcore());
+	int rc;
+
+	/* The mask is big endian, the last byte holding cores 0-7 */
+	memset(bytes, 0, sizeof(bytes));
+	bytes[sizeof(bytes) - 1 - master / 8] = 1 << (master % 8);
+	rc = dpi_set_worker_cores(bytes, sizeof(bytes));
+	dp_test_fail_unless(rc == -EINVAL,
+			    "master core accepted as DPI worker: %d", rc);
+
+	if (get_nprocs_conf() < BITMASK_BITS) {
+		memset(bytes, 0, sizeof(bytes));
+		bytes[0] = 0x80;
+		rc = dpi_set_worker_cores(bytes, sizeof(bytes));
+		dp_test_fail_unless(rc == -EINVAL,
+				    "missing core accepted as DPI worker: %d",
+				    rc);
+	}
+
+	/* An empty mask is inline detection */
+	memset(bytes, 0, sizeof(bytes));
+	rc = dpi_set_worker_cores(bytes, sizeof(bytes));
+	dp_test_fail_unless(rc == 0, "empty DPI worker mask failed: %d", rc);
+} DP_END_TEST;
+
+/*
+ * Find a CPU that none of the dataplane's lcores run on.
+ */
+static int dp_test_dpi_free_cpu(void)
+{
+	unsigned int lcore;
+	int cpu;
+
+	for (cpu = 0; cpu < get_nprocs_conf() && cpu < BITMASK_BITS; cpu++) {
+		bool used = false;
+
+		RTE_LCORE_FOREACH(lcore) {
+			if (rte_lcore_to_cpu_id(lcore) == cpu)
+				used = true;
+		}
+		if (!used)
+			return cpu;
+	}
+	return -1;
+}
+
+/*
+ * With a DPI worker running, packets are handed to it and the flow's
+ * determination is only updated when the worker has processed them.
+ * A flow nDPI can't identify is given up on after it has seen 10
+ * packets, however many more were queued, and that verdict must make
+ * it back to the flow.
+ */
+DP_START_TEST(dpi_workers, async_verdict)
+{
+	struct dpi_engine_procs *ndpi = &ndpi_engine_procs;
+	struct dpi_engine_flow *flow = NULL;
+	uint8_t bytes[BITMASK_BYTESZ];
+	struct rte_mbuf *pak;
+	int len = 32;
+	int cpu, rc, i;
+
+	cpu = dp_test_dpi_free_cpu();
+	if (cpu < 0)
+		return;
+
+	dp_test_fail_unless(dpi_init(IANA_NDPI) == 0,
+			    "failed to initialise nDPI");
+
+	memset(bytes, 0, sizeof(bytes));
+	bytes[sizeof(bytes) - 1 - cpu / 8] = 1 << (cpu % 8);
+	rc = dpi_set_worker_cores(bytes, sizeof(bytes));
+	dp_test_fail_unless(rc == 0, "DPI worker on core %d failed: %d",
+			    cpu, rc);
+
+	pak = dp_test_create_udp_ipv4_pak("10.73.0.1", "10.73.2.1",
+					  41000, 41001, 1, &len);
+	rc = ndpi->first_packet(NULL, NULL, pak, 0, len, &flow);
+	dp_test_fail_unless(rc == 0 && flow,
+			    "nDPI failed first packet: %d", rc);
+
+	/* Queue more than the worker will look at */
+	for (i = 0; i < 30; i++)
+		ndpi->process_pkt(flow, pak, 0);
+
+	for (i = 0; i < 500 && !ndpi->is_offloaded(flow); i++)
+		usleep(10000);
+
+	dp_test_fail_unless(ndpi->is_offloaded(flow),
+			    "nDPI worker verdict never reached the flow");
+	dp_test_fail_unless(!ndpi->is_error(flow), "nDPI flow in error");
+	dp_test_fail_unless(ndpi->flow_get_proto(flow) != DPI_APP_UNDETERMINED,
+			    "nDPI flow protocol still undetermined");
+
+	ndpi->destructor(flow);
+	rte_pktmbuf_free(pak);
+
+	memset(bytes, 0, sizeof(bytes));
+	rc = dpi_set_worker_cores(bytes, sizeof(bytes));
+	dp_test_fail_unless(rc == 0, "empty DPI worker mask failed: %d", rc);
+} DP_END_TEST;
@@ -5,9 +5,12 @@
  * SPDX-License-Identifier: LGPL-2.1-only
  */
 
+#include <unistd.h>
+
 #include "ip_funcs.h"
 #include "in_cksum.h"
 #include "if_var.h"
+#include "config_internal.h"
 #include "main.h"
 
 #include "dp_test.h"
@@ -44,3 +47,172 @@ DP_START_TEST(if_config_vtun, add_vtun)
 	dp_test_netlink_del_interface_l2("vtun0");
 	dp_test_intf_virt_del("vtun0");
 } DP_END_TEST;
+
+DP_DECL_TEST_CASE(if_cfg_suite, if_config_rx_intr, NULL, NULL);
+/*
+ * Test RX interrupts are only kept on ports whose PMD supports them.
+ * The ring PMD used by the tests has no RX queue interrupts, so its
+ * queues must fall back to polling.
+ */
+DP_START_TEST(if_config_rx_intr, ring_pmd)
+{
+	char real_ifname[IFNAMSIZ];
+	bool saved = platform_cfg.rx_interrupts;
+	struct ifnet *ifp;
+	portid_t port;
+
+	ifp = dp_ifnet_byifname(dp_test_intf_real("dp1T0", real_ifname));
+	dp_test_fail_unless(ifp != NULL, "Expected ifp for %s", real_ifname);
+	port = ifp->if_port;
+
+	/* Not requested */
+	platform_cfg.rx_interrupts = false;
+	eth_port_rx_intr_init(port);
+	dp_test_fail_unless(!eth_port_rx_intr_enabled(port),
+			    "RX interrupts enabled when not configured");
+	dp_test_fail_unless(!eth_port_rx_intr_check(port),
+			    "RX interrupts usable when not configured");
+	dp_test_fail_unless(!eth_port_rx_intr_fallback(port),
+			    "RX interrupt fallback when not configured");
+
+	/* Requested, but refused by the PMD */
+	platform_cfg.rx_interrupts = true;
+	eth_port_rx_intr_init(port);
+	dp_test_fail_unless(eth_port_rx_intr_enabled(port),
+			    "RX interrupts not requested when configured");
+	dp_test_fail_unless(!eth_port_rx_intr_check(port),
+			    "RX interrupts usable on ring PMD");
+	dp_test_fail_unless(!eth_port_rx_intr_enabled(port),
+			    "RX interrupts still enabled after failed check");
+
+	platform_cfg.rx_interrupts = saved;
+	eth_port_rx_intr_init(port);
+} DP_END_TEST;
+
+DP_DECL_TEST_CASE(if_cfg_suite, if_config_rxq_rebalance, NULL, NULL);
+/*
+ * Test which RX queue moves the rebalancer considers worthwhile.
+ */
+DP_START_TEST(if_config_rxq_rebalance, move_choice)
+{
+	uint64_t peak = 0;
+
+	dp_test_fail_unless(!platform_cfg.rx_rebalance,
+			    "RX rebalancing enabled by default");
+
+	/* Loads within 25% of each other are left alone */
+	dp_test_fail_unless(!rxq_move_improves(1000000, 800000, 100000,
+					       &peak),
+			    "Move between balanced lcores");
+
+	/* Moving the only queue just moves the hot spot */
+	dp_test_fail_unless(!rxq_move_improves(1000000, 0, 1000000, &peak),
+			    "Move of the whole load");
+
+	/* A queue bigger than the gap makes things worse */
+	dp_test_fail_unless(!rxq_move_improves(1000000, 500000, 600000,
+					       &peak),
+			    "Move overloading the destination");
+
+	dp_test_fail_unless(!rxq_move_improves(1000000, 0, 0, &peak),
+			    "Move of an idle queue");
+
+	dp_test_fail_unless(rxq_move_improves(1000000, 200000, 300000,
+					      &peak),
+			    "Move to an idle lcore rejected");
+	dp_test_fail_unless(peak == 700000, "Expected peak 700000, got %"PRIu64,
+			    peak);
+
+	dp_test_fail_unless(rxq_move_improves(1000000, 0, 600000, &peak),
+			    "Move of most of the load rejected");
+	dp_test_fail_unless(peak == 600000, "Expected peak 600000, got %"PRIu64,
+			    peak);
+} DP_END_TEST;
+
+/*
+ * Wait for the lcore to go through lcore_rx_intr_wait() at least once
+ * after the given sequence number.
+ */
+static bool dp_test_rx_intr_waited(unsigned int lcore, unsigned long seq)
+{
+	int i;
+
+	for (i = 0; i < 500; i++) {
+		if (lcore_rx_intr_seq(lcore) >= seq + 2)
+			return true;
+		usleep(10000);
+	}
+	return false;
+}
+
+/*
+ * Move an RX queue while its lcore sleeps on RX interrupts. The ring
+ * PMD has no RX interrupts, so the lcore takes the fallback nap, and
+ * the queue must still be handed on and polled by its new owner.
+ */
+DP_START_TEST(if_config_rx_intr, migrate_sleeping)
+{
+	char real_ifname[IFNAMSIZ];
+	bool saved = platform_cfg.rx_interrupts;
+	unsigned int lcore = rte_get_master_lcore();
+	struct dp_test_expected *exp;
+	struct rte_mbuf *test_pak;
+	const char *nh_mac_str;
+	struct ifnet *ifp;
+	unsigned long seq;
+	portid_t port;
+	int len = 22;
+	int i;
+
+	ifp = dp_ifnet_byifname(dp_test_intf_real("dp1T0", real_ifname));
+	dp_test_fail_unless(ifp != NULL, "Expected ifp for %s", real_ifname);
+	port = ifp->if_port;
+
+	platform_cfg.rx_interrupts = true;
+	eth_port_rx_intr_init(port);
+	dp_test_fail_unless(!eth_port_rx_intr_check(port),
+			    "RX interrupts usable on ring PMD");
+
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_netlink_add_route("10.73.2.0/24 nh 2.2.2.1 int:dp2T1");
+	nh_mac_str = "aa:bb:cc:dd:ee:ff";
+	dp_test_netlink_add_neigh("dp2T1", "2.2.2.1", nh_mac_str);
+
+	/* Let the idle lcore go to sleep */
+	seq = lcore_rx_intr_seq(lcore);
+	dp_test_fail_unless(dp_test_rx_intr_waited(lcore, seq),
+			    "lcore %u never waited for RX interrupts", lcore);
+
+	dp_test_fail_unless(rxq_migrate_queue(port, 0, lcore) == 0,
+			    "Failed to move RX queue 0 of %s", real_ifname);
+	for (i = 0; i < 500 && rxq_migrate_pending(); i++)
+		usleep(10000);
+	dp_test_fail_unless(!rxq_migrate_pending(),
+			    "RX queue move never finished");
+
+	/* The queue is polled again after the move */
+	test_pak = dp_test_create_ipv4_pak("10.73.1.1", "10.73.2.1",
+					   1, &len);
+	dp_test_pktmbuf_eth_init(test_pak, dp_test_intf_name2mac_str("dp1T0"),
+				 DP_TEST_INTF_DEF_SRC_MAC, RTE_ETHER_TYPE_IPV4);
+
+	exp = dp_test_exp_create(test_pak);
+	dp_test_exp_set_oif_name(exp, "dp2T1");
+	(void)dp_test_pktmbuf_eth_init(dp_test_exp_get_pak(exp),
+				       nh_mac_str,
+				       dp_test_intf_name2mac_str("dp2T1"),
+				       RTE_ETHER_TYPE_IPV4);
+	dp_test_ipv4_decrement_ttl(dp_test_exp_get_pak(exp));
+
+	dp_test_pak_receive(test_pak, "dp1T0", exp);
+
+	/* Clean Up */
+	dp_test_netlink_del_neigh("dp2T1", "2.2.2.1", nh_mac_str);
+	dp_test_netlink_del_route("10.73.2.0/24 nh 2.2.2.1 int:dp2T1");
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+
+	platform_cfg.rx_interrupts = saved;
+	eth_port_rx_intr_init(port);
+} DP_END_TEST;
@@ -10,11 +10,13 @@
 
 #include <libmnl/libmnl.h>
 #include <linux/random.h>
+#include <linux/rtnetlink.h>
 
 #include "ip_funcs.h"
 #include "in_cksum.h"
 #include "if_var.h"
 #include "main.h"
+#include "nh_common.h"
 
 #include "dp_test.h"
 #include "dp_test_controller.h"
@@ -501,6 +503,55 @@ DP_START_TEST(ip_rx, invalid_paks)
 	dp_test_exp_set_fwd_status(exp, DP_TEST_FWD_DROPPED);
 	dp_test_pak_receive(test_pak, "dp1T1", exp);
 
+	/*
+	 * Test 4a - valid checksum but the NIC flagged it as bad,
+	 * check it's dropped.
+	 */
+	test_pak = dp_test_cp_pak(good_pak);
+	test_pak->ol_flags |= PKT_RX_IP_CKSUM_BAD;
+
+	exp = dp_test_exp_create(test_pak);
+	dp_test_exp_set_fwd_status(exp, DP_TEST_FWD_DROPPED);
+	dp_test_pak_receive(test_pak, "dp1T1", exp);
+
+	/*
+	 * Test 4b - invalid checksum but the NIC flagged it as good,
+	 * check the NIC is trusted and it's forwarded.  The checksum is
+	 * updated incrementally for the TTL, so stays invalid, and isn't
+	 * checked.
+	 */
+	test_pak = dp_test_cp_pak(good_pak);
+	ip = iphdr(test_pak);
+	ip->check = 0xdead;
+	test_pak->ol_flags |= PKT_RX_IP_CKSUM_GOOD;
+
+	exp = dp_test_exp_create(test_pak);
+	(void)dp_test_pktmbuf_eth_init(dp_test_exp_get_pak(exp),
+				       nh_mac_str,
+				       dp_test_intf_name2mac_str("dp2T2"),
+				       RTE_ETHER_TYPE_IPV4);
+	dp_test_ipv4_decrement_ttl(dp_test_exp_get_pak(exp));
+	ip = iphdr(dp_test_exp_get_pak(exp));
+	dp_test_exp_set_dont_care(exp, 0, (uint8_t *)&ip->check, 2);
+
+	dp_test_exp_set_oif_name(exp, "dp2T2");
+	dp_test_pak_receive(test_pak, "dp1T1", exp);
+
+	/*
+	 * Test 4c - invalid checksum flagged as good by a NIC that
+	 * recognised a tunnel, so the verdict is for the inner header.
+	 * Check the outer header is checked in software and dropped.
+	 */
+	test_pak = dp_test_cp_pak(good_pak);
+	ip = iphdr(test_pak);
+	ip->check = 0xdead;
+	test_pak->ol_flags |= PKT_RX_IP_CKSUM_GOOD;
+	test_pak->packet_type |= RTE_PTYPE_TUNNEL_GRE;
+
+	exp = dp_test_exp_create(test_pak);
+	dp_test_exp_set_fwd_status(exp, DP_TEST_FWD_DROPPED);
+	dp_test_pak_receive(test_pak, "dp1T1", exp);
+
 	/*
 	 * Test 5 - make the IP packet length too big and check it's dropped.
 	 */
@@ -2546,3 +2597,57 @@ DP_START_TEST(ip_default_route, ip_default_route2)
 	dp_test_intf_vif_del("dp1T1.103", 103);
 
 } DP_END_TEST;
+
+/*
+ * The nexthop table grows when full and shrinks again as it empties,
+ * and freed slots are not handed out again straight away.
+ */
+#define NH_TBL_TEST_COUNT (NEXTHOP_TBL_MIN_SIZE + 100)
+
+DP_DECL_TEST_CASE(ip_suite, ip_nexthop_tbl, NULL, NULL);
+DP_START_TEST(ip_nexthop_tbl, grow_shrink)
+{
+	static uint32_t idx[NH_TBL_TEST_COUNT];
+	static bool seen[2 * NEXTHOP_TBL_MIN_SIZE];
+	struct next_hop nh = {
+		.flags = RTF_BLACKHOLE,
+		.gateway.type = AF_INET,
+	};
+	uint32_t reuse;
+	unsigned int i;
+	int rc;
+
+	dp_test_check_state_show("route summary", "\"size\":1024", false);
+
+	for (i = 0; i < NH_TBL_TEST_COUNT; i++) {
+		nh.gateway.address.ip_v4.s_addr = htonl(0x0a000000 + i);
+		rc = nexthop_new(AF_INET, &nh, 1, RTPROT_UNSPEC,
+				 FAL_NHG_USE_IP, &idx[i]);
+		dp_test_fail_unless(rc == 0, "nexthop %u alloc failed: %d",
+				    i, rc);
+		dp_test_fail_unless(idx[i] < ARRAY_SIZE(seen),
+				    "nexthop %u index %u out of range",
+				    i, idx[i]);
+		dp_test_fail_unless(!seen[idx[i]],
+				    "nexthop %u index %u already in use",
+				    i, idx[i]);
+		seen[idx[i]] = true;
+	}
+
+	dp_test_check_state_show("route summary", "\"size\":2048", false);
+
+	/* A freed slot is not reused by the next allocation */
+	nexthop_put(AF_INET, idx[10]);
+	nh.gateway.address.ip_v4.s_addr = htonl(0x0a000000 + 10);
+	rc = nexthop_new(AF_INET, &nh, 1, RTPROT_UNSPEC, FAL_NHG_USE_IP,
+			 &reuse);
+	dp_test_fail_unless(rc == 0, "nexthop realloc failed: %d", rc);
+	dp_test_fail_unless(reuse != idx[10], "freed index %u reused",
+			    idx[10]);
+	idx[10] = reuse;
+
+	for (i = 0; i < NH_TBL_TEST_COUNT; i++)
+		nexthop_put(AF_INET, idx[i]);
+
+	dp_test_check_state_show("route summary", "\"size\":1024", false);
+} DP_END_TEST;
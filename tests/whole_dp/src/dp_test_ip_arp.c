@@ -12,6 +12,9 @@
 #include "in_cksum.h"
 #include "if_var.h"
 #include "main.h"
+#include "arp.h"
+#include "if_llatbl.h"
+#include "vrf_internal.h"
 
 #include "dp_test.h"
 #include "dp_test_cmd_state.h"
@@ -23,11 +26,14 @@
 #include "dp_test_pktmbuf_lib_internal.h"
 #include "dp_test_console.h"
 
+#include "protobuf/NbrResConfig.pb-c.h"
+
 struct nh_info {
 	const char *nh_int;
 	const char *nh_mac_str;
 	const char *gw;
 	bool arp;
+	bool keep_arp;
 	bool drop;
 };
 
@@ -83,7 +89,7 @@ static void _build_and_send_pak(const char *src_addr, const char *dest_addr,
 
 	_dp_test_pak_receive(test_pak, "dp1T0", exp, __FILE__, func, line);
 
-	if (nh.arp) {
+	if (nh.arp && !nh.keep_arp) {
 		/* Clear up the arp entry we just created by sending the req */
 		dp_test_neigh_clear_entry(nh.nh_int, dest);
 	}
@@ -1425,3 +1431,109 @@ DP_START_TEST_DONT_RUN(ip_arp_nh_scale,
 	dp_test_nl_del_ip_addr_and_connected("dp1T1", "2.2.0.2/16");
 
 } DP_END_TEST;
+
+static void dp_test_arp_cfg(NbrResConfig__Param param, bool set,
+			    uint32_t value)
+{
+	NbrResConfig cfg = NBR_RES_CONFIG__INIT;
+	void *buf;
+	int len;
+
+	cfg.prot = NBR_RES_CONFIG__PROT__ARP;
+	cfg.has_prot = true;
+	cfg.action = set ? NBR_RES_CONFIG__ACTION__SET :
+		NBR_RES_CONFIG__ACTION__DELETE;
+	cfg.has_action = true;
+	cfg.ifname = (char *)"all";
+	cfg.param = param;
+	cfg.has_param = true;
+	cfg.value = value;
+	cfg.has_value = true;
+
+	len = nbr_res_config__get_packed_size(&cfg);
+	buf = malloc(len);
+	dp_test_assert_internal(buf);
+	nbr_res_config__pack(&cfg, buf);
+
+	dp_test_lib_pb_wrap_and_send_pb("vyatta:arp", buf, len);
+}
+
+static struct arp_stats *dp_test_arp_stats(void)
+{
+	struct vrf *vrf = dp_vrf_get_rcu_from_external(VRF_DEFAULT_ID);
+
+	dp_test_assert_internal(vrf);
+	return &vrf->v_arpstat;
+}
+
+DP_DECL_TEST_CASE(ip_arp_suite, ip_arp_unres_limit, NULL, NULL);
+/*
+ * Forwarding to unresolved neighbours is limited per interface and
+ * across all interfaces. Packets that would need a new incomplete
+ * entry beyond either limit are dropped and counted.
+ */
+DP_START_TEST(ip_arp_unres_limit, ip_arp_unres_limit)
+{
+	struct nh_info nh_arp1 = {.nh_int = "dp1T1",
+				  .arp = true,
+				  .keep_arp = true};
+	struct nh_info nh_arp2 = {.nh_int = "dp1T2",
+				  .arp = true,
+				  .keep_arp = true};
+	struct nh_info nh_drop = {.drop = true};
+	struct arp_stats *stats = dp_test_arp_stats();
+
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp1T1", "2.2.2.2/24");
+	dp_test_nl_add_ip_addr_and_connected("dp1T2", "3.3.3.3/24");
+
+	dp_test_arp_cfg(NBR_RES_CONFIG__PARAM__MAX_UNRESOLVED, true, 2);
+	dp_test_arp_cfg(NBR_RES_CONFIG__PARAM__MAX_UNRESOLVED_TOTAL, true, 3);
+	stats->resthrot = 0;
+	stats->resdropped = 0;
+
+	/* Per-interface limit */
+	build_and_send_pak("10.73.0.0", "2.2.2.10", nh_arp1);
+	build_and_send_pak("10.73.0.0", "2.2.2.11", nh_arp1);
+	build_and_send_pak("10.73.0.0", "2.2.2.12", nh_drop);
+	dp_test_fail_unless(stats->resthrot == 1 && stats->resdropped == 1,
+			    "per-interface throttle %"PRIu64" dropped %"PRIu64,
+			    stats->resthrot, stats->resdropped);
+
+	/* Global limit, with the other interface below its own limit */
+	build_and_send_pak("10.73.0.0", "3.3.3.10", nh_arp2);
+	build_and_send_pak("10.73.0.0", "3.3.3.11", nh_drop);
+	dp_test_fail_unless(stats->resthrot == 2 && stats->resdropped == 2,
+			    "global throttle %"PRIu64" dropped %"PRIu64,
+			    stats->resthrot, stats->resdropped);
+	dp_test_fail_unless(lltable_unres_total() == 3,
+			    "unresolved total %d", lltable_unres_total());
+
+	/* Removing an incomplete entry makes room for another */
+	dp_test_neigh_clear_entry("dp1T1", "2.2.2.10");
+	dp_test_fail_unless(lltable_unres_total() == 2,
+			    "unresolved total after clear %d",
+			    lltable_unres_total());
+	build_and_send_pak("10.73.0.0", "3.3.3.11", nh_arp2);
+	dp_test_fail_unless(stats->resdropped == 2,
+			    "dropped after clear %"PRIu64,
+			    stats->resdropped);
+
+	/* Clean Up */
+	dp_test_neigh_clear_entry("dp1T1", "2.2.2.11");
+	dp_test_neigh_clear_entry("dp1T2", "3.3.3.10");
+	dp_test_neigh_clear_entry("dp1T2", "3.3.3.11");
+	dp_test_fail_unless(lltable_unres_total() == 0,
+			    "unresolved total at end %d",
+			    lltable_unres_total());
+
+	dp_test_arp_cfg(NBR_RES_CONFIG__PARAM__MAX_UNRESOLVED, false, 0);
+	dp_test_arp_cfg(NBR_RES_CONFIG__PARAM__MAX_UNRESOLVED_TOTAL, false,
+			0);
+	stats->resthrot = 0;
+	stats->resdropped = 0;
+
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp1T1", "2.2.2.2/24");
+	dp_test_nl_del_ip_addr_and_connected("dp1T2", "3.3.3.3/24");
+} DP_END_TEST;
@@ -7,7 +7,11 @@
  *
  * IPv4 ICMP generation tests
  */
+#include <pthread.h>
+
 #include "ip_funcs.h"
+#include "ip_icmp.h"
+#include "protobuf/ICMPRateLimConfig.pb-c.h"
 
 #include "dp_test.h"
 #include "dp_test_netlink_state_internal.h"
@@ -666,3 +670,114 @@ DP_START_TEST(ip_icmp, rfc_redirect)
 	dp_test_nl_del_ip_addr_and_connected("dp1T1", "1.1.1.1/24");
 	dp_test_nl_del_ip_addr_and_connected("dp1T1", "2.2.2.2/24");
 } DP_END_TEST;
+
+DP_DECL_TEST_CASE(ip_icmp_suite, ip_icmp_ratelimit, NULL, NULL);
+
+static void
+dp_test_icmp_ratelimit_set(bool set, uint32_t maximum)
+{
+	ICMPRateLimConfig cfg = ICMPRATE_LIM_CONFIG__INIT;
+	void *buf;
+	int len;
+
+	cfg.has_prot = true;
+	cfg.prot = ICMPRATE_LIM_CONFIG__PROT__ICMPV4;
+	cfg.has_action = true;
+	cfg.action = set ? ICMPRATE_LIM_CONFIG__ACTION__SET :
+		ICMPRATE_LIM_CONFIG__ACTION__DELETE;
+	cfg.has_type = true;
+	cfg.type = ICMPRATE_LIM_CONFIG__TYPE__TIMEEXCEEDED;
+	cfg.has_param = true;
+	cfg.param = ICMPRATE_LIM_CONFIG__PARAM__MAXIMUM;
+	cfg.has_maximum = true;
+	cfg.maximum = maximum;
+
+	len = icmprate_lim_config__get_packed_size(&cfg);
+	buf = malloc(len);
+	dp_test_assert_internal(buf);
+	icmprate_lim_config__pack(&cfg, buf);
+
+	dp_test_lib_pb_wrap_and_send_pb("vyatta:icmp-ratelimit", buf, len);
+}
+
+#define ICMP_RL_LIMIT	50
+#define ICMP_RL_CALLS	200
+#define ICMP_RL_THREADS	2
+
+static void *
+dp_test_icmp_ratelimit_thread(void *arg)
+{
+	unsigned int *sent = arg;
+	unsigned int i;
+
+	for (i = 0; i < ICMP_RL_CALLS; i++)
+		if (!icmp_ratelimit_drop(ICMP_TIME_EXCEEDED,
+					 icmp_ratelimit_state,
+					 ICMP_TIME_EXCEEDED + 1))
+			(*sent)++;
+	return NULL;
+}
+
+/*
+ * Non-EAL threads all count against slot 0, along with the master.
+ * Several of them generating errors at once must between them send
+ * exactly the limit, and every error must be counted.
+ */
+DP_START_TEST(ip_icmp_ratelimit, shared_slot)
+{
+	unsigned int sent[ICMP_RL_THREADS];
+	pthread_t tid[ICMP_RL_THREADS];
+	json_object *expected_json;
+	unsigned int i, total = 0;
+	int attempt;
+
+	/*
+	 * The limit is refilled every second, so try again should that
+	 * happen part way through.
+	 */
+	for (attempt = 0; attempt < 3; attempt++) {
+		/* Resets the tokens and the counters */
+		dp_test_icmp_ratelimit_set(true, ICMP_RL_LIMIT);
+
+		memset(sent, 0, sizeof(sent));
+		for (i = 0; i < ICMP_RL_THREADS; i++)
+			dp_test_fail_unless(
+				pthread_create(&tid[i], NULL,
+					       dp_test_icmp_ratelimit_thread,
+					       &sent[i]) == 0,
+				"failed to start thread %u", i);
+
+		total = 0;
+		for (i = 0; i < ICMP_RL_THREADS; i++) {
+			pthread_join(tid[i], NULL);
+			total += sent[i];
+		}
+		if (total == ICMP_RL_LIMIT)
+			break;
+	}
+	dp_test_fail_unless(total == ICMP_RL_LIMIT,
+			    "sent %u time-exceeded errors, limit %u",
+			    total, ICMP_RL_LIMIT);
+
+	expected_json = dp_test_json_create(
+		"{ \"icmp-types\": [ {"
+		"    \"icmp-type\": \"time-exceeded\","
+		"    \"limit\": %u,"
+		"    \"sent\": %u,"
+		"    \"dropped\": %u,"
+		"    \"lcores\": [ {"
+		"      \"lcore\": 0,"
+		"      \"sent\": %u,"
+		"      \"dropped\": %u"
+		"    } ]"
+		"} ] }",
+		ICMP_RL_LIMIT, ICMP_RL_LIMIT,
+		ICMP_RL_THREADS * ICMP_RL_CALLS - ICMP_RL_LIMIT,
+		ICMP_RL_LIMIT,
+		ICMP_RL_THREADS * ICMP_RL_CALLS - ICMP_RL_LIMIT);
+	dp_test_check_json_state("icmprl show v4", expected_json,
+				 DP_TEST_JSON_CHECK_SUBSET, false);
+	json_object_put(expected_json);
+
+	dp_test_icmp_ratelimit_set(false, 0);
+} DP_END_TEST;
@@ -16,6 +16,7 @@
 #include "dp_test_pktmbuf_lib_internal.h"
 #include "dp_test_console.h"
 #include "dp_test_cmd_check.h"
+#include "dp_test_lib_intf_internal.h"
 
 DP_DECL_TEST_SUITE(ip_msuite);
 
@@ -270,3 +271,284 @@ DP_START_TEST(ip_mfwd_5, dp_forwarding)
 	dp_test_nl_del_ip_addr_and_connected("dp2T2", "2003:3:3::1/64");
 
 } DP_END_TEST;
+
+/*
+ * Send one packet from src to the group on dp1T0 and expect a copy
+ * on each of the outputs, which must be in tx ring order.
+ */
+static void
+dp_test_mcast_fwd(const char *src, const char *grp, const char *grp_mac,
+		  const char * const *oifs, int n_oifs)
+{
+	bool v6 = strchr(src, ':') != NULL;
+	struct dp_test_expected *exp;
+	struct rte_mbuf *test_pak;
+	int len = 22;
+	int i;
+
+	if (v6)
+		test_pak = dp_test_create_ipv6_pak(src, grp, 1, &len);
+	else
+		test_pak = dp_test_create_ipv4_pak(src, grp, 1, &len);
+	dp_test_pktmbuf_eth_init(test_pak, dp_test_intf_name2mac_str("dp1T0"),
+				 DP_TEST_INTF_DEF_SRC_MAC,
+				 v6 ? RTE_ETHER_TYPE_IPV6 :
+				 RTE_ETHER_TYPE_IPV4);
+
+	exp = dp_test_exp_create_m(test_pak, n_oifs);
+	for (i = 0; i < n_oifs; i++) {
+		dp_test_exp_set_oif_name_m(exp, i, oifs[i]);
+		(void)dp_test_pktmbuf_eth_init(
+			dp_test_exp_get_pak_m(exp, i), grp_mac,
+			dp_test_intf_name2mac_str(oifs[i]),
+			v6 ? RTE_ETHER_TYPE_IPV6 : RTE_ETHER_TYPE_IPV4);
+		if (v6)
+			dp_test_ipv6_decrement_ttl(
+				dp_test_exp_get_pak_m(exp, i));
+		else
+			dp_test_ipv4_decrement_ttl(
+				dp_test_exp_get_pak_m(exp, i));
+	}
+
+	dp_test_pak_receive(test_pak, "dp1T0", exp);
+}
+
+/*
+ * Find the entry with the given key in the output of a multicast show
+ * command, and check that its per-lcore counters add up to the total
+ * packets and bytes, and that the total is the number of packets sent.
+ */
+static void
+_dp_test_mcast_check_lcore_stats(const char *what, const char *key,
+				 const char *val, const char *pkts_field,
+				 const char *bytes_field, int exp_pkts,
+				 const char *file, int line)
+{
+	struct dp_test_json_find_key entry_key[] = {
+		{ what, NULL },
+		{ key, val },
+	};
+	int pkts, bytes, lcore_pkts, lcore_bytes;
+	int sum_pkts = 0, sum_bytes = 0;
+	json_object *jresp, *jentry, *jlcores, *jlcore;
+	char cmd[32];
+	char *response;
+	int i, nlcores;
+	bool err;
+
+	snprintf(cmd, sizeof(cmd), "multicast %s", what);
+	response = dp_test_console_request_w_err(cmd, &err, false);
+	_dp_test_fail_unless(response && !err, file, line,
+			     "no response to %s", cmd);
+	jresp = parse_json(response, parse_err_str, sizeof(parse_err_str));
+	free(response);
+	_dp_test_fail_unless(jresp, file, line,
+			     "failed to parse %s response", cmd);
+
+	jentry = dp_test_json_find(jresp, entry_key, ARRAY_SIZE(entry_key));
+	_dp_test_fail_unless(jentry, file, line, "no %s entry for %s %s",
+			     what, key, val);
+
+	_dp_test_fail_unless(
+		dp_test_json_int_field_from_obj(jentry, pkts_field, &pkts) &&
+		dp_test_json_int_field_from_obj(jentry, bytes_field, &bytes),
+		file, line, "no %s/%s in %s entry for %s",
+		pkts_field, bytes_field, what, val);
+
+	_dp_test_fail_unless(
+		json_object_object_get_ex(jentry, "lcores", &jlcores),
+		file, line, "no lcores in %s entry for %s", what, val);
+
+	nlcores = json_object_array_length(jlcores);
+	for (i = 0; i < nlcores; i++) {
+		jlcore = json_object_array_get_idx(jlcores, i);
+		_dp_test_fail_unless(
+			dp_test_json_int_field_from_obj(jlcore, "packets",
+							&lcore_pkts) &&
+			dp_test_json_int_field_from_obj(jlcore, "bytes",
+							&lcore_bytes),
+			file, line, "bad lcore counters for %s", val);
+		sum_pkts += lcore_pkts;
+		sum_bytes += lcore_bytes;
+	}
+
+	_dp_test_fail_unless(sum_pkts == pkts && sum_bytes == bytes,
+			     file, line,
+			     "%s %s: lcores sum to %d/%d, total %d/%d",
+			     what, val, sum_pkts, sum_bytes, pkts, bytes);
+	_dp_test_fail_unless(pkts == exp_pkts, file, line,
+			     "%s %s: %d packets, expected %d",
+			     what, val, pkts, exp_pkts);
+
+	json_object_put(jentry);
+	json_object_put(jresp);
+}
+
+#define dp_test_mcast_check_lcore_stats(what, key, val, pkts_field,	\
+					bytes_field, exp_pkts)		\
+	_dp_test_mcast_check_lcore_stats(what, key, val, pkts_field,	\
+					 bytes_field, exp_pkts,		\
+					 __FILE__, __LINE__)
+
+/* Check the packets sent out of a vif */
+static void
+dp_test_mcast_check_pkt_out(const char *ifname, int exp_pkts)
+{
+	json_object *expected_json;
+	char real_ifname[IFNAMSIZ];
+
+	dp_test_intf_real(ifname, real_ifname);
+	expected_json = dp_test_json_create(
+		"{ \"mif\": [ {"
+		"    \"interface\": \"%s\","
+		"    \"pkt_out\": %d"
+		"} ] }", real_ifname, exp_pkts);
+	dp_test_check_json_state("multicast mif", expected_json,
+				 DP_TEST_JSON_CHECK_SUBSET, false);
+	json_object_put(expected_json);
+}
+
+/*
+ * Change the output interfaces of an IPv4 mroute between bursts of
+ * forwarded packets.  The route counters must carry on across the
+ * changes, the per-lcore route and input counters must add up to the
+ * reported totals, and each output must only count the packets sent
+ * while it was in the list.
+ */
+DP_DECL_TEST_CASE(ip_msuite, ip_mfwd_6, NULL, NULL);
+DP_START_TEST(ip_mfwd_6, oif_change)
+{
+	const char * const both[] = { "dp2T1", "dp2T2" };
+	const char * const one[] = { "dp2T2" };
+	const char *grp_mac = "01:00:5e:00:01:01";
+	char real_ifname[IFNAMSIZ];
+	int i;
+
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_netlink_netconf_mcast("dp1T0", AF_INET, true);
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_netlink_netconf_mcast("dp2T1", AF_INET, true);
+	dp_test_nl_add_ip_addr_and_connected("dp2T2", "3.3.3.3/24");
+	dp_test_netlink_netconf_mcast("dp2T2", AF_INET, true);
+
+	dp_test_mroute_nl(RTM_NEWROUTE, "10.73.1.1", "dp1T0",
+			  "224.0.1.1/32 nh int:dp2T1 nh int:dp2T2");
+	dp_test_wait_for_mroute("10.73.1.1", "224.0.1.1",
+				"dpT10", "dpT21 dpT22", false);
+
+	for (i = 0; i < 3; i++)
+		dp_test_mcast_fwd("10.73.1.1", "224.0.1.1", grp_mac,
+				  both, ARRAY_SIZE(both));
+	dp_test_mcast_check_lcore_stats("fcstat", "group", "224.0.1.1",
+					"packets", "bytes", 3);
+
+	/* Drop dp2T1 from the list */
+	dp_test_mroute_nl(RTM_NEWROUTE, "10.73.1.1", "dp1T0",
+			  "224.0.1.1/32 nh int:dp2T2");
+	dp_test_wait_for_mroute("10.73.1.1", "224.0.1.1",
+				"dpT10", "dpT22", false);
+
+	for (i = 0; i < 2; i++)
+		dp_test_mcast_fwd("10.73.1.1", "224.0.1.1", grp_mac,
+				  one, ARRAY_SIZE(one));
+	dp_test_mcast_check_lcore_stats("fcstat", "group", "224.0.1.1",
+					"packets", "bytes", 5);
+
+	/* And add it back */
+	dp_test_mroute_nl(RTM_NEWROUTE, "10.73.1.1", "dp1T0",
+			  "224.0.1.1/32 nh int:dp2T1 nh int:dp2T2");
+	dp_test_wait_for_mroute("10.73.1.1", "224.0.1.1",
+				"dpT10", "dpT21 dpT22", false);
+
+	dp_test_mcast_fwd("10.73.1.1", "224.0.1.1", grp_mac,
+			  both, ARRAY_SIZE(both));
+	dp_test_mcast_check_lcore_stats("fcstat", "group", "224.0.1.1",
+					"packets", "bytes", 6);
+
+	dp_test_intf_real("dp1T0", real_ifname);
+	dp_test_mcast_check_lcore_stats("mif", "interface", real_ifname,
+					"pkt_in", "bytes_in", 6);
+	dp_test_mcast_check_pkt_out("dp2T1", 4);
+	dp_test_mcast_check_pkt_out("dp2T2", 6);
+
+	/* Clean Up */
+	dp_test_mroute_nl(RTM_DELROUTE, "10.73.1.1", "dp1T0",
+			  "224.0.1.1/32 nh int:dp2T1 nh int:dp2T2");
+	dp_test_wait_for_mroute("10.73.1.1", "224.0.1.1",
+				"dpT10", "dpT21 dpT22", true);
+
+	dp_test_netlink_netconf_mcast("dp1T0", AF_INET, false);
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_netlink_netconf_mcast("dp2T1", AF_INET, false);
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_netlink_netconf_mcast("dp2T2", AF_INET, false);
+	dp_test_nl_del_ip_addr_and_connected("dp2T2", "3.3.3.3/24");
+} DP_END_TEST;
+
+/*
+ * IPv6 version of ip_mfwd_6.
+ */
+DP_DECL_TEST_CASE(ip_msuite, ip_mfwd_7, NULL, NULL);
+DP_START_TEST(ip_mfwd_7, oif_change)
+{
+	const char * const both[] = { "dp2T1", "dp2T2" };
+	const char * const one[] = { "dp2T2" };
+	const char *grp_mac = "33:33:00:01:00:01";
+	int i;
+
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "2001:1:1::1/64");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2002:2:2::1/64");
+	dp_test_nl_add_ip_addr_and_connected("dp2T2", "2003:3:3::1/64");
+
+	dp_test_netlink_netconf_mcast("dp1T0", AF_INET6, true);
+	dp_test_netlink_netconf_mcast("dp2T1", AF_INET6, true);
+	dp_test_netlink_netconf_mcast("dp2T2", AF_INET6, true);
+
+	dp_test_mroute_nl(RTM_NEWROUTE, "2001:1:1::2", "dp1T0",
+			  "ff0e::1:1/128 nh int:dp2T1 nh int:dp2T2");
+	dp_test_wait_for_mroute("2001:1:1::2", "ff0e::1:1",
+				"dpT10", "dpT21 dpT22", false);
+
+	for (i = 0; i < 3; i++)
+		dp_test_mcast_fwd("2001:1:1::2", "ff0e::1:1", grp_mac,
+				  both, ARRAY_SIZE(both));
+	dp_test_mcast_check_lcore_stats("fcstat6", "group", "ff0e::1:1",
+					"packets", "bytes", 3);
+
+	/* Drop dp2T1 from the list */
+	dp_test_mroute_nl(RTM_NEWROUTE, "2001:1:1::2", "dp1T0",
+			  "ff0e::1:1/128 nh int:dp2T2");
+	dp_test_wait_for_mroute("2001:1:1::2", "ff0e::1:1",
+				"dpT10", "dpT22", false);
+
+	for (i = 0; i < 2; i++)
+		dp_test_mcast_fwd("2001:1:1::2", "ff0e::1:1", grp_mac,
+				  one, ARRAY_SIZE(one));
+	dp_test_mcast_check_lcore_stats("fcstat6", "group", "ff0e::1:1",
+					"packets", "bytes", 5);
+
+	/* And add it back */
+	dp_test_mroute_nl(RTM_NEWROUTE, "2001:1:1::2", "dp1T0",
+			  "ff0e::1:1/128 nh int:dp2T1 nh int:dp2T2");
+	dp_test_wait_for_mroute("2001:1:1::2", "ff0e::1:1",
+				"dpT10", "dpT21 dpT22", false);
+
+	dp_test_mcast_fwd("2001:1:1::2", "ff0e::1:1", grp_mac,
+			  both, ARRAY_SIZE(both));
+	dp_test_mcast_check_lcore_stats("fcstat6", "group", "ff0e::1:1",
+					"packets", "bytes", 6);
+
+	/* Clean Up */
+	dp_test_mroute_nl(RTM_DELROUTE, "2001:1:1::2", "dp1T0",
+			  "ff0e::1:1/128 nh int:dp2T1 nh int:dp2T2");
+	dp_test_wait_for_mroute("2001:1:1::2", "ff0e::1:1",
+				"dpT10", "dpT21 dpT22", true);
+
+	dp_test_netlink_netconf_mcast("dp1T0", AF_INET6, false);
+	dp_test_netlink_netconf_mcast("dp2T1", AF_INET6, false);
+	dp_test_netlink_netconf_mcast("dp2T2", AF_INET6, false);
+
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "2001:1:1::1/64");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2002:2:2::1/64");
+	dp_test_nl_del_ip_addr_and_connected("dp2T2", "2003:3:3::1/64");
+} DP_END_TEST;
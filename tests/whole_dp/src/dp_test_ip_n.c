@@ -11,6 +11,8 @@
  * get some meaningful performance stats (dcache and icache hits) from a
  * single test.
  */
+#include "if_var.h"
+
 #include "dp_test_lib_exp.h"
 #include "dp_test_lib_intf_internal.h"
 #include "dp_test/dp_test_macros.h"
@@ -123,3 +125,115 @@ DP_START_TEST(ip_fwd_n, if_fwd_n)
 	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
 	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
 } DP_END_TEST;
+
+/*
+ * Paks from one rx burst fanned out over two egress ports. Each port has
+ * its own tx burst buffer on the forwarding lcore, and with fewer than a
+ * full tx burst per port the paks only leave when the buffers are drained
+ * at the end of the poll.
+ */
+#define IP_FWD_MULTI_PORT_PAKS 6
+
+static void
+ip_fwd_multi_port_send(const char *oif[2], const char *nh_mac[2],
+		       bool oif1_down)
+{
+	struct dp_test_expected *exp = NULL;
+	struct rte_mbuf *rx_pak_n[IP_FWD_MULTI_PORT_PAKS];
+	unsigned int order[2];
+	char dst[INET_ADDRSTRLEN];
+	unsigned int i, j, p, n = 0;
+	int len = 22;
+
+	/* Alternate the egress port for each pak in the burst */
+	for (i = 0; i < IP_FWD_MULTI_PORT_PAKS; i++) {
+		snprintf(dst, sizeof(dst), "10.73.%u.%u", i % 2 + 2, i / 2 + 1);
+		rx_pak_n[i] = dp_test_create_ipv4_pak("10.73.1.1", dst,
+						      1, &len);
+		dp_test_pktmbuf_eth_init(rx_pak_n[i],
+					 dp_test_intf_name2mac_str("dp1T0"),
+					 DP_TEST_INTF_DEF_SRC_MAC,
+					 RTE_ETHER_TYPE_IPV4);
+	}
+
+	/*
+	 * The tx rings are read back a port at a time in port order, so
+	 * expect each port's paks together, lowest port first, in the
+	 * order they were received.
+	 */
+	order[0] = dp_test_intf_name2port(oif[0]) <
+		dp_test_intf_name2port(oif[1]) ? 0 : 1;
+	order[1] = !order[0];
+
+	for (j = 0; j < 2; j++) {
+		p = order[j];
+		for (i = p; i < IP_FWD_MULTI_PORT_PAKS; i += 2, n++) {
+			if (!exp)
+				exp = dp_test_exp_create_m(rx_pak_n[i], 1);
+			else
+				dp_test_exp_append_m(exp, rx_pak_n[i], 1);
+
+			if (p == 1 && oif1_down) {
+				dp_test_exp_set_fwd_status_m(
+					exp, n, DP_TEST_FWD_DROPPED);
+				continue;
+			}
+
+			dp_test_pktmbuf_eth_init(
+				dp_test_exp_get_pak_m(exp, n), nh_mac[p],
+				dp_test_intf_name2mac_str(oif[p]),
+				RTE_ETHER_TYPE_IPV4);
+			dp_test_ipv4_decrement_ttl(
+				dp_test_exp_get_pak_m(exp, n));
+			dp_test_exp_set_oif_name_m(exp, n, oif[p]);
+		}
+	}
+
+	dp_test_pak_receive_n(rx_pak_n, IP_FWD_MULTI_PORT_PAKS, "dp1T0", exp);
+}
+
+DP_DECL_TEST_CASE(ip_suite_n, ip_fwd_multi_port, NULL, NULL);
+DP_START_TEST(ip_fwd_multi_port, if_fwd_multi_port)
+{
+	const char *oif[2] = { "dp2T1", "dp3T3" };
+	const char *nh_mac[2] = { "aa:bb:cc:dd:ee:ff", "aa:bb:cc:dd:ee:fe" };
+	char real_ifname[IFNAMSIZ];
+	struct ifnet *ifp;
+
+	/* Set up the interface addresses */
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_nl_add_ip_addr_and_connected("dp3T3", "3.3.3.3/24");
+
+	/* Add the routes / nh arps we want the packets to follow */
+	dp_test_netlink_add_route("10.73.2.0/24 nh 2.2.2.1 int:dp2T1");
+	dp_test_netlink_add_route("10.73.3.0/24 nh 3.3.3.1 int:dp3T3");
+	dp_test_netlink_add_neigh("dp2T1", "2.2.2.1", nh_mac[0]);
+	dp_test_netlink_add_neigh("dp3T3", "3.3.3.1", nh_mac[1]);
+
+	ip_fwd_multi_port_send(oif, nh_mac, false);
+
+	/*
+	 * Take the second port out of the active set. Its paks must be
+	 * dropped without holding up or reordering the first port's.
+	 */
+	ifp = dp_ifnet_byifname(dp_test_intf_real(oif[1], real_ifname));
+	dp_test_fail_unless(ifp, "No interface %s", oif[1]);
+	if_disable_poll_rcu(ifp->if_port);
+
+	ip_fwd_multi_port_send(oif, nh_mac, true);
+
+	/* Back up, only the new burst goes out - nothing left over */
+	if_enable_poll(ifp->if_port);
+
+	ip_fwd_multi_port_send(oif, nh_mac, false);
+
+	/* Clean Up */
+	dp_test_netlink_del_neigh("dp2T1", "2.2.2.1", nh_mac[0]);
+	dp_test_netlink_del_neigh("dp3T3", "3.3.3.1", nh_mac[1]);
+	dp_test_netlink_del_route("10.73.2.0/24 nh 2.2.2.1 int:dp2T1");
+	dp_test_netlink_del_route("10.73.3.0/24 nh 3.3.3.1 int:dp3T3");
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_nl_del_ip_addr_and_connected("dp3T3", "3.3.3.3/24");
+} DP_END_TEST;
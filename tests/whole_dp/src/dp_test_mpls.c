@@ -5984,6 +5984,165 @@ DP_START_TEST(mpls_size, config)
 	dp_test_netlink_set_mpls_forwarding("dp1T1", false);
 } DP_END_TEST;
 
+/*
+ * Check the number of label index leaves and, if label is non-zero,
+ * that the index entry for it matches what was programmed.  Label 0
+ * is reserved so is never checked this way.
+ */
+static void
+dp_test_mpls_check_index(uint32_t leaves, uint32_t label,
+			 enum nh_type nh_type,
+			 enum mpls_payload_type payload)
+{
+	json_object *expected_json;
+	char cmd[40];
+
+	if (!label) {
+		expected_json = dp_test_json_create(
+			"{ \"mpls_tables\": [ { \"lblspc\": 0,"
+			"  \"index_leaves\": %u } ] }", leaves);
+		dp_test_check_json_state("mpls show tables", expected_json,
+					 DP_TEST_JSON_CHECK_SUBSET, false);
+		json_object_put(expected_json);
+		return;
+	}
+
+	snprintf(cmd, sizeof(cmd), "mpls show label %u", label);
+	expected_json = dp_test_json_create(
+		"{ \"mpls_tables\": [ { \"lblspc\": 0,"
+		"  \"index_leaves\": %u,"
+		"  \"mpls_routes\": [ {"
+		"    \"address\": %u,"
+		"    \"payload\": %u,"
+		"    \"nexthop_type\": %u,"
+		"    \"index\": {"
+		"      \"valid\": true,"
+		"      \"nexthop_match\": true,"
+		"      \"payload\": %u,"
+		"      \"nexthop_type\": %u"
+		"    } } ] } ] }",
+		leaves, label, payload, nh_type, payload, nh_type);
+	dp_test_check_json_state(cmd, expected_json,
+				 DP_TEST_JSON_CHECK_SUBSET, false);
+	json_object_put(expected_json);
+}
+
+/* Send a packet with the given label and expect it swapped to 22 */
+static void
+dp_test_mpls_index_fwd(label_t label, const char *nh_mac_str)
+{
+	struct dp_test_expected *exp;
+	struct rte_mbuf *expected_pak;
+	struct rte_mbuf *payload_pak;
+	struct rte_mbuf *test_pak;
+	label_t out_label = 22;
+	int len = 22;
+
+	payload_pak = dp_test_create_ipv4_pak("99.99.0.0", "88.88.0.0",
+					      1, &len);
+	test_pak = dp_test_create_mpls_pak(
+		1, &label,
+		(uint8_t []){DP_TEST_PAK_DEFAULT_TTL},
+		payload_pak);
+	(void)dp_test_pktmbuf_eth_init(test_pak,
+				       dp_test_intf_name2mac_str("dp1T1"),
+				       NULL,
+				       RTE_ETHER_TYPE_MPLS);
+
+	expected_pak = dp_test_create_mpls_pak(
+		1, &out_label,
+		(uint8_t []){DP_TEST_PAK_DEFAULT_TTL - 1},
+		payload_pak);
+	(void)dp_test_pktmbuf_eth_init(expected_pak,
+				       nh_mac_str,
+				       dp_test_intf_name2mac_str("dp2T2"),
+				       RTE_ETHER_TYPE_MPLS);
+
+	exp = dp_test_exp_create(expected_pak);
+	rte_pktmbuf_free(expected_pak);
+	rte_pktmbuf_free(payload_pak);
+	dp_test_exp_set_oif_name(exp, "dp2T2");
+
+	dp_test_pak_receive(test_pak, "dp1T1", exp);
+}
+
+/*
+ * The label index is split into leaves of 1024 labels.  Add and
+ * remove labels either side of the leaf boundaries, checking that
+ * leaves are allocated and freed as expected, that the labels left
+ * in a leaf still forward, and that the packed index entries match
+ * the label table.
+ */
+DP_START_TEST(mpls_size, index)
+{
+	const char *nh_mac_str = "aa:bb:cc:dd:ee:ff";
+
+	dp_test_netlink_set_mpls_forwarding("dp1T1", true);
+	dp_test_netlink_add_neigh("dp2T2", "3.3.3.1", nh_mac_str);
+
+	/* The reserved labels live in the first leaf */
+	dp_test_netlink_add_route("1023 mpt:ipv4 nh 3.3.3.1 int:dp2T2 lbls 22");
+	dp_test_mpls_check_index(1, 1023, NH_TYPE_V4GW, MPT_IPV4);
+	dp_test_mpls_check_index(1, MPLS_IPV6EXPLICITNULL,
+				 NH_TYPE_V4GW, MPT_IPV6);
+
+	dp_test_netlink_add_route("1024 mpt:ipv4 nh 3.3.3.1 int:dp2T2 lbls 22");
+	dp_test_mpls_check_index(2, 1024, NH_TYPE_V4GW, MPT_IPV4);
+
+	dp_test_netlink_add_route("2047 mpt:ipv6 nh 2002::2:2:1 int:dp2T2 "
+				  "lbls 22");
+	dp_test_mpls_check_index(2, 2047, NH_TYPE_V6GW, MPT_IPV6);
+
+	dp_test_netlink_add_route("2048 mpt:ipv4 nh 3.3.3.1 int:dp2T2 lbls 22");
+	dp_test_mpls_check_index(3, 2048, NH_TYPE_V4GW, MPT_IPV4);
+
+	dp_test_mpls_index_fwd(1023, nh_mac_str);
+	dp_test_mpls_index_fwd(1024, nh_mac_str);
+	dp_test_mpls_index_fwd(2048, nh_mac_str);
+
+	/* Replacing a label must not change the leaf accounting */
+	dp_test_netlink_replace_route("2047 mpt:ipv4 nh 3.3.3.1 int:dp2T2 "
+				      "lbls 22");
+	dp_test_mpls_check_index(3, 2047, NH_TYPE_V4GW, MPT_IPV4);
+	dp_test_mpls_index_fwd(2047, nh_mac_str);
+
+	/* Last label in the third leaf */
+	dp_test_netlink_del_route("2048 mpt:ipv4 nh 3.3.3.1 int:dp2T2 lbls 22");
+	dp_test_mpls_check_index(2, 0, 0, 0);
+
+	/* The second leaf stays while 2047 is in it */
+	dp_test_netlink_del_route("1024 mpt:ipv4 nh 3.3.3.1 int:dp2T2 lbls 22");
+	dp_test_mpls_check_index(2, 2047, NH_TYPE_V4GW, MPT_IPV4);
+	dp_test_mpls_index_fwd(2047, nh_mac_str);
+
+	dp_test_netlink_del_route("2047 mpt:ipv4 nh 3.3.3.1 int:dp2T2 lbls 22");
+	dp_test_mpls_check_index(1, 0, 0, 0);
+
+	/* A freed leaf is allocated again on reuse */
+	dp_test_netlink_add_route("1024 mpt:ipv4 nh 3.3.3.1 int:dp2T2 lbls 22");
+	dp_test_mpls_check_index(2, 1024, NH_TYPE_V4GW, MPT_IPV4);
+	dp_test_mpls_index_fwd(1024, nh_mac_str);
+	dp_test_netlink_del_route("1024 mpt:ipv4 nh 3.3.3.1 int:dp2T2 lbls 22");
+
+	/* The first leaf holds the reserved labels, so is never freed */
+	dp_test_netlink_del_route("1023 mpt:ipv4 nh 3.3.3.1 int:dp2T2 lbls 22");
+	dp_test_mpls_check_index(1, MPLS_IPV6EXPLICITNULL,
+				 NH_TYPE_V4GW, MPT_IPV6);
+
+	/* Shrinking past a label purges it from the index too */
+	dp_test_console_request_reply("mpls labeltablesize 4096", false);
+	dp_test_netlink_add_route("3000 mpt:ipv4 nh 3.3.3.1 int:dp2T2 lbls 22");
+	dp_test_mpls_check_index(2, 3000, NH_TYPE_V4GW, MPT_IPV4);
+	dp_test_console_request_reply("mpls labeltablesize 2048", false);
+	dp_test_wait_for_route_gone("3000 mpt:ipv4 nh 3.3.3.1 int:dp2T2 lbls 22",
+				    false, __FILE__, __func__, __LINE__);
+	dp_test_mpls_check_index(1, 0, 0, 0);
+
+	/* Clean up */
+	dp_test_netlink_del_neigh("dp2T2", "3.3.3.1", nh_mac_str);
+	dp_test_netlink_set_mpls_forwarding("dp1T1", false);
+} DP_END_TEST;
+
 DP_DECL_TEST_CASE(mpls, mpls_oam, NULL, NULL);
 
 DP_START_TEST(mpls_oam, v4_ecmp)
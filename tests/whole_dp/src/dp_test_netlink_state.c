@@ -2761,10 +2761,12 @@ _dp_test_netlink_remove_bridge_port(const char *br_name, const char *eth_name,
  *
  * vxlan_id is vxlan VNI
  * intf_parent is name of parent interface i.e. dpT0
+ * remote is the address of the remote VTEP, or NULL for none
  */
 static void
 dp_test_netlink_vxlan(const char *vxlan_name, uint16_t nlmsg_type,
-		      uint32_t vni, const char *parent_name, bool verify,
+		      uint32_t vni, const char *parent_name,
+		      const char *remote, bool verify,
 		      const char *file, const char *func,
 		      int line)
 {
@@ -2837,6 +2839,14 @@ dp_test_netlink_vxlan(const char *vxlan_name, uint16_t nlmsg_type,
 					 dp_test_intf_name2index(parent_name));
 		else
 			dp_test_assert_internal(false);
+		if (remote) {
+			struct in_addr group;
+
+			if (inet_pton(AF_INET, remote, &group) != 1)
+				dp_test_assert_internal(false);
+			mnl_attr_put_u32(nlh, IFLA_VXLAN_GROUP,
+					 group.s_addr);
+		}
 		mnl_attr_nest_end(nlh, vxlan_data);
 	}
 	mnl_attr_nest_end(nlh, vxlan_info);
@@ -2886,7 +2896,21 @@ _dp_test_netlink_create_vxlan(const char *vxlan_name, uint32_t vni,
 			      const char *file, const char *func, int line)
 {
 	dp_test_netlink_vxlan(vxlan_name, RTM_NEWLINK, vni, parent_name,
-			      verify,
+			      NULL, verify,
+			      file, func, line);
+}
+
+/*
+ * Set the remote VTEP of an existing vxlan interface
+ */
+void
+_dp_test_netlink_set_vxlan_remote(const char *vxlan_name, uint32_t vni,
+				  const char *parent_name, const char *remote,
+				  bool verify,
+				  const char *file, const char *func, int line)
+{
+	dp_test_netlink_vxlan(vxlan_name, RTM_NEWLINK, vni, parent_name,
+			      remote, verify,
 			      file, func, line);
 }
 
@@ -2898,8 +2922,8 @@ _dp_test_netlink_del_vxlan(const char *vxlan_name, uint32_t vni,
 			   bool verify,
 			   const char *file, const char *func, int line)
 {
-	dp_test_netlink_vxlan(vxlan_name, RTM_DELLINK, vni, NULL, verify,
-			      file, func, line);
+	dp_test_netlink_vxlan(vxlan_name, RTM_DELLINK, vni, NULL, NULL,
+			      verify, file, func, line);
 }
 
 /*
@@ -354,6 +354,17 @@ void _dp_test_netlink_create_vxlan(const char *vxlan_name, uint32_t vni,
 	_dp_test_netlink_create_vxlan(vxlan_name, vni, parent_name, true,\
 				      __FILE__, __func__, __LINE__)
 
+void _dp_test_netlink_set_vxlan_remote(const char *vxlan_name, uint32_t vni,
+				       const char *parent_name,
+				       const char *remote, bool verify,
+				       const char *file, const char *func,
+				       int line);
+#define dp_test_netlink_set_vxlan_remote(vxlan_name, vni, parent_name,	\
+					 remote)			\
+	_dp_test_netlink_set_vxlan_remote(vxlan_name, vni, parent_name,	\
+					  remote, true,			\
+					  __FILE__, __func__, __LINE__)
+
 void _dp_test_netlink_del_vxlan(const char *vxlan_name, uint32_t vni,
 				bool verify,
 				const char *file, const char *func,
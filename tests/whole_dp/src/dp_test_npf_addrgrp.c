@@ -479,10 +479,19 @@ dp_test_addrgrp_tree_lookup(const char *group, const char *addr_str)
 			     "Failed to parse addr %s", addr_str);
 
 	/*
-	 * This is the function called from the forwarding-threads.
-	 * It does a shortest match lookup to verify address-group membership.
+	 * This is the function called from the forwarding-threads.  Until
+	 * the address-group is compiled it does a shortest match lookup in
+	 * the ptree to verify address-group membership.  Check that the
+	 * compiled form gives the same answer.
 	 */
 	rc = npf_addrgrp_lookup((klen == 4) ? AG_IPv4 : AG_IPv6, tid, &addr);
+
+	npf_addrgrp_compile_all();
+	dp_test_fail_unless(
+		npf_addrgrp_lookup((klen == 4) ? AG_IPv4 : AG_IPv6,
+				   tid, &addr) == rc,
+		"Compiled lookup of %s in %s differs", addr_str, group);
+
 	return rc == 0;
 }
 
@@ -8,6 +8,7 @@
 #include <time.h>
 #include <values.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <linux/if_ether.h>
 #include <netinet/ip_icmp.h>
@@ -17,6 +18,9 @@
 #include "in_cksum.h"
 #include "if_var.h"
 #include "main.h"
+#include "npf/fragment/ipv4_frag_tbl.h"
+#include "npf/fragment/ipv6_rsmbl_tbl.h"
+#include "vrf_internal.h"
 
 #include "dp_test.h"
 #include "dp_test_controller.h"
@@ -781,3 +785,139 @@ _defrag_duplicate(const char *rx_intf, const char *pre_smac, int pre_vlan,
 			file, func, line);
 }
 
+
+static void
+frag_key4(struct ipv4_frag_key *key, uint32_t src, uint32_t dst, uint32_t id)
+{
+	uint32_t src_dst[2] = { src, dst };
+
+	memcpy(&key->src_dst, src_dst, sizeof(key->src_dst));
+	key->id = id;
+}
+
+/* Wait for the RCU callbacks freeing fragment sets to run */
+static bool frag_src4_released(uint32_t src)
+{
+	int i;
+
+	for (i = 0; i < 1000 && ipv4_frag_src_held(src); i++)
+		usleep(1000);
+	return ipv4_frag_src_held(src) == 0;
+}
+
+static bool frag_src6_released(const uint32_t *src)
+{
+	int i;
+
+	for (i = 0; i < 1000 && ipv6_frag_src_held(src); i++)
+		usleep(1000);
+	return ipv6_frag_src_held(src) == 0;
+}
+
+/*
+ * A source is capped at IPV4_FRAG_SRC_MAX_BYTES across all of its
+ * fragment sets, without affecting other sources.
+ */
+DP_DECL_TEST_CASE(npf_defrag, frag_src_cap, NULL, NULL);
+DP_START_TEST(frag_src_cap, ipv4)
+{
+	struct vrf *vrf = get_vrf(VRF_DEFAULT_ID);
+	struct ipv4_frag_pkt *pkt1, *pkt2, *pkt3;
+	uint32_t src1 = htonl(0x0a000001);
+	uint32_t src2 = htonl(0x0a000002);
+	uint32_t dst = htonl(0x0a010001);
+	struct ipv4_frag_key key;
+
+	frag_key4(&key, src1, dst, 1);
+	pkt1 = ipv4_frag_find(vrf, &key);
+	frag_key4(&key, src1, dst, 2);
+	pkt2 = ipv4_frag_find(vrf, &key);
+	frag_key4(&key, src2, dst, 1);
+	pkt3 = ipv4_frag_find(vrf, &key);
+	dp_test_fail_unless(pkt1 && pkt2 && pkt3, "frag set not created");
+
+	dp_test_fail_unless(ipv4_frag_src_hold(pkt1, IPV4_FRAG_SRC_MAX_BYTES),
+			    "hold up to the limit failed");
+	dp_test_fail_unless(!ipv4_frag_src_hold(pkt1, 1),
+			    "hold over the limit succeeded");
+	dp_test_fail_unless(!ipv4_frag_src_hold(pkt2, 1),
+			    "hold in 2nd set of source succeeded");
+	dp_test_fail_unless(ipv4_frag_src_hold(pkt3, 1),
+			    "hold by other source failed");
+	dp_test_fail_unless(ipv4_frag_src_held(src1) ==
+			    IPV4_FRAG_SRC_MAX_BYTES,
+			    "source held %u", ipv4_frag_src_held(src1));
+	dp_test_fail_unless(ipv4_frag_src_held(src2) == 1,
+			    "other source held %u", ipv4_frag_src_held(src2));
+
+	ipv4_frag_free(vrf, pkt1);
+	ipv4_frag_free(vrf, pkt2);
+	ipv4_frag_free(vrf, pkt3);
+	dp_test_fail_unless(frag_src4_released(src1), "source not released");
+	dp_test_fail_unless(frag_src4_released(src2),
+			    "other source not released");
+} DP_END_TEST;
+
+DP_START_TEST(frag_src_cap, ipv6)
+{
+	struct vrf *vrf = get_vrf(VRF_DEFAULT_ID);
+	struct ipv6_frag_pkt *fp1, *fp2;
+	struct ipv6_frag_key key = {
+		.src_dst = { htonl(0x20010db8), 0, 0, htonl(1),
+			     htonl(0x20010db8), htonl(1), 0, htonl(1) },
+		.id = 1,
+	};
+	uint32_t src[4];
+
+	fp1 = ipv6_frag_find_or_create(vrf, &key);
+	/* Same source, different destination */
+	key.src_dst[7] = htonl(2);
+	fp2 = ipv6_frag_find_or_create(vrf, &key);
+	dp_test_fail_unless(fp1 && fp2 && fp1 != fp2, "frag set not created");
+
+	dp_test_fail_unless(ipv6_frag_src_hold(fp1, IPV6_FRAG_SRC_MAX_BYTES),
+			    "hold up to the limit failed");
+	dp_test_fail_unless(!ipv6_frag_src_hold(fp2, 1),
+			    "hold in 2nd set of source succeeded");
+
+	memcpy(src, key.src_dst, sizeof(src));
+	dp_test_fail_unless(ipv6_frag_src_held(src) ==
+			    IPV6_FRAG_SRC_MAX_BYTES,
+			    "source held %u", ipv6_frag_src_held(src));
+
+	ipv6_frag_free(vrf, fp1);
+	ipv6_frag_free(vrf, fp2);
+	dp_test_fail_unless(frag_src6_released(src), "source not released");
+} DP_END_TEST;
+
+/*
+ * An expired set found on lookup is replaced inline rather than
+ * waiting for the gc timer, and its memory is released.
+ */
+DP_DECL_TEST_CASE(npf_defrag, frag_expire, NULL, NULL);
+DP_START_TEST(frag_expire, inline)
+{
+	struct vrf *vrf = get_vrf(VRF_DEFAULT_ID);
+	struct ipv4_frag_pkt *pkt, *new;
+	uint32_t src = htonl(0x0a000003);
+	uint32_t dst = htonl(0x0a010001);
+	struct ipv4_frag_key key;
+	unsigned long cnt;
+
+	frag_key4(&key, src, dst, 1);
+	pkt = ipv4_frag_find(vrf, &key);
+	dp_test_fail_unless(pkt, "frag set not created");
+	dp_test_fail_unless(ipv4_frag_src_hold(pkt, 1000), "hold failed");
+	cnt = CMM_LOAD_SHARED(vrf->v_ipv4_frag_cnt);
+
+	pkt->pkt_expire = 0;
+	new = ipv4_frag_find(vrf, &key);
+	dp_test_fail_unless(new && new != pkt, "expired set not replaced");
+	dp_test_fail_unless(CMM_LOAD_SHARED(vrf->v_ipv4_frag_cnt) == cnt,
+			    "frag set count %lu, expected %lu",
+			    CMM_LOAD_SHARED(vrf->v_ipv4_frag_cnt), cnt);
+	dp_test_fail_unless(frag_src4_released(src),
+			    "expired set not released");
+
+	ipv4_frag_free(vrf, new);
+} DP_END_TEST;
@@ -14,6 +14,7 @@
 #include "in_cksum.h"
 #include "if_var.h"
 #include "main.h"
+#include "npf/npf_apm.h"
 
 #include "dp_test.h"
 #include "dp_test_controller.h"
@@ -43,6 +44,7 @@
  * 6. Mapping of address ranges
  * 7. The "exclude" option
  * 8. Source NAT (port range)
+ * 9. Source NAT port leases
  *
  * To debug:
  *
@@ -2879,3 +2881,129 @@ DP_START_TEST(snat7, test1)
 	dp_test_nl_del_ip_addr_and_connected("dp2T1", "203.0.114.1/24");
 
 } DP_END_TEST;
+
+/*
+ * Source NAT port leases
+ *
+ * Single ports from a large port range are reserved from the portmap 64
+ * at a time into a lease for the lcore, and ports released on that lcore
+ * go back to the lease.  Idle leases are returned to the portmap by the
+ * garbage collector.  Small port ranges don't use leases.
+ *
+ * "ports_reserved" counts the ports allocated plus those held in leases.
+ * The UT forwards packets and releases sessions on the same lcore.
+ */
+DP_DECL_TEST_CASE(npf_nat, snat_lease, NULL, NULL);
+
+DP_START_TEST(snat_lease, test1)
+{
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "10.0.1.254/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "172.0.2.254/24");
+
+	dp_test_netlink_add_neigh("dp1T0", "10.0.1.1", "aa:bb:cc:dd:2:b1");
+	dp_test_netlink_add_neigh("dp1T0", "10.0.1.2", "aa:bb:cc:dd:2:b2");
+	dp_test_netlink_add_neigh("dp2T1", "172.0.2.3", "aa:bb:cc:dd:1:a3");
+
+	struct dp_test_npf_nat_rule_t snat_large = {
+		.desc		= "snat large port range",
+		.rule		= "10",
+		.ifname		= "dp2T1",
+		.proto		= NAT_NULL_PROTO,
+		.map		= "dynamic",
+		.port_alloc	= NULL,
+		.from_addr	= "10.0.1.1/32",
+		.from_port	= NULL,
+		.to_addr	= NULL,
+		.to_port	= NULL,
+		.trans_addr	= "172.0.2.1",
+		.trans_port	= "1024-65535"};
+
+	struct dp_test_npf_nat_rule_t snat_small = {
+		.desc		= "snat small port range",
+		.rule		= "20",
+		.ifname		= "dp2T1",
+		.proto		= NAT_NULL_PROTO,
+		.map		= "dynamic",
+		.port_alloc	= NULL,
+		.from_addr	= "10.0.1.2/32",
+		.from_port	= NULL,
+		.to_addr	= NULL,
+		.to_port	= NULL,
+		.trans_addr	= "172.0.2.2",
+		.trans_port	= "4096-4111"};
+
+	dp_test_npf_snat_add(&snat_large, true);
+	dp_test_npf_snat_add(&snat_small, true);
+
+	/* First port refills the lease */
+	dpt_udp("dp1T0", "aa:bb:cc:dd:2:b1",
+		"10.0.1.1", 10000, "172.0.2.3", 80,
+		"172.0.2.1", 10000, "172.0.2.3", 80,
+		"aa:bb:cc:dd:1:a3", "dp2T1",
+		DP_TEST_FWD_FORWARDED);
+
+	dp_test_npf_portmap_verify("udp", "172.0.2.1", "ACTIVE", 1);
+	dp_test_npf_portmap_reserved_verify("udp", "172.0.2.1", 64);
+
+	/* Second port comes from the lease */
+	dpt_udp("dp1T0", "aa:bb:cc:dd:2:b1",
+		"10.0.1.1", 10001, "172.0.2.3", 80,
+		"172.0.2.1", 10001, "172.0.2.3", 80,
+		"aa:bb:cc:dd:1:a3", "dp2T1",
+		DP_TEST_FWD_FORWARDED);
+
+	dp_test_npf_portmap_verify("udp", "172.0.2.1", "ACTIVE", 2);
+	dp_test_npf_portmap_reserved_verify("udp", "172.0.2.1", 64);
+
+	/* Small range reserves from the portmap directly */
+	dpt_udp("dp1T0", "aa:bb:cc:dd:2:b2",
+		"10.0.1.2", 4100, "172.0.2.3", 80,
+		"172.0.2.2", 4100, "172.0.2.3", 80,
+		"aa:bb:cc:dd:1:a3", "dp2T1",
+		DP_TEST_FWD_FORWARDED);
+
+	dp_test_npf_portmap_verify("udp", "172.0.2.2", "ACTIVE", 1);
+	dp_test_npf_portmap_reserved_verify("udp", "172.0.2.2", 1);
+
+	/* Released ports go back to the lease */
+	dp_test_npf_clear_sessions();
+
+	dp_test_npf_portmap_port_free_verify("udp", "172.0.2.1", 10000);
+	dp_test_npf_portmap_port_free_verify("udp", "172.0.2.1", 10001);
+	dp_test_npf_portmap_reserved_verify("udp", "172.0.2.1", 64);
+	dp_test_npf_portmap_reserved_verify("udp", "172.0.2.2", 0);
+
+	/*
+	 * The first GC pass marks the lease idle, the second returns it
+	 * to the portmap, which is then unused.
+	 */
+	npf_apm_gc();
+	dp_test_npf_portmap_reserved_verify("udp", "172.0.2.1", 64);
+
+	npf_apm_gc();
+	dp_test_npf_portmap_reserved_verify("udp", "172.0.2.1", 0);
+	dp_test_npf_portmap_verify("udp", "172.0.2.1", "REMOVABLE", 0);
+
+	/* A new port on the removable portmap refills the lease */
+	dpt_udp("dp1T0", "aa:bb:cc:dd:2:b1",
+		"10.0.1.1", 10002, "172.0.2.3", 80,
+		"172.0.2.1", 10002, "172.0.2.3", 80,
+		"aa:bb:cc:dd:1:a3", "dp2T1",
+		DP_TEST_FWD_FORWARDED);
+
+	dp_test_npf_portmap_verify("udp", "172.0.2.1", "ACTIVE", 1);
+	dp_test_npf_portmap_reserved_verify("udp", "172.0.2.1", 64);
+
+	/* Cleanup */
+	dp_test_npf_snat_del(snat_large.ifname, snat_large.rule, true);
+	dp_test_npf_snat_del(snat_small.ifname, snat_small.rule, true);
+	dp_test_npf_cleanup();
+
+	dp_test_netlink_del_neigh("dp1T0", "10.0.1.1", "aa:bb:cc:dd:2:b1");
+	dp_test_netlink_del_neigh("dp1T0", "10.0.1.2", "aa:bb:cc:dd:2:b2");
+	dp_test_netlink_del_neigh("dp2T1", "172.0.2.3", "aa:bb:cc:dd:1:a3");
+
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "172.0.2.254/24");
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "10.0.1.254/24");
+
+} DP_END_TEST;
@@ -300,6 +300,55 @@ _dp_test_npf_portmap_verify(const char *prot, const char *addr,
 	json_object_put(jmap);
 }
 
+/*
+ * Verify portmap reserved count
+ */
+void
+_dp_test_npf_portmap_reserved_verify(const char *prot, const char *addr,
+				     uint reserved,
+				     const char *file, int line)
+{
+	json_object *jmap, *jprot;
+	bool rv;
+	uint ival = 0;
+	struct dp_test_json_find_key key[] = { {"protocols", NULL},
+					       {"protocol", prot } };
+
+	jmap = dp_test_npf_json_get_portmap(addr, NULL);
+	if (!jmap) {
+		_dp_test_fail(file, line,
+			      "\nFailed to get portmap for %s\n", addr);
+		return;
+	}
+
+	jprot = dp_test_json_find(jmap, key, ARRAY_SIZE(key));
+	if (!jprot) {
+		_dp_test_fail(file, line,
+			      "\nFailed to get protocol info"
+			      " for %s\n", addr);
+		json_object_put(jmap);
+		return;
+	}
+
+	rv = dp_test_json_int_field_from_obj(jprot, "ports_reserved",
+					     (int *)&ival);
+	if (!rv)
+		_dp_test_fail(file, line,
+			      "\nFailed to get portmap \"ports_reserved\""
+			      " field for %s\n", addr);
+
+	if (reserved != ival)
+		dp_test_npf_print_portmap();
+
+	_dp_test_fail_unless(reserved == ival, file, line,
+			     "\nPortmap addr %s, exp reserved count %d"
+			     " actual count %d\n",
+			     addr, reserved, ival);
+
+	json_object_put(jprot);
+	json_object_put(jmap);
+}
+
 /*
  * Verify portmap port
  */
@@ -31,6 +31,19 @@ _dp_test_npf_portmap_verify(const char *prot, const char *addr,
 #define dp_test_npf_portmap_verify(prot, addr, state, used)		\
 	_dp_test_npf_portmap_verify(prot, addr, state, used, __FILE__, __LINE__)
 
+/*
+ * Verify count of ports reserved from a portmap, including those held
+ * in leases
+ */
+void
+_dp_test_npf_portmap_reserved_verify(const char *prot, const char *addr,
+				     uint reserved,
+				     const char *file, int line);
+
+#define dp_test_npf_portmap_reserved_verify(prot, addr, reserved)	\
+	_dp_test_npf_portmap_reserved_verify(prot, addr, reserved,	\
+					     __FILE__, __LINE__)
+
 /*
  * Verify portmap port
  */
@@ -307,9 +307,9 @@ DP_START_TEST(rldb_rule, match_ipv4)
 		 0);
 	ck_assert_msg(match_packet4("30.0.0.1", "40.0.0.1", 8888, 8888) == 6,
 		      "Addresses-only policy");
-	ck_assert_msg(match_packet4("30.0.1.1", "40.0.0.1", 8888, 8888) != 0,
+	ck_assert_msg(match_packet4("30.0.1.1", "40.0.0.1", 8888, 8888) == 0,
 		      "Negative addresses-only policy");
-	ck_assert_msg(match_packet4("30.0.0.1", "40.0.1.1", 8888, 8888) != 0,
+	ck_assert_msg(match_packet4("30.0.0.1", "40.0.1.1", 8888, 8888) == 0,
 		      "Negative addresses-only policy");
 	add_rule(7, 1000, IPPROTO_UDP, "31.0.0.0", 24, "41.0.0.0", 24, 0, 0, 0,
 		 0);
@@ -322,32 +322,170 @@ DP_START_TEST(rldb_rule, match_ipv4)
 		 0);
 	ck_assert_msg(match_packet4("32.0.0.1", "42.2.0.1", 8888, 8888) == 8,
 		      "Host-to-host policy");
-	ck_assert_msg(match_packet4("32.0.0.2", "42.2.0.1", 8888, 8888) != 0,
+	ck_assert_msg(match_packet4("32.0.0.2", "42.2.0.1", 8888, 8888) == 0,
 		      "Negative host-policy source");
-	ck_assert_msg(match_packet4("32.0.0.1", "42.2.0.2", 8888, 8888) != 0,
+	ck_assert_msg(match_packet4("32.0.0.1", "42.2.0.2", 8888, 8888) == 0,
 		      "Negative host-policy destination");
 
 	add_rule(9, 1000, ANY_PROTO, "33.0.0.0", 24, "0.0.0.0", 0, 0, 0, 0, 0);
 	ck_assert_msg(match_packet4("33.0.0.1", "123.0.0.1", 8888, 8888) == 9,
 		      "Anycast destination");
-	ck_assert_msg(match_packet4("33.3.3.1", "123.0.0.1", 8888, 8888) != 0,
+	ck_assert_msg(match_packet4("33.3.3.1", "123.0.0.1", 8888, 8888) == 0,
 		      "Negative anycast destination");
 
 	add_rule(10, 1000, IPPROTO_UDP, "33.0.1.0", 24, "0.0.0.0", 0, 8888,
 		 8888, 8888, 8888);
 	ck_assert_msg(match_packet4("33.0.1.1", "123.0.0.1", 8888, 8888) == 10,
 		      "Anycast destination & port");
-	ck_assert_msg(match_packet4("33.0.1.1", "123.0.0.1", 8887, 8888) != 0,
+	ck_assert_msg(match_packet4("33.0.1.1", "123.0.0.1", 8887, 8888) == 0,
 		      "Negative anycast destination & port");
 
 	add_rule(11, 1000, IPPROTO_UDP, "34.0.0.0", 24, "44.0.0.0", 24, 8888,
 		 8888, 8888, 8888);
 	ck_assert_msg(match_packet4("34.0.0.1", "44.0.0.1", 8888, 8888) == 11,
 		      "Protocol & port");
-	ck_assert_msg(match_packet4("34.0.0.1", "44.0.0.1", 40, 40) != 0,
+	ck_assert_msg(match_packet4("34.0.0.1", "44.0.0.1", 40, 40) == 0,
 		      "Negative protocol & port");
 
 	add_rule(1, 1, ANY_PROTO, "0.0.0.0", 0, "0.0.0.0", 0, 0, 0, 0, 0);
 	ck_assert_msg(match_packet4("34.0.0.1", "44.0.0.1", 40, 40) == 1,
 		      "Catch all rule");
 } DP_END_TEST;
+
+DP_START_TEST(rldb_rule, match_ipv4_bulk)
+{
+	const int len = 22;
+	struct rldb_result results[3];
+	struct rte_mbuf *m[3];
+	unsigned int i;
+	int rc;
+
+	add_rule(20, 1000, IPPROTO_UDP, "50.0.0.0", 24, "60.0.0.0", 24, 0, 0,
+		 0, 0);
+	add_rule(21, 2000, IPPROTO_UDP, "50.0.0.0", 24, "60.0.0.1", 32, 0, 0,
+		 0, 0);
+
+	m[0] = dp_test_create_udp_ipv4_pak("50.0.0.1", "60.0.0.2", 8888, 8888,
+					   1, &len);
+	m[1] = dp_test_create_udp_ipv4_pak("51.0.0.1", "60.0.0.2", 8888, 8888,
+					   1, &len);
+	m[2] = dp_test_create_udp_ipv4_pak("50.0.0.1", "60.0.0.1", 8888, 8888,
+					   1, &len);
+
+	rc = rldb_match(dh4, m, 3, results);
+	for (i = 0; i < RTE_DIM(m); i++)
+		rte_pktmbuf_free(m[i]);
+
+	ck_assert_msg(rc == 0, "Bulk match failed: %d", rc);
+	ck_assert_msg(results[0].rldb_rule_no == 20,
+		      "Bulk match of first packet");
+	ck_assert_msg(results[1].rldb_rule_no == 0,
+		      "Negative bulk match of second packet");
+	ck_assert_msg(results[2].rldb_rule_no == 21,
+		      "Bulk match of higher priority rule");
+} DP_END_TEST;
+
+/*
+ * More packets than rte_acl classifies in one call, so the burst is
+ * split, with matches and misses either side of the split.
+ */
+DP_START_TEST(rldb_rule, match_ipv4_bulk_split)
+{
+	const int len = 22;
+	struct rldb_result results[40];
+	struct rte_mbuf *m[40];
+	char saddr[INET_ADDRSTRLEN];
+	unsigned int i;
+	int rc;
+
+	add_rule(30, 1000, IPPROTO_UDP, "70.0.0.0", 24, "80.0.0.0", 24, 0, 0,
+		 0, 0);
+
+	for (i = 0; i < RTE_DIM(m); i++) {
+		/* odd packets come from outside the rule's prefix */
+		snprintf(saddr, sizeof(saddr), "70.0.%u.%u", i % 2, i + 1);
+		m[i] = dp_test_create_udp_ipv4_pak(saddr, "80.0.0.1", 8888,
+						   8888, 1, &len);
+	}
+
+	rc = rldb_match(dh4, m, RTE_DIM(m), results);
+	for (i = 0; i < RTE_DIM(m); i++)
+		rte_pktmbuf_free(m[i]);
+
+	ck_assert_msg(rc == 0, "Bulk match failed: %d", rc);
+	for (i = 0; i < RTE_DIM(m); i++)
+		ck_assert_msg(results[i].rldb_rule_no == (i % 2 ? 0 : 30),
+			      "Bulk match of packet %u: rule %u", i,
+			      results[i].rldb_rule_no);
+} DP_END_TEST;
+
+DP_START_TEST(rldb_rule, match_ipv4_bulk_miss)
+{
+	const int len = 22;
+	struct rldb_result results[4];
+	struct rte_mbuf *m[4];
+	unsigned int i;
+	int rc;
+
+	add_rule(31, 1000, IPPROTO_UDP, "90.0.0.0", 24, "100.0.0.0", 24, 0, 0,
+		 0, 0);
+
+	for (i = 0; i < RTE_DIM(m); i++) {
+		m[i] = dp_test_create_udp_ipv4_pak("91.0.0.1", "100.0.0.1",
+						   8888, 8888, 1, &len);
+		results[i].rldb_rule_no = 0xdead;
+	}
+
+	rc = rldb_match(dh4, m, RTE_DIM(m), results);
+	ck_assert_msg(rc == -ENOENT, "Bulk match with no matches: %d", rc);
+	for (i = 0; i < RTE_DIM(m); i++)
+		ck_assert_msg(results[i].rldb_rule_no == 0,
+			      "Result cleared for packet %u", i);
+
+	rc = rldb_match(dh4, m, 0, results);
+	ck_assert_msg(rc == -EINVAL, "Bulk match of no packets: %d", rc);
+
+	for (i = 0; i < RTE_DIM(m); i++)
+		rte_pktmbuf_free(m[i]);
+} DP_END_TEST;
+
+DP_START_TEST(rldb_rule, match_bulk_max)
+{
+	struct rldb_result results[RLDB_MATCH_BULK_MAX + 1];
+	struct rte_mbuf *m[RLDB_MATCH_BULK_MAX + 1] = { NULL };
+	int rc;
+
+	rc = rldb_match(dh4, m, RTE_DIM(m), results);
+	ck_assert_msg(rc == -EINVAL, "Bulk match over the limit: %d", rc);
+} DP_END_TEST;
+
+DP_START_TEST(rldb_rule, match_ipv6_bulk)
+{
+	const int len = 22;
+	struct rldb_result results[3];
+	struct rte_mbuf *m[3];
+	unsigned int i;
+	int rc;
+
+	add_rule(40, 1000, IPPROTO_UDP, "50::", 64, "60::", 64, 0, 0, 0, 0);
+	add_rule(41, 2000, IPPROTO_UDP, "50::", 64, "60::1", 128, 0, 0, 0, 0);
+
+	m[0] = dp_test_create_udp_ipv6_pak("50::1", "60::2", 8888, 8888,
+					   1, &len);
+	m[1] = dp_test_create_udp_ipv6_pak("51::1", "60::2", 8888, 8888,
+					   1, &len);
+	m[2] = dp_test_create_udp_ipv6_pak("50::1", "60::1", 8888, 8888,
+					   1, &len);
+
+	rc = rldb_match(dh6, m, 3, results);
+	for (i = 0; i < RTE_DIM(m); i++)
+		rte_pktmbuf_free(m[i]);
+
+	ck_assert_msg(rc == 0, "Bulk match failed: %d", rc);
+	ck_assert_msg(results[0].rldb_rule_no == 40,
+		      "Bulk match of first packet");
+	ck_assert_msg(results[1].rldb_rule_no == 0,
+		      "Negative bulk match of second packet");
+	ck_assert_msg(results[2].rldb_rule_no == 41,
+		      "Bulk match of higher priority rule");
+} DP_END_TEST;
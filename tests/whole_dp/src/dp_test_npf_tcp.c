@@ -9,11 +9,15 @@
  */
 
 #include <libmnl/libmnl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <urcu/system.h>
 
 #include "ip_funcs.h"
 #include "in_cksum.h"
 #include "if_var.h"
 #include "main.h"
+#include "npf/npf_cache.h"
 #include "npf/npf_state.h"
 
 #include "dp_test.h"
@@ -1222,3 +1226,269 @@ DP_START_TEST(rst_only, test1)
 	dp_test_nl_del_ip_addr_and_connected("dp2T1", "200.201.202.1/24");
 
 } DP_END_TEST;
+
+/*
+ * Window tracking on an established session, driven straight through
+ * npf_state_tcp_fast() and, when that declines a segment, the locked
+ * npf_state_tcp() as npf_state_inspect_tcp() does.
+ */
+DP_DECL_TEST_CASE(npf_tcp, fast_path, NULL, NULL);
+
+#define DPT_FAST_WIN	8192
+
+static struct rte_mbuf *
+dpt_tcp_fast_pak(bool forw, uint8_t flags, uint32_t seq, uint32_t ack,
+		 int dlen, npf_cache_t *npc)
+{
+	struct rte_mbuf *m;
+
+	if (forw)
+		m = dp_test_create_tcp_ipv4_pak("10.73.0.1", "10.73.2.1",
+						41000, 80, flags, seq, ack,
+						DPT_FAST_WIN, NULL, 1, &dlen);
+	else
+		m = dp_test_create_tcp_ipv4_pak("10.73.2.1", "10.73.0.1",
+						80, 41000, flags, seq, ack,
+						DPT_FAST_WIN, NULL, 1, &dlen);
+	dp_test_fail_unless(m, "failed to create TCP packet");
+
+	npf_cache_init(npc);
+	dp_test_fail_unless(npf_cache_all(npc, m,
+					  htons(RTE_ETHER_TYPE_IPV4)) == 0,
+			    "failed to cache TCP packet");
+	return m;
+}
+
+/*
+ * Inspect a segment, returning true if it is accepted. *fast is set if
+ * it was accepted without the state lock.
+ */
+static bool
+dpt_tcp_fast_seg(npf_state_t *nst, bool forw, uint8_t flags, uint32_t seq,
+		 uint32_t ack, int dlen, bool *fast)
+{
+	enum npf_flow_dir di = forw ? NPF_FLOW_FORW : NPF_FLOW_BACK;
+	enum tcp_session_state state;
+	npf_cache_t npc;
+	struct rte_mbuf *m;
+	int error = 0;
+
+	m = dpt_tcp_fast_pak(forw, flags, seq, ack, dlen, &npc);
+
+	*fast = npf_state_tcp_fast(&npc, nst, di);
+	if (!*fast) {
+		rte_spinlock_lock(&nst->nst_lock);
+		state = npf_state_tcp(&npc, m, nst, di, &error);
+		if (error == 0 && state != NPF_TCPS_NONE)
+			CMM_STORE_SHARED(nst->nst_tcp_state, state);
+		rte_spinlock_unlock(&nst->nst_lock);
+	}
+
+	rte_pktmbuf_free(m);
+	return error == 0;
+}
+
+/*
+ * Open a session with ISNs 1000 forwards and 5000 backwards.
+ */
+static void
+dpt_tcp_fast_open(npf_state_t *nst)
+{
+	bool fast;
+
+	memset(nst, 0, sizeof(*nst));
+	rte_spinlock_init(&nst->nst_lock);
+	nst->nst_tcp_state = NPF_TCPS_NONE;
+
+	dpt_tcp_fast_seg(nst, DPT_FORW, TH_SYN, 1000, 0, 0, &fast);
+	dpt_tcp_fast_seg(nst, DPT_BACK, TH_SYN | TH_ACK, 5000, 1001, 0, &fast);
+	dpt_tcp_fast_seg(nst, DPT_FORW, TH_ACK, 1001, 5001, 0, &fast);
+
+	dp_test_fail_unless(nst->nst_tcp_state == NPF_TCPS_ESTABLISHED,
+			    "session not established: %s",
+			    npf_state_get_tcp_name(nst->nst_tcp_state));
+}
+
+DP_START_TEST(fast_path, in_window)
+{
+	struct npf_tcp_window *fw, *bw;
+	npf_state_t nst;
+	bool ok, fast;
+
+	dpt_tcp_fast_open(&nst);
+	fw = &nst.nst_tcp_win[NPF_FLOW_FORW];
+	bw = &nst.nst_tcp_win[NPF_FLOW_BACK];
+
+	ok = dpt_tcp_fast_seg(&nst, DPT_FORW, TH_ACK, 1001, 5001, 100, &fast);
+	dp_test_fail_unless(ok && fast, "forw data not on fast path");
+	dp_test_fail_unless(fw->nst_end == 1101, "forw end %u", fw->nst_end);
+	dp_test_fail_unless(bw->nst_maxend == 5001 + DPT_FAST_WIN,
+			    "back maxend %u", bw->nst_maxend);
+
+	ok = dpt_tcp_fast_seg(&nst, DPT_BACK, TH_ACK, 5001, 1101, 200, &fast);
+	dp_test_fail_unless(ok && fast, "back data not on fast path");
+	dp_test_fail_unless(bw->nst_end == 5201, "back end %u", bw->nst_end);
+	dp_test_fail_unless(fw->nst_maxend == 1101 + DPT_FAST_WIN,
+			    "forw maxend %u", fw->nst_maxend);
+
+	/* A retransmission is still in the window */
+	ok = dpt_tcp_fast_seg(&nst, DPT_FORW, TH_ACK, 1001, 5201, 100, &fast);
+	dp_test_fail_unless(ok && fast, "retransmission not on fast path");
+	dp_test_fail_unless(fw->nst_end == 1101, "forw end %u", fw->nst_end);
+
+	/* A FIN is a transition, so takes the lock */
+	ok = dpt_tcp_fast_seg(&nst, DPT_FORW, TH_FIN | TH_ACK, 1101, 5201, 0,
+			      &fast);
+	dp_test_fail_unless(ok && !fast, "FIN on fast path");
+	dp_test_fail_unless(nst.nst_tcp_state == NPF_TCPS_FIN_SENT,
+			    "state %s after FIN",
+			    npf_state_get_tcp_name(nst.nst_tcp_state));
+
+	/* And the fast path is done with the session */
+	ok = dpt_tcp_fast_seg(&nst, DPT_BACK, TH_ACK, 5201, 1102, 0, &fast);
+	dp_test_fail_unless(ok && !fast, "ACK of FIN on fast path");
+} DP_END_TEST;
+
+DP_START_TEST(fast_path, window_violation)
+{
+	struct npf_tcp_window *fw, *bw;
+	npf_state_t nst;
+	bool ok, fast;
+
+	dpt_tcp_fast_open(&nst);
+	fw = &nst.nst_tcp_win[NPF_FLOW_FORW];
+	bw = &nst.nst_tcp_win[NPF_FLOW_BACK];
+
+	/* (I) Data beyond the receiver's window */
+	ok = dpt_tcp_fast_seg(&nst, DPT_FORW, TH_ACK, 1001 + DPT_FAST_WIN,
+			      5001, 100, &fast);
+	dp_test_fail_unless(!ok && !fast, "data beyond window accepted");
+
+	/* (II) Data more than a window behind */
+	ok = dpt_tcp_fast_seg(&nst, DPT_FORW, TH_ACK, 1001 - 2 * DPT_FAST_WIN,
+			      5001, 100, &fast);
+	dp_test_fail_unless(!ok && !fast, "data behind window accepted");
+
+	/* (III) and (IV) Acks for data never sent, or far in the past */
+	ok = dpt_tcp_fast_seg(&nst, DPT_BACK, TH_ACK, 5001, 1001 + 100000, 0,
+			      &fast);
+	dp_test_fail_unless(!ok && !fast, "ack ahead of data accepted");
+	ok = dpt_tcp_fast_seg(&nst, DPT_BACK, TH_ACK, 5001, 1001 - 100000, 0,
+			      &fast);
+	dp_test_fail_unless(!ok && !fast, "ack behind data accepted");
+
+	/* None of which moved the window */
+	dp_test_fail_unless(fw->nst_end == 1001 && bw->nst_end == 5001,
+			    "window moved: forw end %u back end %u",
+			    fw->nst_end, bw->nst_end);
+	dp_test_fail_unless(nst.nst_tcp_state == NPF_TCPS_ESTABLISHED,
+			    "state %s after window violations",
+			    npf_state_get_tcp_name(nst.nst_tcp_state));
+
+	ok = dpt_tcp_fast_seg(&nst, DPT_FORW, TH_ACK, 1001, 5001, 100, &fast);
+	dp_test_fail_unless(ok && fast, "in-window data not on fast path");
+} DP_END_TEST;
+
+struct dpt_tcp_fast_racer {
+	npf_state_t		*nst;
+	npf_cache_t		data;	/* forwards, 100 bytes */
+	npf_cache_t		ack;	/* backwards, no data */
+	bool			stop;
+	unsigned long		passes;
+};
+
+/*
+ * Keep pushing the window on from both directions, as the lcores
+ * handling each would.
+ */
+static void *
+dpt_tcp_fast_race(void *arg)
+{
+	struct dpt_tcp_fast_racer *racer = arg;
+	uint32_t seq = 1001;
+
+	while (!CMM_LOAD_SHARED(racer->stop)) {
+		racer->data.npc_l4.tcp.seq = htonl(seq);
+		npf_state_tcp_fast(&racer->data, racer->nst, NPF_FLOW_FORW);
+		seq += 100;
+		racer->ack.npc_l4.tcp.ack_seq = htonl(seq);
+		npf_state_tcp_fast(&racer->ack, racer->nst, NPF_FLOW_BACK);
+		CMM_STORE_SHARED(racer->passes, racer->passes + 1);
+	}
+	return NULL;
+}
+
+/*
+ * Re-initialise the window with a SYN, and close it with an RST, while
+ * another thread is tracking segments on the fast path. Neither may be
+ * undone by the fast path.
+ */
+DP_START_TEST(fast_path, reinit_race)
+{
+	struct dpt_tcp_fast_racer racer;
+	struct npf_tcp_window *fw, *bw;
+	struct rte_mbuf *data, *ack;
+	npf_state_t nst;
+	unsigned int i, round;
+	pthread_t tid;
+	bool ok, fast;
+
+	fw = &nst.nst_tcp_win[NPF_FLOW_FORW];
+	bw = &nst.nst_tcp_win[NPF_FLOW_BACK];
+
+	for (round = 0; round < 2; round++) {
+		dpt_tcp_fast_open(&nst);
+
+		memset(&racer, 0, sizeof(racer));
+		racer.nst = &nst;
+		data = dpt_tcp_fast_pak(DPT_FORW, TH_ACK, 1001, 5001, 100,
+					&racer.data);
+		ack = dpt_tcp_fast_pak(DPT_BACK, TH_ACK, 5001, 1001, 0,
+				       &racer.ack);
+
+		dp_test_fail_unless(pthread_create(&tid, NULL,
+						   dpt_tcp_fast_race,
+						   &racer) == 0,
+				    "failed to start fast path thread");
+		for (i = 0; i < 500 && !CMM_LOAD_SHARED(racer.passes); i++)
+			usleep(1000);
+
+		/*
+		 * A new connection reusing the tuple, or an RST with no
+		 * ACK so it is checked against wherever the window has
+		 * got to.
+		 */
+		if (round == 0)
+			ok = dpt_tcp_fast_seg(&nst, DPT_FORW, TH_SYN, 900, 0,
+					      0, &fast);
+		else
+			ok = dpt_tcp_fast_seg(&nst, DPT_BACK, TH_RST, 5001, 0,
+					      0, &fast);
+		dp_test_fail_unless(ok && !fast, "%s not accepted",
+				    round ? "RST" : "SYN");
+
+		/* Let the racer run on against the new state */
+		usleep(10000);
+		CMM_STORE_SHARED(racer.stop, true);
+		pthread_join(tid, NULL);
+
+		rte_pktmbuf_free(data);
+		rte_pktmbuf_free(ack);
+
+		if (round == 0) {
+			dp_test_fail_unless(fw->nst_end == 901 &&
+					    fw->nst_maxend == 901,
+					    "SYN undone: forw end %u maxend %u",
+					    fw->nst_end, fw->nst_maxend);
+			dp_test_fail_unless(bw->nst_end == 0 &&
+					    bw->nst_maxend == 0,
+					    "SYN undone: back end %u maxend %u",
+					    bw->nst_end, bw->nst_maxend);
+		} else {
+			dp_test_fail_unless(
+				nst.nst_tcp_state == NPF_TCPS_RST_RECEIVED,
+				"state %s after RST",
+				npf_state_get_tcp_name(nst.nst_tcp_state));
+		}
+	}
+} DP_END_TEST;
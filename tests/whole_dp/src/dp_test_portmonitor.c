@@ -29,7 +29,10 @@
 #include "dp_test_lib_intf_internal.h"
 #include "dp_test_pktmbuf_lib_internal.h"
 #include "dp_test_lib_exp.h"
+#include "dp_test_lib_pkt.h"
 #include "dp_test_lib_portmonitor.h"
+#include "dp_test_npf_lib.h"
+#include "dp_test_npf_nat_lib.h"
 
 static void
 dp_test_portmonitor_setup_span_rspan(uint32_t vrfid)
@@ -117,6 +120,115 @@ DP_START_TEST(mirroring, span)
 	dp_test_portmonitor_teardown_span_rspan(VRF_DEFAULT_ID);
 } DP_END_TEST;
 
+/*
+ * Mirror a UDP packet that is DNATed on input on dp1T1 and forwarded out
+ * of dp2T1, with a zero-copy SPAN session on srcif.  The payload is
+ * longer than the headers a zero-copy mirror copies.  A receive mirror
+ * must show the frame as it arrived and a transmit mirror the frame as
+ * it left, regardless of the rewrites made in between.
+ */
+static void
+dp_test_portmonitor_span_nat(const char *srcif, uint32_t snaplen)
+{
+	struct dp_test_expected *exp;
+	struct rte_mbuf *test_pak, *post_pak, *mirror_pak;
+	const char *nh_mac_str = "aa:bb:cc:dd:ee:fe";
+	char cmd[TEST_MAX_CMD_LEN];
+
+	struct dp_test_pkt_desc_t pre_pkt = {
+		.text       = "UDP pre",
+		.len        = 200,
+		.ether_type = RTE_ETHER_TYPE_IPV4,
+		.l3_src     = "1.1.1.2",
+		.l2_src     = "aa:bb:cc:dd:ee:ff",
+		.l3_dst     = "10.0.0.1",
+		.l2_dst     = dp_test_intf_name2mac_str("dp1T1"),
+		.proto      = IPPROTO_UDP,
+		.l4         = {
+			.udp = {
+				.sport = 41000,
+				.dport = 1000
+			}
+		},
+		.rx_intf    = "dp1T1",
+		.tx_intf    = "dp2T1",
+	};
+	struct dp_test_pkt_desc_t post_pkt = pre_pkt;
+
+	post_pkt.text = "UDP post";
+	post_pkt.l3_dst = "10.0.0.2";
+
+	dp_test_portmonitor_setup_span_rspan(VRF_DEFAULT_ID);
+	dp_test_netlink_add_neigh("dp2T1", "2.2.2.3", nh_mac_str);
+	dpt_dnat_cfg("dp1T1", IPPROTO_UDP, "10.0.0.1", "10.0.0.2", true);
+
+	dp_test_portmonitor_create_span(1, srcif, "dp1T2", NULL, NULL);
+	dp_test_portmonitor_request(
+		"portmonitor set session 1 zero-copy 0 0 0", false);
+	if (snaplen) {
+		snprintf(cmd, sizeof(cmd),
+			 "portmonitor set session 1 snaplen %u 0 0", snaplen);
+		dp_test_portmonitor_request(cmd, false);
+	}
+
+	test_pak = dp_test_v4_pkt_from_desc(&pre_pkt);
+	post_pak = dp_test_v4_pkt_from_desc(&post_pkt);
+	dp_test_pktmbuf_eth_init(post_pak, nh_mac_str,
+				 dp_test_intf_name2mac_str("dp2T1"),
+				 RTE_ETHER_TYPE_IPV4);
+	dp_test_ipv4_decrement_ttl(post_pak);
+
+	if (strcmp(srcif, "dp1T1") == 0)
+		mirror_pak = dp_test_cp_pak(test_pak);
+	else
+		mirror_pak = dp_test_cp_pak(post_pak);
+	if (snaplen)
+		rte_pktmbuf_trim(mirror_pak,
+				 rte_pktmbuf_pkt_len(mirror_pak) - snaplen);
+
+	/* The mirror on dp1T2 is seen before the packet on dp2T1 */
+	exp = dp_test_exp_create_m(NULL, 2);
+	dp_test_exp_set_pak_m(exp, 0, mirror_pak);
+	dp_test_exp_set_oif_name_m(exp, 0, "dp1T2");
+	dp_test_exp_set_pak_m(exp, 1, post_pak);
+	dp_test_exp_set_oif_name_m(exp, 1, "dp2T1");
+
+	dp_test_pak_receive(test_pak, "dp1T1", exp);
+
+	dp_test_portmonitor_delete_session(1);
+
+	dpt_dnat_cfg("dp1T1", IPPROTO_UDP, "10.0.0.1", "10.0.0.2", false);
+	dp_test_npf_cleanup();
+	dp_test_netlink_del_neigh("dp2T1", "2.2.2.3", nh_mac_str);
+	dp_test_portmonitor_teardown_span_rspan(VRF_DEFAULT_ID);
+}
+
+/*
+ * Received frames are mirrored before NAT, so a zero-copy receive mirror
+ * must still be a copy.
+ */
+DP_START_TEST(mirroring, span_zero_copy_rx_nat)
+{
+	dp_test_portmonitor_span_nat("dp1T1", 0);
+} DP_END_TEST;
+
+/*
+ * Transmitted frames are mirrored after NAT, and may share data.
+ */
+DP_START_TEST(mirroring, span_zero_copy_tx_nat)
+{
+	dp_test_portmonitor_span_nat("dp2T1", 0);
+} DP_END_TEST;
+
+/*
+ * Only the snaplen bytes are mirrored, copied or shared.
+ */
+DP_START_TEST(mirroring, span_snaplen_nat)
+{
+	dp_test_portmonitor_span_nat("dp1T1", 64);
+	dp_test_portmonitor_span_nat("dp2T1", 160);
+} DP_END_TEST;
+
 DP_START_TEST(mirroring, span_filter)
 {
 	struct dp_test_expected *exp;
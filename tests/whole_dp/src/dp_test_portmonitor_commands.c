@@ -189,6 +189,54 @@ DP_START_TEST(pmcmds, span)
 	dp_test_portmonitor_delete_session(1);
 } DP_END_TEST;
 
+DP_START_TEST(pmcmds, span_snaplen_rate)
+{
+	char src_ifname[IFNAMSIZ];
+	char dst_ifname[IFNAMSIZ];
+	json_object *expected;
+
+	dp_test_intf_real("dp1T1", src_ifname);
+	dp_test_intf_real("dp1T2", dst_ifname);
+	dp_test_portmonitor_create_span(1, src_ifname, dst_ifname,
+					NULL, NULL);
+	dp_test_portmonitor_request(
+		"portmonitor set session 1 snaplen 128 0 0", false);
+	dp_test_portmonitor_request(
+		"portmonitor set session 1 rate 1000 0 0", false);
+	dp_test_portmonitor_request(
+		"portmonitor set session 1 zero-copy 0 0 0", false);
+
+	expected = dp_test_json_create(
+	  "{ \"portmonitor_information\": "
+	  "  [ {   \"session\":1,"
+	  "        \"type\": \"span\","
+	  "        \"snaplen\": 128,"
+	  "        \"rate\": 1000,"
+	  "        \"zero_copy\": true,"
+	  "    }"
+	  "    ]"
+	  "}");
+	dp_test_check_json_state("portmonitor show session", expected,
+				 DP_TEST_JSON_CHECK_SUBSET, false);
+	json_object_put(expected);
+
+	dp_test_portmonitor_request(
+		"portmonitor del session 1 zero-copy 0 0 0", false);
+
+	expected = dp_test_json_create(
+	  "{ \"portmonitor_information\": "
+	  "  [ {   \"session\":1,"
+	  "        \"zero_copy\": false,"
+	  "    }"
+	  "    ]"
+	  "}");
+	dp_test_check_json_state("portmonitor show session", expected,
+				 DP_TEST_JSON_CHECK_SUBSET, false);
+	json_object_put(expected);
+
+	dp_test_portmonitor_delete_session(1);
+} DP_END_TEST;
+
 DP_START_TEST(pmcmds, rspan_source)
 {
 	char src_ifname[IFNAMSIZ];
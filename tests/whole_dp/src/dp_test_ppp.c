@@ -487,3 +487,164 @@ DP_START_TEST(ppp_traffic, ppp_traffic_4)
 	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
 	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
 } DP_END_TEST;
+
+static struct ifnet *
+dp_test_pppoe_ses_lookup(const char *under_intf, uint16_t session_id)
+{
+	char real_ifname[IFNAMSIZ];
+	struct ifnet *ifp;
+
+	ifp = dp_ifnet_byifname(dp_test_intf_real(under_intf, real_ifname));
+	dp_test_fail_unless(ifp, "No underlying interface %s", under_intf);
+
+	return ppp_lookup_ses(ifp, session_id);
+}
+
+static bool
+dp_test_pppoe_ses_tbl_exists(const char *under_intf)
+{
+	char real_ifname[IFNAMSIZ];
+	struct ifnet *ifp;
+
+	ifp = dp_ifnet_byifname(dp_test_intf_real(under_intf, real_ifname));
+	dp_test_fail_unless(ifp, "No underlying interface %s", under_intf);
+
+	return rcu_dereference(ifp->if_pppoe_ses) != NULL;
+}
+
+DP_DECL_TEST_CASE(ppp, pppoe_ses_tbl, NULL, NULL);
+
+/*
+ * Add a session then delete it, checking the per-interface session
+ * table only answers for the id that was added and is freed once the
+ * last session goes.
+ */
+DP_START_TEST(pppoe_ses_tbl, add_delete)
+{
+	const char *dst_mac = "aa:bb:cc:dd:ee:ff";
+	uint16_t session_id = 0x1234;
+	struct ifnet *ppp_ifp;
+
+	dp_test_fail_unless(!dp_test_pppoe_ses_tbl_exists("dp1T0"),
+			    "Session table exists before any session");
+
+	dp_test_intf_ppp_create("pppoe0", VRF_DEFAULT_ID);
+	dp_test_create_pppoe_session("pppoe0", "dp1T0", session_id,
+				     dp_test_intf_name2mac_str("dp1T0"),
+				     dst_mac);
+
+	ppp_ifp = dp_ifnet_byifname("pppoe0");
+	dp_test_fail_unless(ppp_ifp, "No pppoe0 interface");
+	dp_test_fail_unless(dp_test_pppoe_ses_lookup("dp1T0", session_id) ==
+			    ppp_ifp, "Session %#x not found", session_id);
+
+	/* Neighbour in the same leaf, and same index in an unused leaf */
+	dp_test_fail_unless(!dp_test_pppoe_ses_lookup("dp1T0",
+						      session_id + 1),
+			    "Unexpected session %#x", session_id + 1);
+	dp_test_fail_unless(!dp_test_pppoe_ses_lookup(
+				    "dp1T0", session_id & PPPOE_SES_LEAF_MASK),
+			    "Unexpected session %#x",
+			    session_id & PPPOE_SES_LEAF_MASK);
+
+	/* Nothing on the other interfaces */
+	dp_test_fail_unless(!dp_test_pppoe_ses_lookup("dp2T1", session_id),
+			    "Session %#x found on dp2T1", session_id);
+
+	dp_test_intf_ppp_delete("pppoe0", VRF_DEFAULT_ID);
+
+	dp_test_fail_unless(!dp_test_pppoe_ses_lookup("dp1T0", session_id),
+			    "Session %#x found after delete", session_id);
+	dp_test_fail_unless(!dp_test_pppoe_ses_tbl_exists("dp1T0"),
+			    "Session table not freed with last session");
+} DP_END_TEST;
+
+/*
+ * The same session id on two underlying interfaces must demux to two
+ * different ppp devices, and removing one must not disturb the other.
+ */
+DP_START_TEST(pppoe_ses_tbl, same_id_two_interfaces)
+{
+	const char *dst_mac = "aa:bb:cc:dd:ee:ff";
+	uint16_t session_id = 5;
+	struct ifnet *ppp0_ifp, *ppp1_ifp;
+
+	dp_test_intf_ppp_create("pppoe0", VRF_DEFAULT_ID);
+	dp_test_intf_ppp_create("pppoe1", VRF_DEFAULT_ID);
+	dp_test_create_pppoe_session("pppoe0", "dp1T0", session_id,
+				     dp_test_intf_name2mac_str("dp1T0"),
+				     dst_mac);
+	dp_test_create_pppoe_session("pppoe1", "dp2T1", session_id,
+				     dp_test_intf_name2mac_str("dp2T1"),
+				     dst_mac);
+
+	ppp0_ifp = dp_ifnet_byifname("pppoe0");
+	ppp1_ifp = dp_ifnet_byifname("pppoe1");
+	dp_test_fail_unless(ppp0_ifp && ppp1_ifp, "No ppp interfaces");
+
+	dp_test_fail_unless(dp_test_pppoe_ses_lookup("dp1T0", session_id) ==
+			    ppp0_ifp, "dp1T0 session not on pppoe0");
+	dp_test_fail_unless(dp_test_pppoe_ses_lookup("dp2T1", session_id) ==
+			    ppp1_ifp, "dp2T1 session not on pppoe1");
+
+	dp_test_intf_ppp_delete("pppoe0", VRF_DEFAULT_ID);
+
+	dp_test_fail_unless(!dp_test_pppoe_ses_lookup("dp1T0", session_id),
+			    "dp1T0 session found after delete");
+	dp_test_fail_unless(dp_test_pppoe_ses_lookup("dp2T1", session_id) ==
+			    ppp1_ifp, "dp2T1 session lost on pppoe0 delete");
+
+	dp_test_intf_ppp_delete("pppoe1", VRF_DEFAULT_ID);
+
+	dp_test_fail_unless(!dp_test_pppoe_ses_lookup("dp2T1", session_id),
+			    "dp2T1 session found after delete");
+} DP_END_TEST;
+
+/*
+ * Deleting the underlying interface takes its session table with it;
+ * the session must come back on the new interface when it returns.
+ */
+DP_START_TEST(pppoe_ses_tbl, underlying_deleted)
+{
+	const char *dst_mac = "aa:bb:cc:dd:ee:ff";
+	uint16_t session_id = 0x301;
+	struct ifnet *ppp_ifp;
+
+	dp_test_intf_vif_create("dp2T1.100", "dp2T1", 100);
+
+	dp_test_intf_ppp_create("pppoe0", VRF_DEFAULT_ID);
+	dp_test_create_pppoe_session("pppoe0", "dp2T1.100", session_id,
+				     dp_test_intf_name2mac_str("dp2T1.100"),
+				     dst_mac);
+
+	ppp_ifp = dp_ifnet_byifname("pppoe0");
+	dp_test_fail_unless(ppp_ifp, "No pppoe0 interface");
+	dp_test_fail_unless(dp_test_pppoe_ses_lookup("dp2T1.100",
+						     session_id) == ppp_ifp,
+			    "Session not found on dp2T1.100");
+	dp_test_fail_unless(!dp_test_pppoe_ses_lookup("dp2T1", session_id),
+			    "Session found on parent dp2T1");
+
+	dp_test_intf_vif_del("dp2T1.100", 100);
+
+	dp_test_verify_pppoe_session("pppoe0", "dp2T1.100", session_id,
+				     dp_test_intf_name2mac_str("dp2T1.100"),
+				     dst_mac, SESS_INVALID);
+	dp_test_fail_unless(!dp_test_pppoe_ses_lookup("dp2T1", session_id),
+			    "Session found on parent after vif delete");
+
+	dp_test_intf_vif_create("dp2T1.100", "dp2T1", 100);
+
+	dp_test_verify_pppoe_session("pppoe0", "dp2T1.100", session_id,
+				     dp_test_intf_name2mac_str("dp2T1.100"),
+				     dst_mac, SESS_VALID);
+	dp_test_fail_unless(dp_test_pppoe_ses_lookup("dp2T1.100",
+						     session_id) == ppp_ifp,
+			    "Session not restored on new dp2T1.100");
+
+	/* Tidy */
+	dp_test_intf_ppp_delete("pppoe0", VRF_DEFAULT_ID);
+	dp_test_fail_unless(!dp_test_pppoe_ses_tbl_exists("dp2T1.100"),
+			    "Session table not freed with last session");
+	dp_test_intf_vif_del("dp2T1.100", 100);
+} DP_END_TEST;
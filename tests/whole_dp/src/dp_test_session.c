@@ -16,6 +16,7 @@
 #include <time.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <unistd.h>
 
 
 #include "ip_funcs.h"
@@ -29,6 +30,7 @@
 #include "npf/npf_cache.h"
 #include "npf/npf_pack.h"
 #include "npf/npf_session.h"
+#include "urcu.h"
 
 #include "dp_test.h"
 #include "dp_test_controller.h"
@@ -1490,6 +1492,23 @@ _dp_test_session_msg_pack_pb(PackedDPSessionMsg *pds, void *buf, uint32_t size,
 	*packed_size = sph->sph_len;
 }
 
+/* Sessions changed since a generation, as found by a table walk */
+struct ssync_changed {
+	uint64_t gen;
+	unsigned int count;
+	struct session *sessions[4];
+};
+
+static int ssync_changed_cb(struct session *s, void *data)
+{
+	struct ssync_changed *changed = data;
+
+	if (dp_session_changed_since(s, changed->gen) &&
+	    changed->count < ARRAY_SIZE(changed->sessions))
+		changed->sessions[changed->count++] = s;
+	return 0;
+}
+
 /*
  * Test session protobuf sync for a TCP firewall session with TCP
  * strict enabled
@@ -1700,17 +1719,74 @@ DP_START_TEST(ssync_pb2, test40)
 	dp_test_fail_unless(rc > 0, "dp_session_pack_pb failed\n");
 	pack_size = rc;
 
+	/*
+	 * A bulk pack of just this session gives the same buffer
+	 */
+	unsigned char pb_buf_bulk[pb_buf_size];
+	unsigned int consumed = 0;
+
+	rc = dp_session_pack_pb_bulk(&s, 1, &pb_buf_bulk, pb_buf_size,
+				     SESSION_PACK_FULL, &consumed);
+	dp_test_fail_unless(rc == pack_size && consumed == 1,
+			    "dp_session_pack_pb_bulk failed %d\n", rc);
+	dp_test_fail_unless(!memcmp(pb_buf, pb_buf_bulk, pack_size),
+			    "dp_session_pack_pb_bulk buffer mismatch\n");
+
+	uint64_t gen = dp_session_generation_next();
+
+	dp_test_fail_unless(!dp_session_changed_since(s, gen),
+			    "session changed in new generation\n");
+
+	/* A packet in the same state only changes the counters */
+	dpt_tcp_call(&tcp_call, tcp_pkt1, ARRAY_SIZE(tcp_pkt1), 4, 4, NULL, 0);
+
+	dp_test_fail_unless(dp_session_changed_since(s, gen),
+			    "session counter change not recorded\n");
+
+	/* Nothing to pack for a generation without changes */
+	struct ssync_changed changed = { 0 };
+
+	gen = dp_session_generation_next();
+	changed.gen = gen;
+	dp_session_table_walk(ssync_changed_cb, &changed, SESSION_TYPE_FW);
+	dp_test_fail_unless(changed.count == 0,
+			    "%u sessions changed, expected 0\n",
+			    changed.count);
+
 	/*
 	 * Remainder of TCP call
 	 */
-	dpt_tcp_call(&tcp_call, tcp_pkt1, ARRAY_SIZE(tcp_pkt1), 4, 11, NULL, 0);
+	dpt_tcp_call(&tcp_call, tcp_pkt1, ARRAY_SIZE(tcp_pkt1), 5, 11, NULL, 0);
+
+	dp_test_fail_unless(dp_session_changed_since(s, gen),
+			    "session state change not recorded\n");
 
 	/* Create the update pack */
+	memset(&pb_buf_update, 0, pb_buf_size);
 	rc = dp_session_pack_pb(s, &pb_buf_update, pb_buf_size,
 				SESSION_PACK_UPDATE, &peer);
 	dp_test_fail_unless(rc > 0, "dp_session_pack_pb failed\n");
 	pack_size_update = rc;
 
+	/*
+	 * A changed-since walk finds just this session, and a bulk
+	 * pack of what it finds is the same update.
+	 */
+	dp_session_generation_next();
+	dp_session_table_walk(ssync_changed_cb, &changed, SESSION_TYPE_FW);
+	dp_test_fail_unless(changed.count == 1 && changed.sessions[0] == s,
+			    "%u sessions changed, expected 1\n",
+			    changed.count);
+
+	memset(&pb_buf_bulk, 0, pb_buf_size);
+	rc = dp_session_pack_pb_bulk(changed.sessions, changed.count,
+				     &pb_buf_bulk, pb_buf_size,
+				     SESSION_PACK_UPDATE, &consumed);
+	dp_test_fail_unless(rc == pack_size_update && consumed == 1,
+			    "changed-since bulk pack failed %d\n", rc);
+	dp_test_fail_unless(!memcmp(pb_buf_update, pb_buf_bulk, rc),
+			    "changed-since bulk pack buffer mismatch\n");
+
 	/*
 	 * Clear the session
 	 */
@@ -1865,3 +1941,157 @@ DP_START_TEST(ssync_pb2, test40)
 
 } DP_END_TEST;
 
+
+/*
+ * Session watch event log. Stats updates may be coalesced by the
+ * exporter so they are not recorded.
+ */
+#define WATCH_LOG_MAX 16
+
+struct watch_log {
+	unsigned int count;
+	enum dp_session_hook ev[WATCH_LOG_MAX];
+};
+
+static void watch_log_cb(struct session *s __unused,
+			 enum dp_session_hook hook, void *data)
+{
+	struct watch_log *wl = data;
+	unsigned int n = CMM_LOAD_SHARED(wl->count);
+
+	if (hook == SESSION_STATS_UPDATE || n >= WATCH_LOG_MAX)
+		return;
+
+	wl->ev[n] = hook;
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(wl->count, n + 1);
+}
+
+/* Wait for the exporter to deliver an expiry */
+static void watch_log_wait_expire(struct watch_log *wl)
+{
+	unsigned int i, n;
+
+	for (i = 0; i < 1000; i++) {
+		n = CMM_LOAD_SHARED(wl->count);
+		cmm_smp_rmb();
+		if (n && wl->ev[n - 1] == SESSION_EXPIRE)
+			return;
+		usleep(1000);
+	}
+}
+
+/*
+ * Two watchers see the same events for a session, in order.
+ */
+DP_DECL_TEST_CASE(session_suite, session_watch, NULL, NULL);
+DP_START_TEST(session_watch, order)
+{
+	struct watch_log log1 = { 0 }, log2 = { 0 };
+	struct session_watch w1 = {
+		.fn = watch_log_cb,
+		.types = SESSION_TYPE_FW,
+		.data = &log1,
+		.name = "ut-watch1",
+	};
+	struct session_watch w2 = {
+		.fn = watch_log_cb,
+		.types = SESSION_TYPE_FW,
+		.data = &log2,
+		.name = "ut-watch2",
+	};
+	unsigned int i;
+	int id1, id2;
+
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.1/24");
+
+	dp_test_netlink_add_neigh("dp1T0", "1.1.1.11",
+				  "aa:bb:cc:dd:1:11");
+	dp_test_netlink_add_neigh("dp2T1", "2.2.2.11",
+				  "aa:bb:cc:dd:2:11");
+
+	struct dp_test_npf_rule_t rules[] = {
+		{
+			.rule = "10",
+			.pass = PASS,
+			.stateful = STATEFUL,
+			.npf = "to=any"
+		},
+		RULE_DEF_BLOCK,
+		NULL_RULE
+	};
+
+	struct dp_test_npf_ruleset_t rset = {
+		.rstype = "fw-out",
+		.name	= "FW1",
+		.enable = 1,
+		.attach_point = "dp2T1",
+		.fwd	= FWD,
+		.dir	= "out",
+		.rules	= rules
+	};
+
+	dp_test_npf_fw_add(&rset, false);
+
+	id1 = dp_session_watch_register(&w1);
+	id2 = dp_session_watch_register(&w2);
+	dp_test_fail_unless(id1 >= 0 && id2 >= 0 && id1 != id2,
+			    "session watch register: %d %d", id1, id2);
+
+	/* Create, establish and then expire a session */
+	dpt_udp("dp1T0", "aa:bb:cc:dd:1:11",
+		"1.1.1.11", 1000, "2.2.2.11", 80,
+		"1.1.1.11", 1000, "2.2.2.11", 80,
+		"aa:bb:cc:dd:2:11", "dp2T1",
+		DP_TEST_FWD_FORWARDED);
+
+	dpt_udp("dp2T1", "aa:bb:cc:dd:2:11",
+		"2.2.2.11", 80, "1.1.1.11", 1000,
+		"2.2.2.11", 80, "1.1.1.11", 1000,
+		"aa:bb:cc:dd:1:11", "dp1T0",
+		DP_TEST_FWD_FORWARDED);
+
+	dp_test_npf_clear_sessions();
+
+	watch_log_wait_expire(&log1);
+	watch_log_wait_expire(&log2);
+
+	dp_test_fail_unless(log1.count >= 2,
+			    "watcher 1 saw %u events", log1.count);
+	dp_test_fail_unless(log1.ev[0] == SESSION_ACTIVATE,
+			    "first event %d, not activate", log1.ev[0]);
+	dp_test_fail_unless(log1.ev[log1.count - 1] == SESSION_EXPIRE,
+			    "last event %d, not expire",
+			    log1.ev[log1.count - 1]);
+	for (i = 1; i < log1.count - 1; i++)
+		dp_test_fail_unless(log1.ev[i] == SESSION_STATE_CHANGE,
+				    "event %u is %d", i, log1.ev[i]);
+
+	dp_test_fail_unless(log2.count == log1.count,
+			    "watchers saw %u and %u events",
+			    log1.count, log2.count);
+	for (i = 0; i < log1.count; i++)
+		dp_test_fail_unless(log2.ev[i] == log1.ev[i],
+				    "event %u differs: %d %d",
+				    i, log1.ev[i], log2.ev[i]);
+
+	dp_test_fail_unless(dp_session_watch_unregister(id1) == 0,
+			    "session watch unregister %d", id1);
+	dp_test_fail_unless(dp_session_watch_unregister(id2) == 0,
+			    "session watch unregister %d", id2);
+	dp_test_fail_unless(dp_session_watch_unregister(id2) == -ENOENT,
+			    "session watch unregister %d twice", id2);
+
+	/* Cleanup */
+	dp_test_npf_fw_del(&rset, false);
+
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.1/24");
+
+	dp_test_netlink_del_neigh("dp1T0", "1.1.1.11",
+				  "aa:bb:cc:dd:1:11");
+	dp_test_netlink_del_neigh("dp2T1", "2.2.2.11",
+				  "aa:bb:cc:dd:2:11");
+
+} DP_END_TEST;
@@ -7,7 +7,21 @@
  *
  * dataplane UT VXLAN tests
  */
+#include <arpa/inet.h>
+#include <netinet/ip.h>
+#include <rte_udp.h>
+
+#include "if/vxlan.h"
+#include "in_cksum.h"
+#include "ip_funcs.h"
+
+#include "dp_test.h"
+#include "dp_test/dp_test_cmd_check.h"
+#include "dp_test_lib_exp.h"
 #include "dp_test_lib_intf_internal.h"
+#include "dp_test_lib_internal.h"
+#include "dp_test_netlink_state_internal.h"
+#include "dp_test_pktmbuf_lib_internal.h"
 #include "dp_test/dp_test_macros.h"
 
 DP_DECL_TEST_SUITE(vxlan_suite);
@@ -44,3 +58,175 @@ DP_START_TEST(vxlan_cfg_duplicate, vxlan_cfg_duplicate)
 	/* vxlan 71 should have failed to be created, so we dont delete it */
 #endif
 } DP_END_TEST;
+
+/*
+ * Send an L2 frame into the bridge with vxl10 in it, and check it is
+ * flooded out of oif encapsulated towards the remote VTEP.  The UDP
+ * source port is a hash of the inner frame, so isn't checked.
+ */
+static void
+dp_test_vxlan_flood(struct rte_mbuf *inner, const char *local,
+		    const char *remote, const char *nh_mac, const char *oif)
+{
+	struct dp_test_expected *exp;
+	struct rte_mbuf *test_pak, *exp_pak;
+	struct rte_vxlan_hdr *vxh;
+	struct rte_udp_hdr *udp;
+	struct iphdr *ip;
+	uint16_t len;
+
+	test_pak = dp_test_cp_pak(inner);
+	exp_pak = dp_test_cp_pak(inner);
+	len = rte_pktmbuf_pkt_len(exp_pak);
+
+	ip = (struct iphdr *)rte_pktmbuf_prepend(
+		exp_pak, sizeof(*ip) + sizeof(*udp) + sizeof(*vxh));
+	dp_test_fail_unless(ip != NULL, "no room for VXLAN encap");
+	udp = (struct rte_udp_hdr *)(ip + 1);
+	vxh = (struct rte_vxlan_hdr *)(udp + 1);
+
+	memset(ip, 0, sizeof(*ip));
+	ip->ihl = 5;
+	ip->version = 4;
+	ip->tot_len = htons(sizeof(*ip) + sizeof(*udp) + sizeof(*vxh) + len);
+	ip->frag_off = htons(IP_DF);
+	ip->ttl = IPDEFTTL;
+	ip->protocol = IPPROTO_UDP;
+	inet_pton(AF_INET, local, &ip->saddr);
+	inet_pton(AF_INET, remote, &ip->daddr);
+	ip->check = ip_checksum(ip, sizeof(*ip));
+
+	udp->src_port = 0;
+	udp->dst_port = htons(VXLAN_PORT);
+	udp->dgram_len = htons(sizeof(*udp) + sizeof(*vxh) + len);
+	udp->dgram_cksum = 0;
+
+	vxh->vx_flags = htonl(VXLAN_VALIDFLAG);
+	vxh->vx_vni = htonl(10 << 8);
+
+	(void)dp_test_pktmbuf_eth_prepend(exp_pak, nh_mac,
+					  dp_test_intf_name2mac_str(oif),
+					  RTE_ETHER_TYPE_IPV4);
+
+	exp = dp_test_exp_create(exp_pak);
+	rte_pktmbuf_free(exp_pak);
+	exp_pak = dp_test_exp_get_pak(exp);
+	udp = rte_pktmbuf_mtod_offset(exp_pak, struct rte_udp_hdr *,
+				      RTE_ETHER_HDR_LEN + sizeof(*ip));
+	dp_test_exp_set_dont_care(exp, 0, (uint8_t *)&udp->src_port,
+				  sizeof(udp->src_port));
+	dp_test_exp_set_oif_name(exp, oif);
+
+	dp_test_pak_receive(test_pak, "dp1T0", exp);
+}
+
+/*
+ * Wait for the encap cache entry for the remote VTEP to be using the
+ * given next hop.  The entry is only tracked on the next run of the
+ * vxlan timer, so allow for a full timer period.
+ */
+static void
+dp_test_vxlan_wait_encap(const char *remote, const char *nh,
+			 const char *oif)
+{
+	char real_ifname[IFNAMSIZ];
+	json_object *expected;
+
+	dp_test_intf_real(oif, real_ifname);
+	expected = dp_test_json_create(
+		"{ \"interfaces\":"
+		"  ["
+		"    {"
+		"      \"name\": \"vxl10\","
+		"      \"vxlan\":"
+		"      {"
+		"        \"encap\":"
+		"        ["
+		"          {"
+		"            \"remote\": \"%s\","
+		"            \"nexthop\": \"%s\","
+		"            \"ifname\": \"%s\","
+		"          }"
+		"        ]"
+		"      }"
+		"    }"
+		"  ]"
+		"}", remote, nh, real_ifname);
+	dp_test_check_json_poll_state_interval("ifconfig vxl10", expected,
+					       DP_TEST_JSON_CHECK_SUBSET,
+					       false, 100, 100);
+	json_object_put(expected);
+}
+
+/*
+ * Check that the encapsulation cached for a remote VTEP is rebuilt when
+ * the route to it or its selected source address changes, and replaced
+ * when the remote VTEP changes.
+ */
+DP_DECL_TEST_CASE(vxlan_suite, vxlan_encap_cache, NULL, NULL);
+DP_START_TEST(vxlan_encap_cache, vxlan_encap_cache)
+{
+	const char *nh1_mac = "aa:bb:cc:dd:2:1";
+	const char *nh2_mac = "aa:bb:cc:dd:3:1";
+	struct rte_mbuf *inner;
+	int len = 22;
+
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "1.1.2.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T2", "1.1.3.1/24");
+	dp_test_netlink_add_neigh("dp2T1", "1.1.2.2", nh1_mac);
+	dp_test_netlink_add_neigh("dp2T2", "1.1.3.2", nh2_mac);
+	dp_test_netlink_add_route("10.73.2.0/24 nh 1.1.2.2 int:dp2T1");
+
+	dp_test_intf_vxlan_create("vxl10", 10, "dp2T1");
+	dp_test_netlink_set_vxlan_remote("vxl10", 10, "dp2T1", "10.73.2.1");
+	dp_test_intf_bridge_create("br1");
+	dp_test_intf_bridge_add_port("br1", "dp1T0");
+	dp_test_intf_bridge_add_port("br1", "vxl10");
+
+	/* Unknown unicast, so flooded to the remote VTEP */
+	inner = dp_test_create_ipv4_pak("10.0.1.1", "10.0.1.2", 1, &len);
+	(void)dp_test_pktmbuf_eth_init(inner, "0:0:a4:0:0:2",
+				       "0:0:a4:0:0:1",
+				       RTE_ETHER_TYPE_IPV4);
+
+	/* Miss, the packet takes the uncached path */
+	dp_test_vxlan_flood(inner, "1.1.2.1", "10.73.2.1", nh1_mac, "dp2T1");
+	dp_test_vxlan_wait_encap("10.73.2.1", "1.1.2.2", "dp2T1");
+	dp_test_vxlan_flood(inner, "1.1.2.1", "10.73.2.1", nh1_mac, "dp2T1");
+
+	/* Move the underlay, the template must follow the route */
+	dp_test_netlink_replace_route("10.73.2.0/24 nh 1.1.3.2 int:dp2T2");
+	dp_test_vxlan_wait_encap("10.73.2.1", "1.1.3.2", "dp2T2");
+	dp_test_vxlan_flood(inner, "1.1.3.1", "10.73.2.1", nh2_mac, "dp2T2");
+
+	/*
+	 * Remove the source address the template selected, the route is
+	 * unchanged but the template must move to the remaining address.
+	 */
+	dp_test_nl_add_ip_addr_and_connected("dp2T2", "1.1.4.1/24");
+	dp_test_vxlan_flood(inner, "1.1.3.1", "10.73.2.1", nh2_mac, "dp2T2");
+	dp_test_netlink_del_ip_address("dp2T2", "1.1.3.1/24");
+	dp_test_vxlan_flood(inner, "1.1.4.1", "10.73.2.1", nh2_mac, "dp2T2");
+	dp_test_netlink_add_ip_address("dp2T2", "1.1.3.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T2", "1.1.4.1/24");
+	dp_test_vxlan_flood(inner, "1.1.3.1", "10.73.2.1", nh2_mac, "dp2T2");
+
+	/* Move the remote VTEP, the old entry must not be used */
+	dp_test_netlink_set_vxlan_remote("vxl10", 10, "dp2T1", "10.73.2.2");
+	dp_test_vxlan_flood(inner, "1.1.3.1", "10.73.2.2", nh2_mac, "dp2T2");
+	dp_test_vxlan_wait_encap("10.73.2.2", "1.1.3.2", "dp2T2");
+	dp_test_vxlan_flood(inner, "1.1.3.1", "10.73.2.2", nh2_mac, "dp2T2");
+
+	rte_pktmbuf_free(inner);
+
+	dp_test_intf_bridge_remove_port("br1", "vxl10");
+	dp_test_intf_bridge_remove_port("br1", "dp1T0");
+	dp_test_intf_bridge_del("br1");
+	dp_test_intf_vxlan_del("vxl10", 10);
+
+	dp_test_netlink_del_route("10.73.2.0/24 nh 1.1.3.2 int:dp2T2");
+	dp_test_netlink_del_neigh("dp2T1", "1.1.2.2", nh1_mac);
+	dp_test_netlink_del_neigh("dp2T2", "1.1.3.2", nh2_mac);
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "1.1.2.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T2", "1.1.3.1/24");
+} DP_END_TEST;